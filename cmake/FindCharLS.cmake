@@ -0,0 +1,107 @@
+# Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+# file Copyright.txt or https://cmake.org/licensing for details.
+
+#[=======================================================================[.rst:
+FindCharLS
+-----------
+
+Find the native CharLS (JPEG-LS) includes and library.
+
+IMPORTED Targets
+^^^^^^^^^^^^^^^^
+
+This module defines :prop_tgt:`IMPORTED` target ``CharLS::CharLS``, if
+CharLS has been found.
+
+Result Variables
+^^^^^^^^^^^^^^^^
+
+This module defines the following variables:
+
+::
+
+  CharLS_INCLUDE_DIRS - where to find charls/charls.h, etc.
+  CharLS_LIBRARIES    - List of libraries when using CharLS.
+  CharLS_FOUND        - True if CharLS found.
+
+::
+
+  CharLS_VERSION_STRING - The version of CharLS found (x.y.z)
+  CharLS_VERSION_MAJOR  - The major version of CharLS
+  CharLS_VERSION_MINOR  - The minor version of CharLS
+
+  Debug and Release variants are found separately.
+#]=======================================================================]
+
+# Standard names to search for
+set(CharLS_NAMES charls charls-2-x64 charls-2-x86)
+set(CharLS_NAMES_DEBUG charlsd charls-2-x64d charls-2-x86d)
+
+find_path(CharLS_INCLUDE_DIR
+          NAMES charls/charls.h
+          PATH_SUFFIXES include)
+
+# Allow CharLS_LIBRARY to be set manually, as the location of the charls library
+if(NOT CharLS_LIBRARY)
+  find_library(CharLS_LIBRARY_RELEASE
+               NAMES ${CharLS_NAMES}
+               PATH_SUFFIXES lib)
+  find_library(CharLS_LIBRARY_DEBUG
+               NAMES ${CharLS_NAMES_DEBUG}
+               PATH_SUFFIXES lib)
+
+  include(SelectLibraryConfigurations)
+  select_library_configurations(CharLS)
+endif()
+
+unset(CharLS_NAMES)
+unset(CharLS_NAMES_DEBUG)
+
+mark_as_advanced(CharLS_INCLUDE_DIR)
+
+if(CharLS_INCLUDE_DIR AND EXISTS "${CharLS_INCLUDE_DIR}/charls/version.h")
+    file(STRINGS "${CharLS_INCLUDE_DIR}/charls/version.h" CharLS_H REGEX "^#define CHARLS_VERSION_.*$")
+
+    string(REGEX REPLACE "^.*CHARLS_VERSION_MAJOR  *([0-9]+).*$" "\\1" CharLS_MAJOR_VERSION "${CharLS_H}")
+    string(REGEX REPLACE "^.*CHARLS_VERSION_MINOR  *([0-9]+).*$" "\\1" CharLS_MINOR_VERSION "${CharLS_H}")
+    string(REGEX REPLACE "^.*CHARLS_VERSION_PATCH  *([0-9]+).*$" "\\1" CharLS_PATCH_VERSION "${CharLS_H}")
+    set(CharLS_VERSION_STRING "${CharLS_MAJOR_VERSION}.${CharLS_MINOR_VERSION}.${CharLS_PATCH_VERSION}")
+endif()
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(CharLS
+        REQUIRED_VARS CharLS_LIBRARY CharLS_INCLUDE_DIR
+        VERSION_VAR CharLS_VERSION_STRING)
+
+if(CharLS_FOUND)
+    set(CharLS_INCLUDE_DIRS ${CharLS_INCLUDE_DIR})
+
+    if(NOT CharLS_LIBRARIES)
+        set(CharLS_LIBRARIES ${CharLS_LIBRARY})
+    endif()
+
+    if(NOT TARGET CharLS::CharLS)
+        add_library(CharLS::CharLS UNKNOWN IMPORTED)
+        set_target_properties(CharLS::CharLS PROPERTIES
+                INTERFACE_INCLUDE_DIRECTORIES "${CharLS_INCLUDE_DIRS}")
+
+        if(CharLS_LIBRARY_RELEASE)
+            set_property(TARGET CharLS::CharLS APPEND PROPERTY
+                    IMPORTED_CONFIGURATIONS RELEASE)
+            set_target_properties(CharLS::CharLS PROPERTIES
+                    IMPORTED_LOCATION_RELEASE "${CharLS_LIBRARY_RELEASE}")
+        endif()
+
+        if(CharLS_LIBRARY_DEBUG)
+            set_property(TARGET CharLS::CharLS APPEND PROPERTY
+                    IMPORTED_CONFIGURATIONS DEBUG)
+            set_target_properties(CharLS::CharLS PROPERTIES
+                    IMPORTED_LOCATION_DEBUG "${CharLS_LIBRARY_DEBUG}")
+        endif()
+
+        if(NOT CharLS_LIBRARY_RELEASE AND NOT CharLS_LIBRARY_DEBUG)
+            set_target_properties(CharLS::CharLS PROPERTIES
+                    IMPORTED_LOCATION "${CharLS_LIBRARY}")
+        endif()
+    endif()
+endif()
@@ -0,0 +1,107 @@
+# Distributed under the OSI-approved BSD 3-Clause License.  See accompanying
+# file Copyright.txt or https://cmake.org/licensing for details.
+
+#[=======================================================================[.rst:
+FindLZ4
+--------
+
+Find the native LZ4 includes and library.
+
+IMPORTED Targets
+^^^^^^^^^^^^^^^^
+
+This module defines :prop_tgt:`IMPORTED` target ``LZ4::LZ4``, if
+LZ4 has been found.
+
+Result Variables
+^^^^^^^^^^^^^^^^
+
+This module defines the following variables:
+
+::
+
+  LZ4_INCLUDE_DIRS   - where to find lz4.h, etc.
+  LZ4_LIBRARIES      - List of libraries when using lz4.
+  LZ4_FOUND          - True if lz4 found.
+
+::
+
+  LZ4_VERSION_STRING - The version of lz4 found (x.y.z)
+  LZ4_VERSION_MAJOR  - The major version of lz4
+  LZ4_VERSION_MINOR  - The minor version of lz4
+
+  Debug and Release variants are found separately.
+#]=======================================================================]
+
+# Standard names to search for
+set(LZ4_NAMES lz4 lz4_static)
+set(LZ4_NAMES_DEBUG lz4d lz4_staticd)
+
+find_path(LZ4_INCLUDE_DIR
+          NAMES lz4.h
+          PATH_SUFFIXES include)
+
+# Allow LZ4_LIBRARY to be set manually, as the location of the lz4 library
+if(NOT LZ4_LIBRARY)
+  find_library(LZ4_LIBRARY_RELEASE
+               NAMES ${LZ4_NAMES}
+               PATH_SUFFIXES lib)
+  find_library(LZ4_LIBRARY_DEBUG
+               NAMES ${LZ4_NAMES_DEBUG}
+               PATH_SUFFIXES lib)
+
+  include(SelectLibraryConfigurations)
+  select_library_configurations(LZ4)
+endif()
+
+unset(LZ4_NAMES)
+unset(LZ4_NAMES_DEBUG)
+
+mark_as_advanced(LZ4_INCLUDE_DIR)
+
+if(LZ4_INCLUDE_DIR AND EXISTS "${LZ4_INCLUDE_DIR}/lz4.h")
+    file(STRINGS "${LZ4_INCLUDE_DIR}/lz4.h" LZ4_H REGEX "^#define LZ4_VERSION_.*$")
+
+    string(REGEX REPLACE "^.*LZ4_VERSION_MAJOR  *([0-9]+).*$" "\\1" LZ4_MAJOR_VERSION "${LZ4_H}")
+    string(REGEX REPLACE "^.*LZ4_VERSION_MINOR  *([0-9]+).*$" "\\1" LZ4_MINOR_VERSION "${LZ4_H}")
+    string(REGEX REPLACE "^.*LZ4_VERSION_RELEASE  *([0-9]+).*$" "\\1" LZ4_PATCH_VERSION "${LZ4_H}")
+    set(LZ4_VERSION_STRING "${LZ4_MAJOR_VERSION}.${LZ4_MINOR_VERSION}.${LZ4_PATCH_VERSION}")
+endif()
+
+include(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(LZ4
+        REQUIRED_VARS LZ4_LIBRARY LZ4_INCLUDE_DIR
+        VERSION_VAR LZ4_VERSION_STRING)
+
+if(LZ4_FOUND)
+    set(LZ4_INCLUDE_DIRS ${LZ4_INCLUDE_DIR})
+
+    if(NOT LZ4_LIBRARIES)
+        set(LZ4_LIBRARIES ${LZ4_LIBRARY})
+    endif()
+
+    if(NOT TARGET LZ4::LZ4)
+        add_library(LZ4::LZ4 UNKNOWN IMPORTED)
+        set_target_properties(LZ4::LZ4 PROPERTIES
+                INTERFACE_INCLUDE_DIRECTORIES "${LZ4_INCLUDE_DIRS}")
+
+        if(LZ4_LIBRARY_RELEASE)
+            set_property(TARGET LZ4::LZ4 APPEND PROPERTY
+                    IMPORTED_CONFIGURATIONS RELEASE)
+            set_target_properties(LZ4::LZ4 PROPERTIES
+                    IMPORTED_LOCATION_RELEASE "${LZ4_LIBRARY_RELEASE}")
+        endif()
+
+        if(LZ4_LIBRARY_DEBUG)
+            set_property(TARGET LZ4::LZ4 APPEND PROPERTY
+                    IMPORTED_CONFIGURATIONS DEBUG)
+            set_target_properties(LZ4::LZ4 PROPERTIES
+                    IMPORTED_LOCATION_DEBUG "${LZ4_LIBRARY_DEBUG}")
+        endif()
+
+        if(NOT LZ4_LIBRARY_RELEASE AND NOT LZ4_LIBRARY_DEBUG)
+            set_target_properties(LZ4::LZ4 PROPERTIES
+                    IMPORTED_LOCATION "${LZ4_LIBRARY}")
+        endif()
+    endif()
+endif()
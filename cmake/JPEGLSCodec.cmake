@@ -1,19 +1,37 @@
 # Checks for JPEG-LS codec support
 
 set(JPEGLS_SUPPORT FALSE)
+set(JPEGLS_USABLE FALSE)
 
 find_package(CharLS QUIET)
 if(NOT CharLS_FOUND)
   # Ubuntu packages ship a lowercase 'charlsConfig.cmake'
   find_package(charls CONFIG QUIET)
-  if(charls_FOUND)
+  if(charls_FOUND AND TARGET charls)
     set(CharLS_FOUND TRUE)
-    set(CharLS_INCLUDE_DIRS ${charls_INCLUDE_DIRS})
-    set(CharLS_LIBRARIES charls)
+    set(CharLS_VERSION_STRING ${charls_VERSION})
+    if(NOT TARGET CharLS::CharLS)
+      add_library(CharLS::CharLS INTERFACE IMPORTED)
+      set_target_properties(CharLS::CharLS PROPERTIES
+              INTERFACE_LINK_LIBRARIES charls)
+    endif()
   endif()
 endif()
 
-option(jpegls "use CharLS (required for JPEG-LS compression)" ${CharLS_FOUND})
-if (jpegls AND CharLS_FOUND)
+if(CharLS_FOUND)
+    # The charls_jpegls_encoder/decoder C API appeared in CharLS 2.1, and
+    # CharLS 3 changes it
+    if(CharLS_VERSION_STRING VERSION_LESS "2.1")
+        message(WARNING "Found CharLS library, but not recent enough. Use CharLS >= 2.1")
+    elseif(NOT CharLS_VERSION_STRING VERSION_LESS "3")
+        message(WARNING "Found CharLS ${CharLS_VERSION_STRING}, but only CharLS 2.x (>= 2.1) is supported")
+    else()
+        set(JPEGLS_USABLE TRUE)
+    endif()
+endif()
+
+option(jpegls "use CharLS (required for JPEG-LS compression)" ${JPEGLS_USABLE})
+
+if (jpegls AND JPEGLS_USABLE)
     set(JPEGLS_SUPPORT TRUE)
 endif()
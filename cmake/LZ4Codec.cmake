@@ -0,0 +1,22 @@
+# Checks for LZ4 codec support
+
+# liblz4
+set(LZ4_SUPPORT FALSE)
+set(LZ4_USABLE FALSE)
+
+find_package(LZ4)
+
+if(LZ4_FOUND)
+    # LZ4_compress_HC_extStateHC() appeared in lz4 1.7.0
+    if(LZ4_VERSION_STRING VERSION_GREATER_EQUAL "1.7.0")
+        set(LZ4_USABLE TRUE)
+    else()
+        message(WARNING "Found LZ4 library, but not recent enough. Use lz4 >= 1.7")
+    endif()
+endif()
+
+option(lz4 "use liblz4 (required for LZ4 compression)" ${LZ4_USABLE})
+
+if (lz4 AND LZ4_USABLE)
+    set(LZ4_SUPPORT TRUE)
+endif()
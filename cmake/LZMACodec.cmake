@@ -28,6 +28,18 @@
 set(LZMA_SUPPORT FALSE)
 find_package(liblzma)
 
+if(liblzma_FOUND)
+    set(CMAKE_REQUIRED_INCLUDES_SAVE ${CMAKE_REQUIRED_INCLUDES})
+    set(CMAKE_REQUIRED_INCLUDES ${CMAKE_REQUIRED_INCLUDES} ${LIBLZMA_INCLUDE_DIRS})
+    set(CMAKE_REQUIRED_LIBRARIES_SAVE ${CMAKE_REQUIRED_LIBRARIES})
+    set(CMAKE_REQUIRED_LIBRARIES ${CMAKE_REQUIRED_LIBRARIES} ${LIBLZMA_LIBRARIES})
+    # Absent from liblzma built without threads, and before 5.2 and 5.4
+    check_symbol_exists(lzma_stream_encoder_mt "lzma.h" HAVE_LZMA_STREAM_ENCODER_MT)
+    check_symbol_exists(lzma_stream_decoder_mt "lzma.h" HAVE_LZMA_STREAM_DECODER_MT)
+    set(CMAKE_REQUIRED_INCLUDES ${CMAKE_REQUIRED_INCLUDES_SAVE})
+    set(CMAKE_REQUIRED_LIBRARIES ${CMAKE_REQUIRED_LIBRARIES_SAVE})
+endif()
+
 option(lzma "use liblzma (required for LZMA2 compression)" ${LIBLZMA_FOUND})
 if (lzma AND LIBLZMA_FOUND)
     set(LZMA_SUPPORT TRUE)
@@ -25,6 +25,7 @@
 
 
 include(CheckSymbolExists)
+include(CheckStructHasMember)
 
 
 # Check for getopt
@@ -45,5 +46,16 @@ check_symbol_exists(posix_fadvise "fcntl.h" HAVE_POSIX_FADVISE)
 # Check for madvise
 check_symbol_exists(madvise "sys/mman.h" HAVE_MADVISE)
 
+# Check for copy_file_range
+set(CMAKE_REQUIRED_DEFINITIONS -D_GNU_SOURCE)
+check_symbol_exists(copy_file_range "unistd.h" HAVE_COPY_FILE_RANGE)
+unset(CMAKE_REQUIRED_DEFINITIONS)
+
+# Check for nanosecond file timestamps
+check_struct_has_member("struct stat" st_mtim "sys/stat.h"
+                        HAVE_STRUCT_STAT_ST_MTIM LANGUAGE C)
+check_struct_has_member("struct stat" st_mtimespec "sys/stat.h"
+                        HAVE_STRUCT_STAT_ST_MTIMESPEC LANGUAGE C)
+
 # Check for setmode
 check_symbol_exists(setmode "unistd.h" HAVE_SETMODE)
@@ -0,0 +1,321 @@
+#include "tiffiop.h"
+#include "tiff_simd.h"
+
+/*
+ * Per-strile integrity checksums.
+ *
+ * With TIFF_STRILECHECKSUM_WRITE, the CRC32C of the uncompressed contents of
+ * each strip/tile is computed as it is handed to the codec and stored in the
+ * private TIFFTAG_STRILECHECKSUMS tag when the directory is written.  The
+ * checksum covers the samples in file byte order (after swabbing on write,
+ * before it on read, or swapped back when the codec swabs them itself, as
+ * the predictor does) so a file verifies identically on any host.
+ *
+ * With TIFF_STRILECHECKSUM_VERIFY, every strip/tile decoded in full is
+ * checked against the stored value before it is returned, so silent
+ * corruption is caught in the same pass that reads the data.  Verification
+ * is opt-in: the tag number is in the private range, where other software
+ * may store unrelated values.
+ */
+
+static tmsize_t strileDecodedSize(TIFF *tif, uint32_t strile)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    uint32_t rowsperstrip, stripsperplane, rows;
+
+    if (isTiled(tif))
+        return tif->tif_tilesize;
+    rowsperstrip = td->td_rowsperstrip;
+    if (rowsperstrip > td->td_imagelength)
+        rowsperstrip = td->td_imagelength;
+    if (rowsperstrip == 0)
+        return 0;
+    stripsperplane =
+        TIFFhowmany_32_maxuint_compat(td->td_imagelength, rowsperstrip);
+    rows = td->td_imagelength - (strile % stripsperplane) * rowsperstrip;
+    if (rows > rowsperstrip)
+        rows = rowsperstrip;
+    return TIFFVStripSize(tif, rows);
+}
+
+/*
+ * CRC32C of the samples of a strip/tile, crc being that of the previous
+ * rows.  buf holds them in file byte order, unless a codec that swabs them
+ * itself has replaced the postdecode method, such as the predictor on 16 bit
+ * and wider data: those are swapped back through a small buffer.
+ */
+static uint32_t strileCRC(TIFF *tif, uint32_t crc, const uint8_t *buf,
+                          tmsize_t cc)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    uint64_t chunk[510]; /* a multiple of 3 and 8 bytes */
+    uint16_t bps = td->td_bitspersample;
+
+    if (bps == 128)
+        bps = 64;
+    else if ((bps == 32 || bps == 64) &&
+             (td->td_sampleformat == SAMPLEFORMAT_COMPLEXINT ||
+              td->td_sampleformat == SAMPLEFORMAT_COMPLEXIEEEFP))
+        bps /= 2;
+    if (!(tif->tif_flags & TIFF_SWAB) ||
+        tif->tif_postdecode != _TIFFNoPostDecode ||
+        (bps != 16 && bps != 24 && bps != 32 && bps != 64) ||
+        cc % (bps / 8) != 0)
+        return tiff_crc32c(crc, buf, (size_t)cc);
+    while (cc > 0)
+    {
+        const tmsize_t n =
+            cc < (tmsize_t)sizeof(chunk) ? cc : (tmsize_t)sizeof(chunk);
+
+        _TIFFmemcpy(chunk, buf, n);
+        switch (bps)
+        {
+            case 16:
+                TIFFSwabArrayOfShort((uint16_t *)chunk, n / 2);
+                break;
+            case 24:
+                TIFFSwabArrayOfTriples((uint8_t *)chunk, n / 3);
+                break;
+            case 32:
+                TIFFSwabArrayOfLong((uint32_t *)chunk, n / 4);
+                break;
+            default:
+                TIFFSwabArrayOfLong8(chunk, n / 8);
+                break;
+        }
+        crc = tiff_crc32c(crc, (const uint8_t *)chunk, (size_t)n);
+        buf += n;
+        cc -= n;
+    }
+    return crc;
+}
+
+/*
+ * The checksum is taken over what the caller hands to the encoder, which only
+ * matches what a reader decodes for lossless schemes.
+ */
+static int isLosslessEncoding(TIFF *tif)
+{
+    switch (tif->tif_dir.td_compression)
+    {
+        case COMPRESSION_OJPEG:
+        case COMPRESSION_JPEG:
+        case COMPRESSION_JXL:
+        case COMPRESSION_PIXARLOG:
+        case COMPRESSION_SGILOG:
+        case COMPRESSION_SGILOG24:
+            return 0;
+        case COMPRESSION_WEBP:
+        {
+            int lossless = 0;
+            return TIFFGetField(tif, TIFFTAG_WEBP_LOSSLESS, &lossless) &&
+                   lossless;
+        }
+        case COMPRESSION_LERC:
+        {
+            double maxzerror = 0;
+            return TIFFGetField(tif, TIFFTAG_LERC_MAXZERROR, &maxzerror) &&
+                   maxzerror == 0;
+        }
+        default:
+            return 1;
+    }
+}
+
+void _TIFFStrileChecksumInvalidate(TIFF *tif, const char *reason)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+
+    if (!(tif->tif_strilechecksums & TIFF_STRILECHECKSUM_WRITE) ||
+        td->td_strilechecksumsinvalid)
+        return;
+    TIFFWarningExtR(tif, "StrileChecksums",
+                    "Not writing strile checksums for this directory: %s",
+                    reason);
+    td->td_strilechecksumsinvalid = 1;
+}
+
+/*
+ * Return the slot for the checksum of strile, growing the array as needed.
+ * When a directory that already carries checksums is being updated, the
+ * values of striles that are not rewritten are preserved.
+ */
+static uint32_t *strileChecksumSlot(TIFF *tif, uint32_t strile)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+
+    if (td->td_strilechecksumsinvalid)
+        return NULL;
+    if (td->td_strilechecksums == NULL && !isLosslessEncoding(tif))
+    {
+        _TIFFStrileChecksumInvalidate(tif, "compression scheme is lossy");
+        return NULL;
+    }
+    if (strile >= td->td_strilechecksumsallocsize)
+    {
+        uint32_t oldsize = td->td_strilechecksumsallocsize;
+        uint32_t newsize = TIFFmax(td->td_nstrips, strile + 1);
+        uint32_t *newarray = (uint32_t *)_TIFFreallocExt(
+            tif, td->td_strilechecksums, (tmsize_t)newsize * 4);
+        if (newarray == NULL)
+        {
+            _TIFFStrileChecksumInvalidate(tif, "out of memory");
+            return NULL;
+        }
+        _TIFFmemset(newarray + oldsize, 0, (tmsize_t)(newsize - oldsize) * 4);
+        if (oldsize == 0)
+        {
+            uint32_t count = 0;
+            uint32_t *stored = NULL;
+            if (TIFFGetField(tif, TIFFTAG_STRILECHECKSUMS, &count, &stored) &&
+                stored != NULL)
+                _TIFFmemcpy(newarray, stored,
+                            (tmsize_t)TIFFmin(count, newsize) * 4);
+        }
+        td->td_strilechecksums = newarray;
+        td->td_strilechecksumsallocsize = newsize;
+    }
+    return &td->td_strilechecksums[strile];
+}
+
+void _TIFFStrileChecksumWrite(TIFF *tif, uint32_t strile, const uint8_t *buf,
+                              tmsize_t cc)
+{
+    uint32_t *slot;
+    tmsize_t size;
+
+    if (!(tif->tif_strilechecksums & TIFF_STRILECHECKSUM_WRITE))
+        return;
+    slot = strileChecksumSlot(tif, strile);
+    if (slot == NULL)
+        return;
+    size = strileDecodedSize(tif, strile);
+    if (size == 0 || cc < size)
+    {
+        _TIFFStrileChecksumInvalidate(tif, "partial strip/tile write");
+        return;
+    }
+    *slot = strileCRC(tif, 0, buf, size);
+}
+
+/*
+ * Scanline variant: rows must arrive in order from the first row of the
+ * strip, first being set for that row.
+ */
+void _TIFFStrileChecksumWriteRow(TIFF *tif, uint32_t strip, const uint8_t *buf,
+                                 tmsize_t cc, int first)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    uint32_t *slot;
+
+    if (!(tif->tif_strilechecksums & TIFF_STRILECHECKSUM_WRITE))
+        return;
+    slot = strileChecksumSlot(tif, strip);
+    if (slot == NULL)
+        return;
+    if (first)
+    {
+        if (td->td_photometric == PHOTOMETRIC_YCBCR && !isUpSampled(tif) &&
+            (td->td_ycbcrsubsampling[0] != 1 ||
+             td->td_ycbcrsubsampling[1] != 1))
+        {
+            _TIFFStrileChecksumInvalidate(
+                tif, "subsampled YCbCr written by scanline");
+            return;
+        }
+        *slot = 0;
+    }
+    *slot = strileCRC(tif, *slot, buf, cc);
+}
+
+int _TIFFStrileChecksumVerify(TIFF *tif, uint32_t strile, const uint8_t *buf,
+                              tmsize_t cc)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    const uint32_t *stored;
+    uint32_t crc;
+
+    if (!(tif->tif_strilechecksums & TIFF_STRILECHECKSUM_VERIFY))
+        return 1;
+    /* Looked up again only once the directory or the tag changes */
+    if (!td->td_strilechecksumslookedup)
+    {
+        uint32_t count = 0;
+        uint32_t *values = NULL;
+
+        if (!TIFFGetField(tif, TIFFTAG_STRILECHECKSUMS, &count, &values))
+            values = NULL;
+        td->td_strilechecksumsstored = values;
+        td->td_strilechecksumsstoredcount = values ? count : 0;
+        td->td_strilechecksumslookedup = 1;
+    }
+    stored = td->td_strilechecksumsstored;
+    if (stored == NULL || strile >= td->td_strilechecksumsstoredcount)
+        return 1;
+    /* Partial or reduced resolution decodes and never written (sparse)
+     * striles are not checked */
+    if (isDecodeScaled(tif) || cc != strileDecodedSize(tif, strile) ||
+        TIFFGetStrileByteCount(tif, strile) == 0)
+        return 1;
+    crc = strileCRC(tif, 0, buf, cc);
+    if (crc != stored[strile])
+    {
+        TIFFErrorExtR(tif, TIFFFileName(tif),
+                      "Checksum mismatch for %s %" PRIu32
+                      ": expected 0x%08" PRIx32 ", got 0x%08" PRIx32,
+                      isTiled(tif) ? "tile" : "strip", strile, stored[strile],
+                      crc);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Called before a directory is written: publish the checksums gathered for
+ * it, or drop stored ones that data written without checksumming has made
+ * stale.
+ */
+int _TIFFStrileChecksumFlush(TIFF *tif)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    uint32_t count = 0;
+    uint32_t *stored = NULL;
+
+    if (td->td_strilechecksums != NULL && !td->td_strilechecksumsinvalid)
+    {
+        if (td->td_strilechecksumsallocsize < td->td_nstrips &&
+            strileChecksumSlot(tif, td->td_nstrips - 1) == NULL)
+            return TIFFUnsetField(tif, TIFFTAG_STRILECHECKSUMS);
+        return TIFFSetField(tif, TIFFTAG_STRILECHECKSUMS, td->td_nstrips,
+                            td->td_strilechecksums);
+    }
+    if ((td->td_strilechecksumsinvalid ||
+         (tif->tif_flags & TIFF_BEENWRITING)) &&
+        TIFFGetField(tif, TIFFTAG_STRILECHECKSUMS, &count, &stored))
+        return TIFFUnsetField(tif, TIFFTAG_STRILECHECKSUMS);
+    return 1;
+}
+
+/*
+ * Return in *crc the CRC32C of the decoded contents of a strip/tile, either
+ * as recorded while writing it or as stored in the file.
+ */
+int TIFFGetStrileChecksum(TIFF *tif, uint32_t strile, uint32_t *crc)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    uint32_t count = 0;
+    uint32_t *stored = NULL;
+
+    if (td->td_strilechecksums != NULL && !td->td_strilechecksumsinvalid)
+    {
+        if (strile >= td->td_strilechecksumsallocsize)
+            return 0;
+        *crc = td->td_strilechecksums[strile];
+        return 1;
+    }
+    if (!TIFFGetField(tif, TIFFTAG_STRILECHECKSUMS, &count, &stored) ||
+        stored == NULL || strile >= count)
+        return 0;
+    *crc = stored[strile];
+    return 1;
+}
@@ -49,11 +49,14 @@ void TIFFCleanup(TIFF *tif)
      */
     if (tif->tif_mode != O_RDONLY)
         TIFFFlush(tif);
+    _TIFFWriteBehindFree(tif);
     TIFFFreeDirectory(tif);
     _TIFFCleanupCustomValueMap(&tif->tif_dir);
 
     _TIFFCleanupIFDOffsetAndNumberMaps(tif);
+    _TIFFIFDIndexFree(tif);
     _tiffUringTeardown(tif);
+    _TIFFStrileCacheDetach(tif);
 
     /*
      * Clean up client info links.
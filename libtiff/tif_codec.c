@@ -76,6 +76,9 @@ static int tiff_not_configured(TIFF *, int);
 #ifndef ZSTD_SUPPORT
 #define TIFFInitZSTD tiff_not_configured
 #endif
+#ifndef LZ4_SUPPORT
+#define TIFFInitLZ4 tiff_not_configured
+#endif
 #ifndef JPEGLS_SUPPORT
 #define TIFFInitJPEGLS tiff_not_configured
 #endif
@@ -107,6 +110,7 @@ const TIFFCodec _TIFFBuiltinCODECS[] = {
     {"SGILog24", COMPRESSION_SGILOG24, TIFFInitSGILog},
     {"LZMA", COMPRESSION_LZMA, TIFFInitLZMA},
     {"ZSTD", COMPRESSION_ZSTD, TIFFInitZSTD},
+    {"LZ4", COMPRESSION_LZ4, TIFFInitLZ4},
     {"WEBP", COMPRESSION_WEBP, TIFFInitWebP},
     {"LERC", COMPRESSION_LERC, TIFFInitLERC},
     {NULL, 0, NULL}};
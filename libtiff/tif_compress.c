@@ -162,6 +162,7 @@ void _TIFFSetDefaultCompressionState(TIFF *tif)
     tif->tif_defstripsize = _TIFFDefaultStripSize;
     tif->tif_deftilesize = _TIFFDefaultTileSize;
     tif->tif_flags &= ~(TIFF_NOBITREV | TIFF_NOREADRAW);
+    tif->tif_decodescale = 1;
 }
 
 int TIFFSetCompressionScheme(TIFF *tif, int scheme)
@@ -224,6 +224,79 @@ static TIFFTagValue *TIFFCustomValueLookup(TIFFDirectory *td, uint32_t tag)
     return (TIFFTagValue *)TIFFHashSetLookup(td->td_customValueMap, &tvDummy);
 }
 
+/*
+ * Return the custom value entry of fip, freeing its previous value, or add an
+ * empty one if the tag is not set yet.
+ */
+static TIFFTagValue *TIFFCustomValueReset(TIFF *tif, const TIFFField *fip)
+{
+    static const char module[] = "_TIFFVSetField";
+    TIFFDirectory *td = &tif->tif_dir;
+
+    /*
+     * Find the existing entry for this custom value.
+     */
+    TIFFTagValue *tv = TIFFCustomValueLookup(td, fip->field_tag);
+    if (tv != NULL)
+    {
+        if (tv->value != NULL)
+        {
+            _TIFFfreeExt(tif, tv->value);
+            tv->value = NULL;
+        }
+        tv->lazytype = 0;
+        return tv;
+    }
+    if (td->td_customValueMap == NULL && td->td_customValueCount > 0)
+    {
+        if (!TIFFBuildCustomValueMap(td))
+            return NULL;
+    }
+
+    /*
+     * Grow the custom list as the entry was not found.
+     */
+    TIFFTagValue *new_customValues = (TIFFTagValue *)_TIFFreallocExt(
+        tif, td->td_customValues,
+        sizeof(TIFFTagValue) * (td->td_customValueCount + 1));
+    if (!new_customValues)
+    {
+        TIFFErrorExtR(tif, module,
+                      "%s: Failed to allocate space for list of custom values",
+                      tif->tif_name);
+        return NULL;
+    }
+
+    td->td_customValueCount++;
+    td->td_customValues = new_customValues;
+
+    tv = td->td_customValues + (td->td_customValueCount - 1);
+    _TIFFmemset(tv, 0, sizeof(*tv));
+    tv->info = fip;
+
+    if (!TIFFBuildCustomValueMap(td))
+        return NULL;
+    return tv;
+}
+
+/*
+ * Record the entry of a custom tag whose value is only read by the first
+ * TIFFGetField() asking for it.
+ */
+int _TIFFSetLazyCustomValue(TIFF *tif, const TIFFField *fip,
+                            const TIFFDirEntry *dp)
+{
+    TIFFTagValue *tv = TIFFCustomValueReset(tif, fip);
+    if (tv == NULL)
+        return 0;
+    tv->count = 0;
+    tv->lazytype = dp->tdir_type;
+    tv->lazycount = dp->tdir_count;
+    tv->lazyoffset = dp->tdir_offset.toff_long8;
+    TIFFSetFieldBit(tif, fip->field_bit);
+    return 1;
+}
+
 /*
  * Count ink names separated by \0.  Returns
  * zero if the ink names are not as expected.
@@ -269,6 +342,8 @@ static int _TIFFVSetField(TIFF *tif, uint32_t tag, va_list ap)
     uint32_t standard_tag = tag;
     if (fip == NULL) /* cannot happen since OkToChangeTag() already checks it */
         return 0;
+    if (tag == TIFFTAG_STRILECHECKSUMS)
+        td->td_strilechecksumslookedup = 0;
     /*
      * We want to force the custom code to be used for custom
      * fields even if the tag happens to match a well known
@@ -737,60 +812,11 @@ static int _TIFFVSetField(TIFF *tif, uint32_t tag, va_list ap)
                 break;
             }
 
-            /*
-             * Find the existing entry for this custom value.
-             */
-            tv = TIFFCustomValueLookup(td, tag);
-            if (tv != NULL)
-            {
-                if (tv->value != NULL)
-                {
-                    _TIFFfreeExt(tif, tv->value);
-                    tv->value = NULL;
-                }
-            }
-            if (td->td_customValueMap == NULL && td->td_customValueCount > 0)
-            {
-                if (!TIFFBuildCustomValueMap(td))
-                {
-                    status = 0;
-                    goto end;
-                }
-            }
-
-            /*
-             * Grow the custom list if the entry was not found.
-             */
+            tv = TIFFCustomValueReset(tif, fip);
             if (tv == NULL)
             {
-                TIFFTagValue *new_customValues;
-
-                new_customValues = (TIFFTagValue *)_TIFFreallocExt(
-                    tif, td->td_customValues,
-                    sizeof(TIFFTagValue) * (td->td_customValueCount + 1));
-                if (!new_customValues)
-                {
-                    TIFFErrorExtR(tif, module,
-                                  "%s: Failed to allocate space for list of "
-                                  "custom values",
-                                  tif->tif_name);
-                    status = 0;
-                    goto end;
-                }
-
-                td->td_customValueCount++;
-                td->td_customValues = new_customValues;
-
-                tv = td->td_customValues + (td->td_customValueCount - 1);
-                tv->info = fip;
-                tv->value = NULL;
-                tv->count = 0;
-
-                if (!TIFFBuildCustomValueMap(td))
-                {
-                    status = 0;
-                    goto end;
-                }
+                status = 0;
+                goto end;
             }
 
             /*
@@ -1193,6 +1219,8 @@ int TIFFUnsetField(TIFF *tif, uint32_t tag)
 
     if (!fip)
         return 0;
+    if (tag == TIFFTAG_STRILECHECKSUMS)
+        td->td_strilechecksumslookedup = 0;
 
     if (fip->field_bit != FIELD_CUSTOM)
         TIFFClrFieldBit(tif, fip->field_bit);
@@ -1609,6 +1637,18 @@ int TIFFGetField(TIFF *tif, uint32_t tag, ...)
 int TIFFVGetField(TIFF *tif, uint32_t tag, va_list ap)
 {
     const TIFFField *fip = TIFFFindField(tif, tag, TIFF_ANY);
+    if (fip && fip->field_bit == FIELD_CUSTOM && tif->tif_lazytagthreshold > 0)
+    {
+        /* Read a deferred value now; drop the tag if that fails */
+        const TIFFTagValue *tv = TIFFCustomValueLookup(&tif->tif_dir, tag);
+        if (tv != NULL && tv->lazytype != 0)
+        {
+            const uint32_t dirty = tif->tif_flags & TIFF_DIRTYDIRECT;
+            if (!_TIFFFetchLazyTag(tif, tv))
+                TIFFUnsetField(tif, tag);
+            tif->tif_flags = (tif->tif_flags & ~TIFF_DIRTYDIRECT) | dirty;
+        }
+    }
     return (fip && (isPseudoTag(tag) || TIFFFieldSet(tif, fip->field_bit))
                 ? (*tif->tif_tagmethods.vgetfield)(tif, tag, ap)
                 : 0);
@@ -1648,6 +1688,12 @@ void TIFFFreeDirectory(TIFF *tif)
     CleanupField(td_stripoffset_p);
     CleanupField(td_stripbytecount_p);
     td->td_stripoffsetbyteallocsize = 0;
+    _TIFFStrilePagesFree(tif);
+    _TIFFStrileStreamFree(tif);
+    CleanupField(td_strilechecksums);
+    td->td_strilechecksumsallocsize = 0;
+    td->td_strilechecksumsinvalid = 0;
+    td->td_strilechecksumslookedup = 0;
     TIFFClrFieldBit(tif, FIELD_YCBCRSUBSAMPLING);
     TIFFClrFieldBit(tif, FIELD_YCBCRPOSITIONING);
 
@@ -2037,25 +2083,74 @@ static int TIFFAdvanceDirectory(TIFF *tif, uint64_t *nextdiroff, uint64_t *off,
     return (1);
 }
 
+/*
+ * Record the offset of main IFD n while counting directories, growing the
+ * array as needed.  On failure the array is released and *offsets set to
+ * NULL, which only means that no index gets built.
+ */
+static void TIFFIFDIndexAppend(TIFF *tif, uint64_t **offsets, tdir_t *alloc,
+                               tdir_t n, uint64_t diroff)
+{
+    if (n >= *alloc)
+    {
+        tdir_t newalloc = *alloc ? *alloc * 2 : 64;
+        uint64_t *newoffsets = NULL;
+        if (newalloc > *alloc)
+            newoffsets = (uint64_t *)_TIFFreallocExt(
+                tif, *offsets, (tmsize_t)newalloc * sizeof(uint64_t));
+        if (newoffsets == NULL)
+        {
+            _TIFFfreeExt(tif, *offsets);
+            *offsets = NULL;
+            return;
+        }
+        *offsets = newoffsets;
+        *alloc = newalloc;
+    }
+    (*offsets)[n] = diroff;
+}
+
 /*
  * Count the number of directories in a file.
+ * On read-only handles the walk also builds the index of the main IFD chain
+ * (see tif_ifdindex.c), which answers later calls without any I/O.
  */
 tdir_t TIFFNumberOfDirectories(TIFF *tif)
 {
     uint64_t nextdiroff;
     tdir_t nextdirnum;
     tdir_t n;
+    uint64_t *offsets = NULL;
+    tdir_t alloc = 0;
+    int build = tif->tif_mode == O_RDONLY;
+
+    if (tif->tif_ifdindex != NULL)
+    {
+        tif->tif_curdircount = tif->tif_ifdindexcount;
+        return tif->tif_ifdindexcount;
+    }
     if (!(tif->tif_flags & TIFF_BIGTIFF))
         nextdiroff = tif->tif_header.classic.tiff_diroff;
     else
         nextdiroff = tif->tif_header.big.tiff_diroff;
     nextdirnum = 0;
     n = 0;
-    while (nextdiroff != 0 &&
-           TIFFAdvanceDirectory(tif, &nextdiroff, NULL, &nextdirnum))
+    while (nextdiroff != 0)
     {
+        if (build)
+        {
+            TIFFIFDIndexAppend(tif, &offsets, &alloc, n, nextdiroff);
+            build = offsets != NULL;
+        }
+        if (!TIFFAdvanceDirectory(tif, &nextdiroff, NULL, &nextdirnum))
+            break;
         ++n;
     }
+    /* Index only chains that were walked to their end */
+    if (build && n > 0 && nextdiroff == 0)
+        _TIFFIFDIndexSet(tif, offsets, n);
+    else
+        _TIFFfreeExt(tif, offsets);
     /* Update number of main-IFDs in file. */
     tif->tif_curdircount = n;
     return (n);
@@ -2080,9 +2175,18 @@ int TIFFSetDirectory(TIFF *tif, tdir_t dirn)
         _TIFFCleanupIFDOffsetAndNumberMaps(tif); /* invalidate IFD loop lists */
     }
 
+    if (tif->tif_ifdindex != NULL)
+    {
+        /* Fastest path: the whole main IFD chain is indexed. */
+        if (dirn >= tif->tif_ifdindexcount)
+            return (0);
+        tif->tif_nextdiroff = tif->tif_ifdindex[dirn];
+        tif->tif_curdir = dirn;
+        tif->tif_setdirectory_force_absolute = FALSE;
+    }
     /* Even faster path, if offset is available within IFD loop hash list. */
-    if (!tif->tif_setdirectory_force_absolute &&
-        _TIFFGetOffsetFromDirNumber(tif, dirn, &nextdiroff))
+    else if (!tif->tif_setdirectory_force_absolute &&
+             _TIFFGetOffsetFromDirNumber(tif, dirn, &nextdiroff))
     {
         /* Set parameters for following TIFFReadDirectory() below. */
         tif->tif_nextdiroff = nextdiroff;
@@ -38,6 +38,11 @@ typedef struct
     const TIFFField *info;
     int count;
     void *value;
+    /* IFD entry of a value not read yet (lazy tag loading), if lazytype != 0.
+     * lazyoffset holds the raw entry offset, in file byte order. */
+    uint16_t lazytype;
+    uint64_t lazycount;
+    uint64_t lazyoffset;
 } TIFFTagValue;
 
 /*
@@ -146,6 +151,8 @@ typedef struct
 
     unsigned char
         td_deferstrilearraywriting; /* see TIFFDeferStrileArrayWriting() */
+    unsigned char
+        td_streamstrilearrays; /* see TIFFStreamStrileArrayWriting() */
 
     unsigned char
         td_iswrittentofile; /* indicates if current IFD is present on file */
@@ -164,6 +171,16 @@ typedef struct
         *td_dirdatasize_offsets; /* auxiliary array for all offsets of IFD tag
                                     entries with data outside the IFD tag
                                     entries. */
+
+    /* CRC32C of striles written in this session, flushed to
+     * TIFFTAG_STRILECHECKSUMS when the directory is written. */
+    uint32_t *td_strilechecksums;
+    uint32_t td_strilechecksumsallocsize;
+    int td_strilechecksumsinvalid; /* a strile could not be checksummed */
+    /* TIFFTAG_STRILECHECKSUMS as stored, looked up once for verification */
+    const uint32_t *td_strilechecksumsstored;
+    uint32_t td_strilechecksumsstoredcount;
+    int td_strilechecksumslookedup;
 } TIFFDirectory;
 
 /*
@@ -310,6 +327,9 @@ extern "C"
     extern void _TIFFPrintFieldInfo(TIFF *, FILE *);
 
     extern int _TIFFFillStriles(TIFF *);
+    extern int _TIFFSetLazyCustomValue(TIFF *tif, const TIFFField *fip,
+                                       const TIFFDirEntry *dp);
+    extern int _TIFFFetchLazyTag(TIFF *tif, const TIFFTagValue *tv);
 
     typedef enum
     {
@@ -341,6 +341,7 @@ static const TIFFField tiffFields[] = {
     {TIFFTAG_STRIPROWCOUNTS, -1, -1, TIFF_LONG, 0, TIFF_SETGET_C16_UINT32,  FIELD_CUSTOM, 1, 1, "StripRowCounts", NULL},
     {TIFFTAG_IMAGELAYER, 2, 2, TIFF_LONG, 0, TIFF_SETGET_C0_UINT32,  FIELD_CUSTOM, 1, 0, "ImageLayer", NULL},
     /* end TIFF/FX tags */
+    {TIFFTAG_STRILECHECKSUMS, -3, -3, TIFF_LONG, 0, TIFF_SETGET_C32_UINT32,  FIELD_CUSTOM, 1, 1, "StrileChecksums", NULL},
     /* begin pseudo tags */
 };
 
@@ -1269,6 +1270,8 @@ int _TIFFCheckFieldIsValidForCodec(TIFF *tif, ttag_t tag)
         case TIFFTAG_GROUP4OPTIONS:
         /* LERC */
         case TIFFTAG_LERC_PARAMETERS:
+        /* ZSTD */
+        case TIFFTAG_ZSTD_DICTIONARY:
             break;
         default:
             return 1;
@@ -1352,6 +1355,10 @@ int _TIFFCheckFieldIsValidForCodec(TIFF *tif, ttag_t tag)
                 return 1;
             break;
         case COMPRESSION_ZSTD:
+            if (tag == TIFFTAG_PREDICTOR || tag == TIFFTAG_ZSTD_DICTIONARY)
+                return 1;
+            break;
+        case COMPRESSION_LZ4:
             if (tag == TIFFTAG_PREDICTOR)
                 return 1;
             break;
@@ -262,8 +262,11 @@ static int CheckDirCount(TIFF *, TIFFDirEntry *, uint32_t);
 static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
                                    TIFFDirEntry **pdir, uint64_t *nextdiroff);
 static int TIFFFetchNormalTag(TIFF *, TIFFDirEntry *, int recover);
+static int TIFFIsLazyTagCandidate(TIFF *tif, const TIFFDirEntry *dp);
+static void TIFFFetchOrDeferNormalTag(TIFF *tif, TIFFDirEntry *dp);
 static int TIFFFetchStripThing(TIFF *tif, TIFFDirEntry *dir, uint32_t nstrips,
                                uint64_t **lpp);
+static void TIFFCheckStrileExtents(TIFF *tif);
 static int TIFFFetchSubjectDistance(TIFF *, TIFFDirEntry *);
 static void ChopUpSingleUncompressedStrip(TIFF *);
 static void TryChopUpUncompressedBigTiff(TIFF *);
@@ -1193,6 +1196,173 @@ TIFFReadDirEntryIfd8(TIFF *tif, TIFFDirEntry *direntry, uint64_t *value)
     (THRESHOLD_MULTIPLIER * THRESHOLD_MULTIPLIER * THRESHOLD_MULTIPLIER *      \
      INITIAL_THRESHOLD)
 
+/*
+ * Directory data block.
+ *
+ * When the directory of a file that is not memory mapped is fetched, the
+ * directory itself and then the out-of-line values of its entries are each
+ * read with a single I/O call into tif_dirblock.  The TIFFReadDirEntry*()
+ * functions copy from that block instead of seeking and reading every value.
+ * The block only lives while the directory is being parsed.
+ */
+
+/* Size of the read that fetches a directory.  It usually also covers the
+ * values that libtiff writes right after the directory. */
+#define DIRBLOCK_HEAD_SIZE 4096
+/* Largest block read for the out-of-line values, and largest hole allowed
+ * between two values read in the same block */
+#define DIRBLOCK_MAX_SIZE (1024 * 1024)
+#define DIRBLOCK_MAX_GAP (64 * 1024)
+
+static void TIFFReleaseDirBlock(TIFF *tif)
+{
+    _TIFFfreeExt(tif, tif->tif_dirblock);
+    tif->tif_dirblock = NULL;
+    tif->tif_dirblockoff = 0;
+    tif->tif_dirblocksize = 0;
+}
+
+/* Replace the directory data block by up to size bytes read at offset. */
+static void TIFFLoadDirBlock(TIFF *tif, uint64_t offset, tmsize_t size)
+{
+    uint8_t *block = (uint8_t *)_TIFFmallocExt(tif, size);
+    tmsize_t got;
+
+    TIFFReleaseDirBlock(tif);
+    if (block == NULL)
+        return;
+    /* Reading past the end of file is expected: keep what was read */
+    if (!SeekOK(tif, offset) || (got = TIFFReadFile(tif, block, size)) <= 0)
+    {
+        _TIFFfreeExt(tif, block);
+        return;
+    }
+    tif->tif_dirblock = block;
+    tif->tif_dirblockoff = offset;
+    tif->tif_dirblocksize = got;
+}
+
+/* Return the bytes [offset, offset + size) if the directory data block holds
+ * them, or NULL. */
+static const uint8_t *TIFFDirBlockData(TIFF *tif, uint64_t offset,
+                                       tmsize_t size)
+{
+    uint64_t skip = offset - tif->tif_dirblockoff;
+
+    if (tif->tif_dirblock == NULL || offset < tif->tif_dirblockoff ||
+        skip > (uint64_t)tif->tif_dirblocksize ||
+        (uint64_t)size > (uint64_t)tif->tif_dirblocksize - skip)
+        return NULL;
+    return tif->tif_dirblock + skip;
+}
+
+typedef struct
+{
+    uint64_t offset;
+    uint64_t end;
+} TIFFDirValueSpan;
+
+static int TIFFDirValueSpanCompare(const void *a, const void *b)
+{
+    const TIFFDirValueSpan *pa = (const TIFFDirValueSpan *)a;
+    const TIFFDirValueSpan *pb = (const TIFFDirValueSpan *)b;
+    return pa->offset < pb->offset ? -1 : pa->offset > pb->offset ? 1 : 0;
+}
+
+/*
+ * Read the out-of-line values of the entries of dir with one I/O call, unless
+ * the directory data block already holds them.  When the values are spread
+ * over the file, the largest cluster of them is read and the others are
+ * read individually as before.
+ */
+static void TIFFPrefetchDirEntryData(TIFF *tif, TIFFDirEntry *dir,
+                                     uint16_t dircount)
+{
+    const uint64_t inlinesize = (tif->tif_flags & TIFF_BIGTIFF) ? 8 : 4;
+    TIFFDirValueSpan *spans;
+    uint64_t start = 0, end = 0, beststart = 0, bestend = 0;
+    uint32_t nspans = 0, n = 0, bestn = 0;
+    uint16_t i;
+
+    if (isMapped(tif) || dircount == 0)
+        return;
+    spans = (TIFFDirValueSpan *)_TIFFmallocExt(
+        tif, (tmsize_t)dircount * (tmsize_t)sizeof(TIFFDirValueSpan));
+    if (spans == NULL)
+        return;
+    for (i = 0; i < dircount; i++)
+    {
+        const TIFFDirEntry *dp = &dir[i];
+        uint64_t typesize = (uint64_t)TIFFDataWidth(dp->tdir_type);
+        uint64_t offset, size;
+
+        if (typesize == 0 || dp->tdir_count == 0 ||
+            dp->tdir_count > DIRBLOCK_MAX_SIZE / typesize)
+            continue;
+        size = dp->tdir_count * typesize;
+        if (size <= inlinesize)
+            continue;
+        /* Deferred strile arrays and lazy tags are not read while parsing */
+        if ((tif->tif_flags & TIFF_DEFERSTRILELOAD) &&
+            (dp->tdir_tag == TIFFTAG_STRIPOFFSETS ||
+             dp->tdir_tag == TIFFTAG_STRIPBYTECOUNTS ||
+             dp->tdir_tag == TIFFTAG_TILEOFFSETS ||
+             dp->tdir_tag == TIFFTAG_TILEBYTECOUNTS))
+            continue;
+        if (TIFFIsLazyTagCandidate(tif, dp))
+            continue;
+        if (!(tif->tif_flags & TIFF_BIGTIFF))
+        {
+            uint32_t offset32 = dp->tdir_offset.toff_long;
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong(&offset32);
+            offset = offset32;
+        }
+        else
+        {
+            offset = dp->tdir_offset.toff_long8;
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong8(&offset);
+        }
+        if (offset > UINT64_MAX - size)
+            continue;
+        spans[nspans].offset = offset;
+        spans[nspans].end = offset + size;
+        nspans++;
+    }
+    qsort(spans, nspans, sizeof(TIFFDirValueSpan), TIFFDirValueSpanCompare);
+
+    /* Pick the cluster holding the most values */
+    for (i = 0; i < nspans; i++)
+    {
+        if (n > 0 && spans[i].offset <= end + DIRBLOCK_MAX_GAP &&
+            TIFFmax(end, spans[i].end) - start <= DIRBLOCK_MAX_SIZE)
+        {
+            end = TIFFmax(end, spans[i].end);
+            n++;
+        }
+        else
+        {
+            start = spans[i].offset;
+            end = spans[i].end;
+            n = 1;
+        }
+        if (n > bestn)
+        {
+            beststart = start;
+            bestend = end;
+            bestn = n;
+        }
+    }
+    _TIFFfreeExt(tif, spans);
+
+    /* A single value is not worth an extra copy */
+    if (bestn < 2 ||
+        TIFFDirBlockData(tif, beststart, (tmsize_t)(bestend - beststart)))
+        return;
+    TIFFLoadDirBlock(tif, beststart, (tmsize_t)(bestend - beststart));
+}
+
 static enum TIFFReadDirEntryErr TIFFReadDirEntryDataAndRealloc(TIFF *tif,
                                                                uint64_t offset,
                                                                tmsize_t size,
@@ -1202,10 +1372,11 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryDataAndRealloc(TIFF *tif,
     tmsize_t threshold = INITIAL_THRESHOLD;
 #endif
     tmsize_t already_read = 0;
+    const uint8_t *block = TIFFDirBlockData(tif, offset, size);
 
     assert(!isMapped(tif));
 
-    if (!SeekOK(tif, offset))
+    if (block == NULL && !SeekOK(tif, offset))
         return (TIFFReadDirEntryErrIo);
 
     /* On 64 bit processes, read first a maximum of 1 MB, then 10 MB, etc */
@@ -1220,7 +1391,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryDataAndRealloc(TIFF *tif,
         tmsize_t bytes_read;
         tmsize_t to_read = size - already_read;
 #if SIZEOF_SIZE_T == 8
-        if (to_read >= threshold && threshold < MAX_THRESHOLD)
+        if (block == NULL && to_read >= threshold && threshold < MAX_THRESHOLD)
         {
             to_read = threshold;
             threshold *= THRESHOLD_MULTIPLIER;
@@ -1241,7 +1412,15 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryDataAndRealloc(TIFF *tif,
         }
         *pdest = new_dest;
 
-        bytes_read = TIFFReadFile(tif, (char *)*pdest + already_read, to_read);
+        if (block != NULL)
+        {
+            _TIFFmemcpy((char *)*pdest + already_read, block + already_read,
+                        to_read);
+            bytes_read = to_read;
+        }
+        else
+            bytes_read =
+                TIFFReadFile(tif, (char *)*pdest + already_read, to_read);
         already_read += bytes_read;
         if (bytes_read != to_read)
         {
@@ -2519,20 +2698,9 @@ TIFFReadDirEntryLong8ArrayWithLimit(TIFF *tif, TIFFDirEntry *direntry,
         }
         break;
         case TIFF_SHORT:
-        {
-            uint16_t *ma;
-            uint64_t *mb;
-            uint32_t n;
-            ma = (uint16_t *)origdata;
-            mb = data;
-            for (n = 0; n < count; n++)
-            {
-                if (tif->tif_flags & TIFF_SWAB)
-                    TIFFSwabShort(ma);
-                *mb++ = (uint64_t)(*ma++);
-            }
-        }
-        break;
+            _TIFFWidenArrayOfShort(data, origdata, count,
+                                   (tif->tif_flags & TIFF_SWAB) != 0);
+            break;
         case TIFF_SSHORT:
         {
             int16_t *ma;
@@ -2552,20 +2720,9 @@ TIFFReadDirEntryLong8ArrayWithLimit(TIFF *tif, TIFFDirEntry *direntry,
         }
         break;
         case TIFF_LONG:
-        {
-            uint32_t *ma;
-            uint64_t *mb;
-            uint32_t n;
-            ma = (uint32_t *)origdata;
-            mb = data;
-            for (n = 0; n < count; n++)
-            {
-                if (tif->tif_flags & TIFF_SWAB)
-                    TIFFSwabLong(ma);
-                *mb++ = (uint64_t)(*ma++);
-            }
-        }
-        break;
+            _TIFFWidenArrayOfLong(data, origdata, count,
+                                  (tif->tif_flags & TIFF_SWAB) != 0);
+            break;
         case TIFF_SLONG:
         {
             int32_t *ma;
@@ -3900,6 +4057,12 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryData(TIFF *tif, uint64_t offset,
     assert(size > 0);
     if (!isMapped(tif))
     {
+        const uint8_t *block = TIFFDirBlockData(tif, offset, size);
+        if (block != NULL)
+        {
+            _TIFFmemcpy(dest, block, size);
+            return (TIFFReadDirEntryErrOk);
+        }
         if (!SeekOK(tif, offset))
             return (TIFFReadDirEntryErrIo);
         if (!ReadOK(tif, dest, size))
@@ -4277,6 +4440,7 @@ int TIFFReadDirectory(TIFF *tif)
     dircount = TIFFFetchDirectory(tif, nextdiroff, &dir, &tif->tif_nextdiroff);
     if (!dircount)
     {
+        TIFFReleaseDirBlock(tif);
         TIFFErrorExtR(tif, module,
                       "Failed to read directory at offset %" PRIu64,
                       nextdiroff);
@@ -4790,7 +4954,7 @@ int TIFFReadDirectory(TIFF *tif)
                     break;
 #endif
                 default:
-                    (void)TIFFFetchNormalTag(tif, dp, TRUE);
+                    TIFFFetchOrDeferNormalTag(tif, dp);
                     break;
             } /* -- switch (dp->tdir_tag) -- */
         }     /* -- if (!dp->tdir_ignore) */
@@ -4955,6 +5119,7 @@ int TIFFReadDirectory(TIFF *tif)
                 goto bad;
             }
         }
+        TIFFCheckStrileExtents(tif);
     }
 
     /*
@@ -5097,6 +5262,7 @@ int TIFFReadDirectory(TIFF *tif)
         _TIFFfreeExt(tif, dir);
         dir = NULL;
     }
+    TIFFReleaseDirBlock(tif);
     if (!TIFFFieldSet(tif, FIELD_MAXSAMPLEVALUE))
     {
         if (tif->tif_dir.td_bitspersample >= 16)
@@ -5205,6 +5371,7 @@ int TIFFReadDirectory(TIFF *tif)
 bad:
     if (dir)
         _TIFFfreeExt(tif, dir);
+    TIFFReleaseDirBlock(tif);
     return (0);
 } /*-- TIFFReadDirectory() --*/
 
@@ -5294,6 +5461,7 @@ int TIFFReadCustomDirectory(TIFF *tif, toff_t diroff,
     dircount = TIFFFetchDirectory(tif, diroff, &dir, NULL);
     if (!dircount)
     {
+        TIFFReleaseDirBlock(tif);
         TIFFErrorExtR(tif, module,
                       "Failed to read custom directory at offset %" PRIu64,
                       diroff);
@@ -5345,6 +5513,7 @@ int TIFFReadCustomDirectory(TIFF *tif, toff_t diroff,
             "Failed to allocate memory for counting IFD data size at reading");
         if (dir)
             _TIFFfreeExt(tif, dir);
+        TIFFReleaseDirBlock(tif);
         return 0;
     }
 
@@ -5443,7 +5612,7 @@ int TIFFReadCustomDirectory(TIFF *tif, toff_t diroff,
                         }
                         break;
                     default:
-                        (void)TIFFFetchNormalTag(tif, dp, TRUE);
+                        TIFFFetchOrDeferNormalTag(tif, dp);
                         break;
                 }
             } /*-- if (!dp->tdir_ignore) */
@@ -5456,6 +5625,7 @@ int TIFFReadCustomDirectory(TIFF *tif, toff_t diroff,
     tif->tif_setdirectory_force_absolute = TRUE;
     if (dir)
         _TIFFfreeExt(tif, dir);
+    TIFFReleaseDirBlock(tif);
     return 1;
 }
 
@@ -5964,11 +6134,10 @@ int _TIFFRemoveEntryFromDirectoryListByOffset(TIFF *tif, uint64_t diroff)
                                   foundEntryOldDir);
                 TIFFHashSetRemove(tif->tif_map_dir_offset_to_number,
                                   foundEntryOldOff);
-                if (foundEntryOldOff->dirNumber <
-                        tif->tif_dir_offset_cache_count &&
+                if (entryOld.dirNumber < tif->tif_dir_offset_cache_count &&
                     tif->tif_dir_offset_cache)
                 {
-                    tif->tif_dir_offset_cache[foundEntryOldOff->dirNumber] = 0;
+                    tif->tif_dir_offset_cache[entryOld.dirNumber] = 0;
                 }
                 return 1;
             }
@@ -6039,6 +6208,7 @@ static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
         *nextdiroff = 0;
     if (!isMapped(tif))
     {
+        uint64_t off = tif->tif_diroff;
         if (!SeekOK(tif, tif->tif_diroff))
         {
             TIFFErrorExtR(tif, module,
@@ -6046,15 +6216,19 @@ static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
                           tif->tif_name);
             return 0;
         }
+        /* The count, the entries and the link are then copied from it */
+        TIFFLoadDirBlock(tif, off, DIRBLOCK_HEAD_SIZE);
         if (!(tif->tif_flags & TIFF_BIGTIFF))
         {
-            if (!ReadOK(tif, &dircount16, sizeof(uint16_t)))
+            if (TIFFReadDirEntryData(tif, off, sizeof(uint16_t),
+                                     &dircount16) != TIFFReadDirEntryErrOk)
             {
                 TIFFErrorExtR(tif, module,
                               "%s: Can not read TIFF directory count",
                               tif->tif_name);
                 return 0;
             }
+            off += sizeof(uint16_t);
             if (tif->tif_flags & TIFF_SWAB)
                 TIFFSwabShort(&dircount16);
             if (dircount16 > 4096)
@@ -6069,13 +6243,15 @@ static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
         else
         {
             uint64_t dircount64;
-            if (!ReadOK(tif, &dircount64, sizeof(uint64_t)))
+            if (TIFFReadDirEntryData(tif, off, sizeof(uint64_t),
+                                     &dircount64) != TIFFReadDirEntryErrOk)
             {
                 TIFFErrorExtR(tif, module,
                               "%s: Can not read TIFF directory count",
                               tif->tif_name);
                 return 0;
             }
+            off += sizeof(uint64_t);
             if (tif->tif_flags & TIFF_SWAB)
                 TIFFSwabLong8(&dircount64);
             if (dircount64 > 4096)
@@ -6092,7 +6268,8 @@ static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
                                    "to read TIFF directory");
         if (origdir == NULL)
             return 0;
-        if (!ReadOK(tif, origdir, (tmsize_t)(dircount16 * dirsize)))
+        if (TIFFReadDirEntryData(tif, off, (tmsize_t)(dircount16 * dirsize),
+                                 origdir) != TIFFReadDirEntryErrOk)
         {
             TIFFErrorExtR(tif, module, "%.100s: Can not read TIFF directory",
                           tif->tif_name);
@@ -6105,10 +6282,12 @@ static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
          */
         if (nextdiroff)
         {
+            off += (uint64_t)dircount16 * dirsize;
             if (!(tif->tif_flags & TIFF_BIGTIFF))
             {
                 uint32_t nextdiroff32;
-                if (!ReadOK(tif, &nextdiroff32, sizeof(uint32_t)))
+                if (TIFFReadDirEntryData(tif, off, sizeof(uint32_t),
+                                         &nextdiroff32) != TIFFReadDirEntryErrOk)
                     nextdiroff32 = 0;
                 if (tif->tif_flags & TIFF_SWAB)
                     TIFFSwabLong(&nextdiroff32);
@@ -6116,7 +6295,8 @@ static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
             }
             else
             {
-                if (!ReadOK(tif, nextdiroff, sizeof(uint64_t)))
+                if (TIFFReadDirEntryData(tif, off, sizeof(uint64_t),
+                                         nextdiroff) != TIFFReadDirEntryErrOk)
                     *nextdiroff = 0;
                 if (tif->tif_flags & TIFF_SWAB)
                     TIFFSwabLong8(nextdiroff);
@@ -6307,10 +6487,70 @@ static uint16_t TIFFFetchDirectory(TIFF *tif, uint64_t diroff,
         mb++;
     }
     _TIFFfreeExt(tif, origdir);
+    TIFFPrefetchDirEntryData(tif, dir, dircount16);
     *pdir = dir;
     return dircount16;
 }
 
+/*
+ * Lazy tag loading.
+ *
+ * With a lazy tag threshold, large BYTE, SBYTE, UNDEFINED and ASCII values of
+ * custom tags (XMP packets, ICC profiles, Photoshop blocks, private blobs...)
+ * are not read with their directory: only their entry is recorded, and
+ * TIFFVGetField() reads the value the first time it is asked for.
+ */
+static int TIFFIsLazyTagCandidate(TIFF *tif, const TIFFDirEntry *dp)
+{
+    if (tif->tif_lazytagthreshold <= 0 || tif->tif_mode != O_RDONLY)
+        return 0;
+    if (dp->tdir_type != TIFF_BYTE && dp->tdir_type != TIFF_SBYTE &&
+        dp->tdir_type != TIFF_UNDEFINED && dp->tdir_type != TIFF_ASCII)
+        return 0;
+    /* Values stored in the entry itself are never deferred */
+    return dp->tdir_count >= (uint64_t)tif->tif_lazytagthreshold &&
+           dp->tdir_count > ((tif->tif_flags & TIFF_BIGTIFF) ? 8U : 4U);
+}
+
+static void TIFFFetchOrDeferNormalTag(TIFF *tif, TIFFDirEntry *dp)
+{
+    if (TIFFIsLazyTagCandidate(tif, dp))
+    {
+        uint32_t fii;
+        TIFFReadDirectoryFindFieldInfo(tif, dp->tdir_tag, &fii);
+        if (fii != FAILED_FII)
+        {
+            const TIFFField *fip = tif->tif_fields[fii];
+            if (fip->field_bit == FIELD_CUSTOM &&
+                (fip->set_get_field_type == TIFF_SETGET_ASCII ||
+                 fip->set_get_field_type == TIFF_SETGET_C16_UINT8 ||
+                 fip->set_get_field_type == TIFF_SETGET_C32_UINT8 ||
+                 fip->set_get_field_type == TIFF_SETGET_C16_SINT8 ||
+                 fip->set_get_field_type == TIFF_SETGET_C32_SINT8) &&
+                _TIFFSetLazyCustomValue(tif, fip, dp))
+                return;
+        }
+    }
+    (void)TIFFFetchNormalTag(tif, dp, TRUE);
+}
+
+/*
+ * Read the value of a tag deferred by TIFFFetchOrDeferNormalTag().  Returns 0
+ * if it could not be read.
+ */
+int _TIFFFetchLazyTag(TIFF *tif, const TIFFTagValue *tv)
+{
+    TIFFDirEntry entry;
+
+    _TIFFmemset(&entry, 0, sizeof(entry));
+    entry.tdir_tag = (uint16_t)tv->info->field_tag;
+    entry.tdir_type = tv->lazytype;
+    entry.tdir_count = tv->lazycount;
+    entry.tdir_offset.toff_long8 = tv->lazyoffset;
+    /* Replaces the recorded entry through TIFFSetField() */
+    return TIFFFetchNormalTag(tif, &entry, TRUE);
+}
+
 /*
  * Fetch a tag that is not handled by special case code.
  */
@@ -7680,6 +7920,72 @@ static int TIFFFetchNormalTag(TIFF *tif, TIFFDirEntry *dp, int recover)
     return (1);
 }
 
+/*
+ * Bulk load of a SHORT, LONG or LONG8 strip/tile array lying within the
+ * file: the values are read with a single request into the tail of the
+ * final array, then byte-swapped and widened in place.  Returns NULL without
+ * emitting any error if the entry does not qualify or cannot be read, in
+ * which case the caller falls back to TIFFReadDirEntryLong8ArrayWithLimit().
+ */
+static uint64_t *TIFFReadStrileArrayBulk(TIFF *tif, TIFFDirEntry *dir,
+                                         uint32_t nstrips)
+{
+    const int bSwab = (tif->tif_flags & TIFF_SWAB) != 0;
+    const uint64_t inlinesize = (tif->tif_flags & TIFF_BIGTIFF) ? 8 : 4;
+    uint64_t offset, datasize, filesize;
+    uint32_t count;
+    int typesize;
+    uint64_t *data;
+
+    if (dir->tdir_type != TIFF_SHORT && dir->tdir_type != TIFF_LONG &&
+        dir->tdir_type != TIFF_LONG8)
+        return NULL;
+    typesize = TIFFDataWidth((TIFFDataType)dir->tdir_type);
+    /* Values stored in the entry itself are not worth it */
+    if (dir->tdir_count <= inlinesize / (uint64_t)typesize)
+        return NULL;
+    count = dir->tdir_count > nstrips ? nstrips : (uint32_t)dir->tdir_count;
+    if (count == 0 || count > MAX_SIZE_TAG_DATA / sizeof(uint64_t))
+        return NULL;
+
+    if (tif->tif_flags & TIFF_BIGTIFF)
+    {
+        offset = dir->tdir_offset.toff_long8;
+        if (bSwab)
+            TIFFSwabLong8(&offset);
+    }
+    else
+    {
+        uint32_t offset32 = dir->tdir_offset.toff_long;
+        if (bSwab)
+            TIFFSwabLong(&offset32);
+        offset = offset32;
+    }
+    datasize = (uint64_t)count * typesize;
+    filesize = isMapped(tif) ? (uint64_t)tif->tif_size : TIFFGetFileSize(tif);
+    if (offset > filesize || datasize > filesize - offset)
+        return NULL;
+
+    data = (uint64_t *)_TIFFmallocExt(tif, (tmsize_t)count * 8);
+    if (data == NULL)
+        return NULL;
+    if (TIFFReadDirEntryData(tif, offset, (tmsize_t)datasize,
+                             (uint8_t *)data + (count * 8 - datasize)) !=
+        TIFFReadDirEntryErrOk)
+    {
+        _TIFFfreeExt(tif, data);
+        return NULL;
+    }
+    if (dir->tdir_type == TIFF_SHORT)
+        _TIFFWidenArrayOfShort(data, (uint8_t *)data + count * 6, count,
+                               bSwab);
+    else if (dir->tdir_type == TIFF_LONG)
+        _TIFFWidenArrayOfLong(data, (uint8_t *)data + count * 4, count, bSwab);
+    else if (bSwab)
+        TIFFSwabArrayOfLong8(data, count);
+    return data;
+}
+
 /*
  * Fetch a set of offsets or lengths.
  * While this routine says "strips", in fact it's also used for tiles.
@@ -7688,9 +7994,10 @@ static int TIFFFetchStripThing(TIFF *tif, TIFFDirEntry *dir, uint32_t nstrips,
                                uint64_t **lpp)
 {
     static const char module[] = "TIFFFetchStripThing";
-    enum TIFFReadDirEntryErr err;
-    uint64_t *data;
-    err = TIFFReadDirEntryLong8ArrayWithLimit(tif, dir, &data, nstrips);
+    enum TIFFReadDirEntryErr err = TIFFReadDirEntryErrOk;
+    uint64_t *data = TIFFReadStrileArrayBulk(tif, dir, nstrips);
+    if (data == NULL)
+        err = TIFFReadDirEntryLong8ArrayWithLimit(tif, dir, &data, nstrips);
     if (err != TIFFReadDirEntryErrOk)
     {
         const TIFFField *fip = TIFFFieldWithTag(tif, dir->tdir_tag);
@@ -7769,6 +8076,34 @@ static int TIFFFetchStripThing(TIFF *tif, TIFFDirEntry *dir, uint32_t nstrips,
     return (1);
 }
 
+/*
+ * Warn once, when the strip/tile arrays of a read-only file have been
+ * loaded, about the striles whose data extends past the end of the file.
+ * The loop is branch-free so that it vectorizes.
+ */
+static void TIFFCheckStrileExtents(TIFF *tif)
+{
+    static const char module[] = "TIFFReadDirectory";
+    const TIFFDirectory *td = &tif->tif_dir;
+    const uint64_t *offsets = td->td_stripoffset_p;
+    const uint64_t *bytecounts = td->td_stripbytecount_p;
+    uint64_t filesize;
+    uint32_t nbad = 0;
+
+    if (tif->tif_mode != O_RDONLY || offsets == NULL || bytecounts == NULL)
+        return;
+    filesize = isMapped(tif) ? (uint64_t)tif->tif_size : TIFFGetFileSize(tif);
+    if (filesize == 0)
+        return;
+    for (uint32_t i = 0; i < td->td_nstrips; i++)
+        nbad += (uint32_t)((offsets[i] > filesize) |
+                           (bytecounts[i] > filesize - offsets[i]));
+    if (nbad != 0)
+        TIFFWarningExtR(tif, module,
+                        "%" PRIu32 " %s extend past the end of the file",
+                        nbad, isTiled(tif) ? "tiles" : "strips");
+}
+
 /*
  * Fetch and set the SubjectDistance EXIF tag.
  */
@@ -8115,7 +8450,10 @@ static int _TIFFPartialReadStripArray(TIFF *tif, TIFFDirEntry *dirent,
     tmsize_t nRead;
     uint64_t nLastStripOffset;
     int iStartBefore;
-    int i;
+    uint64_t nStart;
+    uint32_t nFirst;
+    uint32_t nCount;
+    const unsigned char *pSrc;
     const uint32_t arraySize = tif->tif_dir.td_stripoffsetbyteallocsize;
     unsigned char buffer[2 * IO_CACHE_PAGE_SIZE];
 
@@ -8205,53 +8543,28 @@ static int _TIFFPartialReadStripArray(TIFF *tif, TIFFDirEntry *dirent,
     iStartBefore = -(int)((nOffset - nOffsetStartPage) / sizeofval);
     if (strile + iStartBefore < 0)
         iStartBefore = -strile;
-    for (i = iStartBefore;
-         (uint32_t)(strile + i) < arraySize &&
-         _TIFFUnsanitizedAddUInt64AndInt(nOffset, (i + 1) * sizeofvalint) <=
-             nOffsetEndPage;
-         ++i)
-    {
-        if (dirent->tdir_type == TIFF_SHORT)
-        {
-            uint16_t val;
-            memcpy(&val,
-                   buffer + (nOffset - nOffsetStartPage) + i * sizeofvalint,
-                   sizeof(val));
-            if (bSwab)
-                TIFFSwabShort(&val);
-            panVals[strile + i] = val;
-        }
-        else if (dirent->tdir_type == TIFF_LONG)
-        {
-            uint32_t val;
-            memcpy(&val,
-                   buffer + (nOffset - nOffsetStartPage) + i * sizeofvalint,
-                   sizeof(val));
-            if (bSwab)
-                TIFFSwabLong(&val);
-            panVals[strile + i] = val;
-        }
-        else if (dirent->tdir_type == TIFF_LONG8)
-        {
-            uint64_t val;
-            memcpy(&val,
-                   buffer + (nOffset - nOffsetStartPage) + i * sizeofvalint,
-                   sizeof(val));
-            if (bSwab)
-                TIFFSwabLong8(&val);
-            panVals[strile + i] = val;
-        }
-        else /* if( dirent->tdir_type == TIFF_SLONG8 ) */
-        {
-            /* Non conformant data type */
-            int64_t val;
-            memcpy(&val,
-                   buffer + (nOffset - nOffsetStartPage) + i * sizeofvalint,
-                   sizeof(val));
-            if (bSwab)
-                TIFFSwabLong8((uint64_t *)&val);
-            panVals[strile + i] = (uint64_t)val;
-        }
+    /* Convert all the values of the pages at once */
+    nFirst = (uint32_t)(strile + iStartBefore);
+    nStart = _TIFFUnsanitizedAddUInt64AndInt(nOffset,
+                                             iStartBefore * sizeofvalint);
+    nCount = 0;
+    if (nFirst < arraySize && nStart < nOffsetEndPage)
+    {
+        nCount = (uint32_t)((nOffsetEndPage - nStart) / sizeofval);
+        if (nCount > arraySize - nFirst)
+            nCount = arraySize - nFirst;
+    }
+    pSrc = buffer + (nStart - nOffsetStartPage);
+    if (dirent->tdir_type == TIFF_SHORT)
+        _TIFFWidenArrayOfShort(panVals + nFirst, pSrc, nCount, bSwab);
+    else if (dirent->tdir_type == TIFF_LONG)
+        _TIFFWidenArrayOfLong(panVals + nFirst, pSrc, nCount, bSwab);
+    else
+    {
+        /* LONG8, or the non conformant SLONG8 taken as is */
+        memcpy(panVals + nFirst, pSrc, (size_t)nCount * sizeof(uint64_t));
+        if (bSwab)
+            TIFFSwabArrayOfLong8(panVals + nFirst, nCount);
     }
     return 1;
 }
@@ -8384,6 +8697,17 @@ static uint64_t _TIFFGetStrileOffsetOrByteCountValue(TIFF *tif, uint32_t strile,
                 /* the same arguments */
             }
         }
+        else if (tif->tif_strilepagesbudget > 0)
+        {
+            uint64_t value = 0;
+            if (!_TIFFStrilePagesGet(tif, dirent, strile, &value))
+            {
+                if (pbErr)
+                    *pbErr = 1;
+                return 0;
+            }
+            return value;
+        }
         else
         {
             if (!_TIFFFetchStrileValue(tif, strile, dirent, parray))
@@ -8394,6 +8718,18 @@ static uint64_t _TIFFGetStrileOffsetOrByteCountValue(TIFF *tif, uint32_t strile,
             }
         }
     }
+    else if (tif->tif_strilestream != NULL)
+    {
+        /* Directory being written with TIFFStreamStrileArrayWriting() */
+        uint64_t *entry[2];
+        if (!_TIFFStrileStreamEntry(tif, strile, &entry[0], &entry[1]))
+        {
+            if (pbErr)
+                *pbErr = 1;
+            return 0;
+        }
+        return *entry[dirent == &td->td_stripbytecount_entry];
+    }
     if (*parray == NULL || strile >= td->td_nstrips)
     {
         if (pbErr)
@@ -8457,6 +8793,7 @@ static int _TIFFFillStrilesInternal(TIFF *tif, int loadStripByteCount)
         td->td_stripoffset_p = NULL;
         td->td_stripbytecount_p = NULL;
         td->td_stripoffsetbyteallocsize = 0;
+        _TIFFStrilePagesFree(tif);
         tif->tif_flags &= ~TIFF_LAZYSTRILELOAD;
     }
 
@@ -8483,6 +8820,8 @@ static int _TIFFFillStrilesInternal(TIFF *tif, int loadStripByteCount)
 
     _TIFFmemset(&(td->td_stripoffset_entry), 0, sizeof(TIFFDirEntry));
     _TIFFmemset(&(td->td_stripbytecount_entry), 0, sizeof(TIFFDirEntry));
+    if (return_value == 1 && loadStripByteCount)
+        TIFFCheckStrileExtents(tif);
 
 #ifdef STRIPBYTECOUNTSORTED_UNUSED
     if (tif->tif_dir.td_nstrips > 1 && return_value == 1)
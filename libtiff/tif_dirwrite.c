@@ -283,6 +283,45 @@ int TIFFDeferStrileArrayWriting(TIFF *tif)
     return 1;
 }
 
+/*
+ * This is an advanced writing function for images with a very large number
+ * of strips/tiles. When called before the first strip/tile of the current
+ * directory is written, the [Strip/Tile][Offsets/ByteCounts] arrays are not
+ * kept in memory: they are reserved at the end of the file when writing
+ * starts, as LONG8 arrays in BigTIFF files and LONG arrays otherwise, and
+ * only a small window of their entries is kept in memory and written back to
+ * the file as strips/tiles are written, in any order. The memory used thus
+ * does not depend on the number of strips/tiles.
+ *
+ * Its effect is only valid for the current directory, and will be reset
+ * when changing directory. While the directory is being written,
+ * TIFFGetField() returns no array for those tags.
+ *
+ * Returns 1 in case of success, 0 otherwise.
+ */
+int TIFFStreamStrileArrayWriting(TIFF *tif)
+{
+    static const char module[] = "TIFFStreamStrileArrayWriting";
+    if (tif->tif_mode == O_RDONLY)
+    {
+        TIFFErrorExtR(tif, tif->tif_name, "File opened in read-only mode");
+        return 0;
+    }
+    if (tif->tif_diroff != 0)
+    {
+        TIFFErrorExtR(tif, module, "Directory has already been written");
+        return 0;
+    }
+    if (tif->tif_dir.td_stripoffset_p != NULL)
+    {
+        TIFFErrorExtR(tif, module, "Strips/tiles have already been set up");
+        return 0;
+    }
+
+    tif->tif_dir.td_streamstrilearrays = TRUE;
+    return 1;
+}
+
 /*
  * Similar to TIFFWriteDirectory(), writes the directory out
  * but leaves all data structures in memory so that it can be
@@ -503,6 +542,9 @@ static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
 
     _TIFFFillStriles(tif);
 
+    if (isimage && !_TIFFStrileChecksumFlush(tif))
+        return (0);
+
     /*
      * Clear write state so that subsequent images with
      * different characteristics get the right buffers
@@ -747,7 +789,8 @@ static int TIFFWriteDirectorySec(TIFF *tif, int isimage, int imagedone,
                      * We can get here when using tiffset on such a file.
                      * See http://bugzilla.maptools.org/show_bug.cgi?id=2500
                      */
-                    if (tif->tif_dir.td_stripoffset_p != NULL &&
+                    if ((tif->tif_dir.td_stripoffset_p != NULL ||
+                         tif->tif_strilestream != NULL) &&
                         !TIFFWriteDirectoryTagLongLong8Array(
                             tif, &ndir, dir, TIFFTAG_STRIPOFFSETS,
                             tif->tif_dir.td_nstrips,
@@ -1886,6 +1929,8 @@ static int _WriteAsType(TIFF *tif, uint64_t strile_size,
              compression == COMPRESSION_LZMA ||
              compression == COMPRESSION_LERC ||
              compression == COMPRESSION_ZSTD ||
+             compression == COMPRESSION_LZ4 ||
+             compression == COMPRESSION_JPEGLS ||
              compression == COMPRESSION_WEBP || compression == COMPRESSION_JXL)
     {
         /* For a few select compression types, we assume that in the worst */
@@ -1935,6 +1980,52 @@ static int TIFFWriteDirectoryTagLongLong8Array(TIFF *tif, uint32_t *ndir,
                                          NULL);
     }
 
+    if (tif->tif_strilestream != NULL)
+    {
+        /* The array has been reserved in the file: point to it. */
+        const int which =
+            tag == TIFFTAG_STRIPBYTECOUNTS || tag == TIFFTAG_TILEBYTECOUNTS;
+        uint64_t offset;
+        if (dir == NULL)
+        {
+            (*ndir)++;
+            return 1;
+        }
+        if (count == 1)
+        {
+            /* A single value is stored in the entry itself */
+            uint64_t *entry[2];
+            if (!_TIFFStrileStreamEntry(tif, 0, &entry[0], &entry[1]))
+                return 0;
+            offset = *entry[which];
+        }
+        else if (!_TIFFStrileStreamArray(tif, which, &offset))
+            return 0;
+        if (tif->tif_flags & TIFF_BIGTIFF)
+        {
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong8(&offset);
+            return TIFFWriteDirectoryTagData(tif, ndir, dir, tag, TIFF_LONG8,
+                                             count, 8, &offset);
+        }
+        else
+        {
+            uint32_t offset32;
+            if (offset > 0xFFFFFFFF)
+            {
+                TIFFErrorExtR(tif, module,
+                              "Attempt to write value larger than 0xFFFFFFFF "
+                              "in LONG array.");
+                return 0;
+            }
+            offset32 = (uint32_t)offset;
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabLong(&offset32);
+            return TIFFWriteDirectoryTagData(tif, ndir, dir, tag, TIFF_LONG,
+                                             count, 4, &offset32);
+        }
+    }
+
     if (tif->tif_flags & TIFF_BIGTIFF)
     {
         int write_aslong8 = 1;
@@ -44,14 +44,14 @@ int TIFFFlush(TIFF *tif)
         !(tif->tif_flags & TIFF_DIRTYDIRECT) && tif->tif_mode == O_RDWR)
     {
         if (TIFFForceStrileArrayWriting(tif))
-            return 1;
+            return _TIFFWriteBehindFlush(tif);
     }
 
     if ((tif->tif_flags & (TIFF_DIRTYDIRECT | TIFF_DIRTYSTRIP)) &&
         !TIFFRewriteDirectory(tif))
         return (0);
 
-    return (1);
+    return _TIFFWriteBehindFlush(tif);
 }
 
 /*
@@ -96,6 +96,16 @@ int TIFFForceStrileArrayWriting(TIFF *tif)
         return 0;
     }
 
+    if (tif->tif_strilestream != NULL)
+    {
+        /* The directory already points to the arrays reserved in the file */
+        if (!_TIFFStrileStreamFlush(tif))
+            return 0;
+        tif->tif_flags &= ~TIFF_DIRTYSTRIP;
+        tif->tif_flags &= ~TIFF_BEENWRITING;
+        return 1;
+    }
+
     if (!(tif->tif_flags & TIFF_DIRTYSTRIP))
     {
         if (!(tif->tif_dir.td_stripoffset_entry.tdir_tag != 0 &&
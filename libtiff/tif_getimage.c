@@ -569,6 +569,10 @@ int TIFFRGBAImageBegin(TIFFRGBAImage *img, TIFF *tif, int stop,
     }
     TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &img->width);
     TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &img->height);
+    /* Decoding at reduced resolution (TIFFTAG_JPEGSCALEDENOM) gives a
+     * proportionally smaller raster; row/col offsets are in its units. */
+    img->width = TIFFScaledDim(tif, img->width);
+    img->height = TIFFScaledDim(tif, img->height);
     TIFFGetFieldDefaulted(tif, TIFFTAG_ORIENTATION, &img->orientation);
     img->isContig =
         !(planarconfig == PLANARCONFIG_SEPARATE && img->samplesperpixel > 1);
@@ -831,6 +835,8 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
 
     TIFFGetField(tif, TIFFTAG_TILEWIDTH, &tw);
     TIFFGetField(tif, TIFFTAG_TILELENGTH, &th);
+    tw = TIFFScaledDim(tif, tw);
+    th = TIFFScaledDim(tif, th);
 
     flip = setorientation(img);
     if (tw > ((int64_t)INT_MAX + w))
@@ -872,9 +878,11 @@ static int gtTileContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         col = img->col_offset;
         while (tocol < w)
         {
-            if (_TIFFReadTileAndAllocBuffer(tif, (void **)&buf, bufsize, col,
-                                            row + img->row_offset, 0,
-                                            0) == (tmsize_t)(-1) &&
+            if (_TIFFReadTileAndAllocBuffer(
+                    tif, (void **)&buf, bufsize,
+                    col * (uint32_t)TIFFDecodeScale(tif),
+                    (row + img->row_offset) * (uint32_t)TIFFDecodeScale(tif),
+                    0, 0) == (tmsize_t)(-1) &&
                 (buf == NULL || img->stoponerr))
             {
                 ret = 0;
@@ -1148,6 +1156,7 @@ static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
         TIFFErrorExtR(tif, TIFFFileName(tif), "rowsperstrip is zero");
         return (0);
     }
+    rowsperstrip = TIFFScaledDim(tif, rowsperstrip);
 
     scanline = TIFFScanlineSize(tif);
     fromskew = (w < imagewidth ? imagewidth - w : 0);
@@ -1167,7 +1176,11 @@ static int gtStripContig(TIFFRGBAImage *img, uint32_t *raster, uint32_t w,
             return 0;
         }
         if (_TIFFReadEncodedStripAndAllocBuffer(
-                tif, TIFFComputeStrip(tif, row + img->row_offset, 0),
+                tif,
+                TIFFComputeStrip(tif,
+                                 (row + img->row_offset) *
+                                     (uint32_t)TIFFDecodeScale(tif),
+                                 0),
                 (void **)(&buf), maxstripsize,
                 temp * scanline) == (tmsize_t)(-1) &&
             (buf == NULL || img->stoponerr))
@@ -3581,6 +3594,7 @@ int TIFFReadRGBAStripExt(TIFF *tif, uint32_t row, uint32_t *raster,
         TIFFErrorExtR(tif, TIFFFileName(tif), "rowsperstrip is zero");
         return (0);
     }
+    rowsperstrip = TIFFScaledDim(tif, rowsperstrip);
 
     if ((row % rowsperstrip) != 0)
     {
@@ -3663,6 +3677,8 @@ int TIFFReadRGBATileExt(TIFF *tif, uint32_t col, uint32_t row, uint32_t *raster,
                       "tile_xsize or tile_ysize is zero");
         return (0);
     }
+    tile_xsize = TIFFScaledDim(tif, tile_xsize);
+    tile_ysize = TIFFScaledDim(tif, tile_ysize);
 
     if ((col % tile_xsize) != 0 || (row % tile_ysize) != 0)
     {
@@ -0,0 +1,249 @@
+#include "tiffiop.h"
+#include "tiff_simd.h"
+#include <stdio.h>
+
+/*
+ * Index of the main IFD chain.
+ *
+ * On read-only handles the first TIFFNumberOfDirectories() call records the
+ * offset of every main IFD, after which directory counts are answered without
+ * I/O and TIFFSetDirectory() jumps straight to any page, even after SubIFDs
+ * have been visited.  The index can be saved to a sidecar file and loaded by
+ * later handles, which validate it against the size and modification time of
+ * the TIFF file, its first IFD offset and the end of its last IFD.
+ *
+ * Sidecar layout, all integers little-endian:
+ *   char[8]  "TIFFIFDX"
+ *   uint32   version (1)
+ *   uint32   flags (1 if BigTIFF)
+ *   uint64   size of the TIFF file
+ *   uint64   modification time of the TIFF file, 0 if unknown
+ *   uint64   number of IFDs, n
+ *   uint64   offsets[n]
+ *   uint32   CRC32C of all the preceding bytes
+ */
+
+#define IFDINDEX_MAGIC "TIFFIFDX"
+#define IFDINDEX_VERSION 1
+#define IFDINDEX_HEADER_SIZE 40
+
+static void putLE32(uint8_t *p, uint32_t v)
+{
+    for (int i = 0; i < 4; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static void putLE64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++)
+        p[i] = (uint8_t)(v >> (8 * i));
+}
+
+static uint32_t getLE32(const uint8_t *p)
+{
+    uint32_t v = 0;
+    for (int i = 3; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t getLE64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--)
+        v = (v << 8) | p[i];
+    return v;
+}
+
+static uint64_t firstIFDOffset(TIFF *tif)
+{
+    if (tif->tif_flags & TIFF_BIGTIFF)
+        return tif->tif_header.big.tiff_diroff;
+    return tif->tif_header.classic.tiff_diroff;
+}
+
+/*
+ * Install offsets[0..count) as the index of tif, taking ownership of the
+ * array (allocated with _TIFFmallocExt).
+ */
+void _TIFFIFDIndexSet(TIFF *tif, uint64_t *offsets, tdir_t count)
+{
+    _TIFFfreeExt(tif, tif->tif_ifdindex);
+    tif->tif_ifdindex = offsets;
+    tif->tif_ifdindexcount = count;
+}
+
+void _TIFFIFDIndexFree(TIFF *tif)
+{
+    _TIFFfreeExt(tif, tif->tif_ifdindex);
+    tif->tif_ifdindex = NULL;
+    tif->tif_ifdindexcount = 0;
+}
+
+/* Read the link to the next IFD of the IFD at diroff. */
+static int readNextIFDOffset(TIFF *tif, uint64_t diroff, uint64_t *next)
+{
+    if (!(tif->tif_flags & TIFF_BIGTIFF))
+    {
+        uint16_t dircount;
+        uint32_t next32;
+        if (!SeekOK(tif, diroff) || !ReadOK(tif, &dircount, sizeof(dircount)))
+            return 0;
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabShort(&dircount);
+        if (!SeekOK(tif, diroff + 2 + (uint64_t)dircount * 12) ||
+            !ReadOK(tif, &next32, sizeof(next32)))
+            return 0;
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabLong(&next32);
+        *next = next32;
+    }
+    else
+    {
+        uint64_t dircount;
+        if (!SeekOK(tif, diroff) || !ReadOK(tif, &dircount, sizeof(dircount)))
+            return 0;
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabLong8(&dircount);
+        if (dircount > 0xFFFF ||
+            !SeekOK(tif, diroff + 8 + dircount * 20) ||
+            !ReadOK(tif, next, sizeof(*next)))
+            return 0;
+        if (tif->tif_flags & TIFF_SWAB)
+            TIFFSwabLong8(next);
+    }
+    return 1;
+}
+
+/*
+ * Save the index of the main IFD chain of tif to filename, building it first
+ * if needed.  The handle must be open read-only.
+ */
+int TIFFWriteIFDIndex(TIFF *tif, const char *filename)
+{
+    static const char module[] = "TIFFWriteIFDIndex";
+    uint64_t mtime = 0;
+    tmsize_t size;
+    uint8_t *buf;
+    FILE *fp;
+    int ok;
+
+    if (tif->tif_mode != O_RDONLY)
+    {
+        TIFFErrorExtR(tif, module, "File must be open read-only");
+        return 0;
+    }
+    if (tif->tif_ifdindex == NULL)
+        (void)TIFFNumberOfDirectories(tif);
+    if (tif->tif_ifdindex == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Cannot index the directories of %s",
+                      tif->tif_name);
+        return 0;
+    }
+
+    size = IFDINDEX_HEADER_SIZE + (tmsize_t)tif->tif_ifdindexcount * 8 + 4;
+    buf = (uint8_t *)_TIFFmallocExt(tif, size);
+    if (buf == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return 0;
+    }
+    (void)_TIFFGetFileModTime(tif, &mtime);
+    memcpy(buf, IFDINDEX_MAGIC, 8);
+    putLE32(buf + 8, IFDINDEX_VERSION);
+    putLE32(buf + 12, (tif->tif_flags & TIFF_BIGTIFF) ? 1 : 0);
+    putLE64(buf + 16, TIFFGetFileSize(tif));
+    putLE64(buf + 24, mtime);
+    putLE64(buf + 32, tif->tif_ifdindexcount);
+    for (tdir_t i = 0; i < tif->tif_ifdindexcount; i++)
+        putLE64(buf + IFDINDEX_HEADER_SIZE + (tmsize_t)i * 8,
+                tif->tif_ifdindex[i]);
+    putLE32(buf + size - 4, tiff_crc32c(0, buf, (size_t)(size - 4)));
+
+    fp = fopen(filename, "wb");
+    ok = fp != NULL && fwrite(buf, 1, (size_t)size, fp) == (size_t)size;
+    if (fp != NULL && fclose(fp) != 0)
+        ok = 0;
+    _TIFFfreeExt(tif, buf);
+    if (!ok)
+    {
+        TIFFErrorExtR(tif, module, "%s: Cannot write IFD index", filename);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Load an index saved by TIFFWriteIFDIndex().  Returns 1 if it was adopted,
+ * and 0 without emitting an error if the sidecar is missing, damaged or does
+ * not describe the file as it is now, in which case the caller may rebuild
+ * it with TIFFWriteIFDIndex().
+ */
+int TIFFReadIFDIndex(TIFF *tif, const char *filename)
+{
+    uint8_t header[IFDINDEX_HEADER_SIZE];
+    uint8_t crcbuf[4];
+    uint64_t mtime = 0, count, next;
+    uint64_t filesize = TIFFGetFileSize(tif);
+    uint64_t *offsets;
+    uint32_t crc;
+    FILE *fp;
+    int ok;
+
+    if (tif->tif_mode != O_RDONLY)
+        return 0;
+    fp = fopen(filename, "rb");
+    if (fp == NULL)
+        return 0;
+    (void)_TIFFGetFileModTime(tif, &mtime);
+    if (fread(header, 1, sizeof(header), fp) != sizeof(header) ||
+        memcmp(header, IFDINDEX_MAGIC, 8) != 0 ||
+        getLE32(header + 8) != IFDINDEX_VERSION ||
+        getLE32(header + 12) != ((tif->tif_flags & TIFF_BIGTIFF) ? 1U : 0U) ||
+        getLE64(header + 16) != filesize || getLE64(header + 24) != mtime)
+    {
+        fclose(fp);
+        return 0;
+    }
+    count = getLE64(header + 32);
+    if (count == 0 || count >= TIFF_NON_EXISTENT_DIR_NUMBER ||
+        count > filesize / 8)
+    {
+        fclose(fp);
+        return 0;
+    }
+    offsets = (uint64_t *)_TIFFmallocExt(tif, (tmsize_t)(count * 8));
+    if (offsets == NULL)
+    {
+        fclose(fp);
+        return 0;
+    }
+    /* Decode in place: each little-endian record becomes a native one */
+    ok = fread(offsets, 8, (size_t)count, fp) == (size_t)count &&
+         fread(crcbuf, 1, 4, fp) == 4;
+    fclose(fp);
+    if (ok)
+    {
+        crc = tiff_crc32c(0, header, sizeof(header));
+        crc = tiff_crc32c(crc, (const uint8_t *)offsets,
+                          (size_t)(count * 8));
+        ok = crc == getLE32(crcbuf);
+    }
+    for (uint64_t i = 0; ok && i < count; i++)
+    {
+        offsets[i] = getLE64((const uint8_t *)&offsets[i]);
+        ok = offsets[i] != 0 && offsets[i] < filesize;
+    }
+    /* The chain must still start and end where the index says */
+    ok = ok && offsets[0] == firstIFDOffset(tif) &&
+         readNextIFDOffset(tif, offsets[count - 1], &next) && next == 0;
+    if (!ok)
+    {
+        _TIFFfreeExt(tif, offsets);
+        return 0;
+    }
+    _TIFFIFDIndexSet(tif, offsets, (tdir_t)count);
+    tif->tif_curdircount = (tdir_t)count;
+    return 1;
+}
@@ -44,8 +44,24 @@
  *
  * Contributed by Tom Lane <tgl@sss.pgh.pa.us>.
  */
+#include "tif_lj92.h"
 #include <setjmp.h>
 
+/*
+ * State of the strip/tile being coded as lossless JPEG, see tif_lj92.c.
+ */
+typedef struct
+{
+    LJ92Layout layout;
+    uint8_t *buffer;      /* strip/tile decoded, or gathered row by row */
+    tmsize_t buffer_size; /* capacity of buffer */
+    tmsize_t buffer_pos;  /* bytes of buffer returned, or gathered */
+    int decoded;          /* buffer holds the decoded strip/tile */
+    uint8_t *out;         /* encoded stream */
+    tmsize_t out_size;    /* capacity of out */
+    tmsize_t out_len;     /* length of the stream, 0 until encoded */
+} JPEGLosslessState;
+
 /* Settings that are independent of libjpeg ABI. Used when reinitializing the */
 /* JPEGState from libjpegs 8 bit to libjpeg 12 bits, which have potentially */
 /* different ABI */
@@ -63,6 +79,10 @@ typedef struct
     int jpegquality;            /* Compression quality level */
     int jpegcolormode;          /* Auto RGB<=>YCbCr convert? */
     int jpegtablesmode;         /* What to put in JPEGTables */
+    int jpegscaledenom;         /* Decode at 1/jpegscaledenom size */
+    int jpeglossless;           /* Lossless JPEG predictor, 0 for DCT */
+
+    JPEGLosslessState *lossless;
 
     int ycbcrsampling_fetched;
     int max_allowed_scan_number;
@@ -218,6 +238,8 @@ static int JPEGEncode(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s);
 static int JPEGEncodeRaw(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s);
 static int JPEGInitializeLibJPEG(TIFF *tif, int decode);
 static int DecodeRowError(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s);
+static int DecodeRowScaledError(TIFF *tif, uint8_t *buf, tmsize_t cc,
+                                uint16_t s);
 #ifdef TIFF_USE_THREADPOOL
 typedef struct
 {
@@ -245,6 +267,10 @@ static const TIFFField jpegFields[] = {
     {TIFFTAG_JPEGCOLORMODE, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
      FALSE, FALSE, "", NULL},
     {TIFFTAG_JPEGTABLESMODE, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
+     FALSE, FALSE, "", NULL},
+    {TIFFTAG_JPEGSCALEDENOM, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
+     FALSE, FALSE, "", NULL},
+    {TIFFTAG_JPEGLOSSLESS, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
      FALSE, FALSE, "", NULL}};
 
 /*
@@ -817,6 +843,8 @@ JPEGFixupTagsSubsamplingSkip(struct JPEGFixupTagsSubsamplingData *data,
 
 #endif
 
+static void JPEGResetDecodeScale(TIFF *tif);
+
 static int JPEGFixupTags(TIFF *tif)
 {
 #ifdef CHECK_JPEG_YCBCR_SUBSAMPLING
@@ -828,6 +856,10 @@ static int JPEGFixupTags(TIFF *tif)
         JPEGFixupTagsSubsampling(tif);
 #endif
 
+    /* The directory is complete: the strip/tile sizes computed next must
+     * reflect the reduced resolution, if any. */
+    JPEGResetDecodeScale(tif);
+
     return (1);
 }
 
@@ -1173,6 +1205,10 @@ int TIFFJPEGIsFullStripRequired(TIFF *tif)
         return TIFFJPEGIsFullStripRequired_12(tif);
 #endif
 
+    /* Lossless JPEG is decoded from the whole strip at once */
+    if (_TIFFLJ92IsLossless(tif->tif_rawdata, tif->tif_rawcc))
+        return (1);
+
     memset(&state, 0, sizeof(JPEGState));
     state.tif = tif;
 
@@ -1192,6 +1228,149 @@ int TIFFJPEGIsFullStripRequired(TIFF *tif)
     return ret;
 }
 
+/*
+ * Lossless JPEG (process 14, SOF3) strips and tiles are coded by tif_lj92.c
+ * rather than libjpeg.  Whole strips/tiles are decoded straight into the
+ * caller's buffer and encoded straight from it; scanlines go through a
+ * buffer holding the strip/tile.
+ */
+static int JPEGLosslessSetup(TIFF *tif)
+{
+    JPEGState *sp = JState(tif);
+    TIFFDirectory *td = &tif->tif_dir;
+    JPEGLosslessState *ls = sp->otherSettings.lossless;
+
+    if (ls == NULL)
+    {
+        ls = (JPEGLosslessState *)_TIFFmallocExt(tif,
+                                                 sizeof(JPEGLosslessState));
+        if (ls == NULL)
+        {
+            TIFFErrorExtR(tif, "JPEGLosslessSetup",
+                          "No space for lossless JPEG state");
+            return (0);
+        }
+        _TIFFmemset(ls, 0, sizeof(JPEGLosslessState));
+        sp->otherSettings.lossless = ls;
+    }
+    if (isTiled(tif))
+    {
+        ls->layout.width = td->td_tilewidth;
+        ls->layout.rows = td->td_tilelength;
+        ls->layout.rowsize = TIFFTileRowSize(tif);
+    }
+    else
+    {
+        ls->layout.width = td->td_imagewidth;
+        ls->layout.rows = td->td_imagelength - tif->tif_row;
+        if (ls->layout.rows > td->td_rowsperstrip)
+            ls->layout.rows = td->td_rowsperstrip;
+        ls->layout.rowsize = TIFFScanlineSize(tif);
+    }
+    ls->layout.samples = td->td_planarconfig == PLANARCONFIG_CONTIG
+                             ? td->td_samplesperpixel
+                             : 1;
+    ls->layout.bps = td->td_bitspersample;
+    ls->buffer_pos = 0;
+    ls->decoded = 0;
+    ls->out_len = 0;
+    if (ls->layout.rowsize <= 0 ||
+        _TIFFMultiplySSize(tif, ls->layout.rowsize, (tmsize_t)ls->layout.rows,
+                           "JPEGLosslessSetup") == 0)
+        return (0);
+    return (1);
+}
+
+static int JPEGLosslessBuffer(TIFF *tif, JPEGLosslessState *ls)
+{
+    const tmsize_t size = ls->layout.rowsize * (tmsize_t)ls->layout.rows;
+
+    if (ls->buffer_size < size)
+    {
+        uint8_t *buffer = (uint8_t *)_TIFFreallocExt(tif, ls->buffer, size);
+        if (buffer == NULL)
+        {
+            TIFFErrorExtR(tif, "JPEGLosslessBuffer",
+                          "No space for lossless JPEG strip/tile buffer");
+            return (0);
+        }
+        ls->buffer = buffer;
+        ls->buffer_size = size;
+    }
+    return (1);
+}
+
+static int JPEGDecodeLossless(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s)
+{
+    JPEGState *sp = JState(tif);
+    JPEGLosslessState *ls = sp->otherSettings.lossless;
+    const tmsize_t size = ls->layout.rowsize * (tmsize_t)ls->layout.rows;
+    const uint8_t *tables = NULL;
+    tmsize_t tables_size = 0;
+
+    (void)s;
+    if (TIFFFieldSet(tif, FIELD_JPEGTABLES))
+    {
+        tables = (const uint8_t *)sp->otherSettings.jpegtables;
+        tables_size = (tmsize_t)sp->otherSettings.jpegtables_length;
+    }
+    if (!ls->decoded && ls->buffer_pos == 0 && cc <= size &&
+        cc > ls->layout.rowsize && cc % ls->layout.rowsize == 0)
+    {
+        /* Whole strip/tile or its first rows: decode in place */
+        LJ92Layout layout = ls->layout;
+
+        layout.rows = (uint32_t)(cc / layout.rowsize);
+        if (!_TIFFLJ92Decode(tif, tables, tables_size, tif->tif_rawcp,
+                             tif->tif_rawcc, &layout, buf))
+            return (0);
+        ls->buffer_pos = cc;
+        return (1);
+    }
+    if (!ls->decoded)
+    {
+        if (!JPEGLosslessBuffer(tif, ls) ||
+            !_TIFFLJ92Decode(tif, tables, tables_size, tif->tif_rawcp,
+                             tif->tif_rawcc, &ls->layout, ls->buffer))
+            return (0);
+        ls->decoded = 1;
+    }
+    if (cc > size - ls->buffer_pos)
+    {
+        TIFFErrorExtR(tif, "JPEGDecodeLossless",
+                      "Read past the end of the lossless JPEG strip/tile");
+        return (0);
+    }
+    _TIFFmemcpy(buf, ls->buffer + ls->buffer_pos, cc);
+    ls->buffer_pos += cc;
+    return (1);
+}
+
+static int JPEGPreDecodeLossless(TIFF *tif)
+{
+    JPEGState *sp = JState(tif);
+    TIFFDirectory *td = &tif->tif_dir;
+
+    if (td->td_bitspersample > 16 ||
+        (td->td_photometric == PHOTOMETRIC_YCBCR &&
+         (sp->h_sampling != 1 || sp->v_sampling != 1 ||
+          sp->otherSettings.jpegcolormode == JPEGCOLORMODE_RGB)) ||
+        isDecodeScaled(tif))
+    {
+        TIFFErrorExtR(tif, "JPEGPreDecode",
+                      "Lossless JPEG is only supported up to 16 bits per "
+                      "sample, without YCbCr subsampling, color conversion "
+                      "or reduced resolution decoding");
+        return (0);
+    }
+    if (!JPEGLosslessSetup(tif))
+        return (0);
+    tif->tif_decoderow = JPEGDecodeLossless;
+    tif->tif_decodestrip = JPEGDecodeLossless;
+    tif->tif_decodetile = JPEGDecodeLossless;
+    return (1);
+}
+
 /*
  * Set up for decoding a strip or tile.
  */
@@ -1212,6 +1391,8 @@ int TIFFJPEGIsFullStripRequired(TIFF *tif)
     }
 
     assert(sp->cinfo.comm.is_decompressor);
+    if (_TIFFLJ92IsLossless(tif->tif_rawcp, tif->tif_rawcc))
+        return JPEGPreDecodeLossless(tif);
     /*
      * Reset decoder state from any previous strip/tile,
      * in case application didn't read the whole strip.
@@ -1453,6 +1634,13 @@ int TIFFJPEGIsFullStripRequired(TIFF *tif)
         tif->tif_decoderow = JPEGDecode;
         tif->tif_decodestrip = JPEGDecode;
         tif->tif_decodetile = JPEGDecode;
+        if (isDecodeScaled(tif))
+        {
+            /* Let the IDCT produce the reduced resolution output */
+            sp->cinfo.d.scale_num = 1;
+            sp->cinfo.d.scale_denom = (unsigned int)tif->tif_decodescale;
+            tif->tif_decoderow = DecodeRowScaledError;
+        }
     }
     /* Start JPEG decompressor */
     if (!TIFFjpeg_start_decompress(sp))
@@ -1496,8 +1684,8 @@ static int JPEGDecodeInternal(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s)
     if (cc % sp->bytesperline)
         TIFFWarningExtR(tif, tif->tif_name, "fractional scanline not read");
 
-    if (nrows > (tmsize_t)sp->cinfo.d.image_height)
-        nrows = sp->cinfo.d.image_height;
+    if (nrows > (tmsize_t)sp->cinfo.d.output_height)
+        nrows = sp->cinfo.d.output_height;
 
     /* data is expected to be read in multiples of a scanline */
     if (nrows)
@@ -1557,8 +1745,8 @@ static int JPEGDecodeInternal(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s)
     if (cc % sp->bytesperline)
         TIFFWarningExtR(tif, tif->tif_name, "fractional scanline not read");
 
-    if (nrows > (tmsize_t)sp->cinfo.d.image_height)
-        nrows = sp->cinfo.d.image_height;
+    if (nrows > (tmsize_t)sp->cinfo.d.output_height)
+        nrows = sp->cinfo.d.output_height;
 
     /* data is expected to be read in multiples of a scanline */
     if (nrows)
@@ -1680,6 +1868,21 @@ static int JPEGDecode(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s)
     return 0;
 }
 
+/*ARGSUSED*/ static int DecodeRowScaledError(TIFF *tif, uint8_t *buf,
+                                             tmsize_t cc, uint16_t s)
+
+{
+    (void)buf;
+    (void)cc;
+    (void)s;
+
+    TIFFErrorExtR(tif, "TIFFReadScanline",
+                  "scanline oriented access is not supported when decoding "
+                  "JPEG compressed images at reduced resolution "
+                  "(TIFFTAG_JPEGSCALEDENOM), read whole strips instead.");
+    return 0;
+}
+
 /*
  * Decode a chunk of pixels.
  * Returned data is downsampled per sampling factors.
@@ -1961,12 +2164,53 @@ static void TIFF_std_huff_tables(j_compress_ptr cinfo)
 }
 #endif
 
+static int JPEGSetupEncodeLossless(TIFF *tif)
+{
+    JPEGState *sp = JState(tif);
+    TIFFDirectory *td = &tif->tif_dir;
+    static const char module[] = "JPEGSetupEncode";
+
+    if (td->td_bitspersample < 1 || td->td_bitspersample > 16)
+    {
+        TIFFErrorExtR(tif, module,
+                      "BitsPerSample %" PRIu16 " not allowed for lossless JPEG",
+                      td->td_bitspersample);
+        return (0);
+    }
+    if (td->td_photometric == PHOTOMETRIC_YCBCR &&
+        (td->td_ycbcrsubsampling[0] != 1 || td->td_ycbcrsubsampling[1] != 1))
+    {
+        TIFFErrorExtR(tif, module,
+                      "YCbCr subsampling not allowed for lossless JPEG");
+        return (0);
+    }
+    if (td->td_planarconfig == PLANARCONFIG_CONTIG &&
+        td->td_samplesperpixel > 4)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Lossless JPEG allows at most 4 interleaved samples, "
+                      "not %" PRIu16,
+                      td->td_samplesperpixel);
+        return (0);
+    }
+    sp->photometric = td->td_photometric;
+    sp->h_sampling = 1;
+    sp->v_sampling = 1;
+    /* Each strip/tile carries its own Huffman table */
+    TIFFClrFieldBit(tif, FIELD_JPEGTABLES);
+    tif->tif_postdecode = _TIFFNoPostDecode; /* samples are coded native */
+    return (1);
+}
+
 static int JPEGSetupEncode(TIFF *tif)
 {
     JPEGState *sp = JState(tif);
     TIFFDirectory *td = &tif->tif_dir;
     static const char module[] = "JPEGSetupEncode";
 
+    if (sp->otherSettings.jpeglossless)
+        return JPEGSetupEncodeLossless(tif);
+
 #if defined(JPEG_DUAL_MODE_8_12) && !defined(FROM_TIF_JPEG_12)
     if (tif->tif_dir.td_bitspersample == 12)
     {
@@ -2199,6 +2443,83 @@ static int JPEGSetupEncode(TIFF *tif)
 /*
  * Set encoding state at the start of a strip or tile.
  */
+/*
+ * Encode a whole strip/tile straight from the caller's buffer, or gather
+ * the rows written by scanlines, which are encoded by JPEGPostEncode().
+ */
+static int JPEGEncodeLossless(TIFF *tif, uint8_t *buf, tmsize_t cc, uint16_t s)
+{
+    JPEGState *sp = JState(tif);
+    JPEGLosslessState *ls = sp->otherSettings.lossless;
+    const tmsize_t size = ls->layout.rowsize * (tmsize_t)ls->layout.rows;
+
+    (void)s;
+    if (ls->buffer_pos == 0 && cc == size && ls->out_len == 0)
+        return _TIFFLJ92Encode(tif, buf, &ls->layout,
+                               sp->otherSettings.jpeglossless, &ls->out,
+                               &ls->out_size, &ls->out_len);
+    if (ls->out_len != 0 || cc > size - ls->buffer_pos)
+    {
+        TIFFErrorExtR(tif, "JPEGEncodeLossless",
+                      "Write past the end of the lossless JPEG strip/tile");
+        return (0);
+    }
+    if (!JPEGLosslessBuffer(tif, ls))
+        return (0);
+    _TIFFmemcpy(ls->buffer + ls->buffer_pos, buf, cc);
+    ls->buffer_pos += cc;
+    return (1);
+}
+
+static int JPEGPostEncodeLossless(TIFF *tif)
+{
+    JPEGState *sp = JState(tif);
+    JPEGLosslessState *ls = sp->otherSettings.lossless;
+    const tmsize_t size = ls->layout.rowsize * (tmsize_t)ls->layout.rows;
+    const uint8_t *p;
+    tmsize_t left;
+
+    if (ls->out_len == 0)
+    {
+        /* Rows that were not written are encoded as zeros */
+        if (!JPEGLosslessBuffer(tif, ls))
+            return (0);
+        _TIFFmemset(ls->buffer + ls->buffer_pos, 0, size - ls->buffer_pos);
+        if (!_TIFFLJ92Encode(tif, ls->buffer, &ls->layout,
+                             sp->otherSettings.jpeglossless, &ls->out,
+                             &ls->out_size, &ls->out_len))
+            return (0);
+    }
+    p = ls->out;
+    left = ls->out_len;
+    while (left > 0)
+    {
+        tmsize_t n = tif->tif_rawdatasize - tif->tif_rawcc;
+
+        if (n > left)
+            n = left;
+        _TIFFmemcpy(tif->tif_rawcp, p, n);
+        tif->tif_rawcp += n;
+        tif->tif_rawcc += n;
+        p += n;
+        left -= n;
+        if (tif->tif_rawcc >= tif->tif_rawdatasize && !TIFFFlushData1(tif))
+            return (0);
+    }
+    ls->out_len = 0;
+    return (1);
+}
+
+static int JPEGPreEncodeLossless(TIFF *tif)
+{
+    if (!JPEGLosslessSetup(tif))
+        return (0);
+    tif->tif_encoderow = JPEGEncodeLossless;
+    tif->tif_encodestrip = JPEGEncodeLossless;
+    tif->tif_encodetile = JPEGEncodeLossless;
+    return (1);
+}
+
 static int JPEGPreEncode(TIFF *tif, uint16_t s)
 {
     JPEGState *sp = JState(tif);
@@ -2215,6 +2536,8 @@ static int JPEGPreEncode(TIFF *tif, uint16_t s)
     }
 
     assert(!sp->cinfo.comm.is_decompressor);
+    if (sp->otherSettings.jpeglossless)
+        return JPEGPreEncodeLossless(tif);
     /*
      * Set encoding parameters for this strip/tile.
      */
@@ -2547,6 +2870,8 @@ static int JPEGPostEncode(TIFF *tif)
 {
     JPEGState *sp = JState(tif);
 
+    if (sp->otherSettings.jpeglossless)
+        return JPEGPostEncodeLossless(tif);
     if (sp->scancount > 0)
     {
         /*
@@ -2589,12 +2914,48 @@ static void JPEGCleanup(TIFF *tif)
         TIFFjpeg_destroy(sp);         /* release libjpeg resources */
     if (sp->otherSettings.jpegtables) /* tag value */
         _TIFFfreeExt(tif, sp->otherSettings.jpegtables);
+    if (sp->otherSettings.lossless)
+    {
+        _TIFFfreeExt(tif, sp->otherSettings.lossless->buffer);
+        _TIFFfreeExt(tif, sp->otherSettings.lossless->out);
+        _TIFFfreeExt(tif, sp->otherSettings.lossless);
+    }
     _TIFFfreeExt(tif, tif->tif_data); /* release local state */
     tif->tif_data = NULL;
 
     _TIFFSetDefaultCompressionState(tif);
 }
 
+/*
+ * Work out the reduction (TIFFTAG_JPEGSCALEDENOM) the decoder will apply to
+ * the current directory.  It is only honoured where libjpeg produces whole
+ * pixels that map onto the strip/tile grid: read-only handles on contiguous
+ * images whose data is not returned as raw subsampled YCbCr, with strips or
+ * tiles whose height (and tile width) is a multiple of the denominator.
+ * Elsewhere the image is decoded at full resolution.
+ */
+static void JPEGResetDecodeScale(TIFF *tif)
+{
+    JPEGState *sp = JState(tif);
+    TIFFDirectory *td = &tif->tif_dir;
+    uint32_t d = (uint32_t)sp->otherSettings.jpegscaledenom;
+
+    tif->tif_decodescale = 1;
+    if (d <= 1 || tif->tif_mode != O_RDONLY ||
+        td->td_planarconfig != PLANARCONFIG_CONTIG ||
+        (td->td_photometric == PHOTOMETRIC_YCBCR && !isUpSampled(tif)))
+        return;
+    if (isTiled(tif))
+    {
+        if (td->td_tilewidth % d != 0 || td->td_tilelength % d != 0)
+            return;
+    }
+    else if (td->td_rowsperstrip < td->td_imagelength &&
+             td->td_rowsperstrip % d != 0)
+        return;
+    tif->tif_decodescale = (int)d;
+}
+
 static void JPEGResetUpsampled(TIFF *tif)
 {
     JPEGState *sp = JState(tif);
@@ -2622,6 +2983,7 @@ static void JPEGResetUpsampled(TIFF *tif)
 #endif
         }
     }
+    JPEGResetDecodeScale(tif);
 
     /*
      * Must recalculate cached tile size in case sampling state changed.
@@ -2671,6 +3033,35 @@ static int JPEGVSetField(TIFF *tif, uint32_t tag, va_list ap)
         case TIFFTAG_JPEGTABLESMODE:
             sp->otherSettings.jpegtablesmode = (int)va_arg(ap, int);
             return (1); /* pseudo tag */
+        case TIFFTAG_JPEGSCALEDENOM:
+        {
+            int denom = (int)va_arg(ap, int);
+            if (denom != 1 && denom != 2 && denom != 4 && denom != 8)
+            {
+                TIFFErrorExtR(tif, "JPEGVSetField",
+                              "Invalid JPEG scale denominator %d: "
+                              "should be 1, 2, 4 or 8",
+                              denom);
+                return 0;
+            }
+            sp->otherSettings.jpegscaledenom = denom;
+            JPEGResetUpsampled(tif);
+            return (1); /* pseudo tag */
+        }
+        case TIFFTAG_JPEGLOSSLESS:
+        {
+            int predictor = (int)va_arg(ap, int);
+            if (predictor < 0 || predictor > 7)
+            {
+                TIFFErrorExtR(tif, "JPEGVSetField",
+                              "Invalid lossless JPEG predictor %d: "
+                              "should be 1 to 7, or 0 for DCT",
+                              predictor);
+                return 0;
+            }
+            sp->otherSettings.jpeglossless = predictor;
+            return (1); /* pseudo tag */
+        }
         case TIFFTAG_YCBCRSUBSAMPLING:
             /* mark the fact that we have a real ycbcrsubsampling! */
             sp->otherSettings.ycbcrsampling_fetched = 1;
@@ -2714,6 +3105,12 @@ static int JPEGVGetField(TIFF *tif, uint32_t tag, va_list ap)
         case TIFFTAG_JPEGTABLESMODE:
             *va_arg(ap, int *) = sp->otherSettings.jpegtablesmode;
             break;
+        case TIFFTAG_JPEGSCALEDENOM:
+            *va_arg(ap, int *) = sp->otherSettings.jpegscaledenom;
+            break;
+        case TIFFTAG_JPEGLOSSLESS:
+            *va_arg(ap, int *) = sp->otherSettings.jpeglossless;
+            break;
         default:
             return (*sp->otherSettings.vgetparent)(tif, tag, ap);
     }
@@ -2854,6 +3251,10 @@ static void TIFFInitJPEGCommon(TIFF *tif)
     sp->otherSettings.jpegtablesmode =
         JPEGTABLESMODE_QUANT | JPEGTABLESMODE_HUFF;
     sp->otherSettings.ycbcrsampling_fetched = 0;
+    sp->otherSettings.jpegscaledenom =
+        tif->tif_jpegscaledenom > 0 ? tif->tif_jpegscaledenom : 1;
+    sp->otherSettings.jpeglossless = 0;
+    sp->otherSettings.lossless = NULL;
 
     tif->tif_tagmethods.vgetfield = JPEGVGetField; /* hook for codec tags */
     tif->tif_tagmethods.vsetfield = JPEGVSetField; /* hook for codec tags */
@@ -1,13 +1,745 @@
+#include "tiff_simd.h"
 #include "tiffiop.h"
 #ifdef JPEGLS_SUPPORT
+/*
+ * TIFF Library.
+ *
+ * JPEG-LS Compression Support, through CharLS
+ *
+ * Each strip or tile is a complete, lossless, JPEG-LS stream.  8 and 16 bit
+ * samples are handed to CharLS as they are, and whole striles decoded
+ * straight into the caller's buffer; other depths, from 1 to 16 bits, are
+ * unpacked to 8 or 16 bit samples, 1 bit ones being coded with the minimum
+ * JPEG-LS precision of 2 bits.  Pixel interleaved images of 3 samples are
+ * coded sample interleaved and others line interleaved, while the striles
+ * of planar images hold a single component.
+ */
+
+#include <charls/charls.h>
+
+#if !defined(CHARLS_VERSION_MAJOR) || CHARLS_VERSION_MAJOR != 2 ||            \
+    CHARLS_VERSION_MINOR < 1
+#error "JPEG-LS support requires CharLS 2.x (>= 2.1)"
+#endif
+
+#include <stdio.h>
+
+/*
+ * State block for each open TIFF file using JPEG-LS compression.
+ */
+typedef struct
+{
+    int precision;           /* JPEG-LS sample precision */
+    int components;          /* samples per pixel of a strile */
+    int wide;                /* CharLS samples are 16-bit, else 8-bit */
+    uint32_t width;          /* pixels per strile row */
+    tmsize_t rowsize;        /* bytes per strile row */
+    tmsize_t strile_size;    /* bytes in the current strile */
+    uint8_t *buffer;         /* strile gathered or decoded row by row */
+    tmsize_t buffer_size;    /* capacity of buffer */
+    tmsize_t buffer_len;     /* bytes in buffer */
+    tmsize_t buffer_pos;     /* bytes of buffer already returned */
+    uint8_t *cbuffer;        /* strile in the CharLS sample layout */
+    tmsize_t cbuffer_size;   /* capacity of cbuffer */
+    int strile_start;        /* nothing decoded/encoded yet in the strile */
+    int state;               /* state flags */
+#define LSSTATE_INIT_DECODE 0x01
+#define LSSTATE_INIT_ENCODE 0x02
+} JPEGLSState;
+
+#define GetJPEGLSState(tif) ((JPEGLSState *)(tif)->tif_data)
+
+static int JPEGLSFixupTags(TIFF *tif)
+{
+    (void)tif;
+    return 1;
+}
+
+static int JPEGLSReserve(TIFF *tif, uint8_t **buffer, tmsize_t *buffer_size,
+                         tmsize_t size)
+{
+    static const char module[] = "JPEGLSReserve";
+    uint8_t *new_buffer;
+
+    if (size <= *buffer_size)
+        return 1;
+    new_buffer = (uint8_t *)_TIFFreallocExt(tif, *buffer, size);
+    if (new_buffer == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return 0;
+    }
+    *buffer = new_buffer;
+    *buffer_size = size;
+    return 1;
+}
+
+/*
+ * Check that the image can be coded, and work out the strile geometry.
+ */
+static int JPEGLSSetupGeometry(TIFF *tif, JPEGLSState *sp)
+{
+    static const char module[] = "JPEGLSSetupGeometry";
+    TIFFDirectory *td = &tif->tif_dir;
+
+    if (td->td_bitspersample < 1 || td->td_bitspersample > 16)
+    {
+        TIFFErrorExtR(tif, module,
+                      "JPEG-LS supports 1 to 16 bits per sample, not %" PRIu16,
+                      td->td_bitspersample);
+        return 0;
+    }
+    if (td->td_planarconfig == PLANARCONFIG_CONTIG &&
+        td->td_photometric == PHOTOMETRIC_YCBCR &&
+        (td->td_ycbcrsubsampling[0] != 1 || td->td_ycbcrsubsampling[1] != 1))
+    {
+        TIFFErrorExtR(tif, module,
+                      "JPEG-LS does not support subsampled YCbCr data");
+        return 0;
+    }
+    sp->components = td->td_planarconfig == PLANARCONFIG_CONTIG
+                         ? td->td_samplesperpixel
+                         : 1;
+    if (sp->components > 255)
+    {
+        TIFFErrorExtR(tif, module,
+                      "JPEG-LS supports at most 255 samples per pixel");
+        return 0;
+    }
+    sp->precision = td->td_bitspersample < 2 ? 2 : td->td_bitspersample;
+    sp->wide = td->td_bitspersample > 8;
+    if (isTiled(tif))
+    {
+        sp->width = td->td_tilewidth;
+        sp->rowsize = TIFFTileRowSize(tif);
+    }
+    else
+    {
+        sp->width = td->td_imagewidth;
+        sp->rowsize = TIFFScanlineSize(tif);
+    }
+    return sp->rowsize > 0;
+}
+
+/*
+ * Rows in the strile starting at tif_row.
+ */
+static uint32_t JPEGLSStrileRows(TIFF *tif)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+
+    if (isTiled(tif))
+        return td->td_tilelength;
+    if (td->td_rowsperstrip > td->td_imagelength - tif->tif_row)
+        return td->td_imagelength - tif->tif_row;
+    return td->td_rowsperstrip;
+}
+
+/*
+ * Whether the samples of a strile are laid out the way CharLS takes them.
+ */
+static int JPEGLSDirect(TIFF *tif, JPEGLSState *sp,
+                        charls_interleave_mode mode)
+{
+    const uint16_t bps = tif->tif_dir.td_bitspersample;
+
+    return (bps == 8 || bps == 16) &&
+           (sp->components == 1 || mode == CHARLS_INTERLEAVE_MODE_SAMPLE);
+}
+
+/*
+ * Index of sample c of pixel x of row y in the CharLS layout of a strile.
+ */
+static size_t JPEGLSIndex(JPEGLSState *sp, charls_interleave_mode mode,
+                          uint32_t rows, uint32_t y, uint32_t x, int c)
+{
+    switch (mode)
+    {
+        case CHARLS_INTERLEAVE_MODE_SAMPLE:
+            return ((size_t)y * sp->width + x) * sp->components + c;
+        case CHARLS_INTERLEAVE_MODE_LINE:
+            return ((size_t)y * sp->components + c) * sp->width + x;
+        default:
+            return ((size_t)c * rows + y) * sp->width + x;
+    }
+}
+
+/*
+ * Unpack the rows of a strile to sp->cbuffer, in the CharLS layout.
+ */
+static void JPEGLSToCharLS(TIFF *tif, JPEGLSState *sp,
+                           charls_interleave_mode mode, const uint8_t *src,
+                           uint32_t rows)
+{
+    const uint16_t bps = tif->tif_dir.td_bitspersample;
+    const uint32_t mask = (1U << bps) - 1;
+    uint16_t *dst16 = (uint16_t *)sp->cbuffer;
+
+    for (uint32_t y = 0; y < rows; y++)
+    {
+        const uint8_t *p = src + (tmsize_t)y * sp->rowsize;
+        uint32_t bits = 0;
+        uint32_t nbits = 0;
+
+        for (uint32_t x = 0; x < sp->width; x++)
+        {
+            for (int c = 0; c < sp->components; c++)
+            {
+                const size_t i = JPEGLSIndex(sp, mode, rows, y, x, c);
+                uint32_t v;
+
+                if (bps == 16)
+                {
+                    uint16_t v16;
+                    _TIFFmemcpy(&v16, p, 2);
+                    p += 2;
+                    v = v16;
+                }
+                else if (bps == 8)
+                    v = *p++;
+                else
+                {
+                    /* bps bits, MSB first */
+                    while (nbits < bps)
+                    {
+                        bits = (bits << 8) | *p++;
+                        nbits += 8;
+                    }
+                    nbits -= bps;
+                    v = (bits >> nbits) & mask;
+                }
+                if (sp->wide)
+                    dst16[i] = (uint16_t)v;
+                else
+                    sp->cbuffer[i] = (uint8_t)v;
+            }
+        }
+    }
+}
+
+/*
+ * Pack the samples decoded by CharLS in sp->cbuffer to the rows of a
+ * strile.
+ */
+static void JPEGLSFromCharLS(TIFF *tif, JPEGLSState *sp,
+                             charls_interleave_mode mode, uint8_t *dst,
+                             uint32_t rows)
+{
+    const uint16_t bps = tif->tif_dir.td_bitspersample;
+    const uint32_t mask = (1U << bps) - 1;
+    const uint16_t *src16 = (const uint16_t *)sp->cbuffer;
+
+    for (uint32_t y = 0; y < rows; y++)
+    {
+        uint8_t *p = dst + (tmsize_t)y * sp->rowsize;
+        uint32_t bits = 0;
+        uint32_t nbits = 0;
+
+        for (uint32_t x = 0; x < sp->width; x++)
+        {
+            for (int c = 0; c < sp->components; c++)
+            {
+                const size_t i = JPEGLSIndex(sp, mode, rows, y, x, c);
+                const uint32_t v = sp->wide ? src16[i] : sp->cbuffer[i];
+
+                if (bps == 16)
+                {
+                    const uint16_t v16 = (uint16_t)v;
+                    _TIFFmemcpy(p, &v16, 2);
+                    p += 2;
+                }
+                else if (bps == 8)
+                    *p++ = (uint8_t)v;
+                else
+                {
+                    bits = (bits << bps) | (v & mask);
+                    nbits += bps;
+                    while (nbits >= 8)
+                    {
+                        nbits -= 8;
+                        *p++ = (uint8_t)(bits >> nbits);
+                    }
+                }
+            }
+        }
+        if (nbits > 0)
+            *p = (uint8_t)(bits << (8 - nbits));
+    }
+}
+
+static int JPEGLSSetupDecode(TIFF *tif)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    assert(sp != NULL);
+
+    /* if we were last encoding, terminate this mode */
+    if (sp->state & LSSTATE_INIT_ENCODE)
+        sp->state = 0;
+
+    if (!JPEGLSSetupGeometry(tif, sp))
+        return 0;
+    /* CharLS decodes samples in native byte order */
+    tif->tif_postdecode = _TIFFNoPostDecode;
+    sp->state |= LSSTATE_INIT_DECODE;
+    return 1;
+}
+
+/*
+ * Setup state for decoding a strip or tile.
+ */
+static int JPEGLSPreDecode(TIFF *tif, uint16_t s)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    (void)s;
+    assert(sp != NULL);
+
+    if ((sp->state & LSSTATE_INIT_DECODE) == 0 && !tif->tif_setupdecode(tif))
+        return 0;
+
+    sp->strile_size = (tmsize_t)JPEGLSStrileRows(tif) * sp->rowsize;
+    sp->strile_start = 1;
+    sp->buffer_len = 0;
+    sp->buffer_pos = 0;
+    return 1;
+}
+
+/*
+ * Decode the JPEG-LS stream of the current strile to op, which has room
+ * for the whole strile.
+ */
+static int JPEGLSDecompress(TIFF *tif, uint8_t *op)
+{
+    static const char module[] = "JPEGLSDecompress";
+    JPEGLSState *sp = GetJPEGLSState(tif);
+    const uint32_t rows = (uint32_t)(sp->strile_size / sp->rowsize);
+    charls_jpegls_decoder *decoder;
+    charls_jpegls_errc err;
+    charls_frame_info info;
+    charls_interleave_mode mode = CHARLS_INTERLEAVE_MODE_NONE;
+    size_t size = 0;
+    int ok = 0;
+
+    decoder = charls_jpegls_decoder_create();
+    if (decoder == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Cannot create the JPEG-LS decoder");
+        return 0;
+    }
+    err = charls_jpegls_decoder_set_source_buffer(decoder, tif->tif_rawcp,
+                                                  (size_t)tif->tif_rawcc);
+    if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+        err = charls_jpegls_decoder_read_header(decoder);
+    if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+        err = charls_jpegls_decoder_get_frame_info(decoder, &info);
+    if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+        err = charls_jpegls_decoder_get_interleave_mode(decoder, &mode);
+    if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+        err = charls_jpegls_decoder_get_destination_size(decoder, 0, &size);
+
+    if (err != CHARLS_JPEGLS_ERRC_SUCCESS)
+        TIFFErrorExtR(tif, module, "%s at scanline %" PRIu32,
+                      charls_get_error_message(err), tif->tif_row);
+    else if (info.width != sp->width || info.height != rows ||
+             info.component_count != sp->components ||
+             info.bits_per_sample < 2 ||
+             info.bits_per_sample > sp->precision ||
+             (info.bits_per_sample > 8) != sp->wide)
+        TIFFErrorExtR(tif, module,
+                      "JPEG-LS image of %" PRIu32 "x%" PRIu32
+                      " pixels of %d %d-bit samples does not match the "
+                      "strip or tile at scanline %" PRIu32,
+                      info.width, info.height, (int)info.component_count,
+                      (int)info.bits_per_sample, tif->tif_row);
+    else
+    {
+        const int direct = JPEGLSDirect(tif, sp, mode);
+
+        if (direct && size != (size_t)sp->strile_size)
+            TIFFErrorExtR(tif, module, "Unexpected JPEG-LS image size");
+        else if (direct || (size <= (size_t)TIFF_TMSIZE_T_MAX &&
+                            JPEGLSReserve(tif, &sp->cbuffer,
+                                          &sp->cbuffer_size, (tmsize_t)size)))
+        {
+            err = charls_jpegls_decoder_decode_to_buffer(
+                decoder, direct ? op : sp->cbuffer, size, 0);
+            if (err != CHARLS_JPEGLS_ERRC_SUCCESS)
+                TIFFErrorExtR(tif, module, "%s at scanline %" PRIu32,
+                              charls_get_error_message(err), tif->tif_row);
+            else
+            {
+                if (!direct)
+                    JPEGLSFromCharLS(tif, sp, mode, op, rows);
+                ok = 1;
+            }
+        }
+    }
+    charls_jpegls_decoder_destroy(decoder);
+    return ok;
+}
+
+/*
+ * Decode the whole strile in the strile buffer, the first time rows of it
+ * are read.
+ */
+static int JPEGLSFillBuffer(TIFF *tif, JPEGLSState *sp)
+{
+    if (!sp->strile_start)
+        return 1;
+    sp->strile_start = 0;
+    if (!JPEGLSReserve(tif, &sp->buffer, &sp->buffer_size, sp->strile_size) ||
+        !JPEGLSDecompress(tif, sp->buffer))
+        return 0;
+    sp->buffer_len = sp->strile_size;
+    tif->tif_rawcp += tif->tif_rawcc;
+    tif->tif_rawcc = 0;
+    return 1;
+}
+
+/*
+ * Decode rows, copied from the strile buffer.
+ */
+static int JPEGLSDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
+{
+    static const char module[] = "JPEGLSDecode";
+    JPEGLSState *sp = GetJPEGLSState(tif);
+    tmsize_t n;
+
+    (void)s;
+    assert(sp != NULL);
+    assert(sp->state == LSSTATE_INIT_DECODE);
+
+    if (!JPEGLSFillBuffer(tif, sp))
+    {
+        tiff_memset_u8(op, 0, (size_t)occ);
+        return 0;
+    }
+
+    n = sp->buffer_len - sp->buffer_pos;
+    if (n > occ)
+        n = occ;
+    _TIFFmemcpy(op, sp->buffer + sp->buffer_pos, n);
+    sp->buffer_pos += n;
+    if (n < occ)
+    {
+        tiff_memset_u8(op + n, 0, (size_t)(occ - n));
+        TIFFErrorExtR(tif, module,
+                      "Not enough data at scanline %" PRIu32
+                      " (short %" TIFF_SSIZE_FORMAT " bytes)",
+                      tif->tif_row, occ - n);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Skip rows of a strip, which costs nothing once it is decoded.
+ */
+static int JPEGLSSeek(TIFF *tif, uint32_t off)
+{
+    static const char module[] = "JPEGLSSeek";
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    assert(sp != NULL);
+    if (!JPEGLSFillBuffer(tif, sp))
+        return 0;
+    if ((tmsize_t)off > (sp->buffer_len - sp->buffer_pos) / sp->rowsize)
+    {
+        TIFFErrorExtR(tif, module, "Seek past the end of the strip");
+        return 0;
+    }
+    sp->buffer_pos += (tmsize_t)off * sp->rowsize;
+    return 1;
+}
+
+/*
+ * Decode a whole strip or tile directly into the output.
+ */
+static int JPEGLSDecodeStrile(TIFF *tif, uint8_t *op, tmsize_t occ,
+                              uint16_t s)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    assert(sp != NULL);
+    assert(sp->state == LSSTATE_INIT_DECODE);
+
+    if (!sp->strile_start || occ != sp->strile_size)
+        return JPEGLSDecode(tif, op, occ, s);
+
+    sp->strile_start = 0;
+    if (!JPEGLSDecompress(tif, op))
+    {
+        tiff_memset_u8(op, 0, (size_t)occ);
+        return 0;
+    }
+    tif->tif_rawcp += tif->tif_rawcc;
+    tif->tif_rawcc = 0;
+    return 1;
+}
+
+static int JPEGLSSetupEncode(TIFF *tif)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    assert(sp != NULL);
+    if (sp->state & LSSTATE_INIT_DECODE)
+        sp->state = 0;
+
+    if (!JPEGLSSetupGeometry(tif, sp))
+        return 0;
+    /* CharLS encodes samples in native byte order */
+    tif->tif_postdecode = _TIFFNoPostDecode;
+    sp->state |= LSSTATE_INIT_ENCODE;
+    return 1;
+}
+
+/*
+ * Reset encoding state at the start of a strip or tile.
+ */
+static int JPEGLSPreEncode(TIFF *tif, uint16_t s)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    (void)s;
+    assert(sp != NULL);
+    if (sp->state != LSSTATE_INIT_ENCODE && !tif->tif_setupencode(tif))
+        return 0;
+
+    sp->strile_size = (tmsize_t)JPEGLSStrileRows(tif) * sp->rowsize;
+    sp->strile_start = 1;
+    sp->buffer_len = 0;
+    return 1;
+}
+
+/*
+ * Append n bytes of compressed data to the raw data buffer, flushing it
+ * when full.
+ */
+static int JPEGLSAppend(TIFF *tif, const uint8_t *src, tmsize_t n)
+{
+    while (n > 0)
+    {
+        tmsize_t chunk = tif->tif_rawdatasize - tif->tif_rawcc;
+        if (chunk > n)
+            chunk = n;
+        _TIFFmemcpy(tif->tif_rawcp, src, chunk);
+        tif->tif_rawcp += chunk;
+        tif->tif_rawcc += chunk;
+        src += chunk;
+        n -= chunk;
+        if (tif->tif_rawcc == tif->tif_rawdatasize && !TIFFFlushData1(tif))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Compress a whole strile, directly into the raw data buffer if it has
+ * room for the estimated worst case, as it has unless set up by the
+ * application.
+ */
+static int JPEGLSCompress(TIFF *tif, const uint8_t *bp, tmsize_t cc)
+{
+    static const char module[] = "JPEGLSCompress";
+    JPEGLSState *sp = GetJPEGLSState(tif);
+    const charls_interleave_mode mode =
+        sp->components == 1   ? CHARLS_INTERLEAVE_MODE_NONE
+        : sp->components == 3 ? CHARLS_INTERLEAVE_MODE_SAMPLE
+                              : CHARLS_INTERLEAVE_MODE_LINE;
+    charls_jpegls_encoder *encoder;
+    charls_jpegls_errc err;
+    charls_frame_info info;
+    const void *src = bp;
+    size_t src_size = (size_t)cc;
+    size_t bound = 0;
+    size_t written = 0;
+    uint8_t *dst = NULL;
+    int dst_allocated = 0;
+    int ok = 0;
+
+    if (cc <= 0 || cc % sp->rowsize != 0)
+    {
+        TIFFErrorExtR(tif, module,
+                      "JPEG-LS strips and tiles must be made of whole rows");
+        return 0;
+    }
+    info.width = sp->width;
+    info.height = (uint32_t)(cc / sp->rowsize);
+    info.bits_per_sample = sp->precision;
+    info.component_count = sp->components;
+    if (!JPEGLSDirect(tif, sp, mode))
+    {
+        src_size = (size_t)info.width * info.height * sp->components *
+                   (sp->wide ? 2 : 1);
+        if (src_size > (size_t)TIFF_TMSIZE_T_MAX ||
+            !JPEGLSReserve(tif, &sp->cbuffer, &sp->cbuffer_size,
+                           (tmsize_t)src_size))
+            return 0;
+        JPEGLSToCharLS(tif, sp, mode, bp, info.height);
+        src = sp->cbuffer;
+    }
+
+    encoder = charls_jpegls_encoder_create();
+    if (encoder == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Cannot create the JPEG-LS encoder");
+        return 0;
+    }
+    err = charls_jpegls_encoder_set_frame_info(encoder, &info);
+    if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+        err = charls_jpegls_encoder_set_interleave_mode(encoder, mode);
+    if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+        err = charls_jpegls_encoder_get_estimated_destination_size(encoder,
+                                                                   &bound);
+    if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+    {
+        if ((size_t)(tif->tif_rawdatasize - tif->tif_rawcc) >= bound)
+            dst = tif->tif_rawcp;
+        else if (bound <= (size_t)TIFF_TMSIZE_T_MAX)
+        {
+            dst = (uint8_t *)_TIFFmallocExt(tif, (tmsize_t)bound);
+            dst_allocated = 1;
+        }
+        if (dst == NULL)
+            TIFFErrorExtR(tif, module, "Out of memory");
+        else
+        {
+            err = charls_jpegls_encoder_set_destination_buffer(encoder, dst,
+                                                               bound);
+            if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+                err = charls_jpegls_encoder_encode_from_buffer(
+                    encoder, src, src_size, 0);
+            if (err == CHARLS_JPEGLS_ERRC_SUCCESS)
+                err = charls_jpegls_encoder_get_bytes_written(encoder,
+                                                              &written);
+        }
+    }
+    if (err != CHARLS_JPEGLS_ERRC_SUCCESS)
+        TIFFErrorExtR(tif, module, "%s at scanline %" PRIu32,
+                      charls_get_error_message(err), tif->tif_row);
+    else if (dst_allocated)
+        ok = JPEGLSAppend(tif, dst, (tmsize_t)written);
+    else if (dst != NULL)
+    {
+        tif->tif_rawcp += written;
+        tif->tif_rawcc += (tmsize_t)written;
+        ok = 1;
+    }
+
+    if (dst_allocated)
+        _TIFFfreeExt(tif, dst);
+    charls_jpegls_encoder_destroy(encoder);
+    return ok;
+}
+
+/*
+ * Encode a chunk of pixels: rows are gathered in the strile buffer until
+ * the strile is complete.
+ */
+static int JPEGLSEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+    tmsize_t size;
+
+    assert(sp != NULL);
+    assert(sp->state == LSSTATE_INIT_ENCODE);
+
+    (void)s;
+    if (cc > TIFF_TMSIZE_T_MAX - sp->buffer_len)
+        return 0;
+    size = sp->buffer_len + cc;
+    if (size < sp->strile_size)
+        size = sp->strile_size;
+    if (!JPEGLSReserve(tif, &sp->buffer, &sp->buffer_size, size))
+        return 0;
+    _TIFFmemcpy(sp->buffer + sp->buffer_len, bp, cc);
+    sp->buffer_len += cc;
+    return 1;
+}
+
+/*
+ * Encode a whole strip or tile, compressed at once from the caller's data.
+ */
+static int JPEGLSEncodeStrile(TIFF *tif, uint8_t *bp, tmsize_t cc,
+                              uint16_t s)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    assert(sp != NULL);
+    assert(sp->state == LSSTATE_INIT_ENCODE);
+
+    if (!sp->strile_start || sp->buffer_len > 0)
+        return JPEGLSEncode(tif, bp, cc, s);
+    sp->strile_start = 0;
+    return JPEGLSCompress(tif, bp, cc);
+}
+
+/*
+ * Finish off an encoded strip or tile by compressing the rows gathered.
+ */
+static int JPEGLSPostEncode(TIFF *tif)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    if (sp->buffer_len > 0)
+    {
+        sp->strile_start = 0;
+        if (!JPEGLSCompress(tif, sp->buffer, sp->buffer_len))
+            return 0;
+        sp->buffer_len = 0;
+    }
+    return 1;
+}
+
+static void JPEGLSCleanup(TIFF *tif)
+{
+    JPEGLSState *sp = GetJPEGLSState(tif);
+
+    assert(sp != 0);
+
+    _TIFFfreeExt(tif, sp->buffer);
+    _TIFFfreeExt(tif, sp->cbuffer);
+    _TIFFfreeExt(tif, sp);
+    tif->tif_data = NULL;
+
+    _TIFFSetDefaultCompressionState(tif);
+}
 
-/* Placeholder for JPEG-LS codec using CharLS */
 int TIFFInitJPEGLS(TIFF *tif, int scheme)
 {
     static const char module[] = "TIFFInitJPEGLS";
+
     (void)scheme;
-    TIFFErrorExtR(tif, module, "JPEG-LS compression not implemented");
-    return 0;
-}
+    assert(scheme == COMPRESSION_JPEGLS);
+
+    /*
+     * Allocate state block.
+     */
+    tif->tif_data = (uint8_t *)_TIFFcallocExt(tif, 1, sizeof(JPEGLSState));
+    if (tif->tif_data == NULL)
+    {
+        TIFFErrorExtR(tif, module, "No space for JPEG-LS state block");
+        return 0;
+    }
 
+    /*
+     * Install codec methods.
+     */
+    tif->tif_fixuptags = JPEGLSFixupTags;
+    tif->tif_setupdecode = JPEGLSSetupDecode;
+    tif->tif_predecode = JPEGLSPreDecode;
+    tif->tif_decoderow = JPEGLSDecode;
+    tif->tif_decodestrip = JPEGLSDecodeStrile;
+    tif->tif_decodetile = JPEGLSDecodeStrile;
+    tif->tif_seek = JPEGLSSeek;
+    tif->tif_setupencode = JPEGLSSetupEncode;
+    tif->tif_preencode = JPEGLSPreEncode;
+    tif->tif_postencode = JPEGLSPostEncode;
+    tif->tif_encoderow = JPEGLSEncode;
+    tif->tif_encodestrip = JPEGLSEncodeStrile;
+    tif->tif_encodetile = JPEGLSEncodeStrile;
+    tif->tif_cleanup = JPEGLSCleanup;
+    return 1;
+}
 #endif /* JPEGLS_SUPPORT */
@@ -25,6 +25,9 @@
 #include "tiff_simd.h"
 #include "tiffiop.h"
 #ifdef LERC_SUPPORT
+#ifdef TIFF_USE_THREADPOOL
+#include "tiff_threadpool.h"
+#endif
 /*
  * TIFF Library.
  *
@@ -81,6 +84,19 @@ typedef struct
     unsigned int compressed_size;
     void *compressed_buffer;
 
+    /* Blob validated by LERCPreDecode() but not decoded yet, so that a
+     * whole strile can be decoded straight into the caller buffer */
+    int decode_pending;
+    int read_error;
+    const uint8_t *lerc_data;
+    unsigned int lerc_data_size;
+    int lerc_data_type;
+    int use_mask;
+    unsigned int nomask_bands;
+    int nRequestedMasks;
+    unsigned int nFoundDims;
+    unsigned int nFoundBands;
+
 #if LIBDEFLATE_SUPPORT
     struct libdeflate_decompressor *libdeflate_dec;
     struct libdeflate_compressor *libdeflate_enc;
@@ -301,6 +317,9 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
     if (sp->state != LSTATE_INIT_DECODE)
         tif->tif_setupdecode(tif);
 
+    sp->decode_pending = 0;
+    sp->read_error = 0;
+
     lerc_data_type = GetLercDataType(tif);
     if (lerc_data_type < 0)
         return 0;
@@ -557,7 +576,161 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
     }
 #endif
 
+    sp->lerc_data = lerc_data;
+    sp->lerc_data_size = lerc_data_size;
+    sp->lerc_data_type = lerc_data_type;
+    sp->use_mask = use_mask;
+    sp->nomask_bands = nomask_bands;
+    sp->nRequestedMasks = nRequestedMasks;
+    sp->nFoundDims = nFoundDims;
+    sp->nFoundBands = nFoundBands;
+    sp->decode_pending = 1;
+
+    return 1;
+}
+
+#if LERC_AT_LEAST_VERSION(3, 0, 0)
+/*
+ * Interleaving of the bands of a blob with one mask per band, which LERC
+ * returns band after band, for pixels [first, last).
+ */
+typedef struct
+{
+    const uint8_t *src;
+    const uint8_t *mask;
+    uint8_t *dst;
+    unsigned nb_pixels;
+    int nbands;
+    int bps;
+    unsigned first;
+    unsigned last;
+} LERCInterleaveTask;
+
+static void LERCInterleaveBands(void *arg)
+{
+    const LERCInterleaveTask *t = (const LERCInterleaveTask *)arg;
+    const unsigned nb_pixels = t->nb_pixels;
+    const int nbands = t->nbands;
+    unsigned i;
+#if WORDS_BIGENDIAN
+    const unsigned char nan_bytes[] = {0x7f, 0xc0, 0, 0};
+#else
+    const unsigned char nan_bytes[] = {0, 0, 0xc0, 0x7f};
+#endif
+    float nan_float32;
+    memcpy(&nan_float32, nan_bytes, 4);
+
+    if (t->bps == 32)
+    {
+        const float *src = (const float *)t->src;
+        float *dst = (float *)t->dst;
+        unsigned k = t->first * nbands;
+        for (i = t->first; i < t->last; i++)
+        {
+            for (int j = 0; j < nbands; j++)
+            {
+                if (t->mask[i + j * nb_pixels] == 0)
+                    dst[k] = nan_float32;
+                else
+                    dst[k] = src[i + j * nb_pixels];
+                ++k;
+            }
+        }
+    }
+    else
+    {
+        const double nan_float64 = nan_float32;
+        const double *src = (const double *)t->src;
+        double *dst = (double *)t->dst;
+        unsigned k = t->first * nbands;
+        for (i = t->first; i < t->last; i++)
+        {
+            for (int j = 0; j < nbands; j++)
+            {
+                if (t->mask[i + j * nb_pixels] == 0)
+                    dst[k] = nan_float64;
+                else
+                    dst[k] = src[i + j * nb_pixels];
+                ++k;
+            }
+        }
+    }
+}
+
+#define LERC_MAX_TASKS 16
+#define LERC_MIN_PIXELS_PER_TASK 16384
+
+/*
+ * Interleave the bands into dst, split in pixel ranges over the thread pool
+ * when there is one.
+ */
+static void LERCInterleave(TIFF *tif, LERCState *sp, uint8_t *dst)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    LERCInterleaveTask tasks[LERC_MAX_TASKS];
+    const unsigned nb_pixels = sp->segment_width * sp->segment_height;
+    unsigned ntasks = 1;
+
+#ifdef TIFF_USE_THREADPOOL
+    {
+        const int nthreads = TIFFGetThreadCount(tif);
+        if (nthreads > 1)
+        {
+            ntasks = nb_pixels / LERC_MIN_PIXELS_PER_TASK;
+            if (ntasks > (unsigned)nthreads)
+                ntasks = (unsigned)nthreads;
+            if (ntasks > LERC_MAX_TASKS)
+                ntasks = LERC_MAX_TASKS;
+            if (ntasks == 0)
+                ntasks = 1;
+        }
+    }
+#endif
+
+    for (unsigned i = 0; i < ntasks; i++)
+    {
+        tasks[i].src = sp->uncompressed_buffer_multiband;
+        tasks[i].mask = sp->mask_buffer;
+        tasks[i].dst = dst;
+        tasks[i].nb_pixels = nb_pixels;
+        tasks[i].nbands = td->td_samplesperpixel;
+        tasks[i].bps = td->td_bitspersample;
+        tasks[i].first = (unsigned)((uint64_t)nb_pixels * i / ntasks);
+        tasks[i].last = (unsigned)((uint64_t)nb_pixels * (i + 1) / ntasks);
+    }
+
+#ifdef TIFF_USE_THREADPOOL
+    if (ntasks > 1)
+    {
+        for (unsigned i = 0; i < ntasks; i++)
+        {
+            if (!_TIFFThreadPoolSubmit(tif->tif_threadpool,
+                                       LERCInterleaveBands, &tasks[i]))
+                LERCInterleaveBands(&tasks[i]);
+        }
+        _TIFFThreadPoolWait(tif->tif_threadpool);
+        return;
+    }
+#endif
+    LERCInterleaveBands(&tasks[0]);
+}
+#endif
+
+/*
+ * Decode the blob validated by LERCPreDecode() into dst, which holds a
+ * whole strip or tile.
+ */
+static int LERCDecodeBlob(TIFF *tif, LERCState *sp, uint8_t *dst)
+{
+    static const char module[] = "LERCDecode";
+    lerc_status lerc_ret;
+    TIFFDirectory *td = &tif->tif_dir;
     const unsigned nb_pixels = sp->segment_width * sp->segment_height;
+    const unsigned nomask_bands = sp->nomask_bands;
+    const unsigned nFoundDims = sp->nFoundDims;
+    const unsigned nFoundBands = sp->nFoundBands;
+    const int nRequestedMasks = sp->nRequestedMasks;
+    const int use_mask = sp->use_mask;
 
 #if LERC_AT_LEAST_VERSION(3, 0, 0)
     if (nRequestedMasks > 1)
@@ -572,26 +745,28 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
             if (!sp->uncompressed_buffer_multiband)
             {
                 sp->uncompressed_buffer_multiband_alloc = 0;
+                TIFFErrorExtR(tif, module, "Cannot allocate buffer");
                 return 0;
             }
             sp->uncompressed_buffer_multiband_alloc = num_bytes_needed;
         }
-        lerc_ret = lerc_decode(lerc_data, lerc_data_size, nRequestedMasks,
-                               sp->mask_buffer, nFoundDims, sp->segment_width,
-                               sp->segment_height, nFoundBands, lerc_data_type,
+        lerc_ret = lerc_decode(sp->lerc_data, sp->lerc_data_size,
+                               nRequestedMasks, sp->mask_buffer, nFoundDims,
+                               sp->segment_width, sp->segment_height,
+                               nFoundBands, sp->lerc_data_type,
                                sp->uncompressed_buffer_multiband);
     }
     else
 #endif
     {
         lerc_ret =
-            lerc_decode(lerc_data, lerc_data_size,
+            lerc_decode(sp->lerc_data, sp->lerc_data_size,
 #if LERC_AT_LEAST_VERSION(3, 0, 0)
                         nRequestedMasks,
 #endif
                         use_mask ? sp->mask_buffer : NULL, nFoundDims,
                         sp->segment_width, sp->segment_height, nFoundBands,
-                        lerc_data_type, sp->uncompressed_buffer);
+                        sp->lerc_data_type, dst);
     }
     if (lerc_ret != 0)
     {
@@ -600,30 +775,28 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
     }
 
     /* Interleave alpha mask with other samples. */
-    if (use_mask && GetLercDataType(tif) == 1)
+    if (use_mask && sp->lerc_data_type == 1)
     {
         unsigned src_stride =
             (td->td_samplesperpixel - 1) * (td->td_bitspersample / 8);
         unsigned dst_stride =
             td->td_samplesperpixel * (td->td_bitspersample / 8);
-        unsigned i = sp->segment_width * sp->segment_height;
+        unsigned i = nb_pixels;
         /* Operate from end to begin to be able to move in place */
         while (i > 0 && i > nomask_bands)
         {
             i--;
-            sp->uncompressed_buffer[i * dst_stride + td->td_samplesperpixel -
-                                    1] = 255 * sp->mask_buffer[i];
-            memcpy(sp->uncompressed_buffer + i * dst_stride,
-                   sp->uncompressed_buffer + i * src_stride, src_stride);
+            dst[i * dst_stride + td->td_samplesperpixel - 1] =
+                255 * sp->mask_buffer[i];
+            memcpy(dst + i * dst_stride, dst + i * src_stride, src_stride);
         }
         /* First pixels must use memmove due to overlapping areas */
         while (i > 0)
         {
             i--;
-            sp->uncompressed_buffer[i * dst_stride + td->td_samplesperpixel -
-                                    1] = 255 * sp->mask_buffer[i];
-            tiff_memmove_u8(sp->uncompressed_buffer + i * dst_stride,
-                            sp->uncompressed_buffer + i * src_stride,
+            dst[i * dst_stride + td->td_samplesperpixel - 1] =
+                255 * sp->mask_buffer[i];
+            tiff_memmove_u8(dst + i * dst_stride, dst + i * src_stride,
                             src_stride);
         }
     }
@@ -646,7 +819,7 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
                 for (i = 0; i < nb_pixels; i++)
                 {
                     if (sp->mask_buffer[i] == 0)
-                        ((float *)sp->uncompressed_buffer)[i] = nan_float32;
+                        ((float *)dst)[i] = nan_float32;
                 }
             }
             else
@@ -655,7 +828,7 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
                 for (i = 0; i < nb_pixels; i++)
                 {
                     if (sp->mask_buffer[i] == 0)
-                        ((double *)sp->uncompressed_buffer)[i] = nan_float64;
+                        ((double *)dst)[i] = nan_float64;
                 }
             }
         }
@@ -672,7 +845,7 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
                     for (int j = 0; j < td->td_samplesperpixel; j++)
                     {
                         if (sp->mask_buffer[i] == 0)
-                            ((float *)sp->uncompressed_buffer)[k] = nan_float32;
+                            ((float *)dst)[k] = nan_float32;
                         ++k;
                     }
                 }
@@ -685,8 +858,7 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
                     for (int j = 0; j < td->td_samplesperpixel; j++)
                     {
                         if (sp->mask_buffer[i] == 0)
-                            ((double *)sp->uncompressed_buffer)[k] =
-                                nan_float64;
+                            ((double *)dst)[k] = nan_float64;
                         ++k;
                     }
                 }
@@ -699,41 +871,7 @@ static int LERCPreDecode(TIFF *tif, uint16_t s)
             assert(nFoundDims == 1);
             assert(nFoundBands == td->td_samplesperpixel);
 
-            unsigned k = 0;
-            if (td->td_bitspersample == 32)
-            {
-                for (i = 0; i < nb_pixels; i++)
-                {
-                    for (int j = 0; j < td->td_samplesperpixel; j++)
-                    {
-                        if (sp->mask_buffer[i + j * nb_pixels] == 0)
-                            ((float *)sp->uncompressed_buffer)[k] = nan_float32;
-                        else
-                            ((float *)sp->uncompressed_buffer)[k] =
-                                ((float *)sp->uncompressed_buffer_multiband)
-                                    [i + j * nb_pixels];
-                        ++k;
-                    }
-                }
-            }
-            else
-            {
-                const double nan_float64 = nan_float32;
-                for (i = 0; i < nb_pixels; i++)
-                {
-                    for (int j = 0; j < td->td_samplesperpixel; j++)
-                    {
-                        if (sp->mask_buffer[i + j * nb_pixels] == 0)
-                            ((double *)sp->uncompressed_buffer)[k] =
-                                nan_float64;
-                        else
-                            ((double *)sp->uncompressed_buffer)[k] =
-                                ((double *)sp->uncompressed_buffer_multiband)
-                                    [i + j * nb_pixels];
-                        ++k;
-                    }
-                }
-            }
+            LERCInterleave(tif, sp, dst);
         }
 #endif
     }
@@ -760,6 +898,16 @@ static int LERCDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
         return 0;
     }
 
+    if (sp->read_error)
+    {
+        tiff_memset_u8(op, 0, (size_t)occ);
+        TIFFErrorExtR(tif, module,
+                      "Scanline %" PRIu32 " cannot be read due to previous "
+                      "error",
+                      tif->tif_row);
+        return 0;
+    }
+
     if ((uint64_t)sp->uncompressed_offset + (uint64_t)occ >
         sp->uncompressed_size)
     {
@@ -768,6 +916,29 @@ static int LERCDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
         return 0;
     }
 
+    if (sp->decode_pending)
+    {
+        /* A whole strip or tile is decoded in place, otherwise the blob */
+        /* goes through uncompressed_buffer, from where it is served. */
+        uint8_t *dst = (sp->uncompressed_offset == 0 &&
+                        (uint64_t)occ == sp->uncompressed_size)
+                           ? op
+                           : sp->uncompressed_buffer;
+
+        sp->decode_pending = 0;
+        if (!LERCDecodeBlob(tif, sp, dst))
+        {
+            tiff_memset_u8(op, 0, (size_t)occ);
+            sp->read_error = 1;
+            return 0;
+        }
+        if (dst == op)
+        {
+            sp->uncompressed_offset += (unsigned)occ;
+            return 1;
+        }
+    }
+
     memcpy(op, sp->uncompressed_buffer + sp->uncompressed_offset, occ);
     sp->uncompressed_offset += (unsigned)occ;
 
@@ -0,0 +1,1296 @@
+#include "tiffiop.h"
+#ifdef JPEG_SUPPORT
+/*
+ * TIFF Library.
+ *
+ * Lossless JPEG (LJ92) Support
+ *
+ * Lossless JPEG, the Huffman coded predictive process of ITU-T T.81 Annex H
+ * (SOF3), is the compression 7 of most DNG files from cameras.  libjpeg
+ * only decodes it from version 3 of libjpeg-turbo on, and never at 16 bits
+ * in an 8 bit build, so the JPEG codec hands such streams over to the
+ * decoder below, and writes them when TIFFTAG_JPEGLOSSLESS is set.
+ *
+ * The decoder is table driven: Huffman codes of up to LJ92_LOOKUP_BITS
+ * bits, nearly all of them, are resolved by a single lookup in a 64 bit
+ * bit buffer.  The samples of the frame are mapped in order onto those of
+ * the strip or tile, which covers both the plain case and the DNG habit of
+ * coding a W x H CFA tile as a W/2 x H frame of two components.  At 16 bits
+ * the samples are decoded in place into the caller's buffer; other depths
+ * go through two rows of 16 bit samples and are stored packed.
+ *
+ * A tile being a single entropy coded segment, parallelism comes from
+ * decoding several tiles at once, see _TIFFLJ92ReadTiles().
+ */
+
+#include "tif_lj92.h"
+#ifdef TIFF_USE_THREADPOOL
+#include "tiff_threadpool.h"
+#endif
+
+#define LJ92_LOOKUP_BITS 10
+#define LJ92_MARKER(m) (0xFF00 | (m))
+
+#define M_SOF3 0xC3
+#define M_DHT 0xC4
+#define M_SOI 0xD8
+#define M_EOI 0xD9
+#define M_SOS 0xDA
+#define M_DRI 0xDD
+
+/*
+ * A decoding table (T.81 F.2.2.3), with a lookup table for short codes.
+ */
+typedef struct
+{
+    int defined;
+    uint8_t values[256];
+    int32_t maxcode[18];   /* largest code of each length, -1 if none */
+    int32_t valoffset[17]; /* index in values of code 0 of each length */
+    uint16_t lookup[1 << LJ92_LOOKUP_BITS]; /* length << 8 | value, or 0 */
+} LJ92Huffman;
+
+typedef struct
+{
+    LJ92Huffman huff[4];
+    int frame;          /* a SOF3 was seen */
+    int precision;      /* P */
+    uint32_t width;     /* X */
+    uint32_t height;    /* Y */
+    int ncomp;          /* Nf */
+    uint8_t compid[4];  /* Ci */
+    int table[4];       /* Huffman table of each scan component */
+    int predictor;      /* Ss */
+    int pt;             /* Al */
+    uint32_t restart;   /* restart interval, in pixels */
+
+    /* Set by lj92Prepare() for lj92Run() */
+    const uint8_t *scan;   /* entropy coded data */
+    const uint8_t *end;
+    uint64_t needed;       /* samples of the strile */
+    uint64_t framerow;     /* samples of a frame row */
+    uint64_t rows;         /* frame rows to decode */
+    uint64_t restart_rows; /* frame rows of a restart interval, or 0 */
+    int direct;            /* decode in place into the caller's buffer */
+    uint16_t *scratch;     /* two frame rows, unless direct */
+} LJ92Decoder;
+
+/*
+ * Entropy coded data reader: bits are kept most significant first in acc.
+ * Past a marker or the end of the data zeros are fed, and counted, so that
+ * the hot path never checks for either.
+ */
+typedef struct
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc;
+    int count;       /* bits in acc */
+    int marker;      /* a marker was reached */
+    tmsize_t padding; /* zero bytes fed */
+} LJ92Bits;
+
+typedef struct
+{
+    uint64_t acc;
+    int count;
+    uint8_t *p;
+} LJ92Writer;
+
+/*
+ * Where the decoder reports errors and warnings: straight to tif, or, for a
+ * tile decoded on a worker thread, into msg, reported by the calling thread
+ * once the batch is done, since neither tif nor the user's handlers may be
+ * used concurrently.
+ */
+typedef struct
+{
+    TIFF *tif;
+    int deferred;
+    int error;     /* deferred: msg is an error rather than a warning */
+    char msg[256]; /* deferred: first error, else first warning, or "" */
+} LJ92Report;
+
+static const char module[] = "LJ92";
+
+static void lj92Message(LJ92Report *r, int error, const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    if (!r->deferred)
+    {
+        char msg[256];
+
+        vsnprintf(msg, sizeof(msg), fmt, ap);
+        if (error)
+            TIFFErrorExtR(r->tif, module, "%s", msg);
+        else
+            TIFFWarningExtR(r->tif, module, "%s", msg);
+    }
+    else if (error ? !r->error : r->msg[0] == '\0')
+    {
+        vsnprintf(r->msg, sizeof(r->msg), fmt, ap);
+        r->error = error;
+    }
+    va_end(ap);
+}
+
+static uint16_t lj92Get16(const uint8_t *p)
+{
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static int lj92BuildHuffman(LJ92Huffman *h, const uint8_t *bits,
+                            const uint8_t *values, int nvalues)
+{
+    int32_t code = 0;
+    int k = 0;
+
+    memset(h->lookup, 0, sizeof(h->lookup));
+    memcpy(h->values, values, (size_t)nvalues);
+    for (int l = 1; l <= 16; l++)
+    {
+        h->valoffset[l] = k - code;
+        for (int i = 0; i < bits[l]; i++, k++, code++)
+        {
+            /* Codes of length l must fit in l bits */
+            if (code >= (1 << l))
+                return 0;
+            if (l <= LJ92_LOOKUP_BITS)
+            {
+                const int shift = LJ92_LOOKUP_BITS - l;
+                for (int j = 0; j < (1 << shift); j++)
+                    h->lookup[(code << shift) + j] =
+                        (uint16_t)(l << 8 | values[k]);
+            }
+        }
+        h->maxcode[l] = bits[l] ? code - 1 : -1;
+        code <<= 1;
+    }
+    h->maxcode[17] = INT32_MAX; /* sentinel */
+    h->defined = 1;
+    return 1;
+}
+
+/*
+ * Parse the marker segments of data up to the scan, whose offset is
+ * returned, or up to EOI (JPEGTables), for which 0 is returned.
+ */
+static tmsize_t lj92ReadHeaders(TIFF *tif, const uint8_t *data, tmsize_t size,
+                                LJ92Decoder *d)
+{
+    tmsize_t pos = 2;
+
+    if (size < 4 || lj92Get16(data) != LJ92_MARKER(M_SOI))
+    {
+        TIFFErrorExtR(tif, module, "Missing JPEG SOI marker");
+        return -1;
+    }
+    for (;;)
+    {
+        const uint8_t *seg;
+        tmsize_t len;
+        int m;
+
+        if (pos >= size || data[pos] != 0xFF)
+        {
+            TIFFErrorExtR(tif, module, "Missing JPEG marker");
+            return -1;
+        }
+        while (pos < size && data[pos] == 0xFF)
+            pos++;
+        if (pos >= size)
+            break;
+        m = data[pos++];
+        if (m == M_EOI)
+            return 0;
+        if (m == 0x01 || (m >= 0xD0 && m <= 0xD7))
+            continue;
+        if (size - pos < 2 || (len = lj92Get16(data + pos)) < 2 ||
+            len > size - pos)
+            break;
+        seg = data + pos + 2;
+        len -= 2;
+        pos += len + 2;
+        switch (m)
+        {
+            case M_SOF3:
+                if (len < 6 || len < 6 + 3 * seg[5])
+                    goto truncated;
+                d->precision = seg[0];
+                d->height = lj92Get16(seg + 1);
+                d->width = lj92Get16(seg + 3);
+                d->ncomp = seg[5];
+                if (d->precision < 2 || d->precision > 16 || d->ncomp < 1 ||
+                    d->ncomp > 4 || d->width == 0 || d->height == 0)
+                {
+                    TIFFErrorExtR(tif, module,
+                                  "Unsupported lossless JPEG frame: %d bits, "
+                                  "%ux%u, %d components",
+                                  d->precision, d->width, d->height,
+                                  d->ncomp);
+                    return -1;
+                }
+                for (int i = 0; i < d->ncomp; i++)
+                {
+                    d->compid[i] = seg[6 + 3 * i];
+                    if (seg[7 + 3 * i] != 0x11)
+                    {
+                        TIFFErrorExtR(tif, module,
+                                      "Subsampled lossless JPEG components "
+                                      "are not supported");
+                        return -1;
+                    }
+                }
+                d->frame = 1;
+                break;
+            case M_DHT:
+                while (len > 0)
+                {
+                    int th, n = 0;
+
+                    if (len < 17)
+                        goto truncated;
+                    th = seg[0] & 0x0F;
+                    if ((seg[0] >> 4) != 0 || th > 3)
+                    {
+                        TIFFErrorExtR(tif, module,
+                                      "Invalid lossless JPEG Huffman table "
+                                      "class or number");
+                        return -1;
+                    }
+                    uint8_t bits[17] = {0};
+                    for (int l = 1; l <= 16; l++)
+                        n += bits[l] = seg[l];
+                    if (n > 256 || len < 17 + n)
+                        goto truncated;
+                    if (!lj92BuildHuffman(&d->huff[th], bits, seg + 17, n))
+                    {
+                        TIFFErrorExtR(tif, module,
+                                      "Bad JPEG Huffman table");
+                        return -1;
+                    }
+                    seg += 17 + n;
+                    len -= 17 + n;
+                }
+                break;
+            case M_DRI:
+                if (len < 2)
+                    goto truncated;
+                d->restart = lj92Get16(seg);
+                break;
+            case M_SOS:
+                if (!d->frame)
+                {
+                    TIFFErrorExtR(tif, module,
+                                  "JPEG scan without a lossless frame");
+                    return -1;
+                }
+                if (len < 1 || len < 4 + 2 * seg[0])
+                    goto truncated;
+                if (seg[0] != d->ncomp)
+                {
+                    TIFFErrorExtR(tif, module,
+                                  "Non interleaved lossless JPEG scans are "
+                                  "not supported");
+                    return -1;
+                }
+                for (int i = 0; i < d->ncomp; i++)
+                {
+                    const int th = seg[2 + 2 * i] >> 4;
+                    if (seg[1 + 2 * i] != d->compid[i] || th > 3 ||
+                        !d->huff[th].defined)
+                    {
+                        TIFFErrorExtR(tif, module,
+                                      "Bad lossless JPEG scan component %d",
+                                      i);
+                        return -1;
+                    }
+                    d->table[i] = th;
+                }
+                seg += 1 + 2 * d->ncomp;
+                d->predictor = seg[0];
+                d->pt = seg[2] & 0x0F;
+                if (d->predictor < 1 || d->predictor > 7 ||
+                    d->pt >= d->precision)
+                {
+                    TIFFErrorExtR(tif, module,
+                                  "Bad lossless JPEG predictor %d or point "
+                                  "transform %d",
+                                  d->predictor, d->pt);
+                    return -1;
+                }
+                return pos;
+            default:
+                if (m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 &&
+                    m != 0xCC)
+                {
+                    TIFFErrorExtR(tif, module,
+                                  "Not a lossless JPEG stream (SOF%d)",
+                                  m - 0xC0);
+                    return -1;
+                }
+                break;
+        }
+    }
+truncated:
+    TIFFErrorExtR(tif, module, "Truncated JPEG marker segment");
+    return -1;
+}
+
+/*
+ * Whether data starts a lossless (SOF3) JPEG stream.
+ */
+int _TIFFLJ92IsLossless(const uint8_t *data, tmsize_t size)
+{
+    tmsize_t pos = 2;
+
+    if (data == NULL || size < 4 || lj92Get16(data) != LJ92_MARKER(M_SOI))
+        return 0;
+    while (size - pos >= 4 && data[pos] == 0xFF)
+    {
+        const int m = data[pos + 1];
+
+        if (m == 0xFF)
+        {
+            pos++;
+            continue;
+        }
+        if (m == M_SOF3)
+            return 1;
+        if ((m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 &&
+             m != 0xCC) ||
+            m == M_SOS || m == M_EOI)
+            return 0;
+        pos += 2 + lj92Get16(data + pos + 2);
+    }
+    return 0;
+}
+
+static void lj92Fill(LJ92Bits *b)
+{
+    while (b->count <= 56)
+    {
+        uint64_t byte = 0;
+        int fed = 0;
+
+        if (!b->marker && b->p < b->end)
+        {
+            if (b->p[0] != 0xFF)
+            {
+                byte = *b->p++;
+                fed = 1;
+            }
+            else if (b->end - b->p >= 2 && b->p[1] == 0x00)
+            {
+                byte = 0xFF;
+                b->p += 2;
+                fed = 1;
+            }
+            else
+                b->marker = 1;
+        }
+        if (!fed)
+            b->padding++;
+        b->acc |= byte << (56 - b->count);
+        b->count += 8;
+    }
+}
+
+/*
+ * Whether bits fed after the end of the segment were used.
+ */
+static int lj92Overrun(const LJ92Bits *b)
+{
+    return b->padding * 8 > b->count;
+}
+
+static int lj92Restart(LJ92Report *r, LJ92Bits *b)
+{
+    const uint8_t *p = b->p;
+
+    if (lj92Overrun(b))
+        lj92Message(r, 0, "Premature end of lossless JPEG restart interval");
+    while (b->end - p >= 2 && !(p[0] == 0xFF && p[1] >= 0xD0 && p[1] <= 0xD7))
+        p++;
+    if (b->end - p < 2)
+    {
+        lj92Message(r, 1, "Missing JPEG restart marker");
+        return 0;
+    }
+    b->p = p + 2;
+    b->acc = 0;
+    b->count = 0;
+    b->marker = 0;
+    b->padding = 0;
+    return 1;
+}
+
+/*
+ * Decode the next difference (T.81 H.1.2.2), or return 0 on a bad code.
+ */
+static inline int lj92Diff(LJ92Bits *b, const LJ92Huffman *h, int32_t *diff)
+{
+    uint32_t e, s;
+
+    if (b->count < 32)
+        lj92Fill(b);
+    e = h->lookup[b->acc >> (64 - LJ92_LOOKUP_BITS)];
+    if (e != 0)
+    {
+        b->acc <<= e >> 8;
+        b->count -= (int)(e >> 8);
+        s = e & 0xFF;
+    }
+    else
+    {
+        int l = LJ92_LOOKUP_BITS + 1;
+        int32_t code = (int32_t)(b->acc >> (64 - l));
+
+        while (code > h->maxcode[l])
+            code = (int32_t)(b->acc >> (64 - ++l));
+        if (l > 16)
+            return 0;
+        b->acc <<= l;
+        b->count -= l;
+        s = h->values[code + h->valoffset[l]];
+    }
+    if (s == 0)
+        *diff = 0;
+    else if (s < 16)
+    {
+        int32_t v = (int32_t)(b->acc >> (64 - s));
+        b->acc <<= s;
+        b->count -= (int)s;
+        if (v < (1 << (s - 1)))
+            v -= (1 << s) - 1;
+        *diff = v;
+    }
+    else if (s == 16)
+        *diff = 32768;
+    else
+        return 0;
+    return 1;
+}
+
+/*
+ * Decode a row of the frame into cur, prev being the row above, or NULL on
+ * the first row of the scan or of a restart interval.
+ */
+static int lj92DecodeRow(const LJ92Decoder *d, LJ92Bits *b, uint16_t *cur,
+                         const uint16_t *prev)
+{
+    const int nc = d->ncomp;
+    const uint32_t n = d->width * (uint32_t)nc;
+    const LJ92Huffman *h[4];
+    int32_t diff;
+
+    for (int c = 0; c < nc; c++)
+        h[c] = &d->huff[d->table[c]];
+    for (int c = 0; c < nc; c++)
+    {
+        const int32_t pred =
+            prev ? prev[c] : 1 << (d->precision - d->pt - 1);
+        if (!lj92Diff(b, h[c], &diff))
+            return 0;
+        cur[c] = (uint16_t)(pred + diff);
+    }
+    for (uint32_t i = (uint32_t)nc; i < n;)
+    {
+        for (int c = 0; c < nc; c++, i++)
+        {
+            const int32_t ra = cur[i - nc];
+            int32_t pred;
+
+            if (prev == NULL)
+                pred = ra;
+            else
+            {
+                const int32_t rb = prev[i];
+                const int32_t rc = prev[i - nc];
+                switch (d->predictor)
+                {
+                    case 1:
+                        pred = ra;
+                        break;
+                    case 2:
+                        pred = rb;
+                        break;
+                    case 3:
+                        pred = rc;
+                        break;
+                    case 4:
+                        pred = ra + rb - rc;
+                        break;
+                    case 5:
+                        pred = ra + ((rb - rc) >> 1);
+                        break;
+                    case 6:
+                        pred = rb + ((ra - rc) >> 1);
+                        break;
+                    default:
+                        pred = (ra + rb) >> 1;
+                        break;
+                }
+            }
+            if (!lj92Diff(b, h[c], &diff))
+                return 0;
+            cur[i] = (uint16_t)(pred + diff);
+        }
+    }
+    return 1;
+}
+
+/*
+ * Store n samples, shifted left by pt, from sample index pos of the strile
+ * on, in the layout of libtiff.
+ */
+static void lj92Store(const LJ92Layout *layout, uint8_t *buf, uint64_t pos,
+                      const uint16_t *v, uint32_t n, int pt)
+{
+    const uint64_t rowsamples = (uint64_t)layout->width * layout->samples;
+    const uint32_t bps = layout->bps;
+    const uint32_t mask = (1U << bps) - 1;
+
+    while (n > 0)
+    {
+        uint8_t *row = buf + (tmsize_t)(pos / rowsamples) * layout->rowsize;
+        uint32_t col = (uint32_t)(pos % rowsamples);
+        uint32_t cnt = (uint32_t)(rowsamples - col);
+
+        if (cnt > n)
+            cnt = n;
+        if (bps == 16)
+        {
+            for (uint32_t i = 0; i < cnt; i++)
+            {
+                const uint16_t s = (uint16_t)(v[i] << pt);
+                memcpy(row + 2 * (col + i), &s, 2);
+            }
+        }
+        else if (bps == 8)
+        {
+            for (uint32_t i = 0; i < cnt; i++)
+                row[col + i] = (uint8_t)(v[i] << pt);
+        }
+        else
+        {
+            if (col == 0)
+                memset(row, 0, (size_t)layout->rowsize);
+            for (uint32_t i = 0; i < cnt; i++)
+            {
+                const uint64_t bit = (uint64_t)(col + i) * bps;
+                const uint32_t shift = (uint32_t)(bit & 7);
+                const uint32_t s = ((uint32_t)(v[i] << pt) & mask)
+                                   << (24 - shift - bps);
+                uint8_t *p = row + (tmsize_t)(bit >> 3);
+
+                p[0] |= (uint8_t)(s >> 16);
+                if (shift + bps > 8)
+                    p[1] |= (uint8_t)(s >> 8);
+                if (shift + bps > 16)
+                    p[2] |= (uint8_t)s;
+            }
+        }
+        v += cnt;
+        n -= cnt;
+        pos += cnt;
+    }
+}
+
+/*
+ * Parse the lossless JPEG stream of a strip or tile, tables, if not NULL,
+ * holding the JPEGTables, check it against layout and allocate what
+ * lj92Run() needs to decode it into buf.  Errors are reported to tif.
+ */
+static int lj92Prepare(TIFF *tif, LJ92Decoder *d, const uint8_t *tables,
+                       tmsize_t tables_size, const uint8_t *data,
+                       tmsize_t size, const LJ92Layout *layout,
+                       const uint8_t *buf)
+{
+    tmsize_t pos;
+
+    memset(d, 0, sizeof(LJ92Decoder));
+    if (tables != NULL && tables_size > 0 &&
+        lj92ReadHeaders(tif, tables, tables_size, d) != 0)
+    {
+        TIFFErrorExtR(tif, module, "Bogus JPEGTables field");
+        return 0;
+    }
+    pos = lj92ReadHeaders(tif, data, size, d);
+    if (pos <= 0)
+    {
+        if (pos == 0)
+            TIFFErrorExtR(tif, module, "No scan in lossless JPEG stream");
+        return 0;
+    }
+
+    d->needed = (uint64_t)layout->width * layout->samples * layout->rows;
+    d->framerow = (uint64_t)d->width * (uint64_t)d->ncomp;
+    if (d->framerow * d->height < d->needed)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Lossless JPEG frame of %ux%u with %d components is "
+                      "too small for %" PRIu32 "x%" PRIu32
+                      " pixels of %u samples",
+                      d->width, d->height, d->ncomp, layout->width,
+                      layout->rows, layout->samples);
+        return 0;
+    }
+    if (d->precision > (layout->bps > 2 ? layout->bps : 2))
+    {
+        TIFFErrorExtR(tif, module,
+                      "Lossless JPEG precision %d exceeds BitsPerSample %u",
+                      d->precision, layout->bps);
+        return 0;
+    }
+    if (d->restart != 0)
+    {
+        if (d->restart % d->width != 0)
+        {
+            TIFFErrorExtR(tif, module,
+                          "Lossless JPEG restart intervals of %u pixels, "
+                          "not whole rows, are not supported",
+                          d->restart);
+            return 0;
+        }
+        d->restart_rows = d->restart / d->width;
+    }
+
+    d->rows = (d->needed + d->framerow - 1) / d->framerow;
+    d->direct = layout->bps == 16 && d->pt == 0 &&
+                d->needed % d->framerow == 0 && ((uintptr_t)buf & 1) == 0;
+    if (!d->direct)
+    {
+        d->scratch = (uint16_t *)_TIFFmallocExt(
+            tif, (tmsize_t)(2 * d->framerow * sizeof(uint16_t)));
+        if (d->scratch == NULL)
+        {
+            TIFFErrorExtR(tif, module, "No space for lossless JPEG rows");
+            return 0;
+        }
+    }
+    d->scan = data + pos;
+    d->end = data + size;
+    return 1;
+}
+
+static void lj92Release(TIFF *tif, LJ92Decoder *d)
+{
+    _TIFFfreeExt(tif, d->scratch);
+    d->scratch = NULL;
+}
+
+/*
+ * Decode the stream checked by lj92Prepare() into buf.  Neither memory is
+ * allocated nor tif used, so that tiles can be decoded concurrently.
+ */
+static int lj92Run(LJ92Report *r, const LJ92Decoder *d,
+                   const LJ92Layout *layout, uint8_t *buf)
+{
+    const uint16_t *prev = NULL;
+    LJ92Bits b;
+
+    memset(&b, 0, sizeof(b));
+    b.p = d->scan;
+    b.end = d->end;
+    for (uint64_t y = 0; y < d->rows; y++)
+    {
+        uint16_t *cur = d->direct ? (uint16_t *)buf + y * d->framerow
+                                  : d->scratch + (y & 1) * d->framerow;
+
+        if (d->restart_rows != 0 && y > 0 && y % d->restart_rows == 0)
+        {
+            if (!lj92Restart(r, &b))
+                return 0;
+            prev = NULL;
+        }
+        if (!lj92DecodeRow(d, &b, cur, prev))
+        {
+            lj92Message(r, 1, "Corrupt lossless JPEG data in row %" PRIu64,
+                        y);
+            return 0;
+        }
+        if (!d->direct)
+        {
+            uint64_t n = d->needed - y * d->framerow;
+            lj92Store(layout, buf, y * d->framerow, cur,
+                      (uint32_t)(n < d->framerow ? n : d->framerow), d->pt);
+        }
+        prev = cur;
+    }
+    if (lj92Overrun(&b))
+        lj92Message(r, 0, "Premature end of lossless JPEG data");
+    return 1;
+}
+
+/*
+ * Decode the lossless JPEG stream of a strip or tile into buf, laid out as
+ * described by layout.  tables, if not NULL, holds the JPEGTables.
+ */
+int _TIFFLJ92Decode(TIFF *tif, const uint8_t *tables, tmsize_t tables_size,
+                    const uint8_t *data, tmsize_t size,
+                    const LJ92Layout *layout, uint8_t *buf)
+{
+    LJ92Report report;
+    LJ92Decoder *d;
+    int ok;
+
+    d = (LJ92Decoder *)_TIFFmallocExt(tif, sizeof(LJ92Decoder));
+    if (d == NULL)
+    {
+        TIFFErrorExtR(tif, module, "No space for lossless JPEG decoder");
+        return 0;
+    }
+    memset(&report, 0, sizeof(report));
+    report.tif = tif;
+    ok = lj92Prepare(tif, d, tables, tables_size, data, size, layout, buf) &&
+         lj92Run(&report, d, layout, buf);
+    lj92Release(tif, d);
+    _TIFFfreeExt(tif, d);
+    return ok;
+}
+
+/*
+ * Load row y of the strile as 16 bit samples.
+ */
+static void lj92Load(const LJ92Layout *layout, const uint8_t *buf,
+                     uint32_t y, uint16_t *v)
+{
+    const uint8_t *row = buf + (tmsize_t)y * layout->rowsize;
+    const uint32_t n = layout->width * layout->samples;
+    const uint32_t bps = layout->bps;
+
+    if (bps == 16)
+        memcpy(v, row, (size_t)n * 2);
+    else if (bps == 8)
+    {
+        for (uint32_t i = 0; i < n; i++)
+            v[i] = row[i];
+    }
+    else
+    {
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const uint64_t bit = (uint64_t)i * bps;
+            const uint32_t shift = (uint32_t)(bit & 7);
+            const uint8_t *p = row + (tmsize_t)(bit >> 3);
+            uint32_t s = (uint32_t)p[0] << 16;
+
+            if (shift + bps > 8)
+                s |= (uint32_t)p[1] << 8;
+            if (shift + bps > 16)
+                s |= p[2];
+            v[i] = (uint16_t)((s >> (24 - shift - bps)) & ((1U << bps) - 1));
+        }
+    }
+}
+
+/*
+ * Differences of a row, prev being NULL on the first one.
+ */
+static void lj92Differences(const uint16_t *cur, const uint16_t *prev,
+                            uint32_t n, int nc, int predictor, int precision,
+                            int32_t *diff)
+{
+    for (uint32_t i = 0; i < n; i++)
+    {
+        int32_t pred, d;
+
+        if (i < (uint32_t)nc)
+            pred = prev ? prev[i] : 1 << (precision - 1);
+        else if (prev == NULL)
+            pred = cur[i - nc];
+        else
+        {
+            const int32_t ra = cur[i - nc], rb = prev[i], rc = prev[i - nc];
+            switch (predictor)
+            {
+                case 1:
+                    pred = ra;
+                    break;
+                case 2:
+                    pred = rb;
+                    break;
+                case 3:
+                    pred = rc;
+                    break;
+                case 4:
+                    pred = ra + rb - rc;
+                    break;
+                case 5:
+                    pred = ra + ((rb - rc) >> 1);
+                    break;
+                case 6:
+                    pred = rb + ((ra - rc) >> 1);
+                    break;
+                default:
+                    pred = (ra + rb) >> 1;
+                    break;
+            }
+        }
+        d = (int32_t)((uint32_t)(cur[i] - pred) & 0xFFFF);
+        diff[i] = d >= 0x8000 ? d - 0x10000 : d;
+    }
+}
+
+static int lj92Category(int32_t diff)
+{
+    uint32_t a = (uint32_t)(diff < 0 ? -diff : diff);
+    int s = 0;
+
+    while (a != 0)
+    {
+        s++;
+        a >>= 1;
+    }
+    return s; /* 16 for -32768 */
+}
+
+/*
+ * Optimal table of code lengths of at most 16 bits for the 17 categories
+ * (T.81 K.2 and K.3), a reserved symbol keeping the all ones code unused.
+ */
+static int lj92OptimalTable(const uint64_t *counts, uint8_t *bits,
+                            uint8_t *values)
+{
+    uint64_t freq[18];
+    int codesize[18], others[18];
+    int count[33] = {0};
+    int n = 0, i;
+
+    for (i = 0; i < 17; i++)
+    {
+        freq[i] = counts[i];
+        codesize[i] = 0;
+        others[i] = -1;
+    }
+    freq[17] = 1;
+    codesize[17] = 0;
+    others[17] = -1;
+    for (;;)
+    {
+        int c1 = -1, c2 = -1;
+        uint64_t v = UINT64_MAX;
+
+        for (i = 0; i < 18; i++)
+            if (freq[i] && freq[i] <= v)
+            {
+                v = freq[i];
+                c1 = i;
+            }
+        v = UINT64_MAX;
+        for (i = 0; i < 18; i++)
+            if (freq[i] && freq[i] <= v && i != c1)
+            {
+                v = freq[i];
+                c2 = i;
+            }
+        if (c2 < 0)
+            break;
+        freq[c1] += freq[c2];
+        freq[c2] = 0;
+        codesize[c1]++;
+        while (others[c1] >= 0)
+        {
+            c1 = others[c1];
+            codesize[c1]++;
+        }
+        others[c1] = c2;
+        codesize[c2]++;
+        while (others[c2] >= 0)
+        {
+            c2 = others[c2];
+            codesize[c2]++;
+        }
+    }
+    for (i = 0; i < 18; i++)
+        if (codesize[i])
+            count[codesize[i]]++;
+    for (i = 32; i > 16; i--)
+    {
+        while (count[i] > 0)
+        {
+            int j = i - 2;
+            while (count[j] == 0)
+                j--;
+            count[i] -= 2;
+            count[i - 1]++;
+            count[j + 1] += 2;
+            count[j]--;
+        }
+    }
+    while (count[i] == 0)
+        i--;
+    count[i]--; /* the reserved symbol */
+    bits[0] = 0;
+    for (i = 1; i <= 16; i++)
+        bits[i] = (uint8_t)count[i];
+    for (i = 1; i <= 32; i++)
+        for (int s = 0; s < 17; s++)
+            if (codesize[s] == i)
+                values[n++] = (uint8_t)s;
+    return n;
+}
+
+static void lj92Put(LJ92Writer *w, uint32_t code, int size)
+{
+    w->acc |= (uint64_t)code << (64 - w->count - size);
+    w->count += size;
+    while (w->count >= 8)
+    {
+        const uint8_t byte = (uint8_t)(w->acc >> 56);
+        *w->p++ = byte;
+        if (byte == 0xFF)
+            *w->p++ = 0x00;
+        w->acc <<= 8;
+        w->count -= 8;
+    }
+}
+
+/*
+ * Encode the strip or tile in buf, laid out as described by layout, as a
+ * lossless JPEG stream with the given predictor (1 to 7) and an optimal
+ * Huffman table.  *out, of *out_size bytes, is grown if needed; the length
+ * of the stream is returned in *out_len.
+ */
+int _TIFFLJ92Encode(TIFF *tif, const uint8_t *buf, const LJ92Layout *layout,
+                    int predictor, uint8_t **out, tmsize_t *out_size,
+                    tmsize_t *out_len)
+{
+    const int nc = layout->samples;
+    const int precision = layout->bps > 2 ? layout->bps : 2;
+    const uint32_t n = layout->width * (uint32_t)nc;
+    uint64_t counts[17] = {0}, databits = 0;
+    uint8_t bits[17], values[17];
+    uint32_t code[17], codesize[17] = {0};
+    uint16_t *rows;
+    int32_t *diff;
+    tmsize_t bound;
+    LJ92Writer w;
+    uint8_t *p;
+    int nvalues, ok = 0;
+
+    if (layout->width == 0 || layout->width > 65535 || layout->rows == 0 ||
+        layout->rows > 65535 || nc < 1 || nc > 4 || layout->bps < 1 ||
+        layout->bps > 16 || predictor < 1 || predictor > 7)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Cannot encode %" PRIu32 "x%" PRIu32
+                      " pixels of %d samples of %u bits with predictor %d "
+                      "as lossless JPEG",
+                      layout->width, layout->rows, nc, layout->bps,
+                      predictor);
+        return 0;
+    }
+    rows = (uint16_t *)_TIFFmallocExt(
+        tif, (tmsize_t)n * (2 * sizeof(uint16_t) + sizeof(int32_t)));
+    if (rows == NULL)
+    {
+        TIFFErrorExtR(tif, module, "No space for lossless JPEG rows");
+        return 0;
+    }
+    diff = (int32_t *)(rows + 2 * (size_t)n);
+
+    /* First pass: statistics of the categories */
+    for (uint32_t y = 0; y < layout->rows; y++)
+    {
+        uint16_t *cur = rows + (y & 1) * n;
+        lj92Load(layout, buf, y, cur);
+        lj92Differences(cur, y ? rows + ((y - 1) & 1) * n : NULL, n, nc,
+                        predictor, precision, diff);
+        for (uint32_t i = 0; i < n; i++)
+            counts[lj92Category(diff[i])]++;
+    }
+    nvalues = lj92OptimalTable(counts, bits, values);
+    {
+        uint32_t c = 0;
+        int k = 0;
+        for (int l = 1; l <= 16; l++, c <<= 1)
+            for (int i = 0; i < bits[l]; i++, k++, c++)
+            {
+                code[values[k]] = c;
+                codesize[values[k]] = (uint32_t)l;
+            }
+    }
+    for (int s = 0; s < 17; s++)
+        databits += counts[s] * (codesize[s] + (s < 16 ? (uint32_t)s : 0));
+
+    /* Headers, entropy coded data with room for stuffing, EOI */
+    bound = 2 + (2 + 8 + 3 * nc) + (2 + 19 + nvalues) + (2 + 6 + 2 * nc) +
+            2 * (tmsize_t)((databits + 7) / 8) + 2;
+    if (*out_size < bound)
+    {
+        uint8_t *q = (uint8_t *)_TIFFreallocExt(tif, *out, bound);
+        if (q == NULL)
+        {
+            TIFFErrorExtR(tif, module, "No space for lossless JPEG stream");
+            goto done;
+        }
+        *out = q;
+        *out_size = bound;
+    }
+    p = *out;
+    *p++ = 0xFF;
+    *p++ = M_SOI;
+    *p++ = 0xFF;
+    *p++ = M_SOF3;
+    *p++ = 0;
+    *p++ = (uint8_t)(8 + 3 * nc);
+    *p++ = (uint8_t)precision;
+    *p++ = (uint8_t)(layout->rows >> 8);
+    *p++ = (uint8_t)layout->rows;
+    *p++ = (uint8_t)(layout->width >> 8);
+    *p++ = (uint8_t)layout->width;
+    *p++ = (uint8_t)nc;
+    for (int c = 0; c < nc; c++)
+    {
+        *p++ = (uint8_t)c;
+        *p++ = 0x11;
+        *p++ = 0;
+    }
+    *p++ = 0xFF;
+    *p++ = M_DHT;
+    *p++ = 0;
+    *p++ = (uint8_t)(19 + nvalues);
+    *p++ = 0; /* class 0, table 0 */
+    memcpy(p, bits + 1, 16);
+    p += 16;
+    memcpy(p, values, (size_t)nvalues);
+    p += nvalues;
+    *p++ = 0xFF;
+    *p++ = M_SOS;
+    *p++ = 0;
+    *p++ = (uint8_t)(6 + 2 * nc);
+    *p++ = (uint8_t)nc;
+    for (int c = 0; c < nc; c++)
+    {
+        *p++ = (uint8_t)c;
+        *p++ = 0;
+    }
+    *p++ = (uint8_t)predictor;
+    *p++ = 0;
+    *p++ = 0;
+
+    /* Second pass: entropy coding */
+    w.acc = 0;
+    w.count = 0;
+    w.p = p;
+    for (uint32_t y = 0; y < layout->rows; y++)
+    {
+        uint16_t *cur = rows + (y & 1) * n;
+        lj92Load(layout, buf, y, cur);
+        lj92Differences(cur, y ? rows + ((y - 1) & 1) * n : NULL, n, nc,
+                        predictor, precision, diff);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const int32_t d = diff[i];
+            const int s = lj92Category(d);
+
+            lj92Put(&w, code[s], (int)codesize[s]);
+            if (s > 0 && s < 16)
+                lj92Put(&w, (uint32_t)(d < 0 ? d - 1 : d) & ((1U << s) - 1),
+                        s);
+        }
+    }
+    if (w.count > 0)
+        lj92Put(&w, (1U << (8 - w.count)) - 1, 8 - w.count);
+    p = w.p;
+    *p++ = 0xFF;
+    *p++ = M_EOI;
+    *out_len = p - *out;
+    ok = 1;
+done:
+    _TIFFfreeExt(tif, rows);
+    return ok;
+}
+
+#ifdef TIFF_USE_THREADPOOL
+#define LJ92_BATCH 64
+
+/*
+ * A tile of a batch: prepared and reported on the calling thread, run on a
+ * worker thread.
+ */
+typedef struct
+{
+    LJ92Decoder d;
+    LJ92Report report;
+    const LJ92Layout *layout;
+    uint8_t *buf;
+    int lossless;
+    int result;
+} LJ92Task;
+
+static void LJ92DecodeTask(void *arg)
+{
+    LJ92Task *t = (LJ92Task *)arg;
+    t->result = lj92Run(&t->report, &t->d, t->layout, t->buf);
+}
+
+/*
+ * Decode the lossless JPEG tiles among the n tiles of tiles into bufs, of
+ * TIFFTileSize() bytes each, LJ92_BATCH tiles at a time: the raw data of a
+ * batch is fetched with coalesced reads and its tiles are decoded
+ * concurrently on the thread pool.  Everything touching tif, allocations and
+ * error reporting included, is done on the calling thread, before and after
+ * the concurrent decoding.  done[i] is set for the tiles decoded; the others
+ * are left to TIFFReadEncodedTile().  0 is returned, once the error is
+ * reported, if a tile cannot be read or decoded.
+ */
+int _TIFFLJ92ReadTiles(TIFF *tif, const uint32_t *tiles, uint32_t n,
+                       void **bufs, int *done)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    const tmsize_t tilesize = TIFFTileSize(tif);
+    uint8_t *tables = NULL;
+    uint32_t tables_size = 0;
+    uint8_t *block = NULL;
+    tmsize_t block_size = 0;
+    LJ92Layout layout;
+    LJ92Task *tasks;
+    int ok = 1;
+
+    if (tilesize <= 0 || td->td_bitspersample > 16 ||
+        td->td_photometric == PHOTOMETRIC_YCBCR || isDecodeScaled(tif))
+        return 1;
+    tasks = (LJ92Task *)_TIFFmallocExt(
+        tif, (tmsize_t)(LJ92_BATCH * sizeof(LJ92Task)));
+    if (tasks == NULL)
+    {
+        TIFFErrorExtR(tif, module, "No space for lossless JPEG decoders");
+        return 0;
+    }
+    layout.width = td->td_tilewidth;
+    layout.rows = td->td_tilelength;
+    layout.samples = td->td_planarconfig == PLANARCONFIG_CONTIG
+                         ? td->td_samplesperpixel
+                         : 1;
+    layout.bps = td->td_bitspersample;
+    layout.rowsize = TIFFTileRowSize(tif);
+    if (!TIFFGetField(tif, TIFFTAG_JPEGTABLES, &tables_size, &tables))
+        tables_size = 0;
+
+    for (uint32_t start = 0; ok && start < n; start += LJ92_BATCH)
+    {
+        const uint32_t m = n - start < LJ92_BATCH ? n - start : LJ92_BATCH;
+        uint32_t ids[LJ92_BATCH], idx[LJ92_BATCH];
+        void *raw[LJ92_BATCH];
+        tmsize_t sizes[LJ92_BATCH];
+        uint64_t total = 0;
+        uint32_t k = 0, started;
+
+        for (uint32_t i = start; i < start + m; i++)
+        {
+            uint64_t bytecount;
+
+            if (done[i])
+                continue;
+            if (tif->tif_strilecache != NULL &&
+                _TIFFStrileCacheLookup(tif, tiles[i], bufs[i], tilesize) ==
+                    tilesize)
+            {
+                done[i] = 1;
+                continue;
+            }
+            bytecount = TIFFGetStrileByteCount(tif, tiles[i]);
+            if (bytecount < 4 || bytecount > (uint64_t)TIFF_TMSIZE_T_MAX)
+                continue;
+            ids[k] = tiles[i];
+            idx[k] = i;
+            sizes[k] = (tmsize_t)bytecount;
+            total += bytecount;
+            k++;
+        }
+        if (k == 0)
+            continue;
+        if (total > (uint64_t)TIFF_TMSIZE_T_MAX)
+            break;
+        if ((tmsize_t)total > block_size)
+        {
+            uint8_t *q = (uint8_t *)_TIFFreallocExt(tif, block,
+                                                    (tmsize_t)total);
+            if (q == NULL)
+            {
+                TIFFErrorExtR(tif, module, "No space for raw tile data");
+                ok = 0;
+                break;
+            }
+            block = q;
+            block_size = (tmsize_t)total;
+        }
+        total = 0;
+        for (uint32_t j = 0; j < k; j++)
+        {
+            raw[j] = block + total;
+            total += (uint64_t)sizes[j];
+        }
+        if (TIFFReadRawStriles(tif, ids, k, raw, sizes, 65536) < 0)
+        {
+            ok = 0;
+            break;
+        }
+        for (started = 0; started < k; started++)
+        {
+            LJ92Task *t = &tasks[started];
+            const uint8_t *data = (const uint8_t *)raw[started];
+
+            memset(&t->report, 0, sizeof(t->report));
+            t->report.tif = tif;
+            t->report.deferred = 1;
+            t->layout = &layout;
+            t->buf = (uint8_t *)bufs[idx[started]];
+            t->lossless = _TIFFLJ92IsLossless(data, sizes[started]);
+            t->result = 0;
+            if (!t->lossless)
+                continue;
+            if (!lj92Prepare(tif, &t->d, tables, (tmsize_t)tables_size, data,
+                             sizes[started], &layout, t->buf))
+            {
+                ok = 0;
+                break;
+            }
+            if (!_TIFFThreadPoolSubmit(tif->tif_threadpool, LJ92DecodeTask,
+                                       t))
+                LJ92DecodeTask(t);
+        }
+        _TIFFThreadPoolWait(tif->tif_threadpool);
+        /* A failed preparation has reported its error and allocated nothing */
+        for (uint32_t j = 0; j < started; j++)
+        {
+            LJ92Task *t = &tasks[j];
+
+            if (!t->lossless)
+                continue;
+            lj92Release(tif, &t->d);
+            if (!ok)
+                continue;
+            if (t->report.msg[0] != '\0')
+            {
+                if (t->report.error)
+                    TIFFErrorExtR(tif, module, "Tile %" PRIu32 ": %s",
+                                  ids[j], t->report.msg);
+                else
+                    TIFFWarningExtR(tif, module, "Tile %" PRIu32 ": %s",
+                                    ids[j], t->report.msg);
+            }
+            if (!t->result)
+            {
+                ok = 0;
+                continue;
+            }
+            if (!_TIFFStrileChecksumVerify(tif, ids[j], t->buf, tilesize))
+                continue;
+            if (tif->tif_strilecache != NULL)
+                _TIFFStrileCacheInsert(tif, ids[j], t->buf, tilesize);
+            done[idx[j]] = 1;
+        }
+    }
+    _TIFFfreeExt(tif, block);
+    _TIFFfreeExt(tif, tasks);
+    return ok;
+}
+#endif /* TIFF_USE_THREADPOOL */
+
+#endif /* JPEG_SUPPORT */
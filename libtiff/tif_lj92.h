@@ -0,0 +1,45 @@
+#ifndef TIF_LJ92_H
+#define TIF_LJ92_H
+
+#include "tiffiop.h"
+
+/*
+ * Lossless JPEG (ITU-T T.81 process 14, SOF3) coder used by the JPEG codec,
+ * see tif_lj92.c.
+ */
+
+/*
+ * A strip or tile as libtiff lays it out: rows of width pixels of samples
+ * samples each, of bps bits, every row padded to rowsize bytes.
+ */
+typedef struct
+{
+    uint32_t width;
+    uint32_t rows;
+    uint16_t samples;
+    uint16_t bps;
+    tmsize_t rowsize;
+} LJ92Layout;
+
+#if defined(__cplusplus)
+extern "C"
+{
+#endif
+
+    extern int _TIFFLJ92IsLossless(const uint8_t *data, tmsize_t size);
+    extern int _TIFFLJ92Decode(TIFF *tif, const uint8_t *tables,
+                               tmsize_t tables_size, const uint8_t *data,
+                               tmsize_t size, const LJ92Layout *layout,
+                               uint8_t *buf);
+    extern int _TIFFLJ92Encode(TIFF *tif, const uint8_t *buf,
+                               const LJ92Layout *layout, int predictor,
+                               uint8_t **out, tmsize_t *out_size,
+                               tmsize_t *out_len);
+    extern int _TIFFLJ92ReadTiles(TIFF *tif, const uint32_t *tiles,
+                                  uint32_t n, void **bufs, int *done);
+
+#if defined(__cplusplus)
+}
+#endif
+
+#endif /* TIF_LJ92_H */
@@ -0,0 +1,542 @@
+#include "tiff_simd.h"
+#include "tiffiop.h"
+#ifdef LZ4_SUPPORT
+/*
+ * TIFF Library.
+ *
+ * LZ4 Compression Support
+ *
+ * Each strip or tile is stored as a single LZ4 block, without the LZ4 frame
+ * around it: the decompressed size is known from the strile geometry, and a
+ * whole strile is decoded with a single call straight into the caller's
+ * buffer, which is what lets LZ4 decode at memory speed.  Blocks are
+ * compressed either by the fast compressor, whose acceleration factor is
+ * TIFFTAG_LZ4_LEVEL, or by LZ4HC (TIFFTAG_LZ4_HC), slower to compress but
+ * as fast to decode.
+ *
+ * COMPRESSION_LZ4 is not registered: these files are meant to stay within
+ * the applications that write them, for instance as intermediate results.
+ */
+
+#include "lz4.h"
+#include "lz4hc.h"
+#include "tif_predict.h"
+
+#include <stdio.h>
+
+/*
+ * State block for each open TIFF file using LZ4 compression/decompression.
+ */
+typedef struct
+{
+    TIFFPredictorState predict;
+    int level;             /* acceleration, or LZ4HC level (0: default) */
+    int hc;                /* compress with LZ4HC */
+    void *cstate;          /* compression state */
+    int cstate_hc;         /* whether cstate is an LZ4HC one */
+    uint8_t *buffer;       /* strile gathered or decoded row by row */
+    tmsize_t buffer_size;  /* capacity of buffer */
+    tmsize_t buffer_len;   /* bytes in buffer */
+    tmsize_t buffer_pos;   /* bytes of buffer already returned */
+    int strile_start;      /* nothing decoded/encoded yet in the strile */
+    int state;             /* state flags */
+#define LSTATE_INIT_DECODE 0x01
+#define LSTATE_INIT_ENCODE 0x02
+
+    TIFFVGetMethod vgetparent; /* super-class method */
+    TIFFVSetMethod vsetparent; /* super-class method */
+} LZ4State;
+
+#define GetLZ4State(tif) ((LZ4State *)(tif)->tif_data)
+#define LZ4DecoderState(tif) GetLZ4State(tif)
+#define LZ4EncoderState(tif) GetLZ4State(tif)
+
+static int LZ4FixupTags(TIFF *tif)
+{
+    (void)tif;
+    return 1;
+}
+
+/*
+ * Make room for size bytes in the strile buffer, and at least for a whole
+ * strile, which rows are gathered in and decoded to.
+ */
+static int LZ4ReserveBuffer(TIFF *tif, LZ4State *sp, tmsize_t size)
+{
+    static const char module[] = "LZ4ReserveBuffer";
+    const tmsize_t strile_size =
+        isTiled(tif) ? TIFFTileSize(tif) : TIFFStripSize(tif);
+    uint8_t *buffer;
+
+    if (size < strile_size)
+        size = strile_size;
+    if (size <= sp->buffer_size)
+        return 1;
+    if (size > LZ4_MAX_INPUT_SIZE)
+    {
+        TIFFErrorExtR(tif, module,
+                      "LZ4 cannot deal with strips or tiles this size");
+        return 0;
+    }
+    buffer = (uint8_t *)_TIFFreallocExt(tif, sp->buffer, size);
+    if (buffer == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return 0;
+    }
+    sp->buffer = buffer;
+    sp->buffer_size = size;
+    return 1;
+}
+
+static int LZ4SetupDecode(TIFF *tif)
+{
+    LZ4State *sp = LZ4DecoderState(tif);
+
+    assert(sp != NULL);
+
+    /* if we were last encoding, terminate this mode */
+    if (sp->state & LSTATE_INIT_ENCODE)
+        sp->state = 0;
+
+    sp->state |= LSTATE_INIT_DECODE;
+    return 1;
+}
+
+/*
+ * Setup state for decoding a strip.
+ */
+static int LZ4PreDecode(TIFF *tif, uint16_t s)
+{
+    static const char module[] = "LZ4PreDecode";
+    LZ4State *sp = LZ4DecoderState(tif);
+
+    (void)s;
+    assert(sp != NULL);
+
+    if ((sp->state & LSTATE_INIT_DECODE) == 0)
+        tif->tif_setupdecode(tif);
+
+    if (tif->tif_rawcc > LZ4_MAX_INPUT_SIZE)
+    {
+        TIFFErrorExtR(tif, module, "LZ4 cannot deal with buffers this size");
+        return 0;
+    }
+    sp->strile_start = 1;
+    sp->buffer_len = 0;
+    sp->buffer_pos = 0;
+    return 1;
+}
+
+/*
+ * Decode rows: the whole strile is decoded in the strile buffer the first
+ * time, and the rows are copied from there.
+ */
+static int LZ4Decode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
+{
+    static const char module[] = "LZ4Decode";
+    LZ4State *sp = LZ4DecoderState(tif);
+    tmsize_t n;
+
+    (void)s;
+    assert(sp != NULL);
+    assert(sp->state == LSTATE_INIT_DECODE);
+
+    if (sp->strile_start)
+    {
+        int ret;
+
+        sp->strile_start = 0;
+        if (!LZ4ReserveBuffer(tif, sp, 0))
+        {
+            tiff_memset_u8(op, 0, (size_t)occ);
+            return 0;
+        }
+        ret = LZ4_decompress_safe((const char *)tif->tif_rawcp,
+                                  (char *)sp->buffer, (int)tif->tif_rawcc,
+                                  (int)sp->buffer_size);
+        if (ret < 0)
+        {
+            tiff_memset_u8(op, 0, (size_t)occ);
+            TIFFErrorExtR(tif, module,
+                          "Corrupted LZ4 data at scanline %" PRIu32,
+                          tif->tif_row);
+            return 0;
+        }
+        sp->buffer_len = ret;
+        tif->tif_rawcp += tif->tif_rawcc;
+        tif->tif_rawcc = 0;
+    }
+
+    n = sp->buffer_len - sp->buffer_pos;
+    if (n > occ)
+        n = occ;
+    _TIFFmemcpy(op, sp->buffer + sp->buffer_pos, n);
+    sp->buffer_pos += n;
+    if (n < occ)
+    {
+        tiff_memset_u8(op + n, 0, (size_t)(occ - n));
+        TIFFErrorExtR(tif, module,
+                      "Not enough data at scanline %" PRIu32
+                      " (short %" TIFF_SSIZE_FORMAT " bytes)",
+                      tif->tif_row, occ - n);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Decode a whole strip or tile, or the beginning of it, directly into the
+ * output.
+ */
+static int LZ4DecodeStrile(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
+{
+    static const char module[] = "LZ4DecodeStrile";
+    LZ4State *sp = LZ4DecoderState(tif);
+    int ret;
+
+    assert(sp != NULL);
+    assert(sp->state == LSTATE_INIT_DECODE);
+
+    if (!sp->strile_start)
+        return LZ4Decode(tif, op, occ, s);
+    if (occ > LZ4_MAX_INPUT_SIZE)
+    {
+        tiff_memset_u8(op, 0, (size_t)occ);
+        TIFFErrorExtR(tif, module, "LZ4 cannot deal with buffers this size");
+        return 0;
+    }
+
+    sp->strile_start = 0;
+    ret = LZ4_decompress_safe_partial((const char *)tif->tif_rawcp,
+                                      (char *)op, (int)tif->tif_rawcc,
+                                      (int)occ, (int)occ);
+    if (ret < 0)
+    {
+        tiff_memset_u8(op, 0, (size_t)occ);
+        TIFFErrorExtR(tif, module, "Corrupted LZ4 data at scanline %" PRIu32,
+                      tif->tif_row);
+        return 0;
+    }
+    if (ret < occ)
+    {
+        tiff_memset_u8(op + ret, 0, (size_t)(occ - ret));
+        TIFFErrorExtR(tif, module,
+                      "Not enough data at scanline %" PRIu32
+                      " (short %" TIFF_SSIZE_FORMAT " bytes)",
+                      tif->tif_row, occ - ret);
+        return 0;
+    }
+    tif->tif_rawcp += tif->tif_rawcc;
+    tif->tif_rawcc = 0;
+    return 1;
+}
+
+static int LZ4SetupEncode(TIFF *tif)
+{
+    LZ4State *sp = LZ4EncoderState(tif);
+
+    assert(sp != NULL);
+    if (sp->state & LSTATE_INIT_DECODE)
+        sp->state = 0;
+
+    sp->state |= LSTATE_INIT_ENCODE;
+    return 1;
+}
+
+/*
+ * Reset encoding state at the start of a strip.
+ */
+static int LZ4PreEncode(TIFF *tif, uint16_t s)
+{
+    static const char module[] = "LZ4PreEncode";
+    LZ4State *sp = LZ4EncoderState(tif);
+
+    (void)s;
+    assert(sp != NULL);
+    if (sp->state != LSTATE_INIT_ENCODE)
+        tif->tif_setupencode(tif);
+
+    if (sp->cstate == NULL || sp->cstate_hc != sp->hc)
+    {
+        _TIFFfreeExt(tif, sp->cstate);
+        sp->cstate = _TIFFmallocExt(
+            tif, sp->hc ? LZ4_sizeofStateHC() : LZ4_sizeofState());
+        if (sp->cstate == NULL)
+        {
+            TIFFErrorExtR(tif, module, "Cannot allocate compression state");
+            return 0;
+        }
+        sp->cstate_hc = sp->hc;
+    }
+    sp->strile_start = 1;
+    sp->buffer_len = 0;
+    return 1;
+}
+
+/*
+ * Compress a whole strile, directly into the raw data buffer if it has
+ * room for the worst case, as it has unless set up by the application.
+ */
+static int LZ4CompressStrile(TIFF *tif, const uint8_t *bp, tmsize_t cc)
+{
+    static const char module[] = "LZ4CompressStrile";
+    LZ4State *sp = LZ4EncoderState(tif);
+    tmsize_t bound, room;
+    uint8_t *dst;
+    int ret;
+
+    if (cc > LZ4_MAX_INPUT_SIZE)
+    {
+        TIFFErrorExtR(tif, module, "LZ4 cannot deal with buffers this size");
+        return 0;
+    }
+    bound = LZ4_compressBound((int)cc);
+    room = tif->tif_rawdatasize - tif->tif_rawcc;
+    if (room >= bound)
+        dst = tif->tif_rawcp;
+    else
+    {
+        dst = (uint8_t *)_TIFFmallocExt(tif, bound);
+        if (dst == NULL)
+        {
+            TIFFErrorExtR(tif, module, "Out of memory");
+            return 0;
+        }
+    }
+
+    if (sp->hc)
+        ret = LZ4_compress_HC_extStateHC(sp->cstate, (const char *)bp,
+                                         (char *)dst, (int)cc, (int)bound,
+                                         sp->level);
+    else
+        ret = LZ4_compress_fast_extState(sp->cstate, (const char *)bp,
+                                         (char *)dst, (int)cc, (int)bound,
+                                         sp->level);
+    if (ret <= 0)
+    {
+        TIFFErrorExtR(tif, module,
+                      "LZ4 compression failed at scanline %" PRIu32,
+                      tif->tif_row);
+        if (dst != tif->tif_rawcp)
+            _TIFFfreeExt(tif, dst);
+        return 0;
+    }
+
+    if (dst == tif->tif_rawcp)
+    {
+        tif->tif_rawcp += ret;
+        tif->tif_rawcc += ret;
+    }
+    else
+    {
+        const uint8_t *src = dst;
+        tmsize_t left = ret;
+        while (left > 0)
+        {
+            tmsize_t n = tif->tif_rawdatasize - tif->tif_rawcc;
+            if (n > left)
+                n = left;
+            _TIFFmemcpy(tif->tif_rawcp, src, n);
+            tif->tif_rawcp += n;
+            tif->tif_rawcc += n;
+            src += n;
+            left -= n;
+            if (tif->tif_rawcc == tif->tif_rawdatasize && !TIFFFlushData1(tif))
+            {
+                _TIFFfreeExt(tif, dst);
+                return 0;
+            }
+        }
+        _TIFFfreeExt(tif, dst);
+    }
+    return 1;
+}
+
+/*
+ * Encode a chunk of pixels: rows are gathered in the strile buffer until
+ * the strile is complete.
+ */
+static int LZ4Encode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
+{
+    LZ4State *sp = LZ4EncoderState(tif);
+
+    assert(sp != NULL);
+    assert(sp->state == LSTATE_INIT_ENCODE);
+
+    (void)s;
+    if (cc > TIFF_TMSIZE_T_MAX - sp->buffer_len ||
+        !LZ4ReserveBuffer(tif, sp, sp->buffer_len + cc))
+        return 0;
+    _TIFFmemcpy(sp->buffer + sp->buffer_len, bp, cc);
+    sp->buffer_len += cc;
+    return 1;
+}
+
+/*
+ * Encode a whole strip or tile, compressed at once from the caller's data.
+ */
+static int LZ4EncodeStrile(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
+{
+    LZ4State *sp = LZ4EncoderState(tif);
+
+    assert(sp != NULL);
+    assert(sp->state == LSTATE_INIT_ENCODE);
+
+    if (!sp->strile_start || sp->buffer_len > 0)
+        return LZ4Encode(tif, bp, cc, s);
+    sp->strile_start = 0;
+    return LZ4CompressStrile(tif, bp, cc);
+}
+
+/*
+ * Finish off an encoded strip by compressing the rows gathered.
+ */
+static int LZ4PostEncode(TIFF *tif)
+{
+    LZ4State *sp = LZ4EncoderState(tif);
+
+    if (sp->strile_start || sp->buffer_len > 0)
+    {
+        sp->strile_start = 0;
+        if (!LZ4CompressStrile(tif, sp->buffer, sp->buffer_len))
+            return 0;
+        sp->buffer_len = 0;
+    }
+    return 1;
+}
+
+static void LZ4Cleanup(TIFF *tif)
+{
+    LZ4State *sp = GetLZ4State(tif);
+
+    assert(sp != 0);
+
+    (void)TIFFPredictorCleanup(tif);
+
+    tif->tif_tagmethods.vgetfield = sp->vgetparent;
+    tif->tif_tagmethods.vsetfield = sp->vsetparent;
+
+    _TIFFfreeExt(tif, sp->cstate);
+    _TIFFfreeExt(tif, sp->buffer);
+    _TIFFfreeExt(tif, sp);
+    tif->tif_data = NULL;
+
+    _TIFFSetDefaultCompressionState(tif);
+}
+
+static int LZ4VSetField(TIFF *tif, uint32_t tag, va_list ap)
+{
+    static const char module[] = "LZ4VSetField";
+    LZ4State *sp = GetLZ4State(tif);
+
+    switch (tag)
+    {
+        case TIFFTAG_LZ4_LEVEL:
+            sp->level = (int)va_arg(ap, int);
+            if (sp->level < 0)
+            {
+                TIFFErrorExtR(tif, module, "Invalid LZ4_LEVEL value: %d",
+                              sp->level);
+                sp->level = 0;
+                return 0;
+            }
+            return 1;
+        case TIFFTAG_LZ4_HC:
+            sp->hc = (int)va_arg(ap, int) != 0;
+            return 1;
+        default:
+            return (*sp->vsetparent)(tif, tag, ap);
+    }
+    /*NOTREACHED*/
+}
+
+static int LZ4VGetField(TIFF *tif, uint32_t tag, va_list ap)
+{
+    LZ4State *sp = GetLZ4State(tif);
+
+    switch (tag)
+    {
+        case TIFFTAG_LZ4_LEVEL:
+            *va_arg(ap, int *) = sp->level;
+            break;
+        case TIFFTAG_LZ4_HC:
+            *va_arg(ap, int *) = sp->hc;
+            break;
+        default:
+            return (*sp->vgetparent)(tif, tag, ap);
+    }
+    return 1;
+}
+
+static const TIFFField LZ4Fields[] = {
+    {TIFFTAG_LZ4_LEVEL, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO, TRUE,
+     FALSE, "LZ4 level", NULL},
+    {TIFFTAG_LZ4_HC, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO, TRUE,
+     FALSE, "LZ4 HC", NULL},
+};
+
+int TIFFInitLZ4(TIFF *tif, int scheme)
+{
+    static const char module[] = "TIFFInitLZ4";
+    LZ4State *sp;
+
+    (void)scheme;
+    assert(scheme == COMPRESSION_LZ4);
+
+    /*
+     * Merge codec-specific tag information.
+     */
+    if (!_TIFFMergeFields(tif, LZ4Fields, TIFFArrayCount(LZ4Fields)))
+    {
+        TIFFErrorExtR(tif, module, "Merging LZ4 codec-specific tags failed");
+        return 0;
+    }
+
+    /*
+     * Allocate state block so tag methods have storage to record values.
+     */
+    tif->tif_data = (uint8_t *)_TIFFcallocExt(tif, 1, sizeof(LZ4State));
+    if (tif->tif_data == NULL)
+        goto bad;
+    sp = GetLZ4State(tif);
+
+    /*
+     * Override parent get/set field methods.
+     */
+    sp->vgetparent = tif->tif_tagmethods.vgetfield;
+    tif->tif_tagmethods.vgetfield = LZ4VGetField; /* hook for codec tags */
+    sp->vsetparent = tif->tif_tagmethods.vsetfield;
+    tif->tif_tagmethods.vsetfield = LZ4VSetField; /* hook for codec tags */
+
+    /* Default values for codec-specific fields */
+    sp->level = 0; /* acceleration 1, or LZ4HC level 9 */
+    sp->hc = 0;
+    sp->state = 0;
+
+    /*
+     * Install codec methods.
+     */
+    tif->tif_fixuptags = LZ4FixupTags;
+    tif->tif_setupdecode = LZ4SetupDecode;
+    tif->tif_predecode = LZ4PreDecode;
+    tif->tif_decoderow = LZ4Decode;
+    tif->tif_decodestrip = LZ4DecodeStrile;
+    tif->tif_decodetile = LZ4DecodeStrile;
+    tif->tif_setupencode = LZ4SetupEncode;
+    tif->tif_preencode = LZ4PreEncode;
+    tif->tif_postencode = LZ4PostEncode;
+    tif->tif_encoderow = LZ4Encode;
+    tif->tif_encodestrip = LZ4EncodeStrile;
+    tif->tif_encodetile = LZ4EncodeStrile;
+    tif->tif_cleanup = LZ4Cleanup;
+    /*
+     * Setup predictor setup.
+     */
+    (void)TIFFPredictorInit(tif);
+    return 1;
+bad:
+    TIFFErrorExtR(tif, module, "No space for LZ4 state block");
+    return 0;
+}
+#endif /* LZ4_SUPPORT */
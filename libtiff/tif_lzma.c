@@ -53,6 +53,7 @@ typedef struct
     lzma_options_lzma opt_lzma;   /* LZMA2 filter options */
     int preset;                   /* compression level */
     lzma_check check;             /* type of the integrity check */
+    int threads;                  /* coder threads (0 or 1: none) */
     int state;                    /* state flags */
 #define LSTATE_INIT_DECODE 0x01
 #define LSTATE_INIT_ENCODE 0x02
@@ -61,6 +62,12 @@ typedef struct
     TIFFVSetMethod vsetparent; /* super-class method */
 } LZMAState;
 
+/*
+ * Smallest block cut by the multi-threaded encoder: each block is
+ * compressed independently, so smaller ones would cost too much ratio.
+ */
+#define LZMA_MT_MIN_BLOCK (1024 * 1024)
+
 #define GetLZMAState(tif) ((LZMAState *)(tif)->tif_data)
 #define LZMADecoderState(tif) GetLZMAState(tif)
 #define LZMAEncoderState(tif) GetLZMAState(tif)
@@ -101,6 +108,54 @@ static const char *LZMAStrerror(lzma_ret ret)
     }
 }
 
+/*
+ * Start a stream decoder.  With several threads, the blocks of streams
+ * written by the multi-threaded encoder are decoded in parallel.
+ */
+static lzma_ret LZMAStartDecoder(LZMAState *sp)
+{
+#ifdef HAVE_LZMA_STREAM_DECODER_MT
+    if (sp->threads > 1)
+    {
+        lzma_mt mt;
+        memset(&mt, 0, sizeof(mt));
+        mt.threads = (uint32_t)sp->threads;
+        mt.memlimit_threading = (uint64_t)-1;
+        mt.memlimit_stop = (uint64_t)-1;
+        return lzma_stream_decoder_mt(&sp->stream, &mt);
+    }
+#endif
+    return lzma_stream_decoder(&sp->stream, (uint64_t)-1, 0);
+}
+
+/*
+ * Start a stream encoder.  With several threads, the strip or tile is cut
+ * in one block per thread, of at least LZMA_MT_MIN_BLOCK bytes, and the
+ * blocks are compressed in parallel.
+ */
+static lzma_ret LZMAStartEncoder(TIFF *tif, LZMAState *sp)
+{
+#ifdef HAVE_LZMA_STREAM_ENCODER_MT
+    if (sp->threads > 1)
+    {
+        uint64_t strile =
+            isTiled(tif) ? TIFFTileSize64(tif) : TIFFStripSize64(tif);
+        lzma_mt mt;
+        memset(&mt, 0, sizeof(mt));
+        mt.threads = (uint32_t)sp->threads;
+        mt.block_size = (strile + mt.threads - 1) / mt.threads;
+        if (mt.block_size < LZMA_MT_MIN_BLOCK)
+            mt.block_size = LZMA_MT_MIN_BLOCK;
+        mt.filters = sp->filters;
+        mt.check = sp->check;
+        return lzma_stream_encoder_mt(&sp->stream, &mt);
+    }
+#else
+    (void)tif;
+#endif
+    return lzma_stream_encoder(&sp->stream, sp->filters, sp->check);
+}
+
 static int LZMAFixupTags(TIFF *tif)
 {
     (void)tif;
@@ -152,7 +207,7 @@ static int LZMAPreDecode(TIFF *tif, uint16_t s)
      * Disable memory limit when decoding. UINT64_MAX is a flag to disable
      * the limit, we are passing (uint64_t)-1 which should be the same.
      */
-    ret = lzma_stream_decoder(&sp->stream, (uint64_t)-1, 0);
+    ret = LZMAStartDecoder(sp);
     if (ret != LZMA_OK)
     {
         TIFFErrorExtR(tif, module, "Error initializing the stream decoder, %s",
@@ -294,7 +349,7 @@ static int LZMAPreEncode(TIFF *tif, uint16_t s)
                       "Liblzma cannot deal with buffers this size");
         return 0;
     }
-    ret = lzma_stream_encoder(&sp->stream, sp->filters, sp->check);
+    ret = LZMAStartEncoder(tif, sp);
     if (ret != LZMA_OK)
     {
         TIFFErrorExtR(tif, module, "Error in lzma_stream_encoder(): %s",
@@ -459,6 +514,22 @@ static int LZMAVSetField(TIFF *tif, uint32_t tag, va_list ap)
                 }
             }
             return 1;
+        case TIFFTAG_LZMATHREADS:
+            sp->threads = (int)va_arg(ap, int);
+            if (sp->threads < 0)
+            {
+                TIFFErrorExtR(tif, module, "Invalid LZMATHREADS value: %d",
+                              sp->threads);
+                sp->threads = 0;
+                return 0;
+            }
+#ifndef HAVE_LZMA_STREAM_ENCODER_MT
+            if (sp->threads > 1)
+                TIFFWarningExtR(tif, module,
+                                "liblzma built without multi-threading "
+                                "support: LZMATHREADS ignored");
+#endif
+            return 1;
         default:
             return (*sp->vsetparent)(tif, tag, ap);
     }
@@ -474,6 +545,9 @@ static int LZMAVGetField(TIFF *tif, uint32_t tag, va_list ap)
         case TIFFTAG_LZMAPRESET:
             *va_arg(ap, int *) = sp->preset;
             break;
+        case TIFFTAG_LZMATHREADS:
+            *va_arg(ap, int *) = sp->threads;
+            break;
         default:
             return (*sp->vgetparent)(tif, tag, ap);
     }
@@ -483,6 +557,8 @@ static int LZMAVGetField(TIFF *tif, uint32_t tag, va_list ap)
 static const TIFFField lzmaFields[] = {
     {TIFFTAG_LZMAPRESET, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO, TRUE,
      FALSE, "LZMA2 Compression Preset", NULL},
+    {TIFFTAG_LZMATHREADS, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
+     TRUE, FALSE, "LZMA2 Threads", NULL},
 };
 
 int TIFFInitLZMA(TIFF *tif, int scheme)
@@ -523,6 +599,7 @@ int TIFFInitLZMA(TIFF *tif, int scheme)
     /* Default values for codec-specific fields */
     sp->preset = LZMA_PRESET_DEFAULT; /* default comp. level */
     sp->check = LZMA_CHECK_NONE;
+    sp->threads = 0;
     sp->state = 0;
 
     /* Data filters. So far we are using delta and LZMA2 filters only. */
@@ -73,8 +73,8 @@ typedef size_t WordType;
 #define CODE_EOI 257   /* end-of-information code */
 #define CODE_FIRST 258 /* first free code entry */
 #define CODE_MAX MAXCODE(BITS_MAX)
-#define HSIZE 9001L /* 91% occupancy */
-#define HSHIFT (13 - 8)
+#define HBITS 13
+#define HSIZE (1L << HBITS) /* under 50% occupancy */
 #ifdef LZW_COMPAT
 /* NB: +1024 is for compatibility with old files */
 #define CSIZE (MAXCODE(BITS_MAX) + 1024L)
@@ -110,11 +110,24 @@ typedef struct
  * Encoding-specific state.
  */
 typedef uint16_t hcode_t; /* codes fit in 16 bits */
-typedef struct
-{
-    long hash;
-    hcode_t code;
-} hash_t;
+/*
+ * A hash table entry packs, from the most significant bits down, the
+ * generation of the table it was added in (HGEN_BITS), the prefix code
+ * and next character it stands for (BITS_MAX + 8 bits), its code
+ * (BITS_MAX bits) and the hash of that code as a prefix (HBITS), which
+ * saves recomputing it for the next lookup.  Entries of older
+ * generations are free, so bumping the generation empties the table.
+ */
+typedef uint64_t hash_t;
+#define HGEN_BITS (64 - (BITS_MAX + 8) - BITS_MAX - HBITS)
+#define HGEN(gen) ((uint64_t)(gen) << (BITS_MAX + 8))
+#define HCODE_MASK ((1 << BITS_MAX) - 1)
+/* Consecutive codes must not fill consecutive entries */
+#define HASH_PREFIX(code) (((unsigned int)(code) * 5) & (HSIZE - 1))
+#define HASH_CHAR(c) (((uint32_t)(c) * 2654435761U) >> (32 - HBITS))
+#define HENTRY(key, code)                                                      \
+    (((key) << (BITS_MAX + HBITS)) | ((hash_t)(code) << HBITS) |              \
+     HASH_PREFIX(code))
 
 /*
  * Decoding-specific state.
@@ -129,6 +142,20 @@ typedef struct code_ent
     bool repeated;
 } code_t;
 
+/*
+ * Flat string table of LZWDecode(): rather than being chained to its prefix,
+ * the string of a code is found in the data already decoded, length bytes
+ * at position pos from the start of the strip or tile.
+ */
+typedef struct
+{
+    tmsize_t pos;
+    uint16_t length;
+    uint8_t firstchar;
+    uint8_t lastchar;
+    uint8_t repeated; /* all bytes of the string are the same */
+} lzw_string_t;
+
 typedef int (*decodeFunc)(TIFF *, uint8_t *, tmsize_t, uint16_t);
 
 typedef struct
@@ -149,6 +176,20 @@ typedef struct
     code_t *dec_codetab;    /* kept separate for small machines */
     int read_error; /* whether a read error has occurred, and which should cause
                        further reads in the same strip/tile to be aborted */
+    lzw_string_t *dec_strtab;  /* string table of LZWDecode() */
+    lzw_string_t dec_old;      /* string of the previous code */
+    long dec_free_ent;         /* next free entry, -1 when the table is full */
+    long dec_maxcode;          /* last entry before the code width grows */
+    uint64_t dec_bitbuf;       /* bits read ahead, most significant first */
+    tmsize_t dec_outpos;       /* bytes of the strip/tile decoded so far */
+    tmsize_t dec_strilesize;   /* decoded size of the strip/tile */
+    tmsize_t dec_clearpos;     /* position of the last CODE_CLEAR */
+    tmsize_t dec_restart_pos;  /* position of the rest of a string */
+    uint8_t dec_restart_last;  /* last byte of that string */
+    uint8_t *dec_hist;         /* output of previous calls, from the */
+    tmsize_t dec_hist_alloc;   /* last CODE_CLEAR onwards, when the */
+    tmsize_t dec_hist_start;   /* strip/tile is decoded in several calls */
+    tmsize_t dec_hist_end;
 
     /* Encoding specific data */
     int enc_oldcode;         /* last code encountered */
@@ -159,6 +200,7 @@ typedef struct
     tmsize_t enc_outcount;   /* encoded (output) bytes */
     uint8_t *enc_rawlimit;   /* bound on tif_rawdata buffer */
     hash_t *enc_hashtab;     /* kept separate for small machines */
+    uint32_t enc_generation; /* generation of enc_hashtab entries in use */
 } LZWCodecState;
 
 #define LZWState(tif) ((LZWBaseState *)(tif)->tif_data)
@@ -201,6 +243,9 @@ static int LZWSetupDecode(TIFF *tif)
 
         sp = LZWDecoderState(tif);
         sp->dec_codetab = NULL;
+        sp->dec_strtab = NULL;
+        sp->dec_hist = NULL;
+        sp->dec_hist_alloc = 0;
         sp->dec_decode = NULL;
 
         /*
@@ -236,6 +281,16 @@ static int LZWSetupDecode(TIFF *tif)
         memset(&sp->dec_codetab[CODE_CLEAR], 0,
                (CODE_FIRST - CODE_CLEAR) * sizeof(code_t));
     }
+    if (sp->dec_strtab == NULL)
+    {
+        sp->dec_strtab =
+            (lzw_string_t *)_TIFFcallocExt(tif, CSIZE, sizeof(lzw_string_t));
+        if (sp->dec_strtab == NULL)
+        {
+            TIFFErrorExtR(tif, module, "No space for LZW code table");
+            return (0);
+        }
+    }
     return (1);
 }
 
@@ -249,10 +304,10 @@ static int LZWPreDecode(TIFF *tif, uint16_t s)
 
     (void)s;
     assert(sp != NULL);
-    if (sp->dec_codetab == NULL)
+    if (sp->dec_codetab == NULL || sp->dec_strtab == NULL)
     {
         tif->tif_setupdecode(tif);
-        if (sp->dec_codetab == NULL)
+        if (sp->dec_codetab == NULL || sp->dec_strtab == NULL)
             return (0);
     }
 
@@ -317,6 +372,32 @@ static int LZWPreDecode(TIFF *tif, uint16_t s)
      */
     sp->dec_oldcodep = &sp->dec_codetab[0];
     sp->dec_maxcodep = &sp->dec_codetab[sp->dec_nbitsmask - 1];
+
+    /* Same initial state for LZWDecode(), which requires a CODE_CLEAR first */
+    sp->dec_free_ent = -1;
+    sp->dec_maxcode = MAXCODE(BITS_MIN) - 1;
+    sp->dec_bitbuf = 0;
+    memset(&sp->dec_old, 0, sizeof(sp->dec_old));
+    sp->dec_old.length = 1;
+    sp->dec_outpos = 0;
+    sp->dec_clearpos = 0;
+    sp->dec_hist_start = 0;
+    sp->dec_hist_end = 0;
+    if (isTiled(tif))
+    {
+        sp->dec_strilesize = TIFFTileSize(tif);
+    }
+    else
+    {
+        TIFFDirectory *td = &tif->tif_dir;
+        uint32_t rows = td->td_rowsperstrip;
+        if (rows > td->td_imagelength - tif->tif_row)
+            rows = td->td_imagelength - tif->tif_row;
+        sp->dec_strilesize = TIFFVStripSize(tif, rows);
+    }
+    /* Unknown: keep the output of every call */
+    if (sp->dec_strilesize == 0)
+        sp->dec_strilesize = TIFF_TMSIZE_T_MAX;
     sp->read_error = 0;
     return (1);
 }
@@ -325,100 +406,179 @@ static int LZWPreDecode(TIFF *tif, uint16_t s)
  * Decode a "hunk of data".
  */
 
-/* Get the next 32 or 64-bit from the input data */
+/* Get the next 64 bits of the input data, most significant byte first */
 #ifdef WORDS_BIGENDIAN
-#define GetNextData(nextdata, bp) memcpy(&nextdata, bp, sizeof(nextdata))
-#elif SIZEOF_WORDTYPE == 8
-#if defined(_M_X64)
-#define GetNextData(nextdata, bp) nextdata = _byteswap_uint64(*(uint64_t *)(bp))
+#define GetNextData64(nextdata, bp) memcpy(&nextdata, bp, 8)
+#elif defined(_MSC_VER)
+#define GetNextData64(nextdata, bp)                                            \
+    memcpy(&nextdata, bp, 8);                                                  \
+    nextdata = _byteswap_uint64(nextdata)
 #elif defined(__GNUC__)
-#define GetNextData(nextdata, bp)                                              \
-    memcpy(&nextdata, bp, sizeof(nextdata));                                   \
+#define GetNextData64(nextdata, bp)                                            \
+    memcpy(&nextdata, bp, 8);                                                  \
     nextdata = __builtin_bswap64(nextdata)
 #else
-#define GetNextData(nextdata, bp)                                              \
+#define GetNextData64(nextdata, bp)                                            \
     nextdata = (((uint64_t)bp[0]) << 56) | (((uint64_t)bp[1]) << 48) |         \
                (((uint64_t)bp[2]) << 40) | (((uint64_t)bp[3]) << 32) |         \
                (((uint64_t)bp[4]) << 24) | (((uint64_t)bp[5]) << 16) |         \
                (((uint64_t)bp[6]) << 8) | (((uint64_t)bp[7]))
 #endif
-#elif SIZEOF_WORDTYPE == 4
-#if defined(_M_X86)
-#define GetNextData(nextdata, bp)                                              \
-    nextdata = _byteswap_ulong(*(unsigned long *)(bp))
-#elif defined(__GNUC__)
-#define GetNextData(nextdata, bp)                                              \
-    memcpy(&nextdata, bp, sizeof(nextdata));                                   \
-    nextdata = __builtin_bswap32(nextdata)
-#else
-#define GetNextData(nextdata, bp)                                              \
-    nextdata = (((uint32_t)bp[0]) << 24) | (((uint32_t)bp[1]) << 16) |         \
-               (((uint32_t)bp[2]) << 8) | (((uint32_t)bp[3]))
-#endif
-#else
-#error "Unhandled SIZEOF_WORDTYPE"
-#endif
 
+/*
+ * Codes are read from bitbuf, whose bitcount most significant bits are
+ * valid. When it runs low, it is topped up to at least 56 bits with a single
+ * 64-bit load, which is enough for four 12-bit codes. The bits loaded past
+ * the counted bytes are those the next refill ORs in again.
+ */
 #define GetNextCodeLZW()                                                       \
     do                                                                         \
     {                                                                          \
-        nextbits -= nbits;                                                     \
-        if (nextbits < 0)                                                      \
+        if (bitcount < nbits)                                                  \
         {                                                                      \
-            if (dec_bitsleft >= 8 * SIZEOF_WORDTYPE)                           \
+            if (bpend - bp >= 8)                                               \
             {                                                                  \
-                unsigned codetmp = (unsigned)(nextdata << (-nextbits));        \
-                GetNextData(nextdata, bp);                                     \
-                bp += SIZEOF_WORDTYPE;                                         \
-                nextbits += 8 * SIZEOF_WORDTYPE;                               \
-                dec_bitsleft -= 8 * SIZEOF_WORDTYPE;                           \
-                code = (WordType)((codetmp | (nextdata >> nextbits)) &         \
-                                  nbitsmask);                                  \
-                break;                                                         \
+                uint64_t nextdata;                                             \
+                GetNextData64(nextdata, bp);                                   \
+                bitbuf |= nextdata >> bitcount;                                \
+                bp += (63 - bitcount) >> 3;                                    \
+                bitcount |= 56;                                                \
             }                                                                  \
             else                                                               \
             {                                                                  \
-                if (dec_bitsleft < 8)                                          \
+                while (bitcount <= 56 && bp < bpend)                           \
                 {                                                              \
-                    goto no_eoi;                                               \
-                }                                                              \
-                nextdata = (nextdata << 8) | *(bp)++;                          \
-                nextbits += 8;                                                 \
-                dec_bitsleft -= 8;                                             \
-                if (nextbits < 0)                                              \
-                {                                                              \
-                    if (dec_bitsleft < 8)                                      \
-                    {                                                          \
-                        goto no_eoi;                                           \
-                    }                                                          \
-                    nextdata = (nextdata << 8) | *(bp)++;                      \
-                    nextbits += 8;                                             \
-                    dec_bitsleft -= 8;                                         \
+                    bitbuf |= (uint64_t)*bp++ << (56 - bitcount);              \
+                    bitcount += 8;                                             \
                 }                                                              \
+                if (bitcount < nbits)                                          \
+                    goto no_eoi;                                               \
+            }                                                                  \
+        }                                                                      \
+        code = (unsigned)(bitbuf >> (64 - nbits));                             \
+        bitbuf <<= nbits;                                                      \
+        bitcount -= nbits;                                                     \
+    } while (0)
+
+/*
+ * Register a new code, whose string is the one of the previous code followed
+ * by the first byte of the current one, and grow the code width when needed.
+ */
+#define AddStringLZW(lastc)                                                    \
+    do                                                                         \
+    {                                                                          \
+        lzw_string_t *nextp = &dec_strtab[free_ent];                           \
+        nextp->pos = old.pos;                                                  \
+        nextp->length = (uint16_t)(old.length + 1);                            \
+        nextp->firstchar = old.firstchar;                                      \
+        nextp->lastchar = (lastc);                                             \
+        nextp->repeated =                                                      \
+            (uint8_t)(old.repeated & (old.lastchar == nextp->lastchar));       \
+        if (++free_ent > maxcode)                                              \
+        {                                                                      \
+            /* should not happen for a conformant encoder */                   \
+            if (++nbits > BITS_MAX)                                            \
+                nbits = BITS_MAX;                                              \
+            maxcode = MAXCODE(nbits) - 1;                                      \
+            if (free_ent >= CSIZE)                                             \
+            {                                                                  \
+                /* At that point, the next valid states are either EOI or */  \
+                /* a CODE_CLEAR. If a regular code is read, at the next */    \
+                /* attempt at registering a new entry, we will error out */   \
+                free_ent = -1;                                                 \
             }                                                                  \
         }                                                                      \
-        code = (WordType)((nextdata >> nextbits) & nbitsmask);                 \
     } while (0)
 
+/*
+ * Copy n bytes of the strip or tile output, starting at position pos, to
+ * dst. Those bytes precede dst: they either are in the output of the current
+ * call, which starts at position base in op0, or were saved by a previous one
+ * in dec_hist.
+ */
+static int LZWCopyOutput(LZWCodecState *sp, uint8_t *dst, tmsize_t pos,
+                         tmsize_t n, const uint8_t *op0, tmsize_t base)
+{
+    if (pos < base)
+    {
+        tmsize_t k = base - pos;
+
+        if (k > n)
+            k = n;
+        if (pos < sp->dec_hist_start || pos + k > sp->dec_hist_end)
+            return 0;
+        memcpy(dst, sp->dec_hist + (pos - sp->dec_hist_start), (size_t)k);
+        dst += k;
+        pos += k;
+        n -= k;
+    }
+    if (n > 0)
+        memcpy(dst, op0 + (pos - base), (size_t)n);
+    return 1;
+}
+
+/*
+ * Keep the output of the current call that codes may still refer to, that is
+ * what follows the last CODE_CLEAR, when more of the strip or tile is to be
+ * decoded by another call.
+ */
+static int LZWSaveOutput(TIFF *tif, LZWCodecState *sp, const uint8_t *op0,
+                         tmsize_t base, tmsize_t end)
+{
+    tmsize_t from = base;
+    tmsize_t size;
+
+    if (sp->dec_clearpos > sp->dec_hist_start)
+    {
+        /* A CODE_CLEAR in this call made the older output useless */
+        sp->dec_hist_start = sp->dec_clearpos;
+        sp->dec_hist_end = sp->dec_clearpos;
+        from = sp->dec_clearpos;
+    }
+    if (sp->dec_hist_end != from)
+        return 0;
+    size = end - sp->dec_hist_start;
+    if (size > sp->dec_hist_alloc)
+    {
+        tmsize_t alloc = sp->dec_hist_alloc * 2;
+        uint8_t *hist;
+
+        if (alloc < size)
+            alloc = size;
+        hist = (uint8_t *)_TIFFreallocExt(tif, sp->dec_hist, alloc);
+        if (hist == NULL)
+            return 0;
+        sp->dec_hist = hist;
+        sp->dec_hist_alloc = alloc;
+    }
+    memcpy(sp->dec_hist + (from - sp->dec_hist_start), op0 + (from - base),
+           (size_t)(end - from));
+    sp->dec_hist_end = end;
+    return 1;
+}
+
 static int LZWDecode(TIFF *tif, uint8_t *op0, tmsize_t occ0, uint16_t s)
 {
     static const char module[] = "LZWDecode";
     LZWCodecState *sp = LZWDecoderState(tif);
-    uint8_t *op = (uint8_t *)op0;
-    tmsize_t occ = occ0;
-    size_t occ_initial = (size_t)occ0;
-    uint8_t *bp;
-    long nbits, nextbits, nbitsmask;
-    WordType nextdata;
-    code_t *free_entp, *maxcodep, *oldcodep;
+    uint8_t *op = op0;
+    uint8_t *const opend = op0 + occ0;
+    const tmsize_t base = sp->dec_outpos;
+    const uint8_t *bp;
+    const uint8_t *bpend;
+    uint64_t bitbuf;
+    int bitcount, nbits;
+    long free_ent, maxcode;
+    lzw_string_t old;
+    unsigned code;
 
     (void)s;
     assert(sp != NULL);
-    assert(sp->dec_codetab != NULL);
+    assert(sp->dec_strtab != NULL);
 
     if (sp->read_error)
     {
-        tiff_memset_u8(op, 0, (size_t)occ);
+        tiff_memset_u8(op, 0, (size_t)occ0);
         TIFFErrorExtR(tif, module,
                       "LZWDecode: Scanline %" PRIu32 " cannot be read due to "
                       "previous error",
@@ -426,338 +586,191 @@ static int LZWDecode(TIFF *tif, uint8_t *op0, tmsize_t occ0, uint16_t s)
         return 0;
     }
 
+    bp = tif->tif_rawcp;
+    bpend = bp + tif->tif_rawcc;
+    bitbuf = sp->dec_bitbuf;
+    bitcount = (int)sp->lzw_nextbits;
+    nbits = sp->lzw_nbits;
+    free_ent = sp->dec_free_ent;
+    maxcode = sp->dec_maxcode;
+    old = sp->dec_old;
+    lzw_string_t *const dec_strtab = sp->dec_strtab;
+
     /*
      * Restart interrupted output operation.
      */
     if (sp->dec_restart)
     {
-        tmsize_t residue;
+        /* All but the last byte of the string come from earlier output */
+        tmsize_t residue = sp->dec_restart - 1;
 
-        code_t *codep = sp->dec_codep;
-        residue = codep->length - sp->dec_restart;
-        if (residue > occ)
-        {
-            /*
-             * Residue from previous decode is sufficient
-             * to satisfy decode request.  Skip to the
-             * start of the decoded string, place decoded
-             * values in the output buffer, and return.
-             */
-            sp->dec_restart += occ;
-            do
-            {
-                codep = codep->next;
-            } while (--residue > occ && codep);
-            if (codep)
-            {
-                uint8_t *tp = op + occ;
-                do
-                {
-                    *--tp = codep->value;
-                    codep = codep->next;
-                } while (--occ && codep);
-            }
-#if TIFF_SIMD_AES
-            tiff_aes_unwhiten(op0, occ_initial);
-#endif
-            return (1);
-        }
-        /*
-         * Residue satisfies only part of the decode request.
-         */
+        if (residue > occ0)
+            residue = occ0;
+        if (!LZWCopyOutput(sp, op, sp->dec_restart_pos, residue, op0, base))
+            goto error_code;
         op += residue;
-        occ -= residue;
-        uint8_t *tp = op;
-        do
-        {
-            *--tp = codep->value;
-            codep = codep->next;
-        } while (--residue && codep);
-        sp->dec_restart = 0;
-    }
-
-    bp = (uint8_t *)tif->tif_rawcp;
-    sp->dec_bitsleft += (((uint64_t)tif->tif_rawcc - sp->old_tif_rawcc) << 3);
-    uint64_t dec_bitsleft = sp->dec_bitsleft;
-    nbits = sp->lzw_nbits;
-    nextdata = sp->lzw_nextdata;
-    nextbits = sp->lzw_nextbits;
-    nbitsmask = sp->dec_nbitsmask;
-    oldcodep = sp->dec_oldcodep;
-    free_entp = sp->dec_free_entp;
-    maxcodep = sp->dec_maxcodep;
-    code_t *const dec_codetab = sp->dec_codetab;
-    code_t *codep;
-
-    if (occ == 0)
-    {
-        goto after_loop;
-    }
-
-begin:
-{
-    WordType code;
-    GetNextCodeLZW();
-    codep = dec_codetab + code;
-    if (code >= CODE_FIRST)
-        goto code_above_or_equal_to_258;
-    if (code < 256)
-        goto code_below_256;
-    if (code == CODE_EOI)
-        goto after_loop;
-    goto code_clear;
-
-code_below_256:
-{
-    if (codep > free_entp)
-        goto error_code;
-    free_entp->next = oldcodep;
-    free_entp->firstchar = oldcodep->firstchar;
-    free_entp->length = oldcodep->length + 1;
-    free_entp->value = (uint8_t)code;
-    free_entp->repeated =
-        (bool)(oldcodep->repeated & (oldcodep->value == code));
-    if (++free_entp > maxcodep)
-    {
-        if (++nbits > BITS_MAX) /* should not happen for a conformant encoder */
-            nbits = BITS_MAX;
-        nbitsmask = MAXCODE(nbits);
-        maxcodep = dec_codetab + nbitsmask - 1;
-        if (free_entp >= &dec_codetab[CSIZE])
+        sp->dec_restart -= residue;
+        sp->dec_restart_pos += residue;
+        if (sp->dec_restart == 1 && op < opend)
         {
-            /* At that point, the next valid states are either EOI or a */
-            /* CODE_CLEAR. If a regular code is read, at the next */
-            /* attempt at registering a new entry, we will error out */
-            /* due to setting free_entp before any valid code */
-            free_entp = dec_codetab - 1;
+            *op++ = sp->dec_restart_last;
+            sp->dec_restart = 0;
         }
     }
-    oldcodep = codep;
-    *op++ = (uint8_t)code;
-    occ--;
-    if (occ == 0)
-        goto after_loop;
-    goto begin;
-}
-
-code_above_or_equal_to_258:
-{
-    /*
-     * Add the new entry to the code table.
-     */
-
-    if (codep >= free_entp)
-    {
-        if (codep != free_entp)
-            goto error_code;
-        free_entp->value = oldcodep->firstchar;
-    }
-    else
-    {
-        free_entp->value = codep->firstchar;
-    }
-    free_entp->repeated =
-        (bool)(oldcodep->repeated & (oldcodep->value == free_entp->value));
-    free_entp->next = oldcodep;
 
-    free_entp->firstchar = oldcodep->firstchar;
-    free_entp->length = oldcodep->length + 1;
-    if (++free_entp > maxcodep)
+    while (op < opend)
     {
-        if (++nbits > BITS_MAX) /* should not happen for a conformant encoder */
-            nbits = BITS_MAX;
-        nbitsmask = MAXCODE(nbits);
-        maxcodep = dec_codetab + nbitsmask - 1;
-        if (free_entp >= &dec_codetab[CSIZE])
+        GetNextCodeLZW();
+        if (code >= CODE_FIRST)
         {
-            /* At that point, the next valid states are either EOI or a */
-            /* CODE_CLEAR. If a regular code is read, at the next */
-            /* attempt at registering a new entry, we will error out */
-            /* due to setting free_entp before any valid code */
-            free_entp = dec_codetab - 1;
-        }
-    }
-    oldcodep = codep;
-
-    /*
-     * Code maps to a string, copy string
-     * value to output (written in reverse).
-     */
-    /* tiny bit faster on x86_64 to store in unsigned short than int */
-    unsigned short len = codep->length;
+            const lzw_string_t *codep = &dec_strtab[code];
 
-    if (len < 3) /* equivalent to len == 2 given all other conditions */
-    {
-        if (occ <= 2)
-        {
-            if (occ == 2)
+            /*
+             * Add the new entry to the code table.
+             */
+            if ((long)code >= free_ent)
             {
-                memcpy(op, &(codep->firstchar), 2);
-                op += 2;
-                occ -= 2;
-                goto after_loop;
+                if ((long)code != free_ent)
+                    goto error_code;
+                AddStringLZW(old.firstchar);
+            }
+            else
+            {
+                AddStringLZW(codep->firstchar);
             }
-            goto too_short_buffer;
-        }
 
-        memcpy(op, &(codep->firstchar), 2);
-        op += 2;
-        occ -= 2;
-        goto begin; /* we can save the comparison occ > 0 */
-    }
+            const tmsize_t len = codep->length;
+            const tmsize_t avail = opend - op;
 
-    if (len == 3)
-    {
-        if (occ <= 3)
-        {
-            if (occ == 3)
+            old = *codep;
+            old.pos = base + (op - op0);
+            if (len > avail)
             {
-                op[0] = codep->firstchar;
-                op[1] = codep->next->value;
-                op[2] = codep->value;
-                op += 3;
-                occ -= 3;
-                goto after_loop;
+                /*
+                 * String is too long for decode buffer, copy the part
+                 * that fits and setup restart logic for the next
+                 * decoding call.
+                 */
+                if (!LZWCopyOutput(sp, op, codep->pos, avail, op0, base))
+                    goto error_code;
+                op += avail;
+                sp->dec_restart = len - avail;
+                sp->dec_restart_pos = codep->pos + avail;
+                sp->dec_restart_last = codep->lastchar;
+                break;
+            }
+            if (codep->repeated)
+            {
+                memset(op, codep->firstchar, (size_t)len);
+            }
+            else if (codep->pos >= base && avail >= len + 15)
+            {
+                /* The string was decoded earlier by this call, at least */
+                /* len - 1 bytes before op: copy it 16 bytes at a time, */
+                /* overwriting bytes past the string that are yet to be */
+                /* decoded. */
+                const uint8_t *src = op0 + (codep->pos - base);
+                uint8_t *dst = op;
+                uint8_t *const dstend = op + len - 1;
+                do
+                {
+                    uint8_t chunk[16];
+                    memcpy(chunk, src, 16);
+                    memcpy(dst, chunk, 16);
+                    src += 16;
+                    dst += 16;
+                } while (dst < dstend);
+                op[len - 1] = codep->lastchar;
             }
-            goto too_short_buffer;
+            else
+            {
+                if (!LZWCopyOutput(sp, op, codep->pos, len - 1, op0, base))
+                    goto error_code;
+                op[len - 1] = codep->lastchar;
+            }
+            op += len;
         }
-
-        op[0] = codep->firstchar;
-        op[1] = codep->next->value;
-        op[2] = codep->value;
-        op += 3;
-        occ -= 3;
-        goto begin; /* we can save the comparison occ > 0 */
-    }
-
-    if (len > occ)
-    {
-        goto too_short_buffer;
-    }
-
-    if (codep->repeated)
-    {
-        memset(op, codep->value, len);
-        op += len;
-        occ -= len;
-        if (occ == 0)
-            goto after_loop;
-        goto begin;
-    }
-
-    uint8_t *tp = op + len;
-
-    assert(len >= 4);
-
-    *--tp = codep->value;
-    codep = codep->next;
-    *--tp = codep->value;
-    codep = codep->next;
-    *--tp = codep->value;
-    codep = codep->next;
-    *--tp = codep->value;
-    if (tp > op)
-    {
-        do
+        else if (code < 256)
         {
-            codep = codep->next;
-            *--tp = codep->value;
-        } while (tp > op);
+            if ((long)code > free_ent)
+                goto error_code;
+            AddStringLZW((uint8_t)code);
+            old.pos = base + (op - op0);
+            old.length = 1;
+            old.firstchar = old.lastchar = (uint8_t)code;
+            old.repeated = 1;
+            *op++ = (uint8_t)code;
+        }
+        else if (code == CODE_EOI)
+        {
+            break;
+        }
+        else
+        {
+            /* CODE_CLEAR */
+            free_ent = CODE_FIRST;
+            nbits = BITS_MIN;
+            maxcode = MAXCODE(BITS_MIN) - 1;
+            sp->dec_clearpos = base + (op - op0);
+            do
+            {
+                GetNextCodeLZW();
+            } while (code == CODE_CLEAR); /* consecutive CODE_CLEAR codes */
+            if (code == CODE_EOI)
+                break;
+            if (code > CODE_EOI)
+                goto error_code;
+            old.pos = sp->dec_clearpos;
+            old.length = 1;
+            old.firstchar = old.lastchar = (uint8_t)code;
+            old.repeated = 1;
+            *op++ = (uint8_t)code;
+        }
     }
 
-    assert(occ >= len);
-    op += len;
-    occ -= len;
-    if (occ == 0)
-        goto after_loop;
-    goto begin;
-}
+    tif->tif_rawcc -= (tmsize_t)(bp - tif->tif_rawcp);
+    tif->tif_rawcp = (uint8_t *)bp;
+    sp->dec_bitbuf = bitcount > 0 ? bitbuf & ~(~(uint64_t)0 >> bitcount) : 0;
+    sp->lzw_nextbits = bitcount;
+    sp->lzw_nbits = (unsigned short)nbits;
+    sp->dec_free_ent = free_ent;
+    sp->dec_maxcode = maxcode;
+    sp->dec_old = old;
+    sp->dec_outpos = base + (op - op0);
 
-code_clear:
-{
-    free_entp = dec_codetab + CODE_FIRST;
-    nbits = BITS_MIN;
-    nbitsmask = MAXCODE(BITS_MIN);
-    maxcodep = dec_codetab + nbitsmask - 1;
-    do
+    if (sp->dec_outpos < sp->dec_strilesize &&
+        !LZWSaveOutput(tif, sp, op0, base, sp->dec_outpos))
     {
-        GetNextCodeLZW();
-    } while (code == CODE_CLEAR); /* consecutive CODE_CLEAR codes */
-    if (code == CODE_EOI)
-        goto after_loop;
-    if (code > CODE_EOI)
-    {
-        goto error_code;
+        tiff_memset_u8(op0, 0, (size_t)occ0);
+        sp->read_error = 1;
+        TIFFErrorExtR(tif, module, "Cannot save decoded data for next call");
+        return 0;
     }
-    *op++ = (uint8_t)code;
-    occ--;
-    oldcodep = dec_codetab + code;
-    if (occ == 0)
-        goto after_loop;
-    goto begin;
-}
-}
-
-too_short_buffer:
-{
-    /*
-     * String is too long for decode buffer,
-     * locate portion that will fit, copy to
-     * the decode buffer, and setup restart
-     * logic for the next decoding call.
-     */
-    sp->dec_codep = codep;
-    do
-    {
-        codep = codep->next;
-    } while (codep->length > occ);
-
-    sp->dec_restart = occ;
-    uint8_t *tp = op + occ;
-    do
-    {
-        *--tp = codep->value;
-        codep = codep->next;
-    } while (--occ);
-}
-
-after_loop:
-    tif->tif_rawcc -= (tmsize_t)((uint8_t *)bp - tif->tif_rawcp);
-    tif->tif_rawcp = (uint8_t *)bp;
-    sp->old_tif_rawcc = tif->tif_rawcc;
-    sp->dec_bitsleft = dec_bitsleft;
-    sp->lzw_nbits = (unsigned short)nbits;
-    sp->lzw_nextdata = nextdata;
-    sp->lzw_nextbits = nextbits;
-    sp->dec_nbitsmask = nbitsmask;
-    sp->dec_oldcodep = oldcodep;
-    sp->dec_free_entp = free_entp;
-    sp->dec_maxcodep = maxcodep;
 
-    if (occ > 0)
+    if (op < opend)
     {
-        tiff_memset_u8(op, 0, (size_t)occ);
+        tiff_memset_u8(op, 0, (size_t)(opend - op));
         sp->read_error = 1;
         TIFFErrorExtR(tif, module,
                       "Not enough data at scanline %" PRIu32 " (short %" PRIu64
                       " bytes)",
-                      tif->tif_row, (uint64_t)occ);
+                      tif->tif_row, (uint64_t)(opend - op));
         return (0);
     }
 #if TIFF_SIMD_AES
-    tiff_aes_unwhiten(op0, occ_initial);
+    tiff_aes_unwhiten(op0, (size_t)occ0);
 #endif
     return (1);
 
 no_eoi:
-    tiff_memset_u8(op, 0, (size_t)occ);
+    tiff_memset_u8(op, 0, (size_t)(opend - op));
     sp->read_error = 1;
     TIFFErrorExtR(tif, module,
                   "LZWDecode: Strip %" PRIu32 " not terminated with EOI code",
                   tif->tif_curstrip);
     return 0;
 error_code:
-    tiff_memset_u8(op, 0, (size_t)occ);
+    tiff_memset_u8(op, 0, (size_t)(opend - op));
     sp->read_error = 1;
     TIFFErrorExtR(tif, tif->tif_name, "Using code not yet in table");
     return 0;
@@ -1046,12 +1059,13 @@ static int LZWSetupEncode(TIFF *tif)
     LZWCodecState *sp = LZWEncoderState(tif);
 
     assert(sp != NULL);
-    sp->enc_hashtab = (hash_t *)_TIFFmallocExt(tif, HSIZE * sizeof(hash_t));
+    sp->enc_hashtab = (hash_t *)_TIFFcallocExt(tif, HSIZE, sizeof(hash_t));
     if (sp->enc_hashtab == NULL)
     {
         TIFFErrorExtR(tif, module, "No space for LZW hash table");
         return (0);
     }
+    sp->enc_generation = 0;
     return (1);
 }
 
@@ -1118,11 +1132,13 @@ static int LZWPreEncode(TIFF *tif, uint16_t s)
 /*
  * Encode a chunk of pixels.
  *
- * Uses an open addressing double hashing (no chaining) on the
- * prefix code/next character combination.  We do a variant of
- * Knuth's algorithm D (vol. 3, sec. 6.4) along with G. Knott's
- * relatively-prime secondary probe.  Here, the modular division
- * first probe is gives way to a faster exclusive-or manipulation.
+ * Uses open addressing with linear probing (no chaining) on the
+ * prefix code/next character combination, in a table at most half
+ * full whose entries hold both the key and the code, so that a
+ * lookup usually reads a single word.  The character is hashed
+ * multiplicatively while the hash of the prefix code, on which each
+ * lookup waits for the previous one, comes with the entry it was
+ * found in.
  * Also do block compression with an adaptive reset, whereby the
  * code table is cleared when the compression ratio decreases,
  * but after the table fills.  The variable-length output codes
@@ -1132,11 +1148,13 @@ static int LZWPreEncode(TIFF *tif, uint16_t s)
 static int LZWEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
 {
     register LZWCodecState *sp = LZWEncoderState(tif);
-    register long fcode;
-    register hash_t *hp;
-    register int h, c;
-    hcode_t ent;
-    long disp;
+    register uint64_t key;
+    register hash_t *hashtab;
+    register uint32_t h;
+    register int c;
+    unsigned int ent; /* an hcode_t, kept wider for speed */
+    unsigned int enthash;
+    uint64_t gen;
     tmsize_t incount, outcount, checkpoint;
     WordType nextdata;
     long nextbits;
@@ -1173,6 +1191,8 @@ static int LZWEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
     op = tif->tif_rawcp;
     limit = sp->enc_rawlimit;
     ent = (hcode_t)sp->enc_oldcode;
+    hashtab = sp->enc_hashtab;
+    gen = HGEN(sp->enc_generation);
 
     if (ent == (hcode_t)-1 && cc > 0)
     {
@@ -1186,49 +1206,28 @@ static int LZWEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
         cc--;
         incount++;
     }
+    enthash = HASH_PREFIX(ent);
     while (cc > 0)
     {
         c = *bp++;
         cc--;
         incount++;
-        fcode = ((long)c << BITS_MAX) + ent;
-        h = (c << HSHIFT) ^ ent; /* xor hashing */
-#ifdef _WINDOWS
-        /*
-         * Check hash index for an overflow.
-         */
-        if (h >= HSIZE)
-            h -= HSIZE;
-#endif
-        hp = &sp->enc_hashtab[h];
-        if (hp->hash == fcode)
+        key = gen | ((uint32_t)c << BITS_MAX) | ent;
+        h = HASH_CHAR(c) ^ enthash;
+        for (;;)
         {
-            ent = hp->code;
-            continue;
-        }
-        if (hp->hash >= 0)
-        {
-            /*
-             * Primary hash failed, check secondary hash.
-             */
-            disp = HSIZE - h;
-            if (h == 0)
-                disp = 1;
-            do
+            const hash_t e = hashtab[h];
+            const uint64_t diff = (e >> (BITS_MAX + HBITS)) ^ key;
+
+            if (diff == 0)
             {
-                /*
-                 * Avoid pointer arithmetic because of
-                 * wraparound problems with segments.
-                 */
-                if ((h -= disp) < 0)
-                    h += HSIZE;
-                hp = &sp->enc_hashtab[h];
-                if (hp->hash == fcode)
-                {
-                    ent = hp->code;
-                    goto hit;
-                }
-            } while (hp->hash >= 0);
+                ent = (unsigned int)(e >> HBITS) & HCODE_MASK;
+                enthash = (unsigned int)e & (HSIZE - 1);
+                goto hit;
+            }
+            if (diff >> (BITS_MAX + 8))
+                break; /* free entry, of an older generation */
+            h = (h + 1) & (HSIZE - 1);
         }
         /*
          * New entry, emit code and add to table.
@@ -1253,12 +1252,14 @@ static int LZWEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
         }
         PutNextCode(op, ent);
         ent = (hcode_t)c;
-        hp->code = (hcode_t)(free_ent++);
-        hp->hash = fcode;
+        enthash = HASH_PREFIX(c);
+        hashtab[h] = HENTRY(key, free_ent);
+        free_ent++;
         if (free_ent == CODE_MAX - 1)
         {
             /* table is full, emit clear code and reset */
             cl_hash(sp);
+            gen = HGEN(sp->enc_generation);
             sp->enc_ratio = 0;
             incount = 0;
             outcount = 0;
@@ -1293,6 +1294,7 @@ static int LZWEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
                 if (rat <= sp->enc_ratio)
                 {
                     cl_hash(sp);
+                    gen = HGEN(sp->enc_generation);
                     sp->enc_ratio = 0;
                     incount = 0;
                     outcount = 0;
@@ -1390,28 +1392,17 @@ static int LZWPostEncode(TIFF *tif)
 }
 
 /*
- * Reset encoding hash table.
+ * Reset encoding hash table: entries of previous generations are free,
+ * so only when the generation wraps around does the table need to be
+ * cleared, back to generation 0 which is never in use.
  */
 static void cl_hash(LZWCodecState *sp)
 {
-    register hash_t *hp = &sp->enc_hashtab[HSIZE - 1];
-    register long i = HSIZE - 8;
-
-    do
+    if (++sp->enc_generation == (uint32_t)1 << HGEN_BITS)
     {
-        i -= 8;
-        hp[-7].hash = -1;
-        hp[-6].hash = -1;
-        hp[-5].hash = -1;
-        hp[-4].hash = -1;
-        hp[-3].hash = -1;
-        hp[-2].hash = -1;
-        hp[-1].hash = -1;
-        hp[0].hash = -1;
-        hp -= 8;
-    } while (i >= 0);
-    for (i += 8; i > 0; i--, hp--)
-        hp->hash = -1;
+        memset(sp->enc_hashtab, 0, HSIZE * sizeof(hash_t));
+        sp->enc_generation = 1;
+    }
 }
 
 #endif
@@ -1424,6 +1415,8 @@ static void LZWCleanup(TIFF *tif)
 
     if (LZWDecoderState(tif)->dec_codetab)
         _TIFFfreeExt(tif, LZWDecoderState(tif)->dec_codetab);
+    _TIFFfreeExt(tif, LZWDecoderState(tif)->dec_strtab);
+    _TIFFfreeExt(tif, LZWDecoderState(tif)->dec_hist);
 
     if (LZWEncoderState(tif)->enc_hashtab)
         _TIFFfreeExt(tif, LZWEncoderState(tif)->enc_hashtab);
@@ -1446,6 +1439,9 @@ int TIFFInitLZW(TIFF *tif, int scheme)
     if (tif->tif_data == NULL)
         goto bad;
     LZWDecoderState(tif)->dec_codetab = NULL;
+    LZWDecoderState(tif)->dec_strtab = NULL;
+    LZWDecoderState(tif)->dec_hist = NULL;
+    LZWDecoderState(tif)->dec_hist_alloc = 0;
     LZWDecoderState(tif)->dec_decode = NULL;
     LZWEncoderState(tif)->enc_hashtab = NULL;
     LZWState(tif)->rw_mode = tif->tif_mode;
@@ -140,6 +140,87 @@ void TIFFOpenOptionsSetURingQueueDepth(TIFFOpenOptions *opts,
     opts->uring_queue_depth = depth;
 }
 
+/** Control per-strile CRC32C checksums (TIFFTAG_STRILECHECKSUMS).
+ * TIFF_STRILECHECKSUM_WRITE records the checksum of each strip/tile written
+ * through the encoded/scanline interfaces.  TIFF_STRILECHECKSUM_VERIFY checks
+ * each fully decoded strip/tile against the stored checksum when the
+ * directory has one.  Neither is enabled by default: tag 65400 is in the
+ * private range, and files using it for something else must still decode.
+ */
+void TIFFOpenOptionsSetStrileChecksums(TIFFOpenOptions *opts, int flags)
+{
+    opts->strile_checksums = flags;
+}
+
+/** Share decoded strips/tiles through cache (see TIFFStrileCacheCreate()).
+ * Read-only handles opened with these options consult the cache before
+ * reading and decoding a strip/tile, and hold a reference to it until they
+ * are closed.
+ */
+void TIFFOpenOptionsSetStrileCache(TIFFOpenOptions *opts,
+                                   TIFFStrileCache *cache)
+{
+    opts->strile_cache = cache;
+}
+
+/** Decode JPEG compressed images at 1/denom of their size (denom being 1, 2,
+ * 4 or 8), using the DCT scaling of libjpeg.  This is the default value of
+ * the TIFFTAG_JPEGSCALEDENOM pseudo-tag of every directory read with these
+ * options; see that tag for the images it applies to.
+ */
+void TIFFOpenOptionsSetJPEGScaleDenom(TIFFOpenOptions *opts, int denom)
+{
+    opts->jpeg_scale_denom = denom;
+}
+
+/** Defer the reading of BYTE, SBYTE, UNDEFINED and ASCII tag values of at
+ * least threshold bytes, such as XMP packets, ICC profiles or Photoshop
+ * blocks, until TIFFGetField() first asks for them.  Only applies to files
+ * opened read-only.  0, the default, reads every tag with its directory.
+ */
+void TIFFOpenOptionsSetLazyTagThreshold(TIFFOpenOptions *opts,
+                                        tmsize_t threshold)
+{
+    opts->lazy_tag_threshold = threshold;
+}
+
+/** Bound to max_bytes the memory used for the strip/tile offset and byte
+ * count arrays of files opened with the 'O' (on-demand strile loading) mode
+ * flag.  Their values are then kept in fixed-size pages loaded on demand and
+ * recycled in least recently used order.  0, the default, lets the arrays
+ * grow up to their full size.  Accessing the complete arrays, for instance
+ * with TIFFGetField(TIFFTAG_TILEOFFSETS), still loads them entirely.
+ */
+void TIFFOpenOptionsSetStrileArrayCacheSize(TIFFOpenOptions *opts,
+                                            tmsize_t max_bytes)
+{
+    opts->strile_array_cache_size = max_bytes;
+}
+
+/** Make TIFFOpenExt() bypass the page cache for the bulk of the data,
+ * through a second, O_DIRECT, descriptor: large reads and sequential
+ * writes then go through aligned bounce buffers.  Only effective on
+ * platforms that have O_DIRECT, and not with TIFFFdOpenExt() or
+ * TIFFClientOpenExt().
+ */
+void TIFFOpenOptionsSetDirectIO(TIFFOpenOptions *opts, int enable)
+{
+    opts->direct_io = enable;
+}
+
+/** Gather the data appended to files opened for writing in a buffer of
+ * buffer_size bytes, written with a single call when full or on TIFFFlush().
+ * When reserve is not 0, file space is also reserved that far ahead of the
+ * written data, where supported.  A buffer_size of 0, the default, writes
+ * the data as it comes.
+ */
+void TIFFOpenOptionsSetWriteBehind(TIFFOpenOptions *opts, tmsize_t buffer_size,
+                                   uint64_t reserve)
+{
+    opts->write_behind_size = buffer_size;
+    opts->write_behind_reserve = reserve;
+}
+
 static void _TIFFEmitErrorAboveMaxSingleMemAlloc(TIFF *tif,
                                                  const char *pszFunction,
                                                  tmsize_t s)
@@ -417,6 +498,7 @@ TIFF *TIFFClientOpenExt(const char *name, const char *mode,
     tif->tif_sizeproc = sizeproc;
     tif->tif_mapproc = mapproc ? mapproc : _tiffDummyMapProc;
     tif->tif_unmapproc = unmapproc ? unmapproc : _tiffDummyUnmapProc;
+    tif->tif_strilechecksums = 0;
     if (opts)
     {
         tif->tif_errorhandler = opts->errorhandler;
@@ -427,6 +509,12 @@ TIFF *TIFFClientOpenExt(const char *name, const char *mode,
         tif->tif_max_cumulated_mem_alloc = opts->max_cumulated_mem_alloc;
         tif->tif_warn_about_unknown_tags = opts->warn_about_unknown_tags;
         tif->tif_uring_depth = opts->uring_queue_depth;
+        tif->tif_strilechecksums = opts->strile_checksums;
+        tif->tif_jpegscaledenom = opts->jpeg_scale_denom;
+        tif->tif_lazytagthreshold = opts->lazy_tag_threshold;
+        tif->tif_strilepagesbudget = opts->strile_array_cache_size;
+        tif->tif_writebehindsize = opts->write_behind_size;
+        tif->tif_writebehindreserve = opts->write_behind_reserve;
     }
 
     if (!readproc || !writeproc || !seekproc || !closeproc || !sizeproc)
@@ -436,6 +524,8 @@ TIFF *TIFFClientOpenExt(const char *name, const char *mode,
         _TIFFfreeExt(NULL, tif);
         goto bad2;
     }
+    if (opts)
+        _TIFFStrileCacheAttach(tif, opts->strile_cache);
 
     _TIFFSetDefaultCompressionState(tif); /* setup default state */
     /*
@@ -41,26 +41,6 @@
 #include <arm_neon.h>
 #endif
 
-static inline uint16_t add_sat_u16(uint16_t a, uint16_t b)
-{
-#if defined(HAVE_NEON) && defined(__ARM_NEON)
-    /*
-     * Use NEON saturating arithmetic to avoid branches entirely.
-     * vqaddq_u16 performs unsigned saturating addition and is
-     * cheaper than manually comparing against 65535.
-     */
-    uint16x8_t va = vdupq_n_u16(a);
-    uint16x8_t vb = vdupq_n_u16(b);
-    uint16x8_t sum = vqaddq_u16(va, vb);
-    return vgetq_lane_u16(sum, 0);
-#else
-    uint32_t sum = (uint32_t)a + (uint32_t)b;
-    if (sum > 65535U)
-        sum = 65535U;
-    return (uint16_t)sum;
-#endif
-}
-
 #define PredictorState(tif) ((TIFFPredictorState *)(tif)->tif_data)
 
 static int horAcc8(TIFF *tif, uint8_t *cp0, tmsize_t cc);
@@ -699,10 +679,10 @@ static int horAcc16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
                 {
                     __builtin_prefetch(p + 16);
                     uint16x8_t v = vld1q_u16(p);
-                    v = vqaddq_u16(v, vextq_u16(vdupq_n_u16(0), v, 7));
-                    v = vqaddq_u16(v, vextq_u16(vdupq_n_u16(0), v, 6));
-                    v = vqaddq_u16(v, vextq_u16(vdupq_n_u16(0), v, 4));
-                    v = vqaddq_u16(v, vdupq_n_u16(acc16));
+                    v = vaddq_u16(v, vextq_u16(vdupq_n_u16(0), v, 7));
+                    v = vaddq_u16(v, vextq_u16(vdupq_n_u16(0), v, 6));
+                    v = vaddq_u16(v, vextq_u16(vdupq_n_u16(0), v, 4));
+                    v = vaddq_u16(v, vdupq_n_u16(acc16));
                     vst1q_u16(p, v);
                     acc16 = vgetq_lane_u16(v, 7);
                     p += 8;
@@ -723,10 +703,10 @@ static int horAcc16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
                     __builtin_prefetch(p + 16);
                     __m128i v = _mm_loadu_si128((const __m128i *)p);
                     _mm_prefetch((const char *)(p + 32), _MM_HINT_T0);
-                    v = _mm_adds_epu16(v, _mm_slli_si128(v, 2));
-                    v = _mm_adds_epu16(v, _mm_slli_si128(v, 4));
-                    v = _mm_adds_epu16(v, _mm_slli_si128(v, 8));
-                    v = _mm_adds_epu16(v, _mm_set1_epi16(acc16));
+                    v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+                    v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+                    v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+                    v = _mm_add_epi16(v, _mm_set1_epi16(acc16));
                     _mm_storeu_si128((__m128i *)p, v);
                     acc16 = (uint16_t)_mm_extract_epi16(v, 7);
                     p += 8;
@@ -747,10 +727,10 @@ static int horAcc16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
                     __builtin_prefetch(p + 16);
                     __m128i v = _mm_loadu_si128((const __m128i *)p);
                     _mm_prefetch((const char *)(p + 32), _MM_HINT_T0);
-                    v = _mm_adds_epu16(v, _mm_slli_si128(v, 2));
-                    v = _mm_adds_epu16(v, _mm_slli_si128(v, 4));
-                    v = _mm_adds_epu16(v, _mm_slli_si128(v, 8));
-                    v = _mm_adds_epu16(v, _mm_set1_epi16(acc16));
+                    v = _mm_add_epi16(v, _mm_slli_si128(v, 2));
+                    v = _mm_add_epi16(v, _mm_slli_si128(v, 4));
+                    v = _mm_add_epi16(v, _mm_slli_si128(v, 8));
+                    v = _mm_add_epi16(v, _mm_set1_epi16(acc16));
                     _mm_storeu_si128((__m128i *)p, v);
                     acc16 = (uint16_t)_mm_cvtsi128_si32(_mm_srli_si128(v, 14));
                     p += 8;
@@ -762,7 +742,7 @@ static int horAcc16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
 #endif
             for (; i < wc; i++)
             {
-                acc = add_sat_u16((uint16_t)acc, wp[i]);
+                acc = (uint16_t)(acc + wp[i]);
                 wp[i] = (uint16_t)acc;
             }
         }
@@ -771,7 +751,7 @@ static int horAcc16(TIFF *tif, uint8_t *cp0, tmsize_t cc)
             wc -= stride;
             do
             {
-                REPEAT4(stride, wp[stride] = add_sat_u16(wp[stride], wp[0]);
+                REPEAT4(stride, wp[stride] = (uint16_t)(wp[stride] + wp[0]);
                         wp++)
                 wc -= stride;
             } while (wc > 0);
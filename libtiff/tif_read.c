@@ -31,6 +31,9 @@
 #ifdef TIFF_USE_THREADPOOL
 #include "tiff_threadpool.h"
 #endif
+#ifdef JPEG_SUPPORT
+#include "tif_lj92.h"
+#endif
 #include <stdio.h>
 
 int TIFFFillStrip(TIFF *tif, uint32_t strip);
@@ -349,7 +352,9 @@ static int TIFFSeek(TIFF *tif, uint32_t row, uint16_t sample)
 #if defined(CHUNKY_STRIP_READ_SUPPORT)
     whole_strip = TIFFGetStrileByteCount(tif, strip) < 10 || isMapped(tif);
     if (td->td_compression == COMPRESSION_LERC ||
-        td->td_compression == COMPRESSION_JBIG)
+        td->td_compression == COMPRESSION_JBIG ||
+        td->td_compression == COMPRESSION_LZ4 ||
+        td->td_compression == COMPRESSION_JPEGLS)
     {
         /* Ideally plugins should have a way to declare they don't support
          * chunk strip */
@@ -537,12 +542,22 @@ tmsize_t TIFFReadEncodedStrip(TIFF *tif, uint32_t strip, void *buf,
 {
     static const char module[] = "TIFFReadEncodedStrip";
     TIFFDirectory *td = &tif->tif_dir;
-    tmsize_t stripsize;
+    tmsize_t stripsize, fullsize;
     uint16_t plane;
 
     stripsize = TIFFReadEncodedStripGetStripSize(tif, strip, &plane);
     if (stripsize == ((tmsize_t)(-1)))
         return ((tmsize_t)(-1));
+    fullsize = stripsize;
+
+    if (tif->tif_strilecache != NULL)
+    {
+        tmsize_t cc = _TIFFStrileCacheLookup(
+            tif, strip, buf,
+            (size != (tmsize_t)(-1) && size < stripsize) ? size : stripsize);
+        if (cc > 0)
+            return cc;
+    }
 
     /* shortcut to avoid an extra memcpy() */
     if (td->td_compression == COMPRESSION_NONE && size != (tmsize_t)(-1) &&
@@ -556,7 +571,11 @@ tmsize_t TIFFReadEncodedStrip(TIFF *tif, uint32_t strip, void *buf,
             (tif->tif_flags & TIFF_NOBITREV) == 0)
             TIFFReverseBits(buf, stripsize);
 
+        if (!_TIFFStrileChecksumVerify(tif, strip, buf, stripsize))
+            return ((tmsize_t)(-1));
         (*tif->tif_postdecode)(tif, buf, stripsize);
+        if (tif->tif_strilecache != NULL)
+            _TIFFStrileCacheInsert(tif, strip, buf, stripsize);
         return (stripsize);
     }
 
@@ -572,7 +591,11 @@ tmsize_t TIFFReadEncodedStrip(TIFF *tif, uint32_t strip, void *buf,
     }
     if ((*tif->tif_decodestrip)(tif, buf, stripsize, plane) <= 0)
         return ((tmsize_t)(-1));
+    if (!_TIFFStrileChecksumVerify(tif, strip, buf, stripsize))
+        return ((tmsize_t)(-1));
     (*tif->tif_postdecode)(tif, buf, stripsize);
+    if (tif->tif_strilecache != NULL && stripsize == fullsize)
+        _TIFFStrileCacheInsert(tif, strip, buf, stripsize);
     return (stripsize);
 }
 
@@ -614,6 +637,8 @@ tmsize_t _TIFFReadEncodedStripAndAllocBuffer(TIFF *tif, uint32_t strip,
 
     if ((*tif->tif_decodestrip)(tif, *buf, this_stripsize, plane) <= 0)
         return ((tmsize_t)(-1));
+    if (!_TIFFStrileChecksumVerify(tif, strip, *buf, this_stripsize))
+        return ((tmsize_t)(-1));
     (*tif->tif_postdecode)(tif, *buf, this_stripsize);
     return (this_stripsize);
 }
@@ -967,6 +992,15 @@ tmsize_t TIFFReadEncodedTile(TIFF *tif, uint32_t tile, void *buf, tmsize_t size)
         return ((tmsize_t)(-1));
     }
 
+    if (tif->tif_strilecache != NULL)
+    {
+        tmsize_t cc = _TIFFStrileCacheLookup(
+            tif, tile, buf,
+            (size != (tmsize_t)(-1) && size < tilesize) ? size : tilesize);
+        if (cc > 0)
+            return cc;
+    }
+
     /* shortcut to avoid an extra memcpy() */
     if (td->td_compression == COMPRESSION_NONE && size != (tmsize_t)(-1) &&
         size >= tilesize && !isMapped(tif) &&
@@ -979,7 +1013,11 @@ tmsize_t TIFFReadEncodedTile(TIFF *tif, uint32_t tile, void *buf, tmsize_t size)
             (tif->tif_flags & TIFF_NOBITREV) == 0)
             TIFFReverseBits(buf, tilesize);
 
+        if (!_TIFFStrileChecksumVerify(tif, tile, buf, tilesize))
+            return ((tmsize_t)(-1));
         (*tif->tif_postdecode)(tif, buf, tilesize);
+        if (tif->tif_strilecache != NULL)
+            _TIFFStrileCacheInsert(tif, tile, buf, tilesize);
         return (tilesize);
     }
 
@@ -995,15 +1033,82 @@ tmsize_t TIFFReadEncodedTile(TIFF *tif, uint32_t tile, void *buf, tmsize_t size)
         return ((tmsize_t)(-1));
     }
     else if ((*tif->tif_decodetile)(tif, (uint8_t *)buf, size,
-                                    (uint16_t)(tile / td->td_stripsperimage)))
+                                    (uint16_t)(tile / td->td_stripsperimage)) &&
+             _TIFFStrileChecksumVerify(tif, tile, buf, size))
     {
         (*tif->tif_postdecode)(tif, (uint8_t *)buf, size);
+        if (tif->tif_strilecache != NULL && size == tilesize)
+            _TIFFStrileCacheInsert(tif, tile, buf, size);
         return (size);
     }
     else
         return ((tmsize_t)(-1));
 }
 
+/*
+ * Read and decode several tiles, tiles[i] into bufs[i] of TIFFTileSize()
+ * bytes.  With a thread pool, the lossless JPEG tiles are fetched with
+ * coalesced reads and decoded concurrently, their errors being reported on
+ * the calling thread; the others are read one after the other by
+ * TIFFReadEncodedTile().
+ */
+tmsize_t TIFFReadEncodedTiles(TIFF *tif, const uint32_t *tiles, uint32_t n,
+                              void **bufs)
+{
+    static const char module[] = "TIFFReadEncodedTiles";
+    TIFFDirectory *td = &tif->tif_dir;
+    tmsize_t tilesize, total = 0;
+    int *done;
+    uint32_t i;
+
+    if (!TIFFCheckRead(tif, 1))
+        return ((tmsize_t)(-1));
+    tilesize = TIFFTileSize(tif);
+    if (tilesize == 0)
+        return ((tmsize_t)(-1));
+    for (i = 0; i < n; i++)
+    {
+        if (tiles[i] >= td->td_nstrips)
+        {
+            TIFFErrorExtR(tif, module,
+                          "%" PRIu32 ": Tile out of range, max %" PRIu32,
+                          tiles[i], td->td_nstrips);
+            return ((tmsize_t)(-1));
+        }
+    }
+    if (n == 0)
+        return 0;
+    done = (int *)_TIFFCheckMalloc(tif, (tmsize_t)n, sizeof(int), module);
+    if (done == NULL)
+        return ((tmsize_t)(-1));
+    _TIFFmemset(done, 0, (tmsize_t)n * (tmsize_t)sizeof(int));
+#if defined(JPEG_SUPPORT) && defined(TIFF_USE_THREADPOOL)
+    if (td->td_compression == COMPRESSION_JPEG &&
+        TIFFGetThreadCount(tif) > 1 &&
+        (tif->tif_flags & TIFF_NOREADRAW) == 0 &&
+        !_TIFFLJ92ReadTiles(tif, tiles, n, bufs, done))
+    {
+        _TIFFfreeExt(tif, done);
+        return ((tmsize_t)(-1));
+    }
+#endif
+    for (i = 0; i < n; i++)
+    {
+        tmsize_t cc = tilesize;
+
+        if (!done[i])
+            cc = TIFFReadEncodedTile(tif, tiles[i], bufs[i], tilesize);
+        if (cc < 0)
+        {
+            _TIFFfreeExt(tif, done);
+            return ((tmsize_t)(-1));
+        }
+        total += cc;
+    }
+    _TIFFfreeExt(tif, done);
+    return total;
+}
+
 /* Variant of TIFFReadTile() that does
  * * if *buf == NULL, *buf = _TIFFmallocExt(tif, bufsizetoalloc) only after
  * TIFFFillTile() has succeeded. This avoid excessive memory allocation in case
@@ -1121,7 +1226,8 @@ tmsize_t _TIFFReadEncodedTileAndAllocBuffer(TIFF *tif, uint32_t tile,
 #endif
         decode_ok = (*tif->tif_decodetile)(tif, (uint8_t *)*buf, size_to_read,
                                            (uint16_t)(tile / td->td_stripsperimage)) != 0;
-    if (decode_ok)
+    if (decode_ok &&
+        _TIFFStrileChecksumVerify(tif, tile, *buf, size_to_read))
     {
         (*tif->tif_postdecode)(tif, (uint8_t *)*buf, size_to_read);
         return (size_to_read);
@@ -1222,6 +1328,239 @@ tmsize_t TIFFReadRawTile(TIFF *tif, uint32_t tile, void *buf, tmsize_t size)
     return (TIFFReadRawTile1(tif, tile, buf, bytecountm, module));
 }
 
+/* Largest read shared by several striles, which bounds the staging buffer,
+ * and most striles in one vectored read. */
+#define RAWSTRILES_MAX_RUN (16 * 1024 * 1024)
+#define RAWSTRILES_MAX_IOV 512
+
+typedef struct
+{
+    uint64_t offset;
+    tmsize_t size;
+    uint32_t i; /* index in the request */
+} TIFFRawStrileRead;
+
+static int TIFFRawStrileReadCompare(const void *a, const void *b)
+{
+    const TIFFRawStrileRead *pa = (const TIFFRawStrileRead *)a;
+    const TIFFRawStrileRead *pb = (const TIFFRawStrileRead *)b;
+    if (pa->offset != pb->offset)
+        return pa->offset < pb->offset ? -1 : 1;
+    return pa->i < pb->i ? -1 : pa->i > pb->i ? 1 : 0;
+}
+
+/* Read the striles of a run spanning [start, end[ straight into their
+ * buffers, the gaps between them going to a scratch buffer. */
+static int TIFFReadRawStrilesVectored(TIFF *tif, const TIFFRawStrileRead *reads,
+                                      uint32_t nreads, uint64_t start,
+                                      uint64_t end, void **bufs,
+                                      const char *module)
+{
+    struct iovec iov[2 * RAWSTRILES_MAX_IOV];
+    unsigned int iovcnt = 0;
+    uint64_t pos = start, maxgap = 0;
+    uint8_t *gap;
+    tmsize_t cc;
+
+    for (uint32_t k = 1; k < nreads; k++)
+    {
+        const uint64_t g =
+            reads[k].offset - (reads[k - 1].offset + reads[k - 1].size);
+        if (g > maxgap)
+            maxgap = g;
+    }
+    gap = maxgap ? (uint8_t *)_TIFFmallocExt(tif, (tmsize_t)maxgap) : NULL;
+    if (maxgap && gap == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return 0;
+    }
+    for (uint32_t k = 0; k < nreads; k++)
+    {
+        if (reads[k].offset > pos)
+        {
+            iov[iovcnt].iov_base = gap;
+            iov[iovcnt].iov_len = (size_t)(reads[k].offset - pos);
+            iovcnt++;
+        }
+        iov[iovcnt].iov_base = bufs[reads[k].i];
+        iov[iovcnt].iov_len = (size_t)reads[k].size;
+        iovcnt++;
+        pos = reads[k].offset + reads[k].size;
+    }
+    cc = SeekOK(tif, start)
+             ? _tiffUringReadV(tif->tif_clientdata, iov, iovcnt,
+                               (tmsize_t)(end - start))
+             : -1;
+    _TIFFfreeExt(tif, gap);
+    if (cc != (tmsize_t)(end - start))
+    {
+        TIFFErrorExtR(tif, module,
+                      "Read error at offset %" PRIu64 "; got %" TIFF_SSIZE_FORMAT
+                      " bytes, expected %" PRIu64,
+                      start, cc, end - start);
+        return 0;
+    }
+    return 1;
+}
+
+/*
+ * Read the raw data of several strips or tiles, with as few I/O calls as
+ * possible: the striles are sorted by file offset and those separated by at
+ * most max_gap bytes are fetched with a single read.  On input sizes[i] is
+ * the size of bufs[i], or (tmsize_t)(-1) for the whole strile, and on
+ * output the number of bytes placed in it.
+ */
+tmsize_t TIFFReadRawStriles(TIFF *tif, const uint32_t *striles, uint32_t n,
+                            void **bufs, tmsize_t *sizes, uint64_t max_gap)
+{
+    static const char module[] = "TIFFReadRawStriles";
+    TIFFDirectory *td = &tif->tif_dir;
+    TIFFRawStrileRead *reads;
+    uint8_t *run = NULL;
+    tmsize_t runsize = 0, total = 0;
+    uint32_t i, j;
+
+    if (!TIFFCheckRead(tif, isTiled(tif)))
+        return ((tmsize_t)(-1));
+    if (tif->tif_flags & TIFF_NOREADRAW)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Compression scheme does not support access to raw "
+                      "uncompressed data");
+        return ((tmsize_t)(-1));
+    }
+    if (n == 0)
+        return 0;
+    reads = (TIFFRawStrileRead *)_TIFFCheckMalloc(
+        tif, (tmsize_t)n, sizeof(TIFFRawStrileRead), module);
+    if (reads == NULL)
+        return ((tmsize_t)(-1));
+
+    for (i = 0; i < n; i++)
+    {
+        uint64_t bytecount64;
+        tmsize_t bytecountm;
+
+        if (striles[i] >= td->td_nstrips)
+        {
+            TIFFErrorExtR(tif, module,
+                          "%" PRIu32 ": Strile out of range, max %" PRIu32,
+                          striles[i], td->td_nstrips);
+            goto bad;
+        }
+        bytecount64 = TIFFGetStrileByteCount(tif, striles[i]);
+        if (sizes[i] != (tmsize_t)(-1) && (uint64_t)sizes[i] <= bytecount64)
+            bytecountm = sizes[i];
+        else
+            bytecountm = _TIFFCastUInt64ToSSize(tif, bytecount64, module);
+        reads[i].offset = TIFFGetStrileOffset(tif, striles[i]);
+        if (bytecountm == 0 ||
+            reads[i].offset > (uint64_t)TIFF_TMSIZE_T_MAX - bytecountm)
+        {
+            TIFFErrorExtR(tif, module, "Invalid strile %" PRIu32, striles[i]);
+            goto bad;
+        }
+        reads[i].size = bytecountm;
+        reads[i].i = i;
+    }
+    qsort(reads, n, sizeof(TIFFRawStrileRead), TIFFRawStrileReadCompare);
+
+    for (i = 0; i < n; i = j)
+    {
+        const uint64_t start = reads[i].offset;
+        uint64_t end = start + reads[i].size;
+        int overlap = 0;
+
+        /* Extend the run while the holes stay small enough */
+        for (j = i + 1; j < n; j++)
+        {
+            const uint64_t next = reads[j].offset + reads[j].size;
+            if (reads[j].offset > end && reads[j].offset - end > max_gap)
+                break;
+            if ((next > end ? next : end) - start > RAWSTRILES_MAX_RUN)
+                break;
+            if (reads[j].offset < end)
+                overlap = 1;
+            if (next > end)
+                end = next;
+        }
+
+        if (isMapped(tif))
+        {
+            if (end > (uint64_t)tif->tif_size)
+            {
+                TIFFErrorExtR(tif, module,
+                              "Read error at offset %" PRIu64
+                              "; strile beyond end of file",
+                              start);
+                goto bad;
+            }
+            for (uint32_t k = i; k < j; k++)
+                _TIFFmemcpy(bufs[reads[k].i], tif->tif_base + reads[k].offset,
+                            reads[k].size);
+        }
+        else if (j == i + 1)
+        {
+            if (!SeekOK(tif, start) ||
+                !ReadOK(tif, bufs[reads[i].i], reads[i].size))
+            {
+                TIFFErrorExtR(tif, module,
+                              "Read error at offset %" PRIu64, start);
+                goto bad;
+            }
+        }
+        else if (!overlap && tif->tif_uring != NULL && !tif->tif_uring_async &&
+                 tif->tif_writebehind == NULL && j - i <= RAWSTRILES_MAX_IOV)
+        {
+            if (!TIFFReadRawStrilesVectored(tif, reads + i, j - i, start, end,
+                                            bufs, module))
+                goto bad;
+        }
+        else
+        {
+            /* Read the run in a staging buffer and scatter it */
+            if ((tmsize_t)(end - start) > runsize)
+            {
+                uint8_t *p = (uint8_t *)_TIFFreallocExt(tif, run,
+                                                        (tmsize_t)(end - start));
+                if (p == NULL)
+                {
+                    TIFFErrorExtR(tif, module, "Out of memory");
+                    goto bad;
+                }
+                run = p;
+                runsize = (tmsize_t)(end - start);
+            }
+            if (!SeekOK(tif, start) ||
+                !ReadOK(tif, run, (tmsize_t)(end - start)))
+            {
+                TIFFErrorExtR(tif, module,
+                              "Read error at offset %" PRIu64
+                              " of %" PRIu64 " bytes",
+                              start, end - start);
+                goto bad;
+            }
+            for (uint32_t k = i; k < j; k++)
+                _TIFFmemcpy(bufs[reads[k].i], run + (reads[k].offset - start),
+                            reads[k].size);
+        }
+        for (uint32_t k = i; k < j; k++)
+        {
+            sizes[reads[k].i] = reads[k].size;
+            total += reads[k].size;
+        }
+    }
+    _TIFFfreeExt(tif, run);
+    _TIFFfreeExt(tif, reads);
+    return total;
+
+bad:
+    _TIFFfreeExt(tif, run);
+    _TIFFfreeExt(tif, reads);
+    return ((tmsize_t)(-1));
+}
+
 /*
  * Read the specified tile and setup for decoding. The data buffer is
  * expanded, as necessary, to hold the tile's data.
@@ -1638,6 +1977,8 @@ int TIFFReadFromUserBuffer(TIFF *tif, uint32_t strile, void *inbuf,
             }
         }
     }
+    if (ret && !_TIFFStrileChecksumVerify(tif, strile, outbuf, outsize))
+        ret = 0;
     if (ret)
     {
         (*tif->tif_postdecode)(tif, (uint8_t *)outbuf, outsize);
@@ -0,0 +1,311 @@
+#include "tiffiop.h"
+
+/*
+ * Region of interest reading.
+ *
+ * TIFFReadRegion() reads a rectangle of the image into a caller buffer with
+ * an arbitrary row stride, decoding only the strips/tiles that intersect it.
+ * Strips are decoded no further than the last row needed, and uncompressed
+ * strips are read starting at the first row needed.  With a thread pool,
+ * the JPEG tiles of each tile row of the region are read in a single
+ * TIFFReadEncodedTiles() call, which decodes lossless JPEG ones
+ * concurrently.
+ *
+ * Not done yet, as codec state is per handle and codecs only decode from
+ * the start of a strile:
+ * - decoding the strips, and the tiles of other codecs, concurrently;
+ * - starting strips compressed with a predictor or JPEG at the first row
+ *   needed, which would take a decoder able to resume mid-strip (from a
+ *   restart marker for JPEG).
+ */
+
+/*
+ * Read rows [row0, row0 + nrows) of strip into buf, which must hold
+ * row0 + nrows scanlines.  Returns a pointer to the first requested row, or
+ * NULL on error.
+ */
+static uint8_t *regionReadStripRows(TIFF *tif, uint32_t strip, uint32_t row0,
+                                    uint32_t nrows, uint8_t *buf,
+                                    tmsize_t scanline)
+{
+    static const char module[] = "TIFFReadRegion";
+    TIFFDirectory *td = &tif->tif_dir;
+    tmsize_t size = (tmsize_t)nrows * scanline;
+
+    if (td->td_compression == COMPRESSION_NONE && row0 > 0 &&
+        (tif->tif_flags & TIFF_NOREADRAW) == 0)
+    {
+        uint64_t offset = TIFFGetStrileOffset(tif, strip);
+        uint64_t bytecount = TIFFGetStrileByteCount(tif, strip);
+        uint64_t skip = (uint64_t)row0 * (uint64_t)scanline;
+
+        if (bytecount < skip + (uint64_t)size)
+        {
+            TIFFErrorExtR(tif, module,
+                          "Strip %" PRIu32 " is too short: %" PRIu64
+                          " bytes, need %" PRIu64,
+                          strip, bytecount, skip + (uint64_t)size);
+            return NULL;
+        }
+        offset += skip;
+        if (isMapped(tif))
+        {
+            if (offset > (uint64_t)tif->tif_size ||
+                (uint64_t)size > (uint64_t)tif->tif_size - offset)
+            {
+                TIFFErrorExtR(tif, module,
+                              "Read error on strip %" PRIu32, strip);
+                return NULL;
+            }
+            _TIFFmemcpy(buf, tif->tif_base + offset, size);
+        }
+        else if (!SeekOK(tif, offset) || !ReadOK(tif, buf, size))
+        {
+            TIFFErrorExtR(tif, module, "Read error on strip %" PRIu32, strip);
+            return NULL;
+        }
+        if (!isFillOrder(tif, td->td_fillorder) &&
+            (tif->tif_flags & TIFF_NOBITREV) == 0)
+            TIFFReverseBits(buf, size);
+        (*tif->tif_postdecode)(tif, buf, size);
+        return buf;
+    }
+
+    /* Codecs decode from the start of the strip: stop at the last row */
+    size += (tmsize_t)row0 * scanline;
+    if (TIFFReadEncodedStrip(tif, strip, buf, size) != size)
+        return NULL;
+    return buf + (tmsize_t)row0 * scanline;
+}
+
+static int regionReadStrips(TIFF *tif, uint32_t x, uint32_t y, uint32_t w,
+                            uint32_t h, uint16_t sample, uint8_t *dst,
+                            tmsize_t dst_stride, tmsize_t pixelsize)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    tmsize_t scanline = TIFFScanlineSize(tif);
+    uint32_t rowsperstrip = TIFFmin(td->td_rowsperstrip, td->td_imagelength);
+    uint8_t *buf;
+    uint32_t row;
+    int ok = 1;
+
+    if (scanline == 0)
+        return 0;
+    buf = (uint8_t *)_TIFFmallocExt(tif, (tmsize_t)rowsperstrip * scanline);
+    if (buf == NULL)
+    {
+        TIFFErrorExtR(tif, "TIFFReadRegion", "No space for strip buffer");
+        return 0;
+    }
+    for (row = y; ok && row < y + h;)
+    {
+        uint32_t strip = TIFFComputeStrip(tif, row, sample);
+        uint32_t row0 = row % rowsperstrip;
+        uint32_t nrows = TIFFmin(rowsperstrip - row0, y + h - row);
+        const uint8_t *src =
+            regionReadStripRows(tif, strip, row0, nrows, buf, scanline);
+        uint32_t i;
+
+        if (src == NULL)
+        {
+            ok = 0;
+            break;
+        }
+        src += (tmsize_t)x * pixelsize;
+        for (i = 0; i < nrows; i++)
+            _TIFFmemcpy(dst + (tmsize_t)(row - y + i) * dst_stride,
+                        src + (tmsize_t)i * scanline, (tmsize_t)w * pixelsize);
+        row += nrows;
+    }
+    _TIFFfreeExt(tif, buf);
+    return ok;
+}
+
+/*
+ * Read the tiles of each tile row of the region at once, whole, so that
+ * TIFFReadEncodedTiles() decodes them concurrently.
+ */
+static int regionReadTileRows(TIFF *tif, uint32_t x, uint32_t y, uint32_t w,
+                              uint32_t h, uint16_t sample, uint8_t *dst,
+                              tmsize_t dst_stride, tmsize_t pixelsize)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    const tmsize_t tilerow = TIFFTileRowSize(tif);
+    const tmsize_t tilesize = TIFFTileSize(tif);
+    const uint32_t tw = td->td_tilewidth, tl = td->td_tilelength;
+    const uint32_t x0 = x - x % tw;
+    const uint32_t n = (x + w - x0 + tw - 1) / tw;
+    uint32_t *tiles;
+    void **bufs;
+    uint8_t *block;
+    uint32_t ty;
+    int ok = 1;
+
+    if (tilerow == 0 || tilesize == 0)
+        return 0;
+    tiles = (uint32_t *)_TIFFmallocExt(tif, (tmsize_t)n * sizeof(uint32_t));
+    bufs = (void **)_TIFFmallocExt(tif, (tmsize_t)n * sizeof(void *));
+    block = (uint8_t *)_TIFFCheckMalloc(tif, (tmsize_t)n, tilesize,
+                                        "TIFFReadRegion");
+    if (tiles == NULL || bufs == NULL || block == NULL)
+    {
+        TIFFErrorExtR(tif, "TIFFReadRegion", "No space for tile buffers");
+        ok = 0;
+    }
+    for (ty = y - y % tl; ok && ty < y + h; ty += tl)
+    {
+        uint32_t r0 = TIFFmax(y, ty), r1 = TIFFmin(y + h, ty + tl);
+        uint32_t i;
+
+        for (i = 0; i < n; i++)
+        {
+            tiles[i] = TIFFComputeTile(tif, x0 + i * tw, ty, 0, sample);
+            bufs[i] = block + (tmsize_t)i * tilesize;
+        }
+        if (TIFFReadEncodedTiles(tif, tiles, n, bufs) < 0)
+        {
+            ok = 0;
+            break;
+        }
+        for (i = 0; i < n; i++)
+        {
+            uint32_t tx = x0 + i * tw;
+            uint32_t c0 = TIFFmax(x, tx), c1 = TIFFmin(x + w, tx + tw);
+            uint32_t r;
+
+            for (r = r0; r < r1; r++)
+                _TIFFmemcpy(dst + (tmsize_t)(r - y) * dst_stride +
+                                (tmsize_t)(c0 - x) * pixelsize,
+                            (uint8_t *)bufs[i] + (tmsize_t)(r - ty) * tilerow +
+                                (tmsize_t)(c0 - tx) * pixelsize,
+                            (tmsize_t)(c1 - c0) * pixelsize);
+        }
+    }
+    _TIFFfreeExt(tif, tiles);
+    _TIFFfreeExt(tif, bufs);
+    _TIFFfreeExt(tif, block);
+    return ok;
+}
+
+static int regionReadTiles(TIFF *tif, uint32_t x, uint32_t y, uint32_t w,
+                           uint32_t h, uint16_t sample, uint8_t *dst,
+                           tmsize_t dst_stride, tmsize_t pixelsize)
+{
+    TIFFDirectory *td = &tif->tif_dir;
+    tmsize_t tilerow = TIFFTileRowSize(tif);
+    uint32_t tw = td->td_tilewidth, tl = td->td_tilelength;
+    uint8_t *buf;
+    uint32_t tx, ty;
+    int ok = 1;
+
+    if (tilerow == 0)
+        return 0;
+    buf = (uint8_t *)_TIFFmallocExt(tif, (tmsize_t)tl * tilerow);
+    if (buf == NULL)
+    {
+        TIFFErrorExtR(tif, "TIFFReadRegion", "No space for tile buffer");
+        return 0;
+    }
+    for (ty = y - y % tl; ok && ty < y + h; ty += tl)
+    {
+        uint32_t r0 = TIFFmax(y, ty), r1 = TIFFmin(y + h, ty + tl);
+        /* Decode no further than the last row needed */
+        tmsize_t size = (tmsize_t)(r1 - ty) * tilerow;
+
+        for (tx = x - x % tw; tx < x + w; tx += tw)
+        {
+            uint32_t c0 = TIFFmax(x, tx), c1 = TIFFmin(x + w, tx + tw);
+            uint32_t tile = TIFFComputeTile(tif, tx, ty, 0, sample);
+            uint32_t r;
+
+            if (TIFFReadEncodedTile(tif, tile, buf, size) != size)
+            {
+                ok = 0;
+                break;
+            }
+            for (r = r0; r < r1; r++)
+                _TIFFmemcpy(dst + (tmsize_t)(r - y) * dst_stride +
+                                (tmsize_t)(c0 - x) * pixelsize,
+                            buf + (tmsize_t)(r - ty) * tilerow +
+                                (tmsize_t)(c0 - tx) * pixelsize,
+                            (tmsize_t)(c1 - c0) * pixelsize);
+        }
+    }
+    _TIFFfreeExt(tif, buf);
+    return ok;
+}
+
+/*
+ * Read the w x h rectangle at (x, y) of the current directory into dst, with
+ * rows dst_stride bytes apart.  For PLANARCONFIG_SEPARATE images sample
+ * selects the plane to read; for contiguous ones it must be 0 and every
+ * sample of each pixel is returned.  Samples must be whole bytes.
+ */
+int TIFFReadRegion(TIFF *tif, uint32_t x, uint32_t y, uint32_t w, uint32_t h,
+                   uint16_t sample, void *dst, tmsize_t dst_stride)
+{
+    static const char module[] = "TIFFReadRegion";
+    TIFFDirectory *td = &tif->tif_dir;
+    tmsize_t pixelsize;
+
+    if (tif->tif_mode == O_WRONLY)
+    {
+        TIFFErrorExtR(tif, module, "File not open for reading");
+        return 0;
+    }
+    if (w == 0 || h == 0 || x >= td->td_imagewidth ||
+        w > td->td_imagewidth - x || y >= td->td_imagelength ||
+        h > td->td_imagelength - y)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Region %" PRIu32 "x%" PRIu32 "+%" PRIu32 "+%" PRIu32
+                      " is outside the %" PRIu32 "x%" PRIu32 " image",
+                      w, h, x, y, td->td_imagewidth, td->td_imagelength);
+        return 0;
+    }
+    if (td->td_planarconfig == PLANARCONFIG_SEPARATE
+            ? sample >= td->td_samplesperpixel
+            : sample != 0)
+    {
+        TIFFErrorExtR(tif, module, "%" PRIu16 ": Sample out of range",
+                      sample);
+        return 0;
+    }
+    if (isDecodeScaled(tif))
+    {
+        TIFFErrorExtR(tif, module,
+                      "Not supported when decoding at reduced resolution");
+        return 0;
+    }
+    if (td->td_bitspersample % 8 != 0 ||
+        (td->td_photometric == PHOTOMETRIC_YCBCR && !isUpSampled(tif) &&
+         td->td_planarconfig == PLANARCONFIG_CONTIG &&
+         (td->td_ycbcrsubsampling[0] != 1 || td->td_ycbcrsubsampling[1] != 1)))
+    {
+        TIFFErrorExtR(tif, module,
+                      "Only images with byte aligned, non subsampled pixels "
+                      "are supported");
+        return 0;
+    }
+    pixelsize = td->td_bitspersample / 8;
+    if (td->td_planarconfig == PLANARCONFIG_CONTIG)
+        pixelsize *= td->td_samplesperpixel;
+    if (dst_stride < (tmsize_t)w * pixelsize)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Destination stride %" TIFF_SSIZE_FORMAT
+                      " is smaller than a row of the region",
+                      dst_stride);
+        return 0;
+    }
+
+    if (isTiled(tif) && td->td_compression == COMPRESSION_JPEG &&
+        TIFFGetThreadCount(tif) > 1)
+        return regionReadTileRows(tif, x, y, w, h, sample, (uint8_t *)dst,
+                                  dst_stride, pixelsize);
+    if (isTiled(tif))
+        return regionReadTiles(tif, x, y, w, h, sample, (uint8_t *)dst,
+                               dst_stride, pixelsize);
+    return regionReadStrips(tif, x, y, w, h, sample, (uint8_t *)dst,
+                            dst_stride, pixelsize);
+}
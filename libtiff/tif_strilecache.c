@@ -0,0 +1,474 @@
+#include "tiffiop.h"
+#include <stdlib.h>
+#ifdef TIFF_USE_THREADPOOL
+#include <pthread.h>
+#endif
+
+/*
+ * Decoded strile cache shared between TIFF handles.
+ *
+ * Entries hold the output of TIFFReadEncodedStrip()/TIFFReadEncodedTile()
+ * for a whole strip or tile and are keyed by the identity of the underlying
+ * file, the offset of the directory and the strile index, so that handles
+ * opened independently on the same file share decoded data.  The cache is
+ * split into shards, each with its own lock, hash table, LRU list and share
+ * of the byte budget.
+ */
+
+#define STRILECACHE_MAX_SHARDS 16
+#define STRILECACHE_MIN_SHARD_BYTES (4 * 1024 * 1024)
+
+/* tif_flags bits that change what the decoders produce */
+#define STRILECACHE_DECODE_FLAGS (TIFF_UPSAMPLED | TIFF_NOBITREV)
+
+/*
+ * The cache may only be used from several threads in builds with thread
+ * support; elsewhere the locks compile away.
+ */
+#ifdef TIFF_USE_THREADPOOL
+typedef pthread_mutex_t strilecache_mutex_t;
+#define MUTEX_INIT(m) pthread_mutex_init((m), NULL)
+#define MUTEX_LOCK(m) pthread_mutex_lock(m)
+#define MUTEX_UNLOCK(m) pthread_mutex_unlock(m)
+#define MUTEX_DESTROY(m) pthread_mutex_destroy(m)
+#else
+typedef int strilecache_mutex_t;
+#define MUTEX_INIT(m) (*(m) = 0)
+#define MUTEX_LOCK(m) ((void)(m))
+#define MUTEX_UNLOCK(m) ((void)(m))
+#define MUTEX_DESTROY(m) ((void)(m))
+#endif
+
+typedef struct TIFFStrileCacheKey
+{
+    uint64_t file[4]; /* see _TIFFGetFileIdentity() */
+    uint64_t diroff;
+    uint64_t settings; /* codec pseudo-tag, see decodeSettings() */
+    uint32_t strile;
+    uint32_t variant;
+} TIFFStrileCacheKey;
+
+typedef struct TIFFStrileCacheEntry
+{
+    TIFFStrileCacheKey key;
+    uint64_t hash;
+    struct TIFFStrileCacheEntry *chain; /* next entry in hash bucket */
+    struct TIFFStrileCacheEntry *prev;  /* LRU list, most recent first */
+    struct TIFFStrileCacheEntry *next;
+    tmsize_t size;
+    /* decoded data follows */
+} TIFFStrileCacheEntry;
+
+#define ENTRY_DATA(e) ((uint8_t *)((e) + 1))
+
+typedef struct
+{
+    strilecache_mutex_t mutex;
+    TIFFStrileCacheEntry **buckets;
+    uint32_t nbuckets; /* power of two */
+    uint32_t nentries;
+    TIFFStrileCacheEntry *head;
+    TIFFStrileCacheEntry *tail;
+    uint64_t bytes;
+    uint64_t max_bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+} TIFFStrileCacheShard;
+
+struct TIFFStrileCache
+{
+    strilecache_mutex_t refmutex;
+    int refcount;
+    uint32_t nshards; /* power of two */
+    TIFFStrileCacheShard shards[STRILECACHE_MAX_SHARDS];
+};
+
+static uint64_t mix64(uint64_t h, uint64_t v)
+{
+    h ^= v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t hashKey(const TIFFStrileCacheKey *key)
+{
+    uint64_t h = 0;
+    int i;
+    for (i = 0; i < 4; i++)
+        h = mix64(h, key->file[i]);
+    h = mix64(h, key->diroff);
+    h = mix64(h, key->settings);
+    return mix64(h, ((uint64_t)key->variant << 32) | key->strile);
+}
+
+static int keyEqual(const TIFFStrileCacheKey *a, const TIFFStrileCacheKey *b)
+{
+    return a->strile == b->strile && a->diroff == b->diroff &&
+           a->variant == b->variant && a->settings == b->settings &&
+           a->file[0] == b->file[0] &&
+           a->file[1] == b->file[1] && a->file[2] == b->file[2] &&
+           a->file[3] == b->file[3];
+}
+
+/*
+ * Create a cache holding at most max_bytes of decoded data.  The cache is
+ * returned with one reference owned by the caller, to be dropped with
+ * TIFFStrileCacheRelease(); each handle opened with it holds another.
+ */
+TIFFStrileCache *TIFFStrileCacheCreate(tmsize_t max_bytes)
+{
+    TIFFStrileCache *cache;
+    uint32_t i;
+
+    if (max_bytes <= 0)
+        return NULL;
+    cache = (TIFFStrileCache *)calloc(1, sizeof(TIFFStrileCache));
+    if (cache == NULL)
+        return NULL;
+    cache->nshards = 1;
+    while (cache->nshards < STRILECACHE_MAX_SHARDS &&
+           (uint64_t)max_bytes / (cache->nshards * 2) >=
+               STRILECACHE_MIN_SHARD_BYTES)
+        cache->nshards *= 2;
+    if (MUTEX_INIT(&cache->refmutex) != 0)
+    {
+        free(cache);
+        return NULL;
+    }
+    for (i = 0; i < cache->nshards; i++)
+    {
+        if (MUTEX_INIT(&cache->shards[i].mutex) != 0)
+        {
+            while (i-- > 0)
+                MUTEX_DESTROY(&cache->shards[i].mutex);
+            MUTEX_DESTROY(&cache->refmutex);
+            free(cache);
+            return NULL;
+        }
+        cache->shards[i].max_bytes = (uint64_t)max_bytes / cache->nshards;
+    }
+    cache->refcount = 1;
+    return cache;
+}
+
+static void clearShard(TIFFStrileCacheShard *shard)
+{
+    TIFFStrileCacheEntry *e = shard->head;
+    while (e)
+    {
+        TIFFStrileCacheEntry *next = e->next;
+        free(e);
+        e = next;
+    }
+    if (shard->buckets)
+        memset(shard->buckets, 0,
+               sizeof(TIFFStrileCacheEntry *) * shard->nbuckets);
+    shard->head = shard->tail = NULL;
+    shard->nentries = 0;
+    shard->bytes = 0;
+}
+
+static void TIFFStrileCacheRetain(TIFFStrileCache *cache)
+{
+    MUTEX_LOCK(&cache->refmutex);
+    cache->refcount++;
+    MUTEX_UNLOCK(&cache->refmutex);
+}
+
+/*
+ * Drop a reference to the cache.  Its memory is released once the creator
+ * and every handle using it are done with it.
+ */
+void TIFFStrileCacheRelease(TIFFStrileCache *cache)
+{
+    int refcount;
+    uint32_t i;
+
+    if (cache == NULL)
+        return;
+    MUTEX_LOCK(&cache->refmutex);
+    refcount = --cache->refcount;
+    MUTEX_UNLOCK(&cache->refmutex);
+    if (refcount > 0)
+        return;
+    for (i = 0; i < cache->nshards; i++)
+    {
+        clearShard(&cache->shards[i]);
+        free(cache->shards[i].buckets);
+        MUTEX_DESTROY(&cache->shards[i].mutex);
+    }
+    MUTEX_DESTROY(&cache->refmutex);
+    free(cache);
+}
+
+/* Drop every cached strile; statistics are kept. */
+void TIFFStrileCacheClear(TIFFStrileCache *cache)
+{
+    uint32_t i;
+    for (i = 0; i < cache->nshards; i++)
+    {
+        MUTEX_LOCK(&cache->shards[i].mutex);
+        clearShard(&cache->shards[i]);
+        MUTEX_UNLOCK(&cache->shards[i].mutex);
+    }
+}
+
+void TIFFStrileCacheGetStats(TIFFStrileCache *cache,
+                             TIFFStrileCacheStats *stats)
+{
+    uint32_t i;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < cache->nshards; i++)
+    {
+        TIFFStrileCacheShard *shard = &cache->shards[i];
+        MUTEX_LOCK(&shard->mutex);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->insertions += shard->insertions;
+        stats->evictions += shard->evictions;
+        stats->entries += shard->nentries;
+        stats->bytes += shard->bytes;
+        stats->max_bytes += shard->max_bytes;
+        MUTEX_UNLOCK(&shard->mutex);
+    }
+}
+
+void _TIFFStrileCacheAttach(TIFF *tif, TIFFStrileCache *cache)
+{
+    if (cache == NULL)
+        return;
+    TIFFStrileCacheRetain(cache);
+    tif->tif_strilecache = cache;
+    tif->tif_strilecachefile = 0;
+}
+
+void _TIFFStrileCacheDetach(TIFF *tif)
+{
+    TIFFStrileCacheRelease(tif->tif_strilecache);
+    tif->tif_strilecache = NULL;
+}
+
+/*
+ * Codecs whose output depends on a pseudo-tag set on the handle rather than
+ * on the directory contents: the tag and its value, or 0 for other codecs.
+ */
+static uint64_t decodeSettings(TIFF *tif)
+{
+    uint32_t tag;
+    int value = 0;
+
+    switch (tif->tif_dir.td_compression)
+    {
+        case COMPRESSION_JPEG:
+            tag = TIFFTAG_JPEGCOLORMODE;
+            break;
+        case COMPRESSION_PIXARLOG:
+            tag = TIFFTAG_PIXARLOGDATAFMT;
+            break;
+        case COMPRESSION_SGILOG:
+        case COMPRESSION_SGILOG24:
+            tag = TIFFTAG_SGILOGDATAFMT;
+            break;
+        case COMPRESSION_CCITTRLE:
+        case COMPRESSION_CCITTRLEW:
+        case COMPRESSION_CCITTFAX3:
+        case COMPRESSION_CCITTFAX4:
+            tag = TIFFTAG_FAXMODE;
+            break;
+        default:
+            return 0;
+    }
+    if (TIFFFindField(tif, tag, TIFF_ANY) == NULL ||
+        !TIFFGetField(tif, tag, &value))
+        return 0;
+    return ((uint64_t)tag << 32) | (uint32_t)value;
+}
+
+/*
+ * Build the cache key for strile of the current directory.  Only read-only
+ * handles on files whose identity is known take part in caching.
+ */
+static int makeKey(TIFF *tif, uint32_t strile, TIFFStrileCacheKey *key)
+{
+    if (tif->tif_mode != O_RDONLY)
+        return 0;
+    if (tif->tif_strilecachefile == 0)
+        tif->tif_strilecachefile =
+            _TIFFGetFileIdentity(tif, tif->tif_fileidentity) ? 1 : -1;
+    if (tif->tif_strilecachefile < 0)
+        return 0;
+    memcpy(key->file, tif->tif_fileidentity, sizeof(key->file));
+    key->diroff = tif->tif_diroff;
+    key->settings = decodeSettings(tif);
+    key->strile = strile;
+    key->variant = (uint32_t)(tif->tif_flags & STRILECACHE_DECODE_FLAGS);
+    if (isDecodeScaled(tif))
+        key->variant |= (uint32_t)tif->tif_decodescale << 28;
+    return 1;
+}
+
+static TIFFStrileCacheShard *shardFor(TIFFStrileCache *cache, uint64_t hash)
+{
+    return &cache->shards[(hash >> 32) & (cache->nshards - 1)];
+}
+
+static TIFFStrileCacheEntry *findEntry(TIFFStrileCacheShard *shard,
+                                       const TIFFStrileCacheKey *key,
+                                       uint64_t hash)
+{
+    TIFFStrileCacheEntry *e;
+    if (shard->nbuckets == 0)
+        return NULL;
+    for (e = shard->buckets[hash & (shard->nbuckets - 1)]; e; e = e->chain)
+    {
+        if (e->hash == hash && keyEqual(&e->key, key))
+            return e;
+    }
+    return NULL;
+}
+
+static void lruUnlink(TIFFStrileCacheShard *shard, TIFFStrileCacheEntry *e)
+{
+    if (e->prev)
+        e->prev->next = e->next;
+    else
+        shard->head = e->next;
+    if (e->next)
+        e->next->prev = e->prev;
+    else
+        shard->tail = e->prev;
+}
+
+static void lruPushFront(TIFFStrileCacheShard *shard, TIFFStrileCacheEntry *e)
+{
+    e->prev = NULL;
+    e->next = shard->head;
+    if (shard->head)
+        shard->head->prev = e;
+    shard->head = e;
+    if (shard->tail == NULL)
+        shard->tail = e;
+}
+
+static void removeEntry(TIFFStrileCacheShard *shard, TIFFStrileCacheEntry *e)
+{
+    TIFFStrileCacheEntry **pp =
+        &shard->buckets[e->hash & (shard->nbuckets - 1)];
+    while (*pp != e)
+        pp = &(*pp)->chain;
+    *pp = e->chain;
+    lruUnlink(shard, e);
+    shard->nentries--;
+    shard->bytes -= (uint64_t)e->size;
+    free(e);
+}
+
+static int growBuckets(TIFFStrileCacheShard *shard)
+{
+    uint32_t nbuckets = shard->nbuckets ? shard->nbuckets * 2 : 64;
+    TIFFStrileCacheEntry **buckets = (TIFFStrileCacheEntry **)calloc(
+        nbuckets, sizeof(TIFFStrileCacheEntry *));
+    TIFFStrileCacheEntry *e;
+
+    if (buckets == NULL)
+        return 0;
+    for (e = shard->head; e; e = e->next)
+    {
+        TIFFStrileCacheEntry **bucket = &buckets[e->hash & (nbuckets - 1)];
+        e->chain = *bucket;
+        *bucket = e;
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->nbuckets = nbuckets;
+    return 1;
+}
+
+/*
+ * Copy up to size bytes of the cached strile into buf.  Returns the number
+ * of bytes copied, or 0 if the strile is not cached.
+ */
+tmsize_t _TIFFStrileCacheLookup(TIFF *tif, uint32_t strile, void *buf,
+                                tmsize_t size)
+{
+    TIFFStrileCacheKey key;
+    TIFFStrileCacheShard *shard;
+    TIFFStrileCacheEntry *e;
+    uint64_t hash;
+    tmsize_t cc = 0;
+
+    if (buf == NULL || !makeKey(tif, strile, &key))
+        return 0;
+    hash = hashKey(&key);
+    shard = shardFor(tif->tif_strilecache, hash);
+    MUTEX_LOCK(&shard->mutex);
+    e = findEntry(shard, &key, hash);
+    if (e)
+    {
+        cc = TIFFmin(size, e->size);
+        _TIFFmemcpy(buf, ENTRY_DATA(e), cc);
+        lruUnlink(shard, e);
+        lruPushFront(shard, e);
+        shard->hits++;
+    }
+    else
+        shard->misses++;
+    MUTEX_UNLOCK(&shard->mutex);
+    return cc;
+}
+
+/* Record the fully decoded contents of strile. */
+void _TIFFStrileCacheInsert(TIFF *tif, uint32_t strile, const void *buf,
+                            tmsize_t size)
+{
+    TIFFStrileCacheKey key;
+    TIFFStrileCacheShard *shard;
+    TIFFStrileCacheEntry *e;
+    uint64_t hash;
+
+    if (buf == NULL || size <= 0 || !makeKey(tif, strile, &key))
+        return;
+    hash = hashKey(&key);
+    shard = shardFor(tif->tif_strilecache, hash);
+    if ((uint64_t)size > shard->max_bytes)
+        return;
+    e = (TIFFStrileCacheEntry *)malloc(sizeof(TIFFStrileCacheEntry) +
+                                       (size_t)size);
+    if (e == NULL)
+        return;
+    e->key = key;
+    e->hash = hash;
+    e->size = size;
+    _TIFFmemcpy(ENTRY_DATA(e), buf, size);
+
+    MUTEX_LOCK(&shard->mutex);
+    if (findEntry(shard, &key, hash) != NULL ||
+        (shard->nentries >= shard->nbuckets && !growBuckets(shard)))
+    {
+        /* Another handle got there first, or no memory for the table */
+        MUTEX_UNLOCK(&shard->mutex);
+        free(e);
+        return;
+    }
+    while (shard->bytes + (uint64_t)size > shard->max_bytes)
+    {
+        removeEntry(shard, shard->tail);
+        shard->evictions++;
+    }
+    {
+        TIFFStrileCacheEntry **bucket =
+            &shard->buckets[hash & (shard->nbuckets - 1)];
+        e->chain = *bucket;
+        *bucket = e;
+    }
+    lruPushFront(shard, e);
+    shard->nentries++;
+    shard->bytes += (uint64_t)size;
+    shard->insertions++;
+    MUTEX_UNLOCK(&shard->mutex);
+}
@@ -0,0 +1,270 @@
+#include "tiffiop.h"
+
+/*
+ * Paged cache of the strip/tile offset and byte count arrays.
+ *
+ * With the 'O' open mode flag (TIFF_LAZYSTRILELOAD), values are normally
+ * read around each requested strile into arrays sized for the whole image,
+ * which end up as large as if they had been loaded at once.  When
+ * TIFFOpenOptionsSetStrileArrayCacheSize() sets a budget, the values are
+ * instead kept in pages of STRILEPAGE_ENTRIES consecutive striles, loaded on
+ * demand from each array separately and recycled in least recently used
+ * order once the budget is reached.  Random access to the tiles of huge
+ * images then costs a bounded amount of memory, and at most one small read
+ * per array for each page missed.
+ */
+
+#define STRILEPAGE_ENTRIES 512
+
+typedef struct TIFFStrilePage
+{
+    uint32_t index;    /* first strile is index * STRILEPAGE_ENTRIES */
+    uint8_t loaded[2]; /* offsets, byte counts */
+    struct TIFFStrilePage *hashnext;
+    struct TIFFStrilePage *prev; /* more recently used */
+    struct TIFFStrilePage *next; /* less recently used */
+    uint64_t values[2][STRILEPAGE_ENTRIES];
+} TIFFStrilePage;
+
+struct TIFFStrilePages
+{
+    TIFFStrilePage **buckets;
+    uint32_t nbuckets; /* power of 2 */
+    uint32_t npages;
+    uint32_t maxpages;
+    TIFFStrilePage *head; /* most recently used */
+    TIFFStrilePage *tail; /* least recently used */
+};
+
+void _TIFFStrilePagesFree(TIFF *tif)
+{
+    TIFFStrilePages *pages = tif->tif_strilepages;
+    TIFFStrilePage *page;
+    if (pages == NULL)
+        return;
+    page = pages->head;
+    while (page != NULL)
+    {
+        TIFFStrilePage *next = page->next;
+        _TIFFfreeExt(tif, page);
+        page = next;
+    }
+    _TIFFfreeExt(tif, pages->buckets);
+    _TIFFfreeExt(tif, pages);
+    tif->tif_strilepages = NULL;
+}
+
+static TIFFStrilePages *TIFFStrilePagesCreate(TIFF *tif)
+{
+    static const char module[] = "TIFFStrilePagesCreate";
+    const uint32_t nstrips = tif->tif_dir.td_nstrips;
+    const uint32_t imagepages =
+        nstrips / STRILEPAGE_ENTRIES + (nstrips % STRILEPAGE_ENTRIES != 0);
+    tmsize_t maxpages = tif->tif_strilepagesbudget / sizeof(TIFFStrilePage);
+    TIFFStrilePages *pages;
+    uint32_t nbuckets = 16;
+
+    if (maxpages < 1)
+        maxpages = 1;
+    if ((uint64_t)maxpages > imagepages)
+        maxpages = imagepages;
+    while (nbuckets < (uint64_t)maxpages && nbuckets < 0x80000000U)
+        nbuckets *= 2;
+    pages = (TIFFStrilePages *)_TIFFcallocExt(tif, 1, sizeof(TIFFStrilePages));
+    if (pages != NULL)
+        pages->buckets = (TIFFStrilePage **)_TIFFcallocExt(
+            tif, nbuckets, sizeof(TIFFStrilePage *));
+    if (pages == NULL || pages->buckets == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        _TIFFfreeExt(tif, pages);
+        return NULL;
+    }
+    pages->nbuckets = nbuckets;
+    pages->maxpages = (uint32_t)maxpages;
+    tif->tif_strilepages = pages;
+    return pages;
+}
+
+static void TIFFStrilePageUnlink(TIFFStrilePages *pages, TIFFStrilePage *page)
+{
+    if (page->prev != NULL)
+        page->prev->next = page->next;
+    else
+        pages->head = page->next;
+    if (page->next != NULL)
+        page->next->prev = page->prev;
+    else
+        pages->tail = page->prev;
+}
+
+static void TIFFStrilePagePushFront(TIFFStrilePages *pages,
+                                    TIFFStrilePage *page)
+{
+    page->prev = NULL;
+    page->next = pages->head;
+    if (pages->head != NULL)
+        pages->head->prev = page;
+    else
+        pages->tail = page;
+    pages->head = page;
+}
+
+/* Return the page of the given index, recycling the least recently used
+ * one if the budget is reached.  Its arrays are not loaded yet if it is
+ * new. */
+static TIFFStrilePage *TIFFStrilePageGet(TIFF *tif, TIFFStrilePages *pages,
+                                         uint32_t index)
+{
+    static const char module[] = "TIFFStrilePageGet";
+    TIFFStrilePage **bucket = &pages->buckets[index & (pages->nbuckets - 1)];
+    TIFFStrilePage *page;
+
+    for (page = *bucket; page != NULL; page = page->hashnext)
+    {
+        if (page->index == index)
+        {
+            if (page != pages->head)
+            {
+                TIFFStrilePageUnlink(pages, page);
+                TIFFStrilePagePushFront(pages, page);
+            }
+            return page;
+        }
+    }
+
+    if (pages->npages < pages->maxpages)
+    {
+        page = (TIFFStrilePage *)_TIFFmallocExt(tif, sizeof(TIFFStrilePage));
+        if (page == NULL)
+        {
+            TIFFErrorExtR(tif, module, "Out of memory");
+            return NULL;
+        }
+        pages->npages++;
+    }
+    else
+    {
+        TIFFStrilePage **pp;
+        page = pages->tail;
+        TIFFStrilePageUnlink(pages, page);
+        pp = &pages->buckets[page->index & (pages->nbuckets - 1)];
+        while (*pp != page)
+            pp = &(*pp)->hashnext;
+        *pp = page->hashnext;
+    }
+    page->index = index;
+    page->loaded[0] = 0;
+    page->loaded[1] = 0;
+    page->hashnext = *bucket;
+    *bucket = page;
+    TIFFStrilePagePushFront(pages, page);
+    return page;
+}
+
+/* Read the values of one array of a page, with a single read into the tail
+ * of the page, then widen them in place. */
+static int TIFFStrilePageLoad(TIFF *tif, const TIFFDirEntry *dirent,
+                              TIFFStrilePage *page, int which)
+{
+    static const char module[] = "TIFFStrilePageLoad";
+    const int bSwab = (tif->tif_flags & TIFF_SWAB) != 0;
+    const uint64_t first = (uint64_t)page->index * STRILEPAGE_ENTRIES;
+    uint64_t *values = page->values[which];
+    uint64_t base;
+    uint8_t *raw;
+    tmsize_t sizeofval, size;
+    uint32_t n;
+
+    switch (dirent->tdir_type)
+    {
+        case TIFF_SHORT:
+            sizeofval = 2;
+            break;
+        case TIFF_LONG:
+            sizeofval = 4;
+            break;
+        case TIFF_LONG8:
+        /* Non conformant but used by some images as in */
+        /* https://github.com/OSGeo/gdal/issues/2165 */
+        case TIFF_SLONG8:
+            sizeofval = 8;
+            break;
+        default:
+            TIFFErrorExtR(tif, module,
+                          "Invalid type for [Strip|Tile][Offset/ByteCount] tag");
+            return 0;
+    }
+    if (tif->tif_flags & TIFF_BIGTIFF)
+    {
+        base = dirent->tdir_offset.toff_long8;
+        if (bSwab)
+            TIFFSwabLong8(&base);
+    }
+    else
+    {
+        uint32_t base32 = dirent->tdir_offset.toff_long;
+        if (bSwab)
+            TIFFSwabLong(&base32);
+        base = base32;
+    }
+    n = dirent->tdir_count - first < STRILEPAGE_ENTRIES
+            ? (uint32_t)(dirent->tdir_count - first)
+            : STRILEPAGE_ENTRIES;
+    size = (tmsize_t)n * sizeofval;
+    /* To avoid unsigned integer overflows */
+    if (base > (uint64_t)INT64_MAX ||
+        first * sizeofval > (uint64_t)INT64_MAX - base)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Cannot read offset/size for strile %" PRIu64, first);
+        return 0;
+    }
+    raw = (uint8_t *)values + sizeof(page->values[which]) - size;
+    if (!SeekOK(tif, base + first * sizeofval) ||
+        TIFFReadFile(tif, raw, size) != size)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Cannot read offset/size for strile around ~%" PRIu64,
+                      first);
+        return 0;
+    }
+    if (sizeofval == 2)
+        _TIFFWidenArrayOfShort(values, raw, n, bSwab);
+    else if (sizeofval == 4)
+        _TIFFWidenArrayOfLong(values, raw, n, bSwab);
+    else
+    {
+        if (raw != (uint8_t *)values)
+            memmove(values, raw, (size_t)size);
+        if (bSwab)
+            TIFFSwabArrayOfLong8(values, n);
+    }
+    page->loaded[which] = 1;
+    return 1;
+}
+
+/*
+ * Return in *value the value for strile of the [Strip|Tile]Offsets or
+ * [Strip|Tile]ByteCounts array described by dirent, which is one of the two
+ * deferred entries of the current directory.
+ */
+int _TIFFStrilePagesGet(TIFF *tif, TIFFDirEntry *dirent, uint32_t strile,
+                        uint64_t *value)
+{
+    const int which = dirent == &tif->tif_dir.td_stripbytecount_entry;
+    TIFFStrilePages *pages = tif->tif_strilepages;
+    TIFFStrilePage *page;
+
+    if (strile >= dirent->tdir_count || strile >= tif->tif_dir.td_nstrips)
+        return 0;
+    if (pages == NULL && (pages = TIFFStrilePagesCreate(tif)) == NULL)
+        return 0;
+    page = TIFFStrilePageGet(tif, pages, strile / STRILEPAGE_ENTRIES);
+    if (page == NULL)
+        return 0;
+    if (!page->loaded[which] && !TIFFStrilePageLoad(tif, dirent, page, which))
+        return 0;
+    *value = page->values[which][strile % STRILEPAGE_ENTRIES];
+    return 1;
+}
@@ -0,0 +1,229 @@
+#include "tiffiop.h"
+
+/*
+ * Streamed writing of the strip/tile offset and byte count arrays.
+ *
+ * After TIFFStreamStrileArrayWriting(), TIFFSetupStrips() reserves both
+ * arrays in the file, at its end, before any strip/tile of the directory is
+ * written, instead of allocating them in memory.  The entries of the strips
+ * being written are kept in a window of STRILESTREAM_WINDOW consecutive
+ * striles, which is written back to the reserved arrays when another window
+ * is needed, when the directory is written and by TIFFFlush().  The
+ * directory entries then simply point to the reserved arrays, so that the
+ * metadata kept in memory does not depend on the number of strips/tiles.
+ *
+ * The arrays are stored as LONG8 in BigTIFF files and LONG otherwise.
+ */
+
+#define STRILESTREAM_WINDOW 4096
+
+struct TIFFStrileStream
+{
+    uint64_t arrayoff[2]; /* file offsets of the offset and byte count arrays */
+    uint32_t nstriles;
+    int valuesize; /* 4 or 8 */
+    uint32_t first; /* first strile of the window */
+    uint32_t dirtylo, dirtyhi; /* range of the window to write back */
+    uint32_t written; /* striles from there on were never written back */
+    uint64_t values[2][STRILESTREAM_WINDOW];
+    uint8_t raw[STRILESTREAM_WINDOW * 8]; /* values in the file layout */
+};
+
+void _TIFFStrileStreamFree(TIFF *tif)
+{
+    _TIFFfreeExt(tif, tif->tif_strilestream);
+    tif->tif_strilestream = NULL;
+}
+
+/* Write back the modified entries of the window. */
+int _TIFFStrileStreamFlush(TIFF *tif)
+{
+    static const char module[] = "_TIFFStrileStreamFlush";
+    TIFFStrileStream *stream = tif->tif_strilestream;
+    uint32_t n;
+
+    if (stream == NULL || stream->dirtylo >= stream->dirtyhi)
+        return 1;
+    n = stream->dirtyhi - stream->dirtylo;
+    for (int which = 0; which < 2; which++)
+    {
+        const uint64_t *values = stream->values[which] + stream->dirtylo;
+        const uint64_t off =
+            stream->arrayoff[which] +
+            (uint64_t)(stream->first + stream->dirtylo) * stream->valuesize;
+        if (stream->valuesize == 8)
+        {
+            memcpy(stream->raw, values, (size_t)n * 8);
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabArrayOfLong8((uint64_t *)stream->raw, n);
+        }
+        else
+        {
+            uint32_t *p = (uint32_t *)stream->raw;
+            for (uint32_t i = 0; i < n; i++)
+            {
+                if (values[i] > 0xFFFFFFFFU)
+                {
+                    TIFFErrorExtR(tif, module,
+                                  "Attempt to write value larger than "
+                                  "0xFFFFFFFF in LONG array.");
+                    return 0;
+                }
+                p[i] = (uint32_t)values[i];
+            }
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabArrayOfLong(p, n);
+        }
+        if (!SeekOK(tif, off) ||
+            !WriteOK(tif, stream->raw, (tmsize_t)n * stream->valuesize))
+        {
+            TIFFErrorExtR(tif, module, "IO error writing strile arrays");
+            return 0;
+        }
+    }
+    if (stream->first + stream->dirtyhi > stream->written)
+        stream->written = stream->first + stream->dirtyhi;
+    stream->dirtylo = STRILESTREAM_WINDOW;
+    stream->dirtyhi = 0;
+    return 1;
+}
+
+/* Make the window start at first, reading back the entries already
+ * written. */
+static int TIFFStrileStreamLoad(TIFF *tif, TIFFStrileStream *stream,
+                                uint32_t first)
+{
+    static const char module[] = "TIFFStrileStreamLoad";
+    uint32_t n = stream->nstriles - first < STRILESTREAM_WINDOW
+                     ? stream->nstriles - first
+                     : STRILESTREAM_WINDOW;
+
+    if (!_TIFFStrileStreamFlush(tif))
+        return 0;
+    stream->first = first;
+    memset(stream->values, 0, sizeof(stream->values));
+    if (first >= stream->written)
+        return 1;
+    for (int which = 0; which < 2; which++)
+    {
+        const uint64_t off = stream->arrayoff[which] +
+                             (uint64_t)first * stream->valuesize;
+        if (!SeekOK(tif, off) ||
+            !ReadOK(tif, stream->raw, (tmsize_t)n * stream->valuesize))
+        {
+            TIFFErrorExtR(tif, module, "IO error reading strile arrays");
+            return 0;
+        }
+        if (stream->valuesize == 8)
+        {
+            memcpy(stream->values[which], stream->raw, (size_t)n * 8);
+            if (tif->tif_flags & TIFF_SWAB)
+                TIFFSwabArrayOfLong8(stream->values[which], n);
+        }
+        else
+            _TIFFWidenArrayOfLong(stream->values[which], stream->raw, n,
+                                  (tif->tif_flags & TIFF_SWAB) != 0);
+    }
+    return 1;
+}
+
+/*
+ * Reserve the arrays at the end of the file for the td_nstrips striles set
+ * up by TIFFSetupStrips().
+ */
+int _TIFFStrileStreamSetup(TIFF *tif)
+{
+    static const char module[] = "_TIFFStrileStreamSetup";
+    TIFFStrileStream *stream;
+    uint64_t pos, off, arraysize, end;
+
+    stream =
+        (TIFFStrileStream *)_TIFFcallocExt(tif, 1, sizeof(TIFFStrileStream));
+    if (stream == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return 0;
+    }
+    stream->nstriles = tif->tif_dir.td_nstrips;
+    stream->valuesize = (tif->tif_flags & TIFF_BIGTIFF) ? 8 : 4;
+    stream->dirtylo = STRILESTREAM_WINDOW;
+
+    /* Values must start on a word boundary */
+    pos = off = TIFFSeekFile(tif, 0, SEEK_END);
+    if (off & 1)
+        off++;
+    arraysize = (uint64_t)stream->nstriles * stream->valuesize;
+    end = off + 2 * arraysize;
+    if (!(tif->tif_flags & TIFF_BIGTIFF) && end > 0xFFFFFFFFU)
+    {
+        TIFFErrorExtR(tif, module, "Maximum TIFF file size exceeded");
+        _TIFFfreeExt(tif, stream);
+        return 0;
+    }
+    stream->arrayoff[0] = off;
+    stream->arrayoff[1] = off + arraysize;
+
+    /* Zero-fill both arrays (and the padding byte, if any) */
+    while (pos < end)
+    {
+        tmsize_t chunk = end - pos < sizeof(stream->raw)
+                             ? (tmsize_t)(end - pos)
+                             : (tmsize_t)sizeof(stream->raw);
+        if (!WriteOK(tif, stream->raw, chunk))
+        {
+            TIFFErrorExtR(tif, module, "IO error reserving strile arrays");
+            _TIFFfreeExt(tif, stream);
+            return 0;
+        }
+        pos += (uint64_t)chunk;
+    }
+    tif->tif_strilestream = stream;
+    return 1;
+}
+
+/*
+ * Return pointers to the offset and byte count of strile, which remain
+ * valid until another strile is asked for.  The current write position is
+ * preserved.
+ */
+int _TIFFStrileStreamEntry(TIFF *tif, uint32_t strile, uint64_t **poffset,
+                           uint64_t **pbytecount)
+{
+    static const char module[] = "_TIFFStrileStreamEntry";
+    TIFFStrileStream *stream = tif->tif_strilestream;
+    uint32_t i;
+
+    if (strile >= stream->nstriles)
+    {
+        TIFFErrorExtR(tif, module, "Strile %" PRIu32 " out of range", strile);
+        return 0;
+    }
+    if (strile < stream->first ||
+        strile - stream->first >= STRILESTREAM_WINDOW)
+    {
+        const uint64_t pos = TIFFSeekFile(tif, 0, SEEK_CUR);
+        if (!TIFFStrileStreamLoad(tif, stream,
+                                  strile - strile % STRILESTREAM_WINDOW) ||
+            !SeekOK(tif, pos))
+            return 0;
+    }
+    i = strile - stream->first;
+    /* The caller may update the entry */
+    if (i < stream->dirtylo)
+        stream->dirtylo = i;
+    if (i + 1 > stream->dirtyhi)
+        stream->dirtyhi = i + 1;
+    *poffset = &stream->values[0][i];
+    *pbytecount = &stream->values[1][i];
+    return 1;
+}
+
+/* File offset of the reserved offset (which = 0) or byte count (which = 1)
+ * array, once written back. */
+int _TIFFStrileStreamArray(TIFF *tif, int which, uint64_t *offset)
+{
+    if (!_TIFFStrileStreamFlush(tif))
+        return 0;
+    *offset = tif->tif_strilestream->arrayoff[which];
+    return 1;
+}
@@ -136,7 +136,8 @@ uint64_t TIFFVStripSize64(TIFF *tif, uint32_t nrows)
             _TIFFMultiply64(tif, samplingrow_size, samplingblocks_ver, module));
     }
     else
-        return (_TIFFMultiply64(tif, nrows, TIFFScanlineSize64(tif), module));
+        return (_TIFFMultiply64(tif, TIFFScaledDim(tif, nrows),
+                                TIFFScanlineSize64(tif), module));
 }
 tmsize_t TIFFVStripSize(TIFF *tif, uint32_t nrows)
 {
@@ -299,7 +300,7 @@ uint64_t TIFFScanlineSize64(TIFF *tif)
         else
         {
             uint64_t scanline_samples;
-            uint32_t scanline_width = td->td_imagewidth;
+            uint32_t scanline_width = TIFFScaledDim(tif, td->td_imagewidth);
 
 #if 0
             // Tries to fix https://gitlab.com/libtiff/libtiff/-/merge_requests/564
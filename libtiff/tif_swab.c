@@ -755,3 +755,206 @@ void TIFFReverseBits(uint8_t *cp, tmsize_t n)
 #endif
     TIFFReverseBitsScalar(cp, n);
 }
+
+/*
+ * Widen n SHORT or LONG values, stored unaligned and byte-swapped if swab is
+ * set, to native uint64_t.  Used to load strip/tile offset and byte count
+ * arrays.  src may be the last n * 2 (resp. n * 4) bytes of dst: each block
+ * of values is loaded before the wider results are stored.
+ */
+static void TIFFWidenArrayOfShortScalar(uint64_t *dst, const uint8_t *src,
+                                        tmsize_t n, int swab)
+{
+    for (tmsize_t i = 0; i < n; i++)
+    {
+        uint16_t v;
+        memcpy(&v, src + i * 2, sizeof(v));
+        if (swab)
+            TIFFSwabShort(&v);
+        dst[i] = v;
+    }
+}
+
+static void TIFFWidenArrayOfLongScalar(uint64_t *dst, const uint8_t *src,
+                                       tmsize_t n, int swab)
+{
+    for (tmsize_t i = 0; i < n; i++)
+    {
+        uint32_t v;
+        memcpy(&v, src + i * 4, sizeof(v));
+        if (swab)
+            TIFFSwabLong(&v);
+        dst[i] = v;
+    }
+}
+
+#if defined(HAVE_NEON) && defined(__ARM_NEON)
+static void TIFFWidenArrayOfShortNeon(uint64_t *dst, const uint8_t *src,
+                                      tmsize_t n, int swab)
+{
+    tmsize_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint8x16_t b = vld1q_u8(src + i * 2);
+        if (swab)
+            b = vrev16q_u8(b);
+        uint16x8_t v = vreinterpretq_u16_u8(b);
+        uint32x4_t lo = vmovl_u16(vget_low_u16(v));
+        uint32x4_t hi = vmovl_u16(vget_high_u16(v));
+        vst1q_u64(dst + i, vmovl_u32(vget_low_u32(lo)));
+        vst1q_u64(dst + i + 2, vmovl_u32(vget_high_u32(lo)));
+        vst1q_u64(dst + i + 4, vmovl_u32(vget_low_u32(hi)));
+        vst1q_u64(dst + i + 6, vmovl_u32(vget_high_u32(hi)));
+    }
+    TIFFWidenArrayOfShortScalar(dst + i, src + i * 2, n - i, swab);
+}
+
+static void TIFFWidenArrayOfLongNeon(uint64_t *dst, const uint8_t *src,
+                                     tmsize_t n, int swab)
+{
+    tmsize_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        uint8x16_t b = vld1q_u8(src + i * 4);
+        if (swab)
+            b = vrev32q_u8(b);
+        uint32x4_t v = vreinterpretq_u32_u8(b);
+        vst1q_u64(dst + i, vmovl_u32(vget_low_u32(v)));
+        vst1q_u64(dst + i + 2, vmovl_u32(vget_high_u32(v)));
+    }
+    TIFFWidenArrayOfLongScalar(dst + i, src + i * 4, n - i, swab);
+}
+#endif
+
+#if defined(HAVE_SSE41)
+static void TIFFWidenArrayOfShortSSE41(uint64_t *dst, const uint8_t *src,
+                                       tmsize_t n, int swab)
+{
+    const __m128i mask =
+        _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+    tmsize_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        if (swab)
+            v = _mm_shuffle_epi8(v, mask);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_cvtepu16_epi64(v));
+        _mm_storeu_si128((__m128i *)(dst + i + 2),
+                         _mm_cvtepu16_epi64(_mm_srli_si128(v, 4)));
+        _mm_storeu_si128((__m128i *)(dst + i + 4),
+                         _mm_cvtepu16_epi64(_mm_srli_si128(v, 8)));
+        _mm_storeu_si128((__m128i *)(dst + i + 6),
+                         _mm_cvtepu16_epi64(_mm_srli_si128(v, 12)));
+    }
+    TIFFWidenArrayOfShortScalar(dst + i, src + i * 2, n - i, swab);
+}
+
+static void TIFFWidenArrayOfLongSSE41(uint64_t *dst, const uint8_t *src,
+                                      tmsize_t n, int swab)
+{
+    const __m128i mask =
+        _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    tmsize_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        if (swab)
+            v = _mm_shuffle_epi8(v, mask);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_cvtepu32_epi64(v));
+        _mm_storeu_si128((__m128i *)(dst + i + 2),
+                         _mm_cvtepu32_epi64(_mm_srli_si128(v, 8)));
+    }
+    TIFFWidenArrayOfLongScalar(dst + i, src + i * 4, n - i, swab);
+}
+#endif
+
+#if defined(HAVE_SSE2)
+static void TIFFWidenArrayOfShortSSE2(uint64_t *dst, const uint8_t *src,
+                                      tmsize_t n, int swab)
+{
+    const __m128i zero = _mm_setzero_si128();
+    tmsize_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i lo, hi;
+        if (swab)
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        lo = _mm_unpacklo_epi16(v, zero);
+        hi = _mm_unpackhi_epi16(v, zero);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi32(lo, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 2),
+                         _mm_unpackhi_epi32(lo, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 4),
+                         _mm_unpacklo_epi32(hi, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 6),
+                         _mm_unpackhi_epi32(hi, zero));
+    }
+    TIFFWidenArrayOfShortScalar(dst + i, src + i * 2, n - i, swab);
+}
+
+static void TIFFWidenArrayOfLongSSE2(uint64_t *dst, const uint8_t *src,
+                                     tmsize_t n, int swab)
+{
+    const __m128i zero = _mm_setzero_si128();
+    tmsize_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i * 4));
+        if (swab)
+        {
+            v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+            v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+            v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(2, 3, 0, 1));
+        }
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi32(v, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 2),
+                         _mm_unpackhi_epi32(v, zero));
+    }
+    TIFFWidenArrayOfLongScalar(dst + i, src + i * 4, n - i, swab);
+}
+#endif
+
+void _TIFFWidenArrayOfShort(uint64_t *dst, const void *src, tmsize_t n,
+                            int swab)
+{
+    const uint8_t *p = (const uint8_t *)src;
+#if defined(HAVE_NEON) && defined(__ARM_NEON)
+    if (tiff_use_neon)
+        TIFFWidenArrayOfShortNeon(dst, p, n, swab);
+    else
+#endif
+#if defined(HAVE_SSE41)
+    if (tiff_use_sse41)
+        TIFFWidenArrayOfShortSSE41(dst, p, n, swab);
+    else
+#endif
+#if defined(HAVE_SSE2)
+    if (tiff_use_sse2)
+        TIFFWidenArrayOfShortSSE2(dst, p, n, swab);
+    else
+#endif
+        TIFFWidenArrayOfShortScalar(dst, p, n, swab);
+}
+
+void _TIFFWidenArrayOfLong(uint64_t *dst, const void *src, tmsize_t n,
+                           int swab)
+{
+    const uint8_t *p = (const uint8_t *)src;
+#if defined(HAVE_NEON) && defined(__ARM_NEON)
+    if (tiff_use_neon)
+        TIFFWidenArrayOfLongNeon(dst, p, n, swab);
+    else
+#endif
+#if defined(HAVE_SSE41)
+    if (tiff_use_sse41)
+        TIFFWidenArrayOfLongSSE41(dst, p, n, swab);
+    else
+#endif
+#if defined(HAVE_SSE2)
+    if (tiff_use_sse2)
+        TIFFWidenArrayOfLongSSE2(dst, p, n, swab);
+    else
+#endif
+        TIFFWidenArrayOfLongScalar(dst, p, n, swab);
+}
@@ -154,7 +154,8 @@ uint64_t TIFFTileRowSize64(TIFF *tif)
         TIFFErrorExtR(tif, module, "Tile width is zero");
         return (0);
     }
-    rowsize = _TIFFMultiply64(tif, td->td_bitspersample, td->td_tilewidth,
+    rowsize = _TIFFMultiply64(tif, td->td_bitspersample,
+                              TIFFScaledDim(tif, td->td_tilewidth),
                               "TIFFTileRowSize");
     if (td->td_planarconfig == PLANARCONFIG_CONTIG)
     {
@@ -233,7 +234,8 @@ uint64_t TIFFVTileSize64(TIFF *tif, uint32_t nrows)
             _TIFFMultiply64(tif, samplingrow_size, samplingblocks_ver, module));
     }
     else
-        return (_TIFFMultiply64(tif, nrows, TIFFTileRowSize64(tif), module));
+        return (_TIFFMultiply64(tif, TIFFScaledDim(tif, nrows),
+                                TIFFTileRowSize64(tif), module));
 }
 tmsize_t TIFFVTileSize(TIFF *tif, uint32_t nrows)
 {
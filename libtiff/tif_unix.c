@@ -31,6 +31,10 @@
 #undef TIFF_DO_NOT_USE_NON_EXT_ALLOC_FUNCTIONS
 #endif
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE /* O_DIRECT */
+#endif
+
 #include "tif_config.h"
 
 #ifdef HAVE_SYS_TYPES_H
@@ -259,6 +263,359 @@ static void _tiffUnmapProc(thandle_t fd, void *base, toff_t size)
 }
 #endif /* !HAVE_MMAP */
 
+#ifdef O_DIRECT
+#ifdef TIFF_USE_THREADPOOL
+#include <pthread.h>
+#endif
+
+/*
+ * Direct I/O (TIFFOpenOptionsSetDirectIO()).  The file is opened twice:
+ * once normally and once with O_DIRECT, which bypasses the page cache but
+ * requires the buffer, the file offset and the length of every transfer to
+ * be aligned.  Large reads go through the O_DIRECT descriptor, via an aligned
+ * bounce buffer covering the aligned superset of the requested range.
+ * Writes are gathered in the same buffer while they are sequential, which is
+ * the case of the strips and tiles appended by TIFFAppendToStrip(), and
+ * written out in aligned blocks; only the unaligned head and tail of each
+ * sequence, and small reads such as those of directories, use the page
+ * cache.  The kernel keeps both descriptors coherent.  Should the filesystem
+ * refuse the alignment with EINVAL, everything goes through the page cache.
+ *
+ * In builds with thread support, the bounce buffers are pooled, under a
+ * lock, so that converting many files in a row does not allocate one per
+ * file; elsewhere each file allocates its own.
+ */
+
+#define DIRECTIO_ALIGN 4096
+#define DIRECTIO_BUFSIZE (4 * 1024 * 1024)
+#define DIRECTIO_MIN_READ (64 * 1024) /* smaller reads use the page cache */
+#define DIRECTIO_POOL_SIZE 4
+
+typedef struct
+{
+    int fd;        /* cached descriptor, also tif_fd */
+    int dfd;       /* O_DIRECT descriptor */
+    uint64_t pos;  /* current file offset */
+    uint8_t *buf;  /* aligned bounce buffer */
+    uint64_t wstart; /* aligned file offset of the pending writes */
+    size_t wlen;     /* bytes of pending writes in buf */
+    int nodirect;    /* O_DIRECT transfers were refused */
+} TIFFDirectIO;
+
+#ifdef TIFF_USE_THREADPOOL
+static uint8_t *gDirectIOPool[DIRECTIO_POOL_SIZE];
+static int gDirectIOPoolCount = 0;
+static pthread_mutex_t gDirectIOPoolMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static uint8_t *_tiffDirectBufferGet(void)
+{
+    void *p = NULL;
+#ifdef TIFF_USE_THREADPOOL
+    pthread_mutex_lock(&gDirectIOPoolMutex);
+    if (gDirectIOPoolCount > 0)
+        p = gDirectIOPool[--gDirectIOPoolCount];
+    pthread_mutex_unlock(&gDirectIOPoolMutex);
+#endif
+    if (p == NULL && posix_memalign(&p, DIRECTIO_ALIGN, DIRECTIO_BUFSIZE) != 0)
+        p = NULL;
+    return (uint8_t *)p;
+}
+
+static void _tiffDirectBufferPut(uint8_t *p)
+{
+#ifdef TIFF_USE_THREADPOOL
+    pthread_mutex_lock(&gDirectIOPoolMutex);
+    if (gDirectIOPoolCount < DIRECTIO_POOL_SIZE)
+    {
+        gDirectIOPool[gDirectIOPoolCount++] = p;
+        p = NULL;
+    }
+    pthread_mutex_unlock(&gDirectIOPoolMutex);
+#endif
+    free(p);
+}
+
+static int _tiffDirectPWrite(int fd, const uint8_t *p, size_t n, uint64_t off)
+{
+    while (n > 0)
+    {
+        ssize_t ret = pwrite(fd, p, n, (_TIFF_off_t)off);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return 0;
+        p += ret;
+        n -= (size_t)ret;
+        off += (uint64_t)ret;
+    }
+    return 1;
+}
+
+/* Write out the pending writes: the aligned part through O_DIRECT, the rest
+ * through the page cache. */
+static int _tiffDirectFlush(TIFFDirectIO *d)
+{
+    const size_t aligned = d->wlen & ~(size_t)(DIRECTIO_ALIGN - 1);
+    int ok = 1;
+
+    if (aligned > 0)
+    {
+        ssize_t ret = 0;
+        if (!d->nodirect)
+        {
+            do
+            {
+                ret = pwrite(d->dfd, d->buf, aligned, (_TIFF_off_t)d->wstart);
+            } while (ret < 0 && errno == EINTR);
+            if (ret < 0 && errno == EINVAL)
+            {
+                d->nodirect = 1;
+                ret = 0;
+            }
+        }
+        /* A short or refused O_DIRECT write is completed through the page
+         * cache */
+        if (ret < 0)
+            ok = 0;
+        else if ((size_t)ret < aligned)
+            ok = _tiffDirectPWrite(d->fd, d->buf + ret, aligned - (size_t)ret,
+                                   d->wstart + (uint64_t)ret);
+    }
+    if (ok && d->wlen > aligned)
+        ok = _tiffDirectPWrite(d->fd, d->buf + aligned, d->wlen - aligned,
+                               d->wstart + aligned);
+    d->wstart += d->wlen;
+    d->wlen = 0;
+    return ok;
+}
+
+static ssize_t _tiffDirectCachedRead(TIFFDirectIO *d, void *buf, size_t size)
+{
+    ssize_t ret;
+    do
+    {
+        ret = pread(d->fd, buf, size, (_TIFF_off_t)d->pos);
+    } while (ret < 0 && errno == EINTR);
+    if (ret > 0)
+        d->pos += (uint64_t)ret;
+    return ret;
+}
+
+static tmsize_t _tiffDirectReadProc(thandle_t h, void *buf, tmsize_t size)
+{
+    TIFFDirectIO *d = (TIFFDirectIO *)h;
+    uint8_t *p = (uint8_t *)buf;
+    size_t remaining = (size_t)size;
+
+    if (size < 0 || !_tiffDirectFlush(d))
+        return (tmsize_t)-1;
+    if (size < DIRECTIO_MIN_READ || d->nodirect)
+    {
+        ssize_t ret = _tiffDirectCachedRead(d, buf, (size_t)size);
+        return ret < 0 ? (tmsize_t)-1 : (tmsize_t)ret;
+    }
+    while (remaining > 0)
+    {
+        const uint64_t start = d->pos & ~(uint64_t)(DIRECTIO_ALIGN - 1);
+        const size_t skip = (size_t)(d->pos - start);
+        size_t len = skip + remaining, avail;
+        ssize_t ret;
+
+        len = (len + DIRECTIO_ALIGN - 1) & ~(size_t)(DIRECTIO_ALIGN - 1);
+        if (len > DIRECTIO_BUFSIZE)
+            len = DIRECTIO_BUFSIZE;
+        do
+        {
+            ret = pread(d->dfd, d->buf, len, (_TIFF_off_t)start);
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0 && errno == EINVAL)
+        {
+            d->nodirect = 1;
+            ret = _tiffDirectCachedRead(d, p, remaining);
+            if (ret > 0)
+                p += ret;
+        }
+        if (ret < 0)
+            return p > (uint8_t *)buf ? (tmsize_t)(p - (uint8_t *)buf)
+                                      : (tmsize_t)-1;
+        if (d->nodirect)
+            break;
+        if ((size_t)ret <= skip)
+            break; /* end of file */
+        avail = (size_t)ret - skip;
+        if (avail > remaining)
+            avail = remaining;
+        memcpy(p, d->buf + skip, avail);
+        p += avail;
+        remaining -= avail;
+        d->pos += avail;
+        if ((size_t)ret < len)
+            break;
+    }
+    return (tmsize_t)(p - (uint8_t *)buf);
+}
+
+static tmsize_t _tiffDirectWriteProc(thandle_t h, void *buf, tmsize_t size)
+{
+    TIFFDirectIO *d = (TIFFDirectIO *)h;
+    const uint8_t *p = (const uint8_t *)buf;
+    size_t remaining = (size_t)size;
+
+    if (size < 0)
+        return (tmsize_t)-1;
+    if (d->wlen == 0 || d->pos != d->wstart + d->wlen)
+    {
+        /* Not a continuation: the unaligned head goes to the page cache and
+         * a new sequence starts at the next aligned offset.  A flush leaves
+         * wstart wherever the last sequence ended, so even a write at that
+         * position starts over once nothing is pending. */
+        const size_t head =
+            (size_t)((DIRECTIO_ALIGN - d->pos % DIRECTIO_ALIGN) %
+                     DIRECTIO_ALIGN);
+        const size_t n = head < remaining ? head : remaining;
+        if (!_tiffDirectFlush(d) || !_tiffDirectPWrite(d->fd, p, n, d->pos))
+            return (tmsize_t)-1;
+        p += n;
+        remaining -= n;
+        d->pos += n;
+        d->wstart = d->pos;
+        if (remaining == 0)
+            return size;
+    }
+    while (remaining > 0)
+    {
+        size_t n = DIRECTIO_BUFSIZE - d->wlen;
+        if (n > remaining)
+            n = remaining;
+        memcpy(d->buf + d->wlen, p, n);
+        d->wlen += n;
+        p += n;
+        remaining -= n;
+        d->pos += n;
+        if (d->wlen == DIRECTIO_BUFSIZE && !_tiffDirectFlush(d))
+            return (tmsize_t)-1;
+    }
+    return size;
+}
+
+static uint64_t _tiffDirectSizeProc(thandle_t h)
+{
+    TIFFDirectIO *d = (TIFFDirectIO *)h;
+    _TIFF_stat_s sb;
+    uint64_t size;
+
+    if (_TIFF_fstat_f(d->fd, &sb) < 0)
+        return (0);
+    /* Pending writes are not flushed, so that appending stays sequential */
+    size = (uint64_t)sb.st_size;
+    if (d->wlen > 0 && d->wstart + d->wlen > size)
+        size = d->wstart + d->wlen;
+    return size;
+}
+
+static uint64_t _tiffDirectSeekProc(thandle_t h, uint64_t off, int whence)
+{
+    TIFFDirectIO *d = (TIFFDirectIO *)h;
+    uint64_t base = 0;
+
+    if (whence == SEEK_CUR)
+        base = d->pos;
+    else if (whence == SEEK_END)
+        base = _tiffDirectSizeProc(h);
+    else if (whence != SEEK_SET)
+    {
+        errno = EINVAL;
+        return (uint64_t)-1;
+    }
+    if ((int64_t)(base + off) < 0)
+    {
+        errno = EINVAL;
+        return (uint64_t)-1;
+    }
+    d->pos = base + off;
+    return d->pos;
+}
+
+static int _tiffDirectCloseProc(thandle_t h)
+{
+    TIFFDirectIO *d = (TIFFDirectIO *)h;
+    int ok = _tiffDirectFlush(d);
+
+    _tiffDirectBufferPut(d->buf);
+    if (close(d->dfd) != 0)
+        ok = 0;
+    if (close(d->fd) != 0)
+        ok = 0;
+    free(d);
+    return ok ? 0 : -1;
+}
+
+/* Memory mapping would go through the page cache */
+static int _tiffDirectMapProc(thandle_t h, void **pbase, toff_t *psize)
+{
+    (void)h;
+    (void)pbase;
+    (void)psize;
+    return (0);
+}
+
+static void _tiffDirectUnmapProc(thandle_t h, void *base, toff_t size)
+{
+    (void)h;
+    (void)base;
+    (void)size;
+}
+
+/* Open name a second time with O_DIRECT, next to fd opened with the flags
+ * m.  On success fd is owned by the returned handle. */
+static TIFF *_tiffDirectOpen(int fd, const char *name, const char *mode, int m,
+                             TIFFOpenOptions *opts)
+{
+    static const char module[] = "TIFFOpen";
+    TIFFDirectIO *d;
+    TIFF *tif;
+
+    d = (TIFFDirectIO *)calloc(1, sizeof(TIFFDirectIO));
+    if (d == NULL)
+    {
+        _TIFFErrorEarly(opts, NULL, module, "%s: Out of memory", name);
+        return ((TIFF *)0);
+    }
+    d->fd = fd;
+    d->dfd = open(name, (m & ~(O_CREAT | O_TRUNC)) | O_DIRECT);
+    if (d->dfd < 0)
+    {
+        _TIFFErrorEarly(opts, NULL, module, "%s: Cannot open with O_DIRECT: %s",
+                        name, strerror(errno));
+        free(d);
+        return ((TIFF *)0);
+    }
+    d->buf = _tiffDirectBufferGet();
+    if (d->buf == NULL)
+    {
+        _TIFFErrorEarly(opts, NULL, module, "%s: Out of memory", name);
+        close(d->dfd);
+        free(d);
+        return ((TIFF *)0);
+    }
+    tif = TIFFClientOpenExt(name, mode, (thandle_t)d, _tiffDirectReadProc,
+                            _tiffDirectWriteProc, _tiffDirectSeekProc,
+                            _tiffDirectCloseProc, _tiffDirectSizeProc,
+                            _tiffDirectMapProc, _tiffDirectUnmapProc, opts);
+    if (tif == NULL)
+    {
+        /* fd is closed by the caller */
+        _tiffDirectBufferPut(d->buf);
+        close(d->dfd);
+        free(d);
+        return ((TIFF *)0);
+    }
+    tif->tif_fd = fd;
+    return (tif);
+}
+#endif /* O_DIRECT */
+
 /*
  * Open a TIFF file descriptor for read/writing.
  */
@@ -323,7 +680,12 @@ TIFF *TIFFOpenExt(const char *name, const char *mode, TIFFOpenOptions *opts)
         return ((TIFF *)0);
     }
 
-    tif = TIFFFdOpenExt((int)fd, name, mode, opts);
+#ifdef O_DIRECT
+    if (opts && opts->direct_io)
+        tif = _tiffDirectOpen(fd, name, mode, m, opts);
+    else
+#endif
+        tif = TIFFFdOpenExt((int)fd, name, mode, opts);
     if (!tif)
         close(fd);
     return tif;
@@ -421,13 +783,110 @@ int _TIFFmemcmp(const void *p1, const void *p2, tmsize_t c)
     return (memcmp(p1, p2, (size_t)c));
 }
 
+/*
+ * Modification time of a file in nanoseconds where the system records them,
+ * else in seconds.
+ */
+static uint64_t _tiffStatModTime(const _TIFF_stat_s *sb)
+{
+#if defined(HAVE_STRUCT_STAT_ST_MTIM)
+    return (uint64_t)sb->st_mtim.tv_sec * 1000000000U +
+           (uint64_t)sb->st_mtim.tv_nsec;
+#elif defined(HAVE_STRUCT_STAT_ST_MTIMESPEC)
+    return (uint64_t)sb->st_mtimespec.tv_sec * 1000000000U +
+           (uint64_t)sb->st_mtimespec.tv_nsec;
+#else
+    return (uint64_t)sb->st_mtime;
+#endif
+}
+
+/*
+ * Identify the file behind a handle opened by TIFFFdOpen()/TIFFOpen(), so
+ * that separately opened handles on the same, unmodified file can share
+ * decoded data.  Returns 0 for client-provided I/O procedures.
+ */
+int _TIFFGetFileIdentity(TIFF *tif, uint64_t identity[4])
+{
+    _TIFF_stat_s sb;
+    fd_as_handle_union_t fdh;
+
+    if (tif->tif_readproc != _tiffReadProc)
+        return 0;
+    fdh.h = tif->tif_clientdata;
+    if (_TIFF_fstat_f(fdh.fd, &sb) < 0 || !S_ISREG(sb.st_mode))
+        return 0;
+    identity[0] = (uint64_t)sb.st_dev;
+    identity[1] = (uint64_t)sb.st_ino;
+    identity[2] = (uint64_t)sb.st_size;
+    /* Size and a fine-grained mtime catch files rewritten in place */
+    identity[3] = _tiffStatModTime(&sb);
+    return 1;
+}
+
+/*
+ * Modification time of the file behind a handle opened by
+ * TIFFFdOpen()/TIFFOpen(), in nanoseconds where available so that a file
+ * rewritten within the same second is told apart.  Returns 0 for
+ * client-provided I/O procedures.
+ */
+int _TIFFGetFileModTime(TIFF *tif, uint64_t *mtime)
+{
+    _TIFF_stat_s sb;
+    fd_as_handle_union_t fdh;
+
+    if (tif->tif_readproc != _tiffReadProc)
+        return 0;
+    fdh.h = tif->tif_clientdata;
+    if (_TIFF_fstat_f(fdh.fd, &sb) < 0)
+        return 0;
+    *mtime = _tiffStatModTime(&sb);
+    return 1;
+}
+
+/*
+ * Reserve the space of [offset, offset + length[ in a file opened by
+ * TIFFFdOpen()/TIFFOpen(), without changing its size.  Returns 0 when
+ * that is not supported.
+ */
+int _TIFFReserveFileSpace(TIFF *tif, uint64_t offset, uint64_t length)
+{
+#if defined(__linux__) && defined(FALLOC_FL_KEEP_SIZE)
+    if (tif->tif_readproc != _tiffReadProc)
+        return 0;
+    return fallocate(tif->tif_fd, FALLOC_FL_KEEP_SIZE, (_TIFF_off_t)offset,
+                     (_TIFF_off_t)length) == 0;
+#else
+    (void)tif;
+    (void)offset;
+    (void)length;
+    return 0;
+#endif
+}
+
+/* Give back the space reserved beyond size, the size of the file. */
+void _TIFFReleaseFileSpace(TIFF *tif, uint64_t size)
+{
+    if (tif->tif_readproc == _tiffReadProc)
+        (void)ftruncate(tif->tif_fd, (_TIFF_off_t)size);
+}
+
 int _TIFFCopyFileRange(TIFF *tif, uint64_t offsetRead, uint64_t offsetWrite,
                        uint64_t toCopy)
 {
 #if defined(HAVE_COPY_FILE_RANGE)
     static const char module[] = "_TIFFCopyFileRange";
-    int fd = tif->tif_fd;
-    while (toCopy > 0)
+    /* Client I/O procedures have no descriptor to copy within */
+    int fd = tif->tif_writeproc == _tiffWriteProc ? tif->tif_fd : -1;
+#ifdef O_DIRECT
+    if (tif->tif_writeproc == _tiffDirectWriteProc)
+    {
+        /* Writes gathered for direct I/O are not in the file yet */
+        if (!_tiffDirectFlush((TIFFDirectIO *)tif->tif_clientdata))
+            return 0;
+        fd = tif->tif_fd;
+    }
+#endif
+    while (fd >= 0 && toCopy > 0)
     {
         size_t chunk = toCopy > 1024 * 1024 ? 1024 * 1024 : (size_t)toCopy;
         ssize_t ret;
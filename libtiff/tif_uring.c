@@ -81,7 +81,7 @@ static int _tiffUringThreadAdd(TIFF *tif, int fd)
         return 0;
     }
 
-    _TIFFURingThreadEntry *e = (_TIFFURingThreadEntry *)_TIFFmallocExt(tif, sizeof(*e));
+    _TIFFURingThreadEntry *e = (_TIFFURingThreadEntry *)_TIFFmallocExt(NULL, sizeof(*e));
     if (!e)
     {
         pthread_mutex_unlock(&gUringThreadMutex);
@@ -94,7 +94,7 @@ static int _tiffUringThreadAdd(TIFF *tif, int fd)
     if (!e->pool)
     {
         pthread_mutex_unlock(&gUringThreadMutex);
-        _TIFFfreeExt(tif, e);
+        _TIFFfreeExt(NULL, e);
         TIFFErrorExtR(tif, "tif_uring", "Thread pool init failed");
         return 0;
     }
@@ -104,7 +104,7 @@ static int _tiffUringThreadAdd(TIFF *tif, int fd)
     {
         pthread_mutex_unlock(&gUringThreadMutex);
         _TIFFThreadPoolShutdown(e->pool);
-        _TIFFfreeExt(tif, e);
+        _TIFFfreeExt(NULL, e);
         TIFFErrorExtR(tif, "tif_uring", "pthread_mutex_init failed");
         return 0;
     }
@@ -113,7 +113,7 @@ static int _tiffUringThreadAdd(TIFF *tif, int fd)
         pthread_mutex_destroy(&e->mutex);
         pthread_mutex_unlock(&gUringThreadMutex);
         _TIFFThreadPoolShutdown(e->pool);
-        _TIFFfreeExt(tif, e);
+        _TIFFfreeExt(NULL, e);
         TIFFErrorExtR(tif, "tif_uring", "pthread_cond_init failed");
         return 0;
     }
@@ -312,7 +312,7 @@ static int _tiffUringAdd(TIFF *tif, int fd, struct io_uring *ring)
         return 0;
     }
 
-    _TIFFURingEntry *e = (_TIFFURingEntry *)_TIFFmallocExt(tif, sizeof(*e));
+    _TIFFURingEntry *e = (_TIFFURingEntry *)_TIFFmallocExt(NULL, sizeof(*e));
     if (!e)
     {
         pthread_mutex_unlock(&gUringMutex);
@@ -621,7 +621,7 @@ static int _tiffUringAdd(TIFF *tif, int fd)
         return 0;
     }
 
-    _TIFFURingEntry *e = (_TIFFURingEntry *)_TIFFmallocExt(tif, sizeof(*e));
+    _TIFFURingEntry *e = (_TIFFURingEntry *)_TIFFmallocExt(NULL, sizeof(*e));
     if (!e)
     {
         pthread_mutex_unlock(&gUringMutex);
@@ -634,7 +634,7 @@ static int _tiffUringAdd(TIFF *tif, int fd)
     if (!e->pool)
     {
         pthread_mutex_unlock(&gUringMutex);
-        _TIFFfreeExt(tif, e);
+        _TIFFfreeExt(NULL, e);
         TIFFErrorExtR(tif, "tif_uring", "Thread pool init failed");
         return 0;
     }
@@ -644,7 +644,7 @@ static int _tiffUringAdd(TIFF *tif, int fd)
     {
         pthread_mutex_unlock(&gUringMutex);
         _TIFFThreadPoolShutdown(e->pool);
-        _TIFFfreeExt(tif, e);
+        _TIFFfreeExt(NULL, e);
         TIFFErrorExtR(tif, "tif_uring", "pthread_mutex_init failed");
         return 0;
     }
@@ -653,7 +653,7 @@ static int _tiffUringAdd(TIFF *tif, int fd)
         pthread_mutex_destroy(&e->mutex);
         pthread_mutex_unlock(&gUringMutex);
         _TIFFThreadPoolShutdown(e->pool);
-        _TIFFfreeExt(tif, e);
+        _TIFFfreeExt(NULL, e);
         TIFFErrorExtR(tif, "tif_uring", "pthread_cond_init failed");
         return 0;
     }
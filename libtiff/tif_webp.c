@@ -123,6 +123,38 @@ static int TWebPEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
     return 1;
 }
 
+/*
+ * Whether the whole RIFF container of a WebP blob is in the raw buffer, so
+ * that it can be decoded in one go rather than incrementally.
+ */
+static bool TWebPIsComplete(const uint8_t *data, tmsize_t size)
+{
+    uint32_t riff_size;
+
+    if (size < 12 || memcmp(data, "RIFF", 4) != 0)
+        return false;
+    riff_size = (uint32_t)data[4] | ((uint32_t)data[5] << 8) |
+                ((uint32_t)data[6] << 16) | ((uint32_t)data[7] << 24);
+    return (uint64_t)riff_size + 8 <= (uint64_t)size;
+}
+
+static void TWebPReportStatus(TIFF *tif, const char *module,
+                              VP8StatusCode status)
+{
+    if (status == VP8_STATUS_INVALID_PARAM)
+    {
+        TIFFErrorExtR(tif, module, "Invalid parameter used.");
+    }
+    else if (status == VP8_STATUS_OUT_OF_MEMORY)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory.");
+    }
+    else
+    {
+        TIFFErrorExtR(tif, module, "Unrecognized error.");
+    }
+}
+
 static int TWebPDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
 {
     static const char module[] = "WebPDecode";
@@ -238,6 +270,39 @@ static int TWebPDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
             /* If decoding the whole strip/tile, we can directly use the */
             /* output buffer */
             decode_whole_strile = true;
+#if WEBP_DECODER_ABI_VERSION >= 0x0002
+            /* With the whole blob at hand, decode it in a single call */
+            /* straight into the output buffer, without setting up an */
+            /* incremental decoder. */
+            if (TWebPIsComplete(tif->tif_rawcp, tif->tif_rawcc))
+            {
+                config.output.colorspace =
+                    sp->nSamples > 3 ? MODE_RGBA : MODE_RGB;
+                config.output.is_external_memory = 1;
+                config.output.width = (int)segment_width;
+                config.output.height = (int)segment_height;
+                config.output.u.RGBA.rgba = op;
+                config.output.u.RGBA.stride =
+                    (int)(segment_width * sp->nSamples);
+                config.output.u.RGBA.size = buffer_size;
+
+                status = WebPDecode(tif->tif_rawcp, (size_t)tif->tif_rawcc,
+                                    &config);
+                WebPFreeDecBuffer(&config.output);
+                if (status != VP8_STATUS_OK)
+                {
+                    TWebPReportStatus(tif, module, status);
+                    tiff_memset_u8(op, 0, (size_t)occ);
+                    sp->read_error = 1;
+                    return 0;
+                }
+
+                tif->tif_rawcp += tif->tif_rawcc;
+                tif->tif_rawcc = 0;
+                sp->last_y = (int)segment_height;
+                return 1;
+            }
+#endif
         }
         else if (sp->pBuffer == NULL || buffer_size > sp->buffer_size)
         {
@@ -303,18 +368,7 @@ static int TWebPDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
 
     if (status != VP8_STATUS_OK && status != VP8_STATUS_SUSPENDED)
     {
-        if (status == VP8_STATUS_INVALID_PARAM)
-        {
-            TIFFErrorExtR(tif, module, "Invalid parameter used.");
-        }
-        else if (status == VP8_STATUS_OUT_OF_MEMORY)
-        {
-            TIFFErrorExtR(tif, module, "Out of memory.");
-        }
-        else
-        {
-            TIFFErrorExtR(tif, module, "Unrecognized error.");
-        }
+        TWebPReportStatus(tif, module, status);
         tiff_memset_u8(op, 0, (size_t)occ);
         sp->read_error = 1;
         return 0;
@@ -160,6 +160,56 @@ static uint64_t _tiffSizeProc(thandle_t fd)
         return (0);
 }
 
+/*
+ * Identify the file behind a handle opened by TIFFFdOpen()/TIFFOpen(), so
+ * that separately opened handles on the same, unmodified file can share
+ * decoded data.  Returns 0 for client-provided I/O procedures.
+ */
+int _TIFFGetFileIdentity(TIFF *tif, uint64_t identity[4])
+{
+    BY_HANDLE_FILE_INFORMATION info;
+
+    if (tif->tif_readproc != _tiffReadProc ||
+        !GetFileInformationByHandle(tif->tif_clientdata, &info))
+        return 0;
+    identity[0] = info.dwVolumeSerialNumber;
+    identity[1] = ((uint64_t)info.nFileIndexHigh << 32) | info.nFileIndexLow;
+    identity[2] = ((uint64_t)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+    identity[3] = ((uint64_t)info.ftLastWriteTime.dwHighDateTime << 32) |
+                  info.ftLastWriteTime.dwLowDateTime;
+    return 1;
+}
+
+/*
+ * Modification time of the file behind a handle opened by
+ * TIFFFdOpen()/TIFFOpen().  Returns 0 for client-provided I/O procedures.
+ */
+int _TIFFGetFileModTime(TIFF *tif, uint64_t *mtime)
+{
+    FILETIME ft;
+
+    if (tif->tif_readproc != _tiffReadProc ||
+        !GetFileTime(tif->tif_clientdata, NULL, NULL, &ft))
+        return 0;
+    *mtime = ((uint64_t)ft.dwHighDateTime << 32) | ft.dwLowDateTime;
+    return 1;
+}
+
+/* File space reservation (see tif_unix.c) is not implemented. */
+int _TIFFReserveFileSpace(TIFF *tif, uint64_t offset, uint64_t length)
+{
+    (void)tif;
+    (void)offset;
+    (void)length;
+    return 0;
+}
+
+void _TIFFReleaseFileSpace(TIFF *tif, uint64_t size)
+{
+    (void)tif;
+    (void)size;
+}
+
 /*
  * From "Hermann Josef Hill" <lhill@rhein-zeitung.de>:
  *
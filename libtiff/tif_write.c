@@ -48,7 +48,7 @@ int TIFFWriteScanline(TIFF *tif, void *buf, uint32_t row, uint16_t sample)
 {
     static const char module[] = "TIFFWriteScanline";
     register TIFFDirectory *td;
-    int status, imagegrew = 0;
+    int status, imagegrew = 0, sequential = 1;
     uint32_t strip;
 
     if (!WRITECHECKSTRIPS(tif, module))
@@ -173,11 +173,19 @@ int TIFFWriteScanline(TIFF *tif, void *buf, uint32_t row, uint16_t sample)
         if (!(*tif->tif_seek)(tif, row - tif->tif_row))
             return (-1);
         tif->tif_row = row;
+        sequential = 0;
     }
 
     /* swab if needed - note that source buffer will be altered */
     tif->tif_postdecode(tif, (uint8_t *)buf, tif->tif_scanlinesize);
 
+    if (sequential)
+        _TIFFStrileChecksumWriteRow(tif, strip, (uint8_t *)buf,
+                                    tif->tif_scanlinesize,
+                                    row % td->td_rowsperstrip == 0);
+    else
+        _TIFFStrileChecksumInvalidate(tif, "non sequential scanline write");
+
     status = (*tif->tif_encoderow)(tif, (uint8_t *)buf, tif->tif_scanlinesize,
                                    sample);
 
@@ -195,12 +203,21 @@ int TIFFWriteScanline(TIFF *tif, void *buf, uint32_t row, uint16_t sample)
 static int _TIFFReserveLargeEnoughWriteBuffer(TIFF *tif, uint32_t strip_or_tile)
 {
     TIFFDirectory *td = &tif->tif_dir;
-    if (td->td_stripbytecount_p[strip_or_tile] > 0)
+    uint64_t bytecount;
+    if (tif->tif_strilestream != NULL)
+    {
+        uint64_t *poffset, *pbytecount;
+        if (!_TIFFStrileStreamEntry(tif, strip_or_tile, &poffset, &pbytecount))
+            return 0;
+        bytecount = *pbytecount;
+    }
+    else
+        bytecount = td->td_stripbytecount_p[strip_or_tile];
+    if (bytecount > 0)
     {
         /* The +1 is to ensure at least one extra bytes */
         /* The +4 is because the LZW encoder flushes 4 bytes before the limit */
-        uint64_t safe_buffer_size =
-            (uint64_t)(td->td_stripbytecount_p[strip_or_tile] + 1 + 4);
+        uint64_t safe_buffer_size = (uint64_t)(bytecount + 1 + 4);
         if (tif->tif_rawdatasize <= (tmsize_t)safe_buffer_size)
         {
             if (!(TIFFWriteBufferSetup(
@@ -297,6 +314,7 @@ tmsize_t TIFFWriteEncodedStrip(TIFF *tif, uint32_t strip, void *data,
     {
         /* swab if needed - note that source buffer will be altered */
         tif->tif_postdecode(tif, (uint8_t *)data, cc);
+        _TIFFStrileChecksumWrite(tif, strip, (uint8_t *)data, cc);
 
         if (!isFillOrder(tif, td->td_fillorder) &&
             (tif->tif_flags & TIFF_NOBITREV) == 0)
@@ -313,6 +331,7 @@ tmsize_t TIFFWriteEncodedStrip(TIFF *tif, uint32_t strip, void *data,
 
     /* swab if needed - note that source buffer will be altered */
     tif->tif_postdecode(tif, (uint8_t *)data, cc);
+    _TIFFStrileChecksumWrite(tif, strip, (uint8_t *)data, cc);
 
     if (!(*tif->tif_encodestrip)(tif, (uint8_t *)data, cc, sample))
         return ((tmsize_t)-1);
@@ -385,6 +404,7 @@ tmsize_t TIFFWriteRawStrip(TIFF *tif, uint32_t strip, void *data, tmsize_t cc)
         return ((tmsize_t)-1);
     }
     tif->tif_row = (strip % td->td_stripsperimage) * td->td_rowsperstrip;
+    _TIFFStrileChecksumInvalidate(tif, "raw strip write");
     return (TIFFAppendToStrip(tif, strip, (uint8_t *)data, cc) ? cc
                                                                : (tmsize_t)-1);
 }
@@ -499,6 +519,7 @@ tmsize_t TIFFWriteEncodedTile(TIFF *tif, uint32_t tile, void *data, tmsize_t cc)
     {
         /* swab if needed - note that source buffer will be altered */
         tif->tif_postdecode(tif, (uint8_t *)data, cc);
+        _TIFFStrileChecksumWrite(tif, tile, (uint8_t *)data, cc);
 
         if (!isFillOrder(tif, td->td_fillorder) &&
             (tif->tif_flags & TIFF_NOBITREV) == 0)
@@ -514,6 +535,7 @@ tmsize_t TIFFWriteEncodedTile(TIFF *tif, uint32_t tile, void *data, tmsize_t cc)
         return ((tmsize_t)(-1));
     /* swab if needed - note that source buffer will be altered */
     tif->tif_postdecode(tif, (uint8_t *)data, cc);
+    _TIFFStrileChecksumWrite(tif, tile, (uint8_t *)data, cc);
 
     if (!(*tif->tif_encodetile)(tif, (uint8_t *)data, cc, sample))
         return ((tmsize_t)-1);
@@ -552,6 +574,7 @@ tmsize_t TIFFWriteRawTile(TIFF *tif, uint32_t tile, void *data, tmsize_t cc)
                       (unsigned long)tif->tif_dir.td_nstrips);
         return ((tmsize_t)(-1));
     }
+    _TIFFStrileChecksumInvalidate(tif, "raw tile write");
     return (TIFFAppendToStrip(tif, tile, (uint8_t *)data, cc) ? cc
                                                               : (tmsize_t)(-1));
 }
@@ -563,6 +586,8 @@ int TIFFSetupStrips(TIFF *tif)
 {
     TIFFDirectory *td = &tif->tif_dir;
 
+    if (tif->tif_strilestream != NULL)
+        return 1;
     if (isTiled(tif))
         td->td_stripsperimage = isUnspecified(tif, FIELD_TILEDIMENSIONS)
                                     ? td->td_samplesperpixel
@@ -573,7 +598,8 @@ int TIFFSetupStrips(TIFF *tif)
                                     : TIFFNumberOfStrips(tif);
     td->td_nstrips = td->td_stripsperimage;
     /* TIFFWriteDirectoryTagData has a limitation to 0x80000000U bytes */
-    if (td->td_nstrips >=
+    if (!td->td_streamstrilearrays &&
+        td->td_nstrips >=
         0x80000000U / ((tif->tif_flags & TIFF_BIGTIFF) ? 0x8U : 0x4U))
     {
         TIFFErrorExtR(tif, "TIFFSetupStrips",
@@ -583,6 +609,15 @@ int TIFFSetupStrips(TIFF *tif)
     if (td->td_planarconfig == PLANARCONFIG_SEPARATE)
         td->td_stripsperimage /= td->td_samplesperpixel;
 
+    if (td->td_streamstrilearrays)
+    {
+        /* Arrays reserved in the file, see tif_strilestream.c */
+        if (!_TIFFStrileStreamSetup(tif))
+            return 0;
+        TIFFSetFieldBit(tif, FIELD_STRIPOFFSETS);
+        TIFFSetFieldBit(tif, FIELD_STRIPBYTECOUNTS);
+        return 1;
+    }
     if (td->td_stripoffset_p != NULL)
         _TIFFfreeExt(tif, td->td_stripoffset_p);
     td->td_stripoffset_p = (uint64_t *)_TIFFCheckMalloc(
@@ -755,6 +790,13 @@ static int TIFFGrowStrips(TIFF *tif, uint32_t delta, const char *module)
 
     assert(td->td_planarconfig == PLANARCONFIG_CONTIG);
 
+    if (tif->tif_strilestream != NULL)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Cannot grow the streamed strip/tile arrays");
+        return (0);
+    }
+
     if (alloc == 0)
         alloc = td->td_nstrips;
 
@@ -823,17 +865,34 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
     TIFFDirectory *td = &tif->tif_dir;
     uint64_t m;
     int64_t old_byte_count = -1;
+    uint64_t *poffset;
+    uint64_t *pbytecount;
+
+    if (tif->tif_writebehindsize > 0 && tif->tif_writebehind == NULL &&
+        !_TIFFWriteBehindSetup(tif))
+        return (0);
+
+    if (tif->tif_strilestream != NULL)
+    {
+        if (!_TIFFStrileStreamEntry(tif, strip, &poffset, &pbytecount))
+            return (0);
+    }
+    else
+    {
+        poffset = &td->td_stripoffset_p[strip];
+        pbytecount = &td->td_stripbytecount_p[strip];
+    }
 
     if (tif->tif_curoff == 0)
         tif->tif_lastvalidoff = 0;
 
-    if (td->td_stripoffset_p[strip] == 0 || tif->tif_curoff == 0)
+    if (*poffset == 0 || tif->tif_curoff == 0)
     {
         assert(td->td_nstrips > 0);
 
-        if (td->td_stripbytecount_p[strip] != 0 &&
-            td->td_stripoffset_p[strip] != 0 &&
-            td->td_stripbytecount_p[strip] >= (uint64_t)cc)
+        if (*pbytecount != 0 &&
+            *poffset != 0 &&
+            *pbytecount >= (uint64_t)cc)
         {
             /*
              * There is already tile data on disk, and the new tile
@@ -842,7 +901,7 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
              * more data to append to this strip before we are done
              * depending on how we are getting called.
              */
-            if (!SeekOK(tif, td->td_stripoffset_p[strip]))
+            if (!SeekOK(tif, *poffset))
             {
                 TIFFErrorExtR(tif, module, "Seek error at scanline %lu",
                               (unsigned long)tif->tif_row);
@@ -850,7 +909,7 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
             }
 
             tif->tif_lastvalidoff =
-                td->td_stripoffset_p[strip] + td->td_stripbytecount_p[strip];
+                *poffset + *pbytecount;
         }
         else
         {
@@ -858,17 +917,17 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
              * Seek to end of file, and set that as our location to
              * write this strip.
              */
-            td->td_stripoffset_p[strip] = TIFFSeekFile(tif, 0, SEEK_END);
+            *poffset = TIFFSeekFile(tif, 0, SEEK_END);
             tif->tif_flags |= TIFF_DIRTYSTRIP;
         }
 
-        tif->tif_curoff = td->td_stripoffset_p[strip];
+        tif->tif_curoff = *poffset;
 
         /*
          * We are starting a fresh strip/tile, so set the size to zero.
          */
-        old_byte_count = td->td_stripbytecount_p[strip];
-        td->td_stripbytecount_p[strip] = 0;
+        old_byte_count = *pbytecount;
+        *pbytecount = 0;
     }
 
     m = tif->tif_curoff + cc;
@@ -881,7 +940,7 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
     }
 
     if (tif->tif_lastvalidoff != 0 && m > tif->tif_lastvalidoff &&
-        td->td_stripbytecount_p[strip] > 0)
+        *pbytecount > 0)
     {
         /* Ouch: we have detected that we are rewriting in place a strip/tile */
         /* with several calls to TIFFAppendToStrip(). The first call was with */
@@ -893,9 +952,9 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
         /* wrote. */
         uint64_t offsetRead;
         uint64_t offsetWrite;
-        uint64_t toCopy = td->td_stripbytecount_p[strip];
+        uint64_t toCopy = *pbytecount;
 
-        offsetRead = td->td_stripoffset_p[strip];
+        offsetRead = *poffset;
         offsetWrite = TIFFSeekFile(tif, 0, SEEK_END);
 
         m = offsetWrite + toCopy + cc;
@@ -907,15 +966,25 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
 
         tif->tif_flags |= TIFF_DIRTYSTRIP;
 
-        td->td_stripoffset_p[strip] = offsetWrite;
-        td->td_stripbytecount_p[strip] = 0;
+        *poffset = offsetWrite;
+        *pbytecount = 0;
 
         /* Move data written by previous calls to us at end of file */
 #ifdef HAVE_COPY_FILE_RANGE
         TIFFWarningExtR(tif, module,
                        "_TIFFCopyFileRange used to relocate strip/tile data");
-        if (!_TIFFCopyFileRange(tif, offsetRead, offsetWrite, toCopy))
+        /* Buffered writes may hold part of what is copied */
+        if (!_TIFFWriteBehindFlush(tif) ||
+            !_TIFFCopyFileRange(tif, offsetRead, offsetWrite, toCopy))
+        {
+            return (0);
+        }
+        /* The copy does not move the file position */
+        offsetWrite += toCopy;
+        *pbytecount = toCopy;
+        if (!SeekOK(tif, offsetWrite))
         {
+            TIFFErrorExtR(tif, module, "Seek error");
             return (0);
         }
 #else
@@ -964,7 +1033,7 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
             }
             offsetRead += chunk;
             offsetWrite += chunk;
-            td->td_stripbytecount_p[strip] += chunk;
+            *pbytecount += chunk;
             toCopy -= chunk;
         }
         _TIFFfreeExt(tif, temp);
@@ -982,9 +1051,9 @@ static int TIFFAppendToStrip(TIFF *tif, uint32_t strip, uint8_t *data,
         return (0);
     }
     tif->tif_curoff = m;
-    td->td_stripbytecount_p[strip] += cc;
+    *pbytecount += cc;
 
-    if ((int64_t)td->td_stripbytecount_p[strip] != old_byte_count)
+    if ((int64_t)*pbytecount != old_byte_count)
         tif->tif_flags |= TIFF_DIRTYSTRIP;
 
     return (1);
@@ -0,0 +1,191 @@
+#include "tiffiop.h"
+
+/*
+ * Write-behind buffering (TIFFOpenOptionsSetWriteBehind()).
+ *
+ * When the first strip or tile of a handle is written, this layer takes
+ * over all of its I/O (see the TIFFReadFile() family of macros in
+ * tiffiop.h).  Writes that continue the previous one, as the strips and
+ * tiles appended by TIFFAppendToStrip() and the directories written after
+ * them do, are gathered in a buffer which is written with a single call
+ * when it is full, before any read, and by TIFFFlush().  Seeks only move a
+ * logical position, and the size of the file is tracked, so that appending
+ * a strip does not cost a system call either.  A write elsewhere in the
+ * file writes the buffer out and starts a new one.
+ *
+ * Optionally, file space is reserved ahead of the buffered data, without
+ * changing the size of the file, to limit fragmentation; what is left of it
+ * is given back when the handle is closed.
+ */
+
+struct TIFFWriteBehind
+{
+    uint8_t *buf;
+    tmsize_t size;     /* capacity of buf */
+    tmsize_t len;      /* bytes pending in buf */
+    uint64_t start;    /* file offset of buf[0] */
+    uint64_t pos;      /* logical file position */
+    uint64_t eof;      /* logical file size */
+    uint64_t reserved; /* file space reserved up to there */
+};
+
+/* Write out the pending data. */
+static int TIFFWriteBehindDrain(TIFF *tif, TIFFWriteBehind *wb)
+{
+    static const char module[] = "TIFFWriteBehindDrain";
+    const uint64_t end = wb->start + (uint64_t)wb->len;
+
+    if (wb->len == 0)
+        return 1;
+    if (tif->tif_writebehindreserve > 0 && end > wb->reserved)
+    {
+        const uint64_t from = wb->reserved > wb->start ? wb->reserved
+                                                       : wb->start;
+        const uint64_t to = end + tif->tif_writebehindreserve;
+        /* Not all files and file systems can reserve space: don't insist */
+        if (_TIFFReserveFileSpace(tif, from, to - from))
+            wb->reserved = to;
+        else
+            tif->tif_writebehindreserve = 0;
+    }
+    if ((*tif->tif_seekproc)(tif->tif_clientdata, wb->start, SEEK_SET) !=
+            wb->start ||
+        (*tif->tif_writeproc)(tif->tif_clientdata, wb->buf, wb->len) !=
+            wb->len)
+    {
+        TIFFErrorExtR(tif, module,
+                      "Write error at offset %" PRIu64 " of %" PRIu64
+                      " bytes",
+                      wb->start, (uint64_t)wb->len);
+        wb->len = 0;
+        return 0;
+    }
+    wb->len = 0;
+    return 1;
+}
+
+int _TIFFWriteBehindSetup(TIFF *tif)
+{
+    static const char module[] = "_TIFFWriteBehindSetup";
+    TIFFWriteBehind *wb;
+
+    wb = (TIFFWriteBehind *)_TIFFcallocExt(tif, 1, sizeof(TIFFWriteBehind));
+    if (wb == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        return 0;
+    }
+    wb->buf = (uint8_t *)_TIFFmallocExt(tif, tif->tif_writebehindsize);
+    if (wb->buf == NULL)
+    {
+        TIFFErrorExtR(tif, module, "Out of memory");
+        _TIFFfreeExt(tif, wb);
+        return 0;
+    }
+    wb->size = tif->tif_writebehindsize;
+    wb->pos = TIFFSeekFile(tif, 0, SEEK_CUR);
+    wb->eof = TIFFGetFileSize(tif);
+    wb->start = wb->pos;
+    wb->reserved = wb->eof;
+    tif->tif_writebehind = wb;
+    return 1;
+}
+
+tmsize_t _TIFFWriteBehindRead(TIFF *tif, void *buf, tmsize_t size)
+{
+    TIFFWriteBehind *wb = tif->tif_writebehind;
+    tmsize_t cc;
+
+    if (!TIFFWriteBehindDrain(tif, wb) ||
+        (*tif->tif_seekproc)(tif->tif_clientdata, wb->pos, SEEK_SET) !=
+            wb->pos)
+        return ((tmsize_t)(-1));
+    cc = (*tif->tif_readproc)(tif->tif_clientdata, buf, size);
+    if (cc > 0)
+        wb->pos += (uint64_t)cc;
+    return cc;
+}
+
+tmsize_t _TIFFWriteBehindWrite(TIFF *tif, const void *buf, tmsize_t size)
+{
+    TIFFWriteBehind *wb = tif->tif_writebehind;
+
+    if (size < 0)
+        return ((tmsize_t)(-1));
+    if (wb->len > 0 &&
+        (wb->pos != wb->start + (uint64_t)wb->len || size > wb->size - wb->len))
+    {
+        if (!TIFFWriteBehindDrain(tif, wb))
+            return ((tmsize_t)(-1));
+    }
+    if (wb->len == 0)
+    {
+        wb->start = wb->pos;
+        if (size >= wb->size)
+        {
+            /* Too large to be worth a copy */
+            tmsize_t cc;
+            if ((*tif->tif_seekproc)(tif->tif_clientdata, wb->pos,
+                                     SEEK_SET) != wb->pos)
+                return ((tmsize_t)(-1));
+            cc = (*tif->tif_writeproc)(tif->tif_clientdata, (void *)buf,
+                                       size);
+            if (cc > 0)
+                wb->pos += (uint64_t)cc;
+            if (wb->pos > wb->eof)
+                wb->eof = wb->pos;
+            wb->start = wb->pos;
+            return cc;
+        }
+    }
+    _TIFFmemcpy(wb->buf + wb->len, buf, size);
+    wb->len += size;
+    wb->pos += (uint64_t)size;
+    if (wb->pos > wb->eof)
+        wb->eof = wb->pos;
+    return size;
+}
+
+uint64_t _TIFFWriteBehindSeek(TIFF *tif, uint64_t off, int whence)
+{
+    TIFFWriteBehind *wb = tif->tif_writebehind;
+
+    switch (whence)
+    {
+        case SEEK_SET:
+            wb->pos = off;
+            break;
+        case SEEK_CUR:
+            wb->pos += off;
+            break;
+        case SEEK_END:
+            wb->pos = wb->eof + off;
+            break;
+        default:
+            return ((uint64_t)(-1));
+    }
+    return wb->pos;
+}
+
+uint64_t _TIFFWriteBehindSize(TIFF *tif) { return tif->tif_writebehind->eof; }
+
+int _TIFFWriteBehindFlush(TIFF *tif)
+{
+    if (tif->tif_writebehind == NULL)
+        return 1;
+    return TIFFWriteBehindDrain(tif, tif->tif_writebehind);
+}
+
+void _TIFFWriteBehindFree(TIFF *tif)
+{
+    TIFFWriteBehind *wb = tif->tif_writebehind;
+
+    if (wb == NULL)
+        return;
+    (void)TIFFWriteBehindDrain(tif, wb);
+    if (wb->reserved > wb->eof)
+        _TIFFReleaseFileSpace(tif, wb->eof);
+    tif->tif_writebehind = NULL;
+    _TIFFfreeExt(tif, wb->buf);
+    _TIFFfreeExt(tif, wb);
+}
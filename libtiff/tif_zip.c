@@ -74,9 +74,6 @@ typedef struct
     int zipquality; /* compression level */
     int state;      /* state flags */
     int subcodec;   /* DEFLATE_SUBCODEC_ZLIB or DEFLATE_SUBCODEC_LIBDEFLATE */
-#if defined(HAVE_ARM_CRC32)
-    uint32_t crc32;
-#endif
 #if LIBDEFLATE_SUPPORT
     int libdeflate_state; /* -1 = until first time ZIPEncode() / ZIPDecode() is
                              called, 0 = use zlib, 1 = use libdeflate */
@@ -285,9 +282,6 @@ static int ZIPDecodeInternal(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
 
 #if TIFF_SIMD_AES
             tiff_aes_unwhiten(op, (size_t)occ_initial);
-#endif
-#if defined(HAVE_ARM_CRC32)
-            sp->crc32 = tiff_crc32(0, op, (size_t)occ_initial);
 #endif
             return 1;
         }
@@ -346,9 +340,6 @@ static int ZIPDecodeInternal(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
 #if TIFF_SIMD_AES
     tiff_aes_unwhiten(op, (size_t)occ_initial);
 #endif
-#if defined(HAVE_ARM_CRC32)
-    sp->crc32 = tiff_crc32(0, op, (size_t)occ_initial);
-#endif
 
     return (1);
 }
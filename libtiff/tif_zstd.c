@@ -33,10 +33,32 @@
  */
 
 #include "tif_predict.h"
+#include "zdict.h"
 #include "zstd.h"
 
 #include <stdio.h>
 
+/*
+ * Since zstd 1.4.0, the compression parameters, among which the number of
+ * worker threads, and the dictionary are set on the context and kept across
+ * frames, and ZSTD_compressStream()/ZSTD_endStream() honour them.
+ */
+#if ZSTD_VERSION_NUMBER >= 10400
+#define ZSTD_HAVE_ADVANCED_API
+#endif
+
+/*
+ * A dictionary trained with TIFFTAG_ZSTD_DICTSIZE is fed with this many
+ * times its size of strile data, as advised by the zstd documentation, but
+ * no more than ZSTD_TRAINING_MAX bytes, which large dictionaries settle for.
+ * The sample buffer grows from ZSTD_TRAINING_MIN bytes as striles arrive.
+ */
+#define ZSTD_TRAINING_RATIO 100
+#define ZSTD_TRAINING_MAX (32 * 1024 * 1024)
+#define ZSTD_TRAINING_MIN (64 * 1024)
+
+#define FIELD_ZSTDDICTIONARY (FIELD_CODEC + 1) /* FIELD_PREDICTOR is +0 */
+
 /*
  * State block for each open TIFF file using ZSTD compression/decompression.
  */
@@ -46,13 +68,34 @@ typedef struct
     ZSTD_DStream *dstream;
     ZSTD_CStream *cstream;
     int compression_level; /* compression level */
+    int workers;           /* compression worker threads (0: none) */
+    int job_size;          /* bytes per compression job (0: default) */
     ZSTD_outBuffer out_buffer;
-    int state; /* state flags */
+    int frame_start; /* nothing decoded/encoded yet in the current strile */
+    int state;       /* state flags */
+
+    /* ZSTDDictionary tag, and the digested forms of it */
+    uint8_t *dictionary;
+    uint32_t dictionary_size;
+    unsigned dictionary_id; /* 0 for a raw content dictionary */
+    ZSTD_CDict *cdict;
+    int cdict_level; /* compression level of cdict */
+    ZSTD_DDict *ddict;
+
+    /* Training of a dictionary from the first striles written */
+    uint32_t train_size; /* size of the dictionary to train (0: none) */
+    uint8_t *samples;
+    size_t samples_alloc;
+    size_t samples_len;
+    size_t *sample_sizes;
+    unsigned nsamples;
+
 #define LSTATE_INIT_DECODE 0x01
 #define LSTATE_INIT_ENCODE 0x02
 
     TIFFVGetMethod vgetparent; /* super-class method */
     TIFFVSetMethod vsetparent; /* super-class method */
+    TIFFPrintMethod printdir;  /* super-class method */
 } ZSTDState;
 
 #define GetZSTDState(tif) ((ZSTDState *)(tif)->tif_data)
@@ -62,6 +105,35 @@ typedef struct
 static int ZSTDEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s);
 static int ZSTDDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s);
 
+/*
+ * Return in *ddict the dictionary to decompress the frame at tif_rawcp with:
+ * frames written while a dictionary was being trained, which record no
+ * dictionary ID, don't use it.
+ */
+static int ZSTDFrameDictionary(TIFF *tif, const ZSTD_DDict **ddict)
+{
+    static const char module[] = "ZSTDFrameDictionary";
+    ZSTDState *sp = ZSTDDecoderState(tif);
+
+    *ddict = NULL;
+    if (sp->dictionary == NULL ||
+        (sp->dictionary_id != 0 &&
+         ZSTD_getDictID_fromFrame(tif->tif_rawcp, (size_t)tif->tif_rawcc) !=
+             sp->dictionary_id))
+        return 1;
+    if (sp->ddict == NULL)
+    {
+        sp->ddict = ZSTD_createDDict(sp->dictionary, sp->dictionary_size);
+        if (sp->ddict == NULL)
+        {
+            TIFFErrorExtR(tif, module, "Cannot load the ZSTD dictionary");
+            return 0;
+        }
+    }
+    *ddict = sp->ddict;
+    return 1;
+}
+
 static int ZSTDFixupTags(TIFF *tif)
 {
     (void)tif;
@@ -118,6 +190,7 @@ static int ZSTDPreDecode(TIFF *tif, uint16_t s)
                       ZSTD_getErrorName(zstd_ret));
         return 0;
     }
+    sp->frame_start = 1;
 
     return 1;
 }
@@ -134,6 +207,25 @@ static int ZSTDDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
     assert(sp != NULL);
     assert(sp->state == LSTATE_INIT_DECODE);
 
+    if (sp->frame_start && sp->dictionary != NULL)
+    {
+        const ZSTD_DDict *ddict;
+        if (!ZSTDFrameDictionary(tif, &ddict))
+            return 0;
+#ifdef ZSTD_HAVE_ADVANCED_API
+        if (ddict != NULL)
+        {
+            zstd_ret = ZSTD_DCtx_refDDict(sp->dstream, ddict);
+            if (ZSTD_isError(zstd_ret))
+            {
+                TIFFErrorExtR(tif, module, "Error in ZSTD_DCtx_refDDict(): %s",
+                              ZSTD_getErrorName(zstd_ret));
+                return 0;
+            }
+        }
+#endif
+    }
+    sp->frame_start = 0;
     in_buffer.src = tif->tif_rawcp;
     in_buffer.size = (size_t)tif->tif_rawcc;
     in_buffer.pos = 0;
@@ -171,6 +263,185 @@ static int ZSTDDecode(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
     return 1;
 }
 
+/*
+ * Decode a whole strip or tile.  When its frame is entirely in the raw
+ * buffer and records a decompressed size equal to the strile size, as
+ * written by ZSTDEncodeStrile(), decompress it in one go into the output,
+ * which spares the streaming decoder its window buffer copies.
+ */
+static int ZSTDDecodeStrile(TIFF *tif, uint8_t *op, tmsize_t occ, uint16_t s)
+{
+#ifdef ZSTD_HAVE_ADVANCED_API
+    static const char module[] = "ZSTDDecodeStrile";
+    ZSTDState *sp = ZSTDDecoderState(tif);
+
+    assert(sp != NULL);
+    if (sp->frame_start && tif->tif_rawcc > 0)
+    {
+        const size_t frame_size = ZSTD_findFrameCompressedSize(
+            tif->tif_rawcp, (size_t)tif->tif_rawcc);
+        if (!ZSTD_isError(frame_size) &&
+            ZSTD_getFrameContentSize(tif->tif_rawcp, frame_size) ==
+                (unsigned long long)occ)
+        {
+            const ZSTD_DDict *ddict;
+            size_t zstd_ret;
+
+            if (!ZSTDFrameDictionary(tif, &ddict))
+                return 0;
+            sp->frame_start = 0;
+            zstd_ret =
+                ZSTD_decompress_usingDDict(sp->dstream, op, (size_t)occ,
+                                           tif->tif_rawcp, frame_size, ddict);
+            if (ZSTD_isError(zstd_ret))
+            {
+                tiff_memset_u8(op, 0, (size_t)occ);
+                TIFFErrorExtR(tif, module,
+                              "Error in ZSTD_decompress_usingDDict(): %s",
+                              ZSTD_getErrorName(zstd_ret));
+                return 0;
+            }
+            tif->tif_rawcp += frame_size;
+            tif->tif_rawcc -= (tmsize_t)frame_size;
+            return 1;
+        }
+    }
+#endif
+    return ZSTDDecode(tif, op, occ, s);
+}
+
+/*
+ * Replace the dictionary, as read from or written to the directory.
+ */
+static void ZSTDSetDictionary(TIFF *tif, const void *data, uint32_t size)
+{
+    ZSTDState *sp = GetZSTDState(tif);
+
+    if (sp->cdict)
+    {
+        ZSTD_freeCDict(sp->cdict);
+        sp->cdict = NULL;
+    }
+    if (sp->ddict)
+    {
+        ZSTD_freeDDict(sp->ddict);
+        sp->ddict = NULL;
+    }
+    _TIFFsetByteArrayExt(tif, (void **)&sp->dictionary, data, size);
+    sp->dictionary_size = sp->dictionary ? size : 0;
+    sp->dictionary_id =
+        sp->dictionary ? ZSTD_getDictID_fromDict(data, size) : 0;
+    if (sp->dictionary)
+        TIFFSetFieldBit(tif, FIELD_ZSTDDICTIONARY);
+    else
+        TIFFClrFieldBit(tif, FIELD_ZSTDDICTIONARY);
+    tif->tif_flags |= TIFF_DIRTYDIRECT;
+}
+
+static void ZSTDFreeSamples(TIFF *tif, ZSTDState *sp)
+{
+    _TIFFfreeExt(tif, sp->samples);
+    _TIFFfreeExt(tif, sp->sample_sizes);
+    sp->samples = NULL;
+    sp->sample_sizes = NULL;
+    sp->samples_alloc = 0;
+    sp->samples_len = 0;
+    sp->nsamples = 0;
+}
+
+/*
+ * Bytes of strile data to gather before training the dictionary: no more
+ * than half the image, so that the other half is compressed with it.
+ */
+static size_t ZSTDTrainingBudget(TIFF *tif, const ZSTDState *sp)
+{
+    const uint64_t strilesize =
+        isTiled(tif) ? TIFFTileSize64(tif) : TIFFStripSize64(tif);
+    const uint64_t half = strilesize * tif->tif_dir.td_nstrips / 2;
+    uint64_t budget = (uint64_t)ZSTD_TRAINING_RATIO * sp->train_size;
+
+    if (budget > ZSTD_TRAINING_MAX)
+        budget = ZSTD_TRAINING_MAX;
+    if (budget > half)
+        budget = half;
+    return (size_t)budget;
+}
+
+/*
+ * Add the start of a strile to the training samples.
+ */
+static int ZSTDAddSample(TIFF *tif, ZSTDState *sp, const uint8_t *bp,
+                         tmsize_t cc)
+{
+    const size_t budget = ZSTDTrainingBudget(tif, sp);
+    size_t n;
+
+    n = budget - sp->samples_len;
+    if ((size_t)cc < n)
+        n = (size_t)cc;
+    if (sp->samples_len + n > sp->samples_alloc)
+    {
+        size_t alloc =
+            sp->samples_alloc ? sp->samples_alloc : ZSTD_TRAINING_MIN;
+        uint8_t *samples;
+        while (alloc < sp->samples_len + n)
+            alloc *= 2;
+        if (alloc > budget)
+            alloc = budget;
+        samples =
+            (uint8_t *)_TIFFreallocExt(tif, sp->samples, (tmsize_t)alloc);
+        if (samples == NULL)
+            return 0;
+        sp->samples = samples;
+        sp->samples_alloc = alloc;
+    }
+    if (sp->frame_start)
+    {
+        size_t *sizes = (size_t *)_TIFFreallocExt(
+            tif, sp->sample_sizes, (sp->nsamples + 1) * sizeof(size_t));
+        if (sizes == NULL)
+            return 0;
+        sp->sample_sizes = sizes;
+        sp->sample_sizes[sp->nsamples++] = 0;
+    }
+    _TIFFmemcpy(sp->samples + sp->samples_len, bp, (tmsize_t)n);
+    sp->samples_len += n;
+    sp->sample_sizes[sp->nsamples - 1] += n;
+    return 1;
+}
+
+/*
+ * Train the dictionary once enough strile data has been gathered, and
+ * record it in the directory for the following striles, which use it.
+ * Failing to train one is not an error: they are compressed without it, as
+ * the previous ones.
+ */
+static void ZSTDTrainDictionary(TIFF *tif, ZSTDState *sp)
+{
+    static const char module[] = "ZSTDTrainDictionary";
+    uint8_t *dict = (uint8_t *)_TIFFmallocExt(tif, (tmsize_t)sp->train_size);
+    size_t size;
+
+    if (dict == NULL)
+        size = 0;
+    else
+    {
+        size = ZDICT_trainFromBuffer(dict, sp->train_size, sp->samples,
+                                     sp->sample_sizes, sp->nsamples);
+        if (ZDICT_isError(size))
+        {
+            TIFFWarningExtR(tif, module, "Cannot train a dictionary: %s",
+                            ZDICT_getErrorName(size));
+            size = 0;
+        }
+    }
+    if (size > 0)
+        ZSTDSetDictionary(tif, dict, (uint32_t)size);
+    _TIFFfreeExt(tif, dict);
+    ZSTDFreeSamples(tif, sp);
+    sp->train_size = 0;
+}
+
 static int ZSTDSetupEncode(TIFF *tif)
 {
     ZSTDState *sp = ZSTDEncoderState(tif);
@@ -211,6 +482,57 @@ static int ZSTDPreEncode(TIFF *tif, uint16_t s)
         }
     }
 
+#ifdef ZSTD_HAVE_ADVANCED_API
+    zstd_ret = ZSTD_CCtx_reset(sp->cstream, ZSTD_reset_session_only);
+    if (!ZSTD_isError(zstd_ret))
+        zstd_ret = ZSTD_CCtx_setParameter(
+            sp->cstream, ZSTD_c_compressionLevel, sp->compression_level);
+    if (!ZSTD_isError(zstd_ret) && sp->workers > 0)
+    {
+        if (ZSTD_isError(ZSTD_CCtx_setParameter(sp->cstream, ZSTD_c_nbWorkers,
+                                                sp->workers)))
+        {
+            TIFFWarningExtR(tif, module,
+                            "libzstd is built without multi-threading "
+                            "support: ZSTD_WORKERS ignored");
+            sp->workers = 0;
+        }
+        else if (sp->job_size > 0)
+            zstd_ret = ZSTD_CCtx_setParameter(sp->cstream, ZSTD_c_jobSize,
+                                              sp->job_size);
+    }
+    if (ZSTD_isError(zstd_ret))
+    {
+        TIFFErrorExtR(tif, module, "Error in ZSTD_CCtx_setParameter(): %s",
+                      ZSTD_getErrorName(zstd_ret));
+        return 0;
+    }
+
+    if (sp->train_size > 0 && sp->nsamples > 0 &&
+        sp->samples_len >= ZSTDTrainingBudget(tif, sp))
+        ZSTDTrainDictionary(tif, sp);
+    if (sp->dictionary != NULL &&
+        (sp->cdict == NULL || sp->cdict_level != sp->compression_level))
+    {
+        if (sp->cdict)
+            ZSTD_freeCDict(sp->cdict);
+        sp->cdict = ZSTD_createCDict(sp->dictionary, sp->dictionary_size,
+                                     sp->compression_level);
+        if (sp->cdict == NULL)
+        {
+            TIFFErrorExtR(tif, module, "Cannot load the ZSTD dictionary");
+            return 0;
+        }
+        sp->cdict_level = sp->compression_level;
+    }
+    zstd_ret = ZSTD_CCtx_refCDict(sp->cstream, sp->cdict);
+    if (ZSTD_isError(zstd_ret))
+    {
+        TIFFErrorExtR(tif, module, "Error in ZSTD_CCtx_refCDict(): %s",
+                      ZSTD_getErrorName(zstd_ret));
+        return 0;
+    }
+#else
     zstd_ret = ZSTD_initCStream(sp->cstream, sp->compression_level);
     if (ZSTD_isError(zstd_ret))
     {
@@ -218,6 +540,8 @@ static int ZSTDPreEncode(TIFF *tif, uint16_t s)
                       ZSTD_getErrorName(zstd_ret));
         return 0;
     }
+#endif
+    sp->frame_start = 1;
 
     sp->out_buffer.dst = tif->tif_rawdata;
     sp->out_buffer.size = (size_t)tif->tif_rawdatasize;
@@ -241,6 +565,13 @@ static int ZSTDEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
 
     (void)s;
 
+    if (sp->train_size > 0 && sp->dictionary == NULL &&
+        !ZSTDAddSample(tif, sp, bp, cc))
+    {
+        TIFFErrorExtR(tif, module, "Out of memory for dictionary training");
+        return 0;
+    }
+    sp->frame_start = 0;
     in_buffer.src = bp;
     in_buffer.size = (size_t)cc;
     in_buffer.pos = 0;
@@ -268,6 +599,32 @@ static int ZSTDEncode(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
     return 1;
 }
 
+/*
+ * Encode a whole strip or tile, recording its size in the frame header so
+ * that ZSTDDecodeStrile() can decompress it in one go.
+ */
+static int ZSTDEncodeStrile(TIFF *tif, uint8_t *bp, tmsize_t cc, uint16_t s)
+{
+#ifdef ZSTD_HAVE_ADVANCED_API
+    static const char module[] = "ZSTDEncodeStrile";
+    ZSTDState *sp = ZSTDEncoderState(tif);
+
+    if (sp->frame_start)
+    {
+        size_t zstd_ret = ZSTD_CCtx_setPledgedSrcSize(sp->cstream,
+                                                      (unsigned long long)cc);
+        if (ZSTD_isError(zstd_ret))
+        {
+            TIFFErrorExtR(tif, module,
+                          "Error in ZSTD_CCtx_setPledgedSrcSize(): %s",
+                          ZSTD_getErrorName(zstd_ret));
+            return 0;
+        }
+    }
+#endif
+    return ZSTDEncode(tif, bp, cc, s);
+}
+
 /*
  * Finish off an encoded strip by flushing it.
  */
@@ -308,6 +665,7 @@ static void ZSTDCleanup(TIFF *tif)
 
     tif->tif_tagmethods.vgetfield = sp->vgetparent;
     tif->tif_tagmethods.vsetfield = sp->vsetparent;
+    tif->tif_tagmethods.printdir = sp->printdir;
 
     if (sp->dstream)
     {
@@ -319,6 +677,12 @@ static void ZSTDCleanup(TIFF *tif)
         ZSTD_freeCStream(sp->cstream);
         sp->cstream = NULL;
     }
+    if (sp->cdict)
+        ZSTD_freeCDict(sp->cdict);
+    if (sp->ddict)
+        ZSTD_freeDDict(sp->ddict);
+    _TIFFfreeExt(tif, sp->dictionary);
+    ZSTDFreeSamples(tif, sp);
     _TIFFfreeExt(tif, sp);
     tif->tif_data = NULL;
 
@@ -342,6 +706,56 @@ static int ZSTDVSetField(TIFF *tif, uint32_t tag, va_list ap)
                                 ZSTD_maxCLevel());
             }
             return 1;
+        case TIFFTAG_ZSTD_WORKERS:
+            sp->workers = (int)va_arg(ap, int);
+            if (sp->workers < 0)
+            {
+                TIFFErrorExtR(tif, module, "Invalid ZSTD_WORKERS value: %d",
+                              sp->workers);
+                sp->workers = 0;
+                return 0;
+            }
+            return 1;
+        case TIFFTAG_ZSTD_JOBSIZE:
+            sp->job_size = (int)va_arg(ap, int);
+            if (sp->job_size < 0)
+            {
+                TIFFErrorExtR(tif, module, "Invalid ZSTD_JOBSIZE value: %d",
+                              sp->job_size);
+                sp->job_size = 0;
+                return 0;
+            }
+            return 1;
+        case TIFFTAG_ZSTD_DICTIONARY:
+        {
+            const uint32_t size = (uint32_t)va_arg(ap, uint32_t);
+            const void *data = va_arg(ap, const void *);
+            ZSTDSetDictionary(tif, size > 0 ? data : NULL, size);
+            return 1;
+        }
+        case TIFFTAG_ZSTD_DICTSIZE:
+        {
+            const int size = (int)va_arg(ap, int);
+            /* zstd needs a dictionary of at least 256 bytes */
+            if (size != 0 && (size < 256 || size > (1 << 24)))
+            {
+                TIFFErrorExtR(tif, module,
+                              "ZSTD_DICTSIZE should be 0, or between 256 and "
+                              "%d",
+                              1 << 24);
+                return 0;
+            }
+#ifdef ZSTD_HAVE_ADVANCED_API
+            sp->train_size = (uint32_t)size;
+            ZSTDFreeSamples(tif, sp);
+#else
+            if (size > 0)
+                TIFFWarningExtR(tif, module,
+                                "ZSTD dictionaries need libzstd 1.4.0 or "
+                                "later: ZSTD_DICTSIZE ignored");
+#endif
+            return 1;
+        }
         default:
             return (*sp->vsetparent)(tif, tag, ap);
     }
@@ -357,15 +771,47 @@ static int ZSTDVGetField(TIFF *tif, uint32_t tag, va_list ap)
         case TIFFTAG_ZSTD_LEVEL:
             *va_arg(ap, int *) = sp->compression_level;
             break;
+        case TIFFTAG_ZSTD_WORKERS:
+            *va_arg(ap, int *) = sp->workers;
+            break;
+        case TIFFTAG_ZSTD_JOBSIZE:
+            *va_arg(ap, int *) = sp->job_size;
+            break;
+        case TIFFTAG_ZSTD_DICTIONARY:
+            *va_arg(ap, uint32_t *) = sp->dictionary_size;
+            *va_arg(ap, const void **) = sp->dictionary;
+            break;
+        case TIFFTAG_ZSTD_DICTSIZE:
+            *va_arg(ap, int *) = (int)sp->train_size;
+            break;
         default:
             return (*sp->vgetparent)(tif, tag, ap);
     }
     return 1;
 }
 
+static void ZSTDPrintDir(TIFF *tif, FILE *fd, long flags)
+{
+    ZSTDState *sp = GetZSTDState(tif);
+
+    if (TIFFFieldSet(tif, FIELD_ZSTDDICTIONARY))
+        fprintf(fd, "  ZSTD Dictionary: (%" PRIu32 " bytes)\n",
+                sp->dictionary_size);
+    if (sp->printdir)
+        (*sp->printdir)(tif, fd, flags);
+}
+
 static const TIFFField ZSTDFields[] = {
     {TIFFTAG_ZSTD_LEVEL, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO, TRUE,
      FALSE, "ZSTD compression_level", NULL},
+    {TIFFTAG_ZSTD_WORKERS, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
+     TRUE, FALSE, "ZSTD workers", NULL},
+    {TIFFTAG_ZSTD_JOBSIZE, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
+     TRUE, FALSE, "ZSTD job_size", NULL},
+    {TIFFTAG_ZSTD_DICTSIZE, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, FIELD_PSEUDO,
+     TRUE, FALSE, "ZSTD dictionary_size", NULL},
+    {TIFFTAG_ZSTD_DICTIONARY, -3, -3, TIFF_UNDEFINED, 0, TIFF_SETGET_C32_UINT8,
+     FIELD_ZSTDDICTIONARY, TRUE, TRUE, "ZSTDDictionary", NULL},
 };
 
 int TIFFInitZSTD(TIFF *tif, int scheme)
@@ -388,7 +834,7 @@ int TIFFInitZSTD(TIFF *tif, int scheme)
     /*
      * Allocate state block so tag methods have storage to record values.
      */
-    tif->tif_data = (uint8_t *)_TIFFmallocExt(tif, sizeof(ZSTDState));
+    tif->tif_data = (uint8_t *)_TIFFcallocExt(tif, 1, sizeof(ZSTDState));
     if (tif->tif_data == NULL)
         goto bad;
     sp = GetZSTDState(tif);
@@ -400,9 +846,14 @@ int TIFFInitZSTD(TIFF *tif, int scheme)
     tif->tif_tagmethods.vgetfield = ZSTDVGetField; /* hook for codec tags */
     sp->vsetparent = tif->tif_tagmethods.vsetfield;
     tif->tif_tagmethods.vsetfield = ZSTDVSetField; /* hook for codec tags */
+    sp->printdir = tif->tif_tagmethods.printdir;
+    tif->tif_tagmethods.printdir = ZSTDPrintDir;
 
     /* Default values for codec-specific fields */
     sp->compression_level = 9; /* default comp. level */
+    sp->workers = 0;
+    sp->job_size = 0;
+    sp->frame_start = 0;
     sp->state = 0;
     sp->dstream = 0;
     sp->cstream = 0;
@@ -417,14 +868,14 @@ int TIFFInitZSTD(TIFF *tif, int scheme)
     tif->tif_setupdecode = ZSTDSetupDecode;
     tif->tif_predecode = ZSTDPreDecode;
     tif->tif_decoderow = ZSTDDecode;
-    tif->tif_decodestrip = ZSTDDecode;
-    tif->tif_decodetile = ZSTDDecode;
+    tif->tif_decodestrip = ZSTDDecodeStrile;
+    tif->tif_decodetile = ZSTDDecodeStrile;
     tif->tif_setupencode = ZSTDSetupEncode;
     tif->tif_preencode = ZSTDPreEncode;
     tif->tif_postencode = ZSTDPostEncode;
     tif->tif_encoderow = ZSTDEncode;
-    tif->tif_encodestrip = ZSTDEncode;
-    tif->tif_encodetile = ZSTDEncode;
+    tif->tif_encodestrip = ZSTDEncodeStrile;
+    tif->tif_encodetile = ZSTDEncodeStrile;
     tif->tif_cleanup = ZSTDCleanup;
     /*
      * Setup predictor setup.
@@ -217,6 +217,7 @@ typedef enum
 #define COMPRESSION_ZSTD 50000             /* ZSTD: WARNING not registered in Adobe-maintained registry */
 #define COMPRESSION_WEBP 50001             /* WEBP: WARNING not registered in Adobe-maintained registry */
 #define COMPRESSION_JXL 50002              /* JPEGXL: WARNING not registered in Adobe-maintained registry */
+#define COMPRESSION_LZ4 50004              /* LZ4: WARNING not registered in Adobe-maintained registry */
 #define COMPRESSION_JXL_DNG_1_7 52546      /* JPEGXL from DNG 1.7 specification */
 #define TIFFTAG_PHOTOMETRIC 262            /* photometric interpretation */
 #define PHOTOMETRIC_MINISWHITE 0           /* min value is white */
@@ -501,6 +502,8 @@ typedef enum
 #define TIFFTAG_OCE_IMAGELOGIC_CHARACTERISTICS 50218
 /* tags 50674 to 50677 are reserved for ESRI */
 #define TIFFTAG_LERC_PARAMETERS 50674 /* Stores LERC version and additional compression method */
+/* tag 65250 is a private tag, not registered, used by the ZSTD codec */
+#define TIFFTAG_ZSTD_DICTIONARY 65250 /* ZSTD compression dictionary */
 
 /* Adobe Digital Negative (DNG) format tags */
 #define TIFFTAG_DNGVERSION 50706           /* &DNG version number */
@@ -681,6 +684,9 @@ typedef enum
 #define TIFFTAG_GEO_METADATA 50909        /* https://www.awaresystems.be/imaging/tiff/tifftags/geo_metadata.html */
 #define TIFFTAG_EXTRACAMERAPROFILES 50933 /* http://wwwimages.adobe.com/www.adobe.com/content/dam/Adobe/en/products/photoshop/pdfs/dng_spec_1.4.0.0.pdf */
 
+/* libtiff private tag: CRC32C of the decoded data of each strip/tile */
+#define TIFFTAG_STRILECHECKSUMS 65400 /* see TIFFGetStrileChecksum() */
+
 /* tag 65535 is an undefined tag used by Eastman Kodak */
 #define TIFFTAG_DCSHUESHIFTVALUES 65535 /* hue shift correction data */
 
@@ -711,6 +717,8 @@ typedef enum
 #define JPEGTABLESMODE_QUANT 0x0001  /* include quantization tbls */
 #define JPEGTABLESMODE_HUFF 0x0002   /* include Huffman tbls */
 /* Note: default is JPEGTABLESMODE_QUANT | JPEGTABLESMODE_HUFF */
+#define TIFFTAG_JPEGSCALEDENOM 65572 /* Decode at 1/1, 1/2, 1/4 or 1/8 size */
+#define TIFFTAG_JPEGLOSSLESS 65579   /* Lossless JPEG predictor, 0: DCT */
 #define TIFFTAG_FAXFILLFUNC 65540     /* G3/G4 fill function */
 #define TIFFTAG_PIXARLOGDATAFMT 65549 /* PixarLogCodec I/O data sz */
 #define PIXARLOGDATAFMT_8BIT 0        /* regular u_char samples */
@@ -750,10 +758,16 @@ typedef enum
 #define SGILOGENCODE_NODITHER 0        /* do not dither encoded values*/
 #define SGILOGENCODE_RANDITHER 1       /* randomly dither encd values */
 #define TIFFTAG_LZMAPRESET 65562       /* LZMA2 preset (compression level) */
+#define TIFFTAG_LZMATHREADS 65576      /* LZMA2 coder threads */
 #define TIFFTAG_PERSAMPLE 65563        /* interface for per sample tags */
 #define PERSAMPLE_MERGED 0             /* present as a single value */
 #define PERSAMPLE_MULTI 1              /* present as multiple values */
 #define TIFFTAG_ZSTD_LEVEL 65564       /* ZSTD compression level */
+#define TIFFTAG_ZSTD_WORKERS 65573     /* ZSTD compression worker threads */
+#define TIFFTAG_ZSTD_JOBSIZE 65574     /* ZSTD bytes per compression job */
+#define TIFFTAG_ZSTD_DICTSIZE 65575    /* ZSTD dictionary size to train */
+#define TIFFTAG_LZ4_LEVEL 65577        /* LZ4 acceleration or LZ4HC level */
+#define TIFFTAG_LZ4_HC 65578           /* LZ4: compress with LZ4HC */
 #define TIFFTAG_LERC_VERSION 65565     /* LERC version */
 #define LERC_VERSION_2_4 4
 #define TIFFTAG_LERC_ADD_COMPRESSION 65566 /* LERC additional compression */
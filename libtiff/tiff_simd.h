@@ -304,6 +304,7 @@ extern "C"
     }
 
     uint32_t tiff_crc32(uint32_t crc, const uint8_t *buf, size_t len);
+    uint32_t tiff_crc32c(uint32_t crc, const uint8_t *buf, size_t len);
     uint64_t tiff_pmull_hash(uint64_t h, const uint8_t *buf, size_t len);
     void tiff_aes_whiten(uint8_t *buf, size_t len);
     void tiff_aes_unwhiten(uint8_t *buf, size_t len);
@@ -44,6 +44,28 @@ static void unlockThreadPoolMutex(void)
         pthread_mutex_unlock(&gThreadPoolMutex);
 }
 
+/*
+ * Thread-specific key recording which pool a worker thread belongs to.
+ * Codecs such as ZIPDecode() submit work themselves; when they already run
+ * inside a TPDecodePredictTile() task, queueing onto the same pool and
+ * waiting for it to drain would wait on the calling worker forever, so such
+ * nested submissions are executed inline instead.
+ */
+static pthread_once_t gWorkerKeyOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gWorkerKey;
+static int gWorkerKeyInitialized = 0;
+
+static void initWorkerKey(void)
+{
+    gWorkerKeyInitialized = pthread_key_create(&gWorkerKey, NULL) == 0;
+}
+
+static int isWorkerOf(TIFFThreadPool *pool)
+{
+    pthread_once(&gWorkerKeyOnce, initWorkerKey);
+    return gWorkerKeyInitialized && pthread_getspecific(gWorkerKey) == pool;
+}
+
 #define TIFF_THREADPOOL_MAX_QUEUE 256
 
 typedef struct _TPTask
@@ -83,6 +105,9 @@ void TPDecodePredictTile(void *arg)
 static void *_tiffThreadProc(void *arg)
 {
     TIFFThreadPool *pool = (TIFFThreadPool *)arg;
+    pthread_once(&gWorkerKeyOnce, initWorkerKey);
+    if (gWorkerKeyInitialized)
+        pthread_setspecific(gWorkerKey, pool);
     for (;;)
     {
         pthread_mutex_lock(&pool->mutex);
@@ -220,6 +245,11 @@ int _TIFFThreadPoolSubmit(TIFFThreadPool *pool, void (*func)(void *), void *arg)
         TIFFErrorExtR(NULL, module, "Thread pool not initialized");
         return 0;
     }
+    if (isWorkerOf(pool))
+    {
+        func(arg);
+        return 1;
+    }
     pthread_mutex_lock(&pool->mutex);
     if (pool->threads == NULL || pool->stop)
     {
@@ -265,7 +295,7 @@ int _TIFFThreadPoolSubmit(TIFFThreadPool *pool, void (*func)(void *), void *arg)
 
 void _TIFFThreadPoolWait(TIFFThreadPool *pool)
 {
-    if (!pool)
+    if (!pool || isWorkerOf(pool))
         return;
     pthread_mutex_lock(&pool->mutex);
     while (pool->queued || pool->active)
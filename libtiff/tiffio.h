@@ -450,6 +450,8 @@ extern "C"
     extern int TIFFCreateGPSDirectory(TIFF *);
     extern int TIFFLastDirectory(TIFF *);
     extern int TIFFSetDirectory(TIFF *, tdir_t);
+    extern int TIFFWriteIFDIndex(TIFF *tif, const char *filename);
+    extern int TIFFReadIFDIndex(TIFF *tif, const char *filename);
     extern int TIFFSetSubDirectory(TIFF *, uint64_t);
     extern int TIFFUnlinkDirectory(TIFF *, tdir_t);
     extern int TIFFSetField(TIFF *, uint32_t, ...);
@@ -461,6 +463,7 @@ extern "C"
     extern int TIFFRewriteDirectory(TIFF *);
     extern int TIFFDeferStrileArrayWriting(TIFF *);
     extern int TIFFForceStrileArrayWriting(TIFF *);
+    extern int TIFFStreamStrileArrayWriting(TIFF *);
 
 #if defined(c_plusplus) || defined(__cplusplus)
     extern void TIFFPrintDirectory(TIFF *, FILE *, long = 0);
@@ -542,6 +545,41 @@ extern int TIFFReadRGBAImageHVS(TIFF *, uint32_t, uint32_t, uint32_t *,
     extern void TIFFOpenOptionsSetURingQueueDepth(TIFFOpenOptions *opts,
                                                   unsigned int depth);
 
+#define TIFF_STRILECHECKSUM_WRITE 0x1  /* record CRC32C of written striles */
+#define TIFF_STRILECHECKSUM_VERIFY 0x2 /* verify decoded striles */
+    extern void TIFFOpenOptionsSetStrileChecksums(TIFFOpenOptions *opts,
+                                                  int flags);
+
+    /* Decoded strip/tile cache that can be shared between handles */
+    typedef struct TIFFStrileCache TIFFStrileCache;
+    typedef struct
+    {
+        uint64_t hits;       /* reads served from the cache */
+        uint64_t misses;     /* reads that had to decode */
+        uint64_t insertions; /* striles added */
+        uint64_t evictions;  /* striles dropped to stay within budget */
+        uint64_t entries;    /* striles currently cached */
+        uint64_t bytes;      /* decoded bytes currently cached */
+        uint64_t max_bytes;  /* byte budget */
+    } TIFFStrileCacheStats;
+    extern TIFFStrileCache *TIFFStrileCacheCreate(tmsize_t max_bytes);
+    extern void TIFFStrileCacheRelease(TIFFStrileCache *cache);
+    extern void TIFFStrileCacheClear(TIFFStrileCache *cache);
+    extern void TIFFStrileCacheGetStats(TIFFStrileCache *cache,
+                                        TIFFStrileCacheStats *stats);
+    extern void TIFFOpenOptionsSetStrileCache(TIFFOpenOptions *opts,
+                                              TIFFStrileCache *cache);
+    extern void TIFFOpenOptionsSetJPEGScaleDenom(TIFFOpenOptions *opts,
+                                                 int denom);
+    extern void TIFFOpenOptionsSetLazyTagThreshold(TIFFOpenOptions *opts,
+                                                   tmsize_t threshold);
+    extern void TIFFOpenOptionsSetStrileArrayCacheSize(TIFFOpenOptions *opts,
+                                                       tmsize_t max_bytes);
+    extern void TIFFOpenOptionsSetDirectIO(TIFFOpenOptions *opts, int enable);
+    extern void TIFFOpenOptionsSetWriteBehind(TIFFOpenOptions *opts,
+                                              tmsize_t buffer_size,
+                                              uint64_t reserve);
+
     extern TIFF *TIFFOpen(const char *, const char *);
     extern TIFF *TIFFOpenExt(const char *, const char *, TIFFOpenOptions *opts);
 #ifdef _WIN32
@@ -599,6 +637,14 @@ extern int TIFFReadRGBAImageHVS(TIFF *, uint32_t, uint32_t, uint32_t *,
                                         tmsize_t size);
     extern tmsize_t TIFFReadRawTile(TIFF *tif, uint32_t tile, void *buf,
                                     tmsize_t size);
+    extern tmsize_t TIFFReadRawStriles(TIFF *tif, const uint32_t *striles,
+                                       uint32_t n, void **bufs,
+                                       tmsize_t *sizes, uint64_t max_gap);
+    extern tmsize_t TIFFReadEncodedTiles(TIFF *tif, const uint32_t *tiles,
+                                         uint32_t n, void **bufs);
+    extern int TIFFReadRegion(TIFF *tif, uint32_t x, uint32_t y, uint32_t w,
+                              uint32_t h, uint16_t sample, void *dst,
+                              tmsize_t dst_stride);
     extern int TIFFReadFromUserBuffer(TIFF *tif, uint32_t strile, void *inbuf,
                                       tmsize_t insize, void *outbuf,
                                       tmsize_t outsize);
@@ -633,6 +679,8 @@ extern int TIFFReadRGBAImageHVS(TIFF *, uint32_t, uint32_t, uint32_t *,
                                                int *pbErr);
     extern uint64_t TIFFGetStrileByteCountWithErr(TIFF *tif, uint32_t strile,
                                                   int *pbErr);
+    extern int TIFFGetStrileChecksum(TIFF *tif, uint32_t strile,
+                                     uint32_t *crc);
 
 #ifdef LOGLUV_PUBLIC
 #define U_NEU 0.210526316
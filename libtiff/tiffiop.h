@@ -98,6 +98,9 @@ typedef int (*TIFFSeekMethod)(TIFF *, uint32_t);
 typedef void (*TIFFPostMethod)(TIFF *tif, uint8_t *buf, tmsize_t size);
 typedef uint32_t (*TIFFStripMethod)(TIFF *, uint32_t);
 typedef void (*TIFFTileMethod)(TIFF *, uint32_t *, uint32_t *);
+typedef struct TIFFStrilePages TIFFStrilePages; /* see tif_strilepages.c */
+typedef struct TIFFStrileStream TIFFStrileStream; /* see tif_strilestream.c */
+typedef struct TIFFWriteBehind TIFFWriteBehind; /* see tif_writebehind.c */
 
 struct TIFFOffsetAndDirNumber
 {
@@ -202,6 +205,13 @@ struct tiff
     uint64_t *tif_dir_offset_cache;
     tdir_t tif_dir_offset_cache_count;
     tdir_t tif_dir_offset_cache_alloc;
+    /* Complete index of the main IFD chain (read-only handles) */
+    uint64_t *tif_ifdindex;
+    tdir_t tif_ifdindexcount;
+    /* Out-of-line IFD values read at once while a directory is parsed */
+    uint8_t *tif_dirblock;
+    uint64_t tif_dirblockoff;
+    tmsize_t tif_dirblocksize;
     /* tiling support */
     uint32_t tif_col;      /* current column (offset by row too) */
     uint32_t tif_curtile;  /* current tile for read/write */
@@ -273,6 +283,19 @@ struct tiff
     int tif_uring_async;          /* async flush/wait semantics */
     unsigned int tif_uring_depth; /* queue depth. 0 for default */
     int tif_warn_about_unknown_tags;
+    int tif_strilechecksums; /* TIFF_STRILECHECKSUM_xxx flags */
+    TIFFStrileCache *tif_strilecache; /* shared decoded strile cache */
+    int tif_strilecachefile; /* 1 if tif_fileidentity is valid, -1 if none */
+    uint64_t tif_fileidentity[4];
+    int tif_jpegscaledenom; /* default TIFFTAG_JPEGSCALEDENOM. 0 for none */
+    int tif_decodescale;    /* reduction applied by the decoder. <=1 for none */
+    tmsize_t tif_lazytagthreshold; /* defer larger byte tags. 0 for none */
+    tmsize_t tif_strilepagesbudget; /* in bytes. 0 for full lazy arrays */
+    TIFFStrilePages *tif_strilepages; /* paged lazy strile arrays */
+    TIFFStrileStream *tif_strilestream; /* streamed strile arrays */
+    tmsize_t tif_writebehindsize;     /* in bytes. 0 for unbuffered writes */
+    uint64_t tif_writebehindreserve;  /* file space to reserve ahead */
+    TIFFWriteBehind *tif_writebehind; /* write-behind buffer, once active */
     struct TIFFThreadPool *tif_threadpool; /* thread pool handle */
 };
 
@@ -286,6 +309,14 @@ struct TIFFOpenOptions
     tmsize_t max_cumulated_mem_alloc;  /* in bytes. 0 for unlimited */
     int warn_about_unknown_tags;
     unsigned int uring_queue_depth; /* 0 for default */
+    int strile_checksums;           /* TIFF_STRILECHECKSUM_xxx flags */
+    TIFFStrileCache *strile_cache;  /* may be NULL */
+    int jpeg_scale_denom;           /* 0 for full resolution */
+    tmsize_t lazy_tag_threshold;    /* in bytes. 0 to read all tags eagerly */
+    tmsize_t strile_array_cache_size; /* in bytes. 0 for full lazy arrays */
+    int direct_io;                    /* bypass the page cache (O_DIRECT) */
+    tmsize_t write_behind_size;       /* in bytes. 0 for unbuffered writes */
+    uint64_t write_behind_reserve;    /* file space to reserve ahead */
 };
 
 #define isPseudoTag(t) (t > 0xffff) /* is tag value normal or pseudo */
@@ -294,14 +325,24 @@ struct TIFFOpenOptions
 #define isMapped(tif) (((tif)->tif_flags & TIFF_MAPPED) != 0)
 #define isFillOrder(tif, o) (((tif)->tif_flags & (o)) != 0)
 #define isUpSampled(tif) (((tif)->tif_flags & TIFF_UPSAMPLED) != 0)
+/* Once write-behind buffering is active, all I/O goes through it */
 #define TIFFReadFile(tif, buf, size)                                           \
-    ((*(tif)->tif_readproc)((tif)->tif_clientdata, (buf), (size)))
+    ((tif)->tif_writebehind                                                    \
+         ? _TIFFWriteBehindRead((tif), (buf), (size))                          \
+         : (*(tif)->tif_readproc)((tif)->tif_clientdata, (buf), (size)))
 #define TIFFWriteFile(tif, buf, size)                                          \
-    ((*(tif)->tif_writeproc)((tif)->tif_clientdata, (buf), (size)))
+    ((tif)->tif_writebehind                                                    \
+         ? _TIFFWriteBehindWrite((tif), (buf), (size))                         \
+         : (*(tif)->tif_writeproc)((tif)->tif_clientdata, (buf), (size)))
 #define TIFFSeekFile(tif, off, whence)                                         \
-    ((*(tif)->tif_seekproc)((tif)->tif_clientdata, (off), (whence)))
+    ((tif)->tif_writebehind                                                    \
+         ? _TIFFWriteBehindSeek((tif), (off), (whence))                        \
+         : (*(tif)->tif_seekproc)((tif)->tif_clientdata, (off), (whence)))
 #define TIFFCloseFile(tif) ((*(tif)->tif_closeproc)((tif)->tif_clientdata))
-#define TIFFGetFileSize(tif) ((*(tif)->tif_sizeproc)((tif)->tif_clientdata))
+#define TIFFGetFileSize(tif)                                                   \
+    ((tif)->tif_writebehind                                                    \
+         ? _TIFFWriteBehindSize(tif)                                           \
+         : (*(tif)->tif_sizeproc)((tif)->tif_clientdata))
 #define TIFFMapFileContents(tif, paddr, psize)                                 \
     ((*(tif)->tif_mapproc)((tif)->tif_clientdata, (paddr), (psize)))
 #define TIFFUnmapFileContents(tif, addr, size)                                 \
@@ -333,6 +374,14 @@ struct TIFFOpenOptions
 #define TIFFhowmany8_32(x)                                                     \
     (((x)&0x07) ? ((uint32_t)(x) >> 3) + 1 : (uint32_t)(x) >> 3)
 #define TIFFroundup_32(x, y) (TIFFhowmany_32(x, y) * (y))
+/* Decoding at reduced resolution (TIFFTAG_JPEGSCALEDENOM): x full resolution
+ * pixels decode to TIFFScaledDim(tif, x) pixels */
+#define isDecodeScaled(tif) ((tif)->tif_decodescale > 1)
+#define TIFFDecodeScale(tif) (isDecodeScaled(tif) ? (tif)->tif_decodescale : 1)
+#define TIFFScaledDim(tif, x)                                                  \
+    (isDecodeScaled(tif)                                                       \
+         ? TIFFhowmany_32_maxuint_compat(x, (uint32_t)(tif)->tif_decodescale)  \
+         : (uint32_t)(x))
 #define TIFFhowmany_64(x, y)                                                   \
     ((((uint64_t)(x)) + (((uint64_t)(y)) - 1)) / ((uint64_t)(y)))
 #define TIFFhowmany8_64(x)                                                     \
@@ -437,6 +486,10 @@ extern "C"
     extern void _TIFFSwab24BitData(TIFF *tif, uint8_t *buf, tmsize_t cc);
     extern void _TIFFSwab32BitData(TIFF *tif, uint8_t *buf, tmsize_t cc);
     extern void _TIFFSwab64BitData(TIFF *tif, uint8_t *buf, tmsize_t cc);
+    extern void _TIFFWidenArrayOfShort(uint64_t *dst, const void *src,
+                                       tmsize_t n, int swab);
+    extern void _TIFFWidenArrayOfLong(uint64_t *dst, const void *src,
+                                      tmsize_t n, int swab);
     extern int TIFFFlushData1(TIFF *tif);
     extern int TIFFDefaultDirectory(TIFF *tif);
     extern void _TIFFSetDefaultCompressionState(TIFF *tif);
@@ -549,6 +602,9 @@ extern "C"
 #ifdef ZSTD_SUPPORT
     extern int TIFFInitZSTD(TIFF *, int);
 #endif
+#ifdef LZ4_SUPPORT
+    extern int TIFFInitLZ4(TIFF *, int);
+#endif
 #ifdef JPEGLS_SUPPORT
     extern int TIFFInitJPEGLS(TIFF *, int);
 #endif
@@ -576,6 +632,48 @@ extern "C"
     extern int _TIFFCopyFileRange(TIFF *tif, uint64_t offsetRead,
                                   uint64_t offsetWrite, uint64_t toCopy);
 
+    extern void _TIFFStrileChecksumWrite(TIFF *tif, uint32_t strile,
+                                         const uint8_t *buf, tmsize_t cc);
+    extern void _TIFFStrileChecksumWriteRow(TIFF *tif, uint32_t strip,
+                                            const uint8_t *buf, tmsize_t cc,
+                                            int first);
+    extern void _TIFFStrileChecksumInvalidate(TIFF *tif, const char *reason);
+    extern int _TIFFStrileChecksumVerify(TIFF *tif, uint32_t strile,
+                                         const uint8_t *buf, tmsize_t cc);
+    extern int _TIFFStrileChecksumFlush(TIFF *tif);
+
+    extern int _TIFFGetFileIdentity(TIFF *tif, uint64_t identity[4]);
+    extern int _TIFFGetFileModTime(TIFF *tif, uint64_t *mtime);
+    extern void _TIFFIFDIndexSet(TIFF *tif, uint64_t *offsets, tdir_t count);
+    extern void _TIFFIFDIndexFree(TIFF *tif);
+    extern int _TIFFStrilePagesGet(TIFF *tif, TIFFDirEntry *dirent,
+                                   uint32_t strile, uint64_t *value);
+    extern void _TIFFStrilePagesFree(TIFF *tif);
+    extern int _TIFFStrileStreamSetup(TIFF *tif);
+    extern int _TIFFStrileStreamEntry(TIFF *tif, uint32_t strile,
+                                      uint64_t **poffset,
+                                      uint64_t **pbytecount);
+    extern int _TIFFStrileStreamFlush(TIFF *tif);
+    extern int _TIFFStrileStreamArray(TIFF *tif, int which, uint64_t *offset);
+    extern void _TIFFStrileStreamFree(TIFF *tif);
+    extern int _TIFFWriteBehindSetup(TIFF *tif);
+    extern tmsize_t _TIFFWriteBehindRead(TIFF *tif, void *buf, tmsize_t size);
+    extern tmsize_t _TIFFWriteBehindWrite(TIFF *tif, const void *buf,
+                                          tmsize_t size);
+    extern uint64_t _TIFFWriteBehindSeek(TIFF *tif, uint64_t off, int whence);
+    extern uint64_t _TIFFWriteBehindSize(TIFF *tif);
+    extern int _TIFFWriteBehindFlush(TIFF *tif);
+    extern void _TIFFWriteBehindFree(TIFF *tif);
+    extern int _TIFFReserveFileSpace(TIFF *tif, uint64_t offset,
+                                     uint64_t length);
+    extern void _TIFFReleaseFileSpace(TIFF *tif, uint64_t size);
+    extern void _TIFFStrileCacheAttach(TIFF *tif, TIFFStrileCache *cache);
+    extern void _TIFFStrileCacheDetach(TIFF *tif);
+    extern tmsize_t _TIFFStrileCacheLookup(TIFF *tif, uint32_t strile,
+                                           void *buf, tmsize_t size);
+    extern void _TIFFStrileCacheInsert(TIFF *tif, uint32_t strile,
+                                       const void *buf, tmsize_t size);
+
 #if defined(__cplusplus)
 }
 #endif
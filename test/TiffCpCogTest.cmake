@@ -0,0 +1,94 @@
+# CMake tests for libtiff
+#
+# Copyright © 2015 Open Microscopy Environment / University of Dundee
+# Written by Roger Leigh <rleigh@codelibre.net>
+#
+# Permission to use, copy, modify, distribute, and sell this software and
+# its documentation for any purpose is hereby granted without fee, provided
+# that (i) the above copyright notices and this permission notice appear in
+# all copies of the software and related documentation, and (ii) the names of
+# Sam Leffler and Silicon Graphics may not be used in any advertising or
+# publicity relating to the software without the specific, prior written
+# permission of Sam Leffler and Silicon Graphics.
+#
+# THE SOFTWARE IS PROVIDED "AS-IS" AND WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS, IMPLIED OR OTHERWISE, INCLUDING WITHOUT LIMITATION, ANY
+# WARRANTY OF MERCHANTABILITY OR FITNESS FOR A PARTICULAR PURPOSE.
+#
+# IN NO EVENT SHALL SAM LEFFLER OR SILICON GRAPHICS BE LIABLE FOR
+# ANY SPECIAL, INCIDENTAL, INDIRECT OR CONSEQUENTIAL DAMAGES OF ANY KIND,
+# OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS,
+# WHETHER OR NOT ADVISED OF THE POSSIBILITY OF DAMAGE, AND ON ANY THEORY OF
+# LIABILITY, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+# OF THIS SOFTWARE.
+
+
+include(${CMAKE_CURRENT_LIST_DIR}/TiffTestCommon.cmake)
+
+string(REPLACE "^" ";" TESTFILES "${TESTFILES}")
+
+# Cloud optimized copy, and plain copy for reference
+set(cmd "${TIFFCP};-O;cog:ghost;-t;-w;16;-l;16;-c;lzw")
+test_convert_multi("${cmd}" "${TESTFILES}" "${OUTFILE}")
+unset(native_infile)
+test_convert_multi("${TIFFCP}" "${TESTFILES}" "${OUTFILE}-ref.tiff")
+
+# The ghost area follows the header
+file(READ "${OUTFILE}" ghost OFFSET 8 LIMIT 40)
+string(FIND "${ghost}" "GDAL_STRUCTURAL_METADATA_SIZE=" pos)
+if(NOT pos EQUAL 0)
+  message(FATAL_ERROR "No ghost area in ${OUTFILE}")
+endif()
+
+# All directories of file precede its tiles, which are in read order
+macro(cog_check_layout file)
+  execute_process(COMMAND ${MEMCHECK} ${TIFFDUMP} -m 1000000 "${file}"
+                  OUTPUT_VARIABLE dump
+                  RESULT_VARIABLE TEST_STATUS)
+  if(TEST_STATUS)
+    message(FATAL_ERROR "Returned failed status ${TEST_STATUS}!")
+  endif()
+  string(REGEX MATCHALL "Directory [0-9]+: offset [0-9]+" dirs "${dump}")
+  string(REGEX MATCHALL "TileOffsets \\([0-9]+\\) [A-Z0-9]+ \\([0-9]+\\) [0-9]+<[0-9 ]+>"
+         tileoffsets "${dump}")
+  set(lastdir 0)
+  foreach(dir ${dirs})
+    string(REGEX REPLACE ".* offset " "" off "${dir}")
+    if(off GREATER lastdir)
+      set(lastdir ${off})
+    endif()
+  endforeach()
+  set(previous ${lastdir})
+  list(REVERSE tileoffsets)
+  foreach(offsets ${tileoffsets})
+    string(REGEX REPLACE ".*<(.*)>" "\\1" offsets "${offsets}")
+    string(REPLACE " " ";" offsets "${offsets}")
+    foreach(off ${offsets})
+      if(NOT off GREATER previous)
+        message(FATAL_ERROR "Tile at ${off} of ${file} not after ${previous}")
+      endif()
+      set(previous ${off})
+    endforeach()
+  endforeach()
+endmacro()
+
+cog_check_layout("${OUTFILE}")
+
+# Same image data as the plain copy
+test_convert("${TIFFCP};-s" "${OUTFILE}" "${OUTFILE}-strips.tiff")
+tiff_compare("${OUTFILE}-strips.tiff" "${OUTFILE}-ref.tiff")
+
+# JPEG: the codec adds ReferenceBlackWhite to YCbCr images when encoding
+# starts, which must not move the directory after the tiles
+if(JPEGFILE)
+  set(cmd "${TIFFCP};-O;cog;-t;-w;16;-l;16;-c;jpeg")
+  test_convert("${cmd}" "${JPEGFILE}" "${OUTFILE}-jpeg.tiff")
+  cog_check_layout("${OUTFILE}-jpeg.tiff")
+  set(cmd "${TIFFCP};-t;-w;16;-l;16;-c;jpeg")
+  test_convert("${cmd}" "${JPEGFILE}" "${OUTFILE}-jpeg-ref.tiff")
+  set(cmd "${TIFFCP};-s;-c;none")
+  test_convert("${cmd}" "${OUTFILE}-jpeg.tiff" "${OUTFILE}-jpeg-strips.tiff")
+  test_convert("${cmd}" "${OUTFILE}-jpeg-ref.tiff"
+               "${OUTFILE}-jpeg-ref-strips.tiff")
+  tiff_compare("${OUTFILE}-jpeg-strips.tiff" "${OUTFILE}-jpeg-ref-strips.tiff")
+endif()
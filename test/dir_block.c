@@ -0,0 +1,184 @@
+/*
+ * Tests for the coalesced reading of directories of files that are not
+ * memory mapped: the directory and the out-of-line values of its entries
+ * are fetched with a few reads instead of one per value.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "dir_block.tif"
+#define WIDTH 16
+#define HEIGHT 600
+#define DESCRIPTION_SIZE 10000
+
+/* Client I/O procedures over stdio that count reads */
+static int nreads;
+
+static tmsize_t readProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    nreads++;
+    return (tmsize_t)fread(buf, 1, (size_t)size, (FILE *)fd);
+}
+
+static tmsize_t writeProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+static toff_t seekProc(thandle_t fd, toff_t off, int whence)
+{
+    if (fseek((FILE *)fd, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell((FILE *)fd);
+}
+
+static int closeProc(thandle_t fd) { return fclose((FILE *)fd); }
+
+static toff_t sizeProc(thandle_t fd)
+{
+    long pos = ftell((FILE *)fd), size;
+    fseek((FILE *)fd, 0, SEEK_END);
+    size = ftell((FILE *)fd);
+    fseek((FILE *)fd, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static TIFF *openCounted(const char *mode)
+{
+    FILE *fp = fopen(FILENAME, "rb");
+    if (!fp)
+        return NULL;
+    return TIFFClientOpen(FILENAME, mode, (thandle_t)fp, readProc, writeProc,
+                          seekProc, closeProc, sizeProc, NULL, NULL);
+}
+
+static char description[DESCRIPTION_SIZE];
+
+/* Two pages with many out-of-line values, some of them past the first
+ * kilobytes following the directory. */
+static int writeFile(const char *mode)
+{
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+    uint8_t row[WIDTH] = {0};
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    for (int page = 0; ok && page < 2; page++)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+        TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description);
+        TIFFSetField(tif, TIFFTAG_SOFTWARE, "dir_block test software");
+        TIFFSetField(tif, TIFFTAG_ARTIST, "dir_block test artist");
+        TIFFSetField(tif, TIFFTAG_DATETIME, "2024:01:02 03:04:05");
+        TIFFSetField(tif, TIFFTAG_XRESOLUTION, 300.5 + page);
+        TIFFSetField(tif, TIFFTAG_YRESOLUTION, 150.25);
+        for (uint32_t y = 0; ok && y < HEIGHT; y++)
+        {
+            row[0] = (uint8_t)(y + page);
+            ok = TIFFWriteScanline(tif, row, y, 0) == 1;
+        }
+        ok = ok && TIFFWriteDirectory(tif);
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+static int checkPage(TIFF *tif, int page)
+{
+    const char *desc = NULL, *software = NULL, *artist = NULL, *date = NULL;
+    float xres = 0, yres = 0;
+    uint8_t row[WIDTH];
+
+    if (!TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &desc) ||
+        strcmp(desc, description) != 0 ||
+        !TIFFGetField(tif, TIFFTAG_SOFTWARE, &software) ||
+        strcmp(software, "dir_block test software") != 0 ||
+        !TIFFGetField(tif, TIFFTAG_ARTIST, &artist) ||
+        strcmp(artist, "dir_block test artist") != 0 ||
+        !TIFFGetField(tif, TIFFTAG_DATETIME, &date) ||
+        strcmp(date, "2024:01:02 03:04:05") != 0 ||
+        !TIFFGetField(tif, TIFFTAG_XRESOLUTION, &xres) ||
+        xres != 300.5f + page ||
+        !TIFFGetField(tif, TIFFTAG_YRESOLUTION, &yres) || yres != 150.25f)
+    {
+        fprintf(stderr, "page %d: tag values differ\n", page);
+        return 0;
+    }
+    if (TIFFNumberOfStrips(tif) != HEIGHT ||
+        TIFFReadEncodedStrip(tif, HEIGHT - 1, row, WIDTH) != WIDTH ||
+        row[0] != (uint8_t)(HEIGHT - 1 + page))
+    {
+        fprintf(stderr, "page %d: strips differ\n", page);
+        return 0;
+    }
+    return 1;
+}
+
+static int testLayout(const char *name, const char *wmode)
+{
+    static const char *const rmodes[] = {"r", "rm", "rmD", "rmO"};
+
+    if (!writeFile(wmode))
+    {
+        fprintf(stderr, "%s: cannot write %s\n", name, FILENAME);
+        return 0;
+    }
+    for (size_t i = 0; i < sizeof(rmodes) / sizeof(rmodes[0]); i++)
+    {
+        TIFF *tif = i == 0 ? TIFFOpen(FILENAME, rmodes[i])
+                           : openCounted(rmodes[i]);
+        int ok, reads;
+        if (!tif)
+            return 0;
+        ok = checkPage(tif, 0);
+        nreads = 0;
+        ok = ok && TIFFReadDirectory(tif);
+        reads = nreads;
+        ok = ok && checkPage(tif, 1);
+        TIFFClose(tif);
+        if (!ok)
+        {
+            fprintf(stderr, "%s: mode %s failed\n", name, rmodes[i]);
+            return 0;
+        }
+        /* The directory, then its values past the first read */
+        if (i > 0 && reads > 2)
+        {
+            fprintf(stderr, "%s: mode %s: %d reads for a directory\n", name,
+                    rmodes[i], reads);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(void)
+{
+    int ok;
+    for (int i = 0; i < DESCRIPTION_SIZE - 1; i++)
+        description[i] = (char)('a' + i % 26);
+    ok = testLayout("classic", "w") && testLayout("bigendian", "wb") &&
+         testLayout("bigtiff", "w8");
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/*
+ * Tests for TIFFOpenOptionsSetDirectIO(): files written, updated and read
+ * through O_DIRECT match their contents read through the page cache.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "direct_io.tif"
+#define TILESIZE 256 /* 64 KiB tiles, large enough for O_DIRECT reads */
+#define TILESACROSS 9
+#define HEIGHT 300
+
+static TIFF *openDirect(const char *mode)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif = NULL;
+    if (opts)
+    {
+        TIFFOpenOptionsSetDirectIO(opts, 1);
+        tif = TIFFOpenExt(FILENAME, mode, opts);
+    }
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static uint8_t tileValue(uint32_t t, int i, int pass)
+{
+    return (uint8_t)(t * 31 + i * 7 + pass);
+}
+
+static void fillTile(uint8_t *buf, uint32_t t, int pass)
+{
+    for (int i = 0; i < TILESIZE * TILESIZE; i++)
+        buf[i] = tileValue(t, i, pass);
+}
+
+/* A tiled directory followed by a striped one written by scanlines. */
+static int writeFile(const char *mode, uint8_t *buf)
+{
+    TIFF *tif = openDirect(mode);
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, TILESIZE * TILESACROSS);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, TILESIZE * TILESACROSS);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    for (uint32_t t = 0; ok && t < TILESACROSS * TILESACROSS; t++)
+    {
+        fillTile(buf, t, 0);
+        ok = TIFFWriteEncodedTile(tif, t, buf, TILESIZE * TILESIZE) ==
+             TILESIZE * TILESIZE;
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 3);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 7);
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        uint8_t row[3] = {(uint8_t)y, (uint8_t)(y >> 8), 42};
+        ok = TIFFWriteScanline(tif, row, y, 0) == 1;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Rewrite some tiles in place. */
+static int updateFile(uint8_t *buf)
+{
+    TIFF *tif = openDirect("r+");
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    for (uint32_t t = 1; ok && t < TILESACROSS * TILESACROSS; t += 10)
+    {
+        fillTile(buf, t, 1);
+        ok = TIFFWriteEncodedTile(tif, t, buf, TILESIZE * TILESIZE) ==
+             TILESIZE * TILESIZE;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+static int checkFile(TIFF *tif, const char *name, int updated, uint8_t *buf)
+{
+    int ok = tif != NULL;
+
+    for (uint32_t t = 0; ok && t < TILESACROSS * TILESACROSS; t++)
+    {
+        const int pass = updated && t % 10 == 1;
+        if (TIFFReadEncodedTile(tif, t, buf, TILESIZE * TILESIZE) !=
+            TILESIZE * TILESIZE)
+            ok = 0;
+        for (int i = 0; ok && i < TILESIZE * TILESIZE; i++)
+            ok = buf[i] == tileValue(t, i, pass);
+        if (!ok)
+            fprintf(stderr, "%s: tile %u differs\n", name, t);
+    }
+    if (ok && !TIFFReadDirectory(tif))
+    {
+        fprintf(stderr, "%s: no second directory\n", name);
+        ok = 0;
+    }
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        uint8_t row[3];
+        if (TIFFReadScanline(tif, row, y, 0) != 1 || row[0] != (uint8_t)y ||
+            row[1] != (uint8_t)(y >> 8) || row[2] != 42)
+        {
+            fprintf(stderr, "%s: row %u differs\n", name, y);
+            ok = 0;
+        }
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int testLayout(const char *name, const char *mode, uint8_t *buf)
+{
+    if (!writeFile(mode, buf))
+    {
+        fprintf(stderr, "%s: cannot write %s\n", name, FILENAME);
+        return 0;
+    }
+    if (!checkFile(openDirect("r"), name, 0, buf) ||
+        !checkFile(TIFFOpen(FILENAME, "r"), name, 0, buf))
+        return 0;
+    if (!updateFile(buf))
+    {
+        fprintf(stderr, "%s: cannot update %s\n", name, FILENAME);
+        return 0;
+    }
+    return checkFile(openDirect("r"), name, 1, buf) &&
+           checkFile(TIFFOpen(FILENAME, "r"), name, 1, buf);
+}
+
+/*
+ * Strips appended right after a directory start a long sequential run at
+ * an unaligned offset, which must not reach the O_DIRECT descriptor as is.
+ */
+static int writeStrips(TIFF *tif, uint32_t width, uint32_t height, int seed)
+{
+    uint8_t *row = (uint8_t *)malloc(width);
+    int ok = row != NULL;
+
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+    for (uint32_t y = 0; ok && y < height; y++)
+    {
+        for (uint32_t x = 0; x < width; x++)
+            row[x] = (uint8_t)(x * 3 + y * 5 + seed);
+        ok = TIFFWriteEncodedStrip(tif, y, row, width) == (tmsize_t)width;
+    }
+    free(row);
+    return ok && TIFFWriteDirectory(tif);
+}
+
+static int checkStrips(TIFF *tif, uint32_t width, uint32_t height, int seed)
+{
+    uint8_t *row = (uint8_t *)malloc(width);
+    int ok = row != NULL;
+
+    for (uint32_t y = 0; ok && y < height; y++)
+    {
+        ok = TIFFReadEncodedStrip(tif, y, row, width) == (tmsize_t)width;
+        for (uint32_t x = 0; ok && x < width; x++)
+            ok = row[x] == (uint8_t)(x * 3 + y * 5 + seed);
+        if (!ok)
+            fprintf(stderr, "unaligned: strip %u differs\n", y);
+    }
+    free(row);
+    return ok;
+}
+
+static int testUnalignedRun(void)
+{
+    TIFF *tif = openDirect("w");
+    int ok = tif != NULL && writeStrips(tif, 10000, 10, 0) &&
+             writeStrips(tif, 1000, 100, 1);
+
+    if (tif)
+        TIFFClose(tif);
+    if (!ok)
+    {
+        fprintf(stderr, "unaligned: cannot write %s\n", FILENAME);
+        return 0;
+    }
+    tif = TIFFOpen(FILENAME, "r");
+    ok = tif != NULL && checkStrips(tif, 10000, 10, 0) &&
+         TIFFReadDirectory(tif) && checkStrips(tif, 1000, 100, 1);
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+int main(void)
+{
+    uint8_t *buf = (uint8_t *)malloc(TILESIZE * TILESIZE);
+    int ok;
+
+    if (!buf)
+        return 1;
+    ok = testLayout("classic", "w", buf) && testLayout("bigtiff", "w8", buf) &&
+         testUnalignedRun();
+    free(buf);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,261 @@
+/*
+ * Tests for the index of the main IFD chain: built by
+ * TIFFNumberOfDirectories(), saved with TIFFWriteIFDIndex() and reloaded
+ * with TIFFReadIFDIndex().
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "ifd_index.tif"
+#define SIDECAR "ifd_index.tif.idx"
+#define NPAGES 300
+
+/* Client I/O procedures over stdio that count reads */
+static int nreads;
+
+static tmsize_t readProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    nreads++;
+    return (tmsize_t)fread(buf, 1, (size_t)size, (FILE *)fd);
+}
+
+static tmsize_t writeProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+static toff_t seekProc(thandle_t fd, toff_t off, int whence)
+{
+    if (fseek((FILE *)fd, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell((FILE *)fd);
+}
+
+static int closeProc(thandle_t fd) { return fclose((FILE *)fd); }
+
+static toff_t sizeProc(thandle_t fd)
+{
+    long pos = ftell((FILE *)fd), size;
+    fseek((FILE *)fd, 0, SEEK_END);
+    size = ftell((FILE *)fd);
+    fseek((FILE *)fd, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static TIFF *openCounted(void)
+{
+    FILE *fp = fopen(FILENAME, "rb");
+    if (!fp)
+        return NULL;
+    return TIFFClientOpen(FILENAME, "rm", (thandle_t)fp, readProc, writeProc,
+                          seekProc, closeProc, sizeProc, NULL, NULL);
+}
+
+static int writePages(const char *mode, uint32_t first, uint32_t count)
+{
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+    uint8_t row[(NPAGES + 8) / 8 + 1] = {0};
+    if (!tif)
+        return 0;
+    for (uint32_t i = first; i < first + count; i++)
+    {
+        /* The width identifies the page */
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, i + 1);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 1);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 1);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISWHITE);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+        if (TIFFWriteEncodedStrip(tif, 0, row, (i + 8) / 8) != (i + 8) / 8 ||
+            !TIFFWriteDirectory(tif))
+        {
+            TIFFClose(tif);
+            return 0;
+        }
+    }
+    TIFFClose(tif);
+    return 1;
+}
+
+static int checkPage(TIFF *tif, tdir_t dirn)
+{
+    uint32_t width = 0;
+    if (!TIFFSetDirectory(tif, dirn) ||
+        !TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width) || width != dirn + 1 ||
+        TIFFCurrentDirectory(tif) != dirn)
+    {
+        fprintf(stderr, "page %u: got width %u\n", dirn, width);
+        return 0;
+    }
+    return 1;
+}
+
+/* Random access through an index, built or loaded. */
+static int checkAccess(TIFF *tif, tdir_t npages)
+{
+    uint32_t seed = 1;
+    for (int i = 0; i < 50; i++)
+    {
+        seed = seed * 1103515245U + 12345U;
+        if (!checkPage(tif, (seed >> 8) % npages))
+            return 0;
+    }
+    return checkPage(tif, npages - 1) && checkPage(tif, 0) &&
+           !TIFFSetDirectory(tif, npages);
+}
+
+static int testBuildAndSave(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    int ok;
+    if (!tif)
+        return 0;
+    ok = !TIFFReadIFDIndex(tif, SIDECAR) &&
+         TIFFNumberOfDirectories(tif) == NPAGES && checkAccess(tif, NPAGES) &&
+         TIFFWriteIFDIndex(tif, SIDECAR);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "building and saving the index failed\n");
+    return ok;
+}
+
+static int testLoad(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    int ok;
+    if (!tif)
+        return 0;
+    ok = TIFFReadIFDIndex(tif, SIDECAR) &&
+         TIFFNumberOfDirectories(tif) == NPAGES && checkAccess(tif, NPAGES);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "loading the index failed\n");
+    return ok;
+}
+
+/* Once indexed, counting pages and jumping to one do not walk the chain. */
+static int testNoWalk(void)
+{
+    TIFF *tif = openCounted();
+    int ok, walk, jump;
+    if (!tif)
+        return 0;
+    nreads = 0;
+    ok = TIFFNumberOfDirectories(tif) == NPAGES;
+    walk = nreads;
+    nreads = 0;
+    ok = ok && TIFFNumberOfDirectories(tif) == NPAGES && nreads == 0;
+    ok = ok && checkPage(tif, NPAGES - 1);
+    jump = nreads;
+    TIFFClose(tif);
+    if (!ok || walk < NPAGES || jump > 10)
+    {
+        fprintf(stderr, "%d reads to count pages, %d to jump to the last\n",
+                walk, jump);
+        return 0;
+    }
+    return 1;
+}
+
+/* Appending a page makes the saved index stale. */
+static int testStale(void)
+{
+    TIFF *tif;
+    int ok;
+    if (!writePages("a", NPAGES, 1))
+        return 0;
+    tif = TIFFOpen(FILENAME, "r");
+    if (!tif)
+        return 0;
+    ok = !TIFFReadIFDIndex(tif, SIDECAR) &&
+         TIFFNumberOfDirectories(tif) == NPAGES + 1 &&
+         checkPage(tif, NPAGES) && TIFFWriteIFDIndex(tif, SIDECAR);
+    TIFFClose(tif);
+    if (!ok)
+    {
+        fprintf(stderr, "stale index accepted\n");
+        return 0;
+    }
+
+    /* A damaged sidecar is rejected too */
+    {
+        FILE *fp = fopen(SIDECAR, "r+b");
+        if (!fp || fseek(fp, 50, SEEK_SET) != 0 || fputc(0x55, fp) == EOF)
+            ok = 0;
+        if (fp)
+            fclose(fp);
+    }
+    tif = TIFFOpen(FILENAME, "r");
+    if (!tif)
+        return 0;
+    ok = ok && !TIFFReadIFDIndex(tif, SIDECAR) && checkPage(tif, NPAGES);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "damaged index accepted\n");
+    return ok;
+}
+
+/*
+ * A file modified within the same second as the index was saved makes it
+ * stale: its modification time is compared to the nanosecond.
+ */
+static int testSameSecond(void)
+{
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    struct stat sb;
+    struct timespec times[2];
+    TIFF *tif;
+    int ok;
+
+    if (stat(FILENAME, &sb) != 0)
+        return 0;
+    times[0] = sb.st_atim;
+    times[1] = sb.st_mtim;
+    times[1].tv_nsec = sb.st_mtim.tv_nsec == 0 ? 1 : 0;
+    if (utimensat(AT_FDCWD, FILENAME, times, 0) != 0 ||
+        stat(FILENAME, &sb) != 0 || sb.st_mtim.tv_nsec != times[1].tv_nsec)
+        return 1; /* no sub-second timestamps on this filesystem */
+    tif = TIFFOpen(FILENAME, "r");
+    if (!tif)
+        return 0;
+    ok = !TIFFReadIFDIndex(tif, SIDECAR);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "index accepted after a change in the same second\n");
+    return ok;
+#else
+    return 1;
+#endif
+}
+
+int main(void)
+{
+    int ok;
+    unlink(SIDECAR);
+    ok = writePages("w", 0, NPAGES) && testBuildAndSave() && testLoad() &&
+         testNoWalk() && testSameSecond() && testStale();
+    if (ok)
+    {
+        unlink(FILENAME);
+        unlink(SIDECAR);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/*
+ * Tests for reduced resolution JPEG decoding (TIFFTAG_JPEGSCALEDENOM /
+ * TIFFOpenOptionsSetJPEGScaleDenom).
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "jpeg_scale.tif"
+#define WIDTH 203
+#define HEIGHT 150
+#define ROWSPERSTRIP 16
+#define TILESIZE 64
+#define TOLERANCE 10
+
+/* A smooth image that survives JPEG compression with small errors */
+static uint8_t pattern(uint32_t x, uint32_t y, uint32_t s)
+{
+    return (uint8_t)(s == 0 ? x : s == 1 ? y + 40 : (x + y) / 2);
+}
+
+static int writeFile(uint16_t spp, int tiled)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint8_t *buf;
+    uint32_t bw = tiled ? TILESIZE : WIDTH;
+    uint32_t bh = tiled ? TILESIZE : ROWSPERSTRIP;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_JPEG);
+    TIFFSetField(tif, TIFFTAG_JPEGQUALITY, 95);
+    if (spp == 3)
+    {
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_YCBCR);
+        TIFFSetField(tif, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+
+    buf = (uint8_t *)malloc((size_t)bw * bh * spp);
+    for (uint32_t y0 = 0; ok && y0 < HEIGHT; y0 += bh)
+        for (uint32_t x0 = 0; ok && x0 < WIDTH; x0 += bw)
+        {
+            uint32_t rows = tiled || y0 + bh <= HEIGHT ? bh : HEIGHT - y0;
+            uint8_t *q = buf;
+            for (uint32_t j = 0; j < rows; j++)
+                for (uint32_t i = 0; i < bw; i++)
+                    for (uint16_t s = 0; s < spp; s++)
+                        *q++ = pattern(x0 + i, y0 + j, s);
+            if (tiled)
+                ok = TIFFWriteTile(tif, buf, x0, y0, 0, 0) > 0;
+            else
+                ok = TIFFWriteEncodedStrip(tif, y0 / bh, buf,
+                                           (tmsize_t)rows * bw * spp) > 0;
+        }
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+static TIFF *openScaled(int denom)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif;
+    if (!opts)
+        return NULL;
+    TIFFOpenOptionsSetJPEGScaleDenom(opts, denom);
+    tif = TIFFOpenExt(FILENAME, "r", opts);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+/* Check that the pixel at (x, y) of the reduced image matches the average
+ * of the block of the full resolution image it covers. */
+static int checkPixel(const uint8_t *px, uint32_t x, uint32_t y,
+                      uint16_t spp, int denom)
+{
+    for (uint16_t s = 0; s < spp; s++)
+    {
+        uint32_t sum = 0, n = 0;
+        for (uint32_t j = y * denom; j < (y + 1) * denom && j < HEIGHT; j++)
+            for (uint32_t i = x * denom; i < (x + 1) * denom && i < WIDTH;
+                 i++, n++)
+                sum += pattern(i, j, s);
+        if (abs((int)px[s] - (int)(sum / n)) > TOLERANCE)
+        {
+            fprintf(stderr, "1/%d: pixel %u,%u sample %u is %u, expected %u\n",
+                    denom, x, y, s, px[s], sum / n);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Read every strip/tile at 1/denom and check sizes and content. */
+static int checkStriles(TIFF *tif, uint16_t spp, int tiled, int denom)
+{
+    uint32_t sw = (WIDTH + denom - 1) / denom;
+    uint32_t bw = tiled ? (uint32_t)(TILESIZE / denom) : sw;
+    uint32_t bh = (tiled ? TILESIZE : ROWSPERSTRIP) / denom;
+    tmsize_t size = tiled ? TIFFTileSize(tif) : TIFFStripSize(tif);
+    uint32_t n = tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    uint32_t across = tiled ? (WIDTH + TILESIZE - 1) / TILESIZE : 1;
+    uint8_t *buf;
+    int ok = 1;
+
+    if (TIFFScanlineSize(tif) != (tmsize_t)sw * spp ||
+        size != (tmsize_t)bw * bh * spp)
+    {
+        fprintf(stderr, "1/%d: scanline %d / strile size %d not reduced\n",
+                denom, (int)TIFFScanlineSize(tif), (int)size);
+        return 0;
+    }
+    buf = (uint8_t *)malloc((size_t)size);
+    for (uint32_t t = 0; ok && t < n; t++)
+    {
+        uint32_t x0 = (t % across) * bw, y0 = (t / across) * bh;
+        uint32_t rows = bh;
+        tmsize_t got;
+        if (!tiled && (y0 + bh) * denom > HEIGHT)
+            rows = (HEIGHT - y0 * denom + denom - 1) / denom;
+        got = tiled ? TIFFReadEncodedTile(tif, t, buf, size)
+                    : TIFFReadEncodedStrip(tif, t, buf, size);
+        if (got != (tmsize_t)rows * bw * spp)
+        {
+            fprintf(stderr, "1/%d: strile %u decoded to %d bytes\n", denom, t,
+                    (int)got);
+            ok = 0;
+            break;
+        }
+        for (uint32_t j = 0; ok && j < rows; j++)
+            for (uint32_t i = 0; ok && i < bw && x0 + i < sw; i++)
+                if ((y0 + j) * denom < HEIGHT)
+                    ok = checkPixel(buf + ((tmsize_t)j * bw + i) * spp, x0 + i,
+                                    y0 + j, spp, denom);
+    }
+    free(buf);
+    return ok;
+}
+
+/* TIFFReadRGBAImage() returns the reduced image. */
+static int checkRGBA(TIFF *tif, uint16_t spp, int denom)
+{
+    uint32_t sw = (WIDTH + denom - 1) / denom;
+    uint32_t sh = (HEIGHT + denom - 1) / denom;
+    uint32_t *raster = (uint32_t *)malloc((size_t)sw * sh * sizeof(uint32_t));
+    int ok = raster != NULL &&
+             TIFFReadRGBAImageOriented(tif, sw, sh, raster,
+                                       ORIENTATION_TOPLEFT, 1);
+    for (uint32_t y = 0; ok && y < sh; y++)
+        for (uint32_t x = 0; ok && x < sw; x++)
+        {
+            uint32_t p = raster[y * sw + x];
+            uint8_t px[3] = {(uint8_t)TIFFGetR(p), (uint8_t)TIFFGetG(p),
+                             (uint8_t)TIFFGetB(p)};
+            ok = checkPixel(px, x, y, spp, denom);
+        }
+    if (!ok)
+        fprintf(stderr, "1/%d: RGBA image differs\n", denom);
+    free(raster);
+    return ok;
+}
+
+static int testLayout(const char *name, uint16_t spp, int tiled)
+{
+    if (!writeFile(spp, tiled))
+    {
+        fprintf(stderr, "%s: cannot write %s\n", name, FILENAME);
+        return 0;
+    }
+    for (int denom = 1; denom <= 8; denom *= 2)
+    {
+        /* Through the open option, then through the pseudo-tag */
+        for (int how = 0; how < 2; how++)
+        {
+            TIFF *tif = how == 0 ? openScaled(denom) : TIFFOpen(FILENAME, "r");
+            int ok;
+            if (!tif)
+                return 0;
+            if (spp == 3)
+                TIFFSetField(tif, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+            if (how == 1)
+                TIFFSetField(tif, TIFFTAG_JPEGSCALEDENOM, denom);
+            ok = checkStriles(tif, spp, tiled, denom) &&
+                 checkRGBA(tif, spp, denom);
+            TIFFClose(tif);
+            if (!ok)
+            {
+                fprintf(stderr, "%s failed\n", name);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static void errorHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)fmt;
+    (void)ap;
+}
+
+static int testErrors(void)
+{
+    TIFF *tif = openScaled(4);
+    uint8_t line[WIDTH];
+    TIFFErrorHandler old;
+    int denom = 0, ok;
+
+    if (!tif)
+        return 0;
+    old = TIFFSetErrorHandler(errorHandler);
+    /* Invalid denominators are rejected, scanline access is refused */
+    ok = !TIFFSetField(tif, TIFFTAG_JPEGSCALEDENOM, 3) &&
+         TIFFGetField(tif, TIFFTAG_JPEGSCALEDENOM, &denom) && denom == 4 &&
+         TIFFReadScanline(tif, line, 0, 0) < 0;
+    TIFFSetErrorHandler(old);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "invalid use accepted\n");
+    return ok;
+}
+
+int main(void)
+{
+    int ok = testLayout("strips/rgb", 3, 0) && testLayout("tiles/rgb", 3, 1) &&
+             testLayout("tiles/gray", 1, 1) &&
+             testLayout("strips/gray", 1, 0) && testErrors();
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+/*
+ * Tests for COMPRESSION_JPEGLS: 1 to 16 bit images, interleaved or planar,
+ * in strips or tiles, decode losslessly whether whole striles, part of
+ * them or scanlines are read.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "jpegls_codec.tif"
+#define WIDTH 200
+#define HEIGHT 150
+#define ROWSPERSTRIP 64 /* the last strip is shorter */
+#define STRIPSPERPLANE ((HEIGHT + ROWSPERSTRIP - 1) / ROWSPERSTRIP)
+#define TILESIZE 64
+
+typedef struct
+{
+    uint16_t bps;
+    uint16_t spp;
+    uint16_t planar;
+    int tiled;
+    int scanlines; /* written scanline by scanline */
+} TestCase;
+
+static const TestCase cases[] = {
+    {8, 1, PLANARCONFIG_CONTIG, 0, 0},    {16, 1, PLANARCONFIG_CONTIG, 1, 0},
+    {12, 1, PLANARCONFIG_CONTIG, 0, 1},   {8, 3, PLANARCONFIG_CONTIG, 0, 1},
+    {16, 4, PLANARCONFIG_CONTIG, 1, 0},   {16, 3, PLANARCONFIG_SEPARATE, 0, 0},
+    {1, 1, PLANARCONFIG_CONTIG, 0, 0},    {10, 3, PLANARCONFIG_CONTIG, 1, 0},
+    {5, 3, PLANARCONFIG_SEPARATE, 1, 0}};
+
+/* Bytes per row of a strile, and the rows of strile s. */
+static tmsize_t strileGeometry(TIFF *tif, const TestCase *c, uint32_t s,
+                               uint32_t *rows)
+{
+    if (c->tiled)
+    {
+        *rows = TILESIZE;
+        return TIFFTileRowSize(tif);
+    }
+    *rows = HEIGHT - s % STRIPSPERPLANE * ROWSPERSTRIP;
+    if (*rows > ROWSPERSTRIP)
+        *rows = ROWSPERSTRIP;
+    return TIFFScanlineSize(tif);
+}
+
+/* The content of strile s, with the padding bits of rows cleared. */
+static void fillStrile(const TestCase *c, uint32_t s, uint8_t *buf,
+                       tmsize_t rowsize, uint32_t rows)
+{
+    const uint32_t width = c->tiled ? TILESIZE : WIDTH;
+    const uint32_t rowbits =
+        width * (c->planar == PLANARCONFIG_CONTIG ? c->spp : 1) * c->bps;
+
+    for (uint32_t y = 0; y < rows; y++)
+    {
+        uint8_t *row = buf + (tmsize_t)y * rowsize;
+        for (tmsize_t i = 0; i < rowsize; i++)
+            row[i] = (uint8_t)(i * 7 + y * 3 + s * 11 + (i * i + y) % 5);
+        if (rowbits % 8 != 0)
+            row[rowsize - 1] &= (uint8_t)(0xff << (8 - rowbits % 8));
+    }
+}
+
+static TIFF *openFile(const TestCase *c, const char *mode)
+{
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+
+    if (!tif || mode[0] != 'w')
+        return tif;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, c->bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, c->spp);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, c->planar);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC,
+                 c->spp == 1 ? PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_RGB);
+    if (c->spp == 4)
+    {
+        uint16_t extra = EXTRASAMPLE_ASSOCALPHA;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    if (c->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    if (TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_JPEGLS) != 1)
+    {
+        TIFFClose(tif);
+        return NULL;
+    }
+    return tif;
+}
+
+static int writeFile(const TestCase *c, uint8_t *buf)
+{
+    TIFF *tif = openFile(c, "w");
+    const uint32_t nstriles =
+        tif ? (c->tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif))
+            : 0;
+    int ok = tif != NULL;
+
+    for (uint32_t s = 0; ok && s < nstriles; s++)
+    {
+        uint32_t rows;
+        tmsize_t rowsize = strileGeometry(tif, c, s, &rows);
+        tmsize_t size = rowsize * rows;
+
+        fillStrile(c, s, buf, rowsize, rows);
+        if (c->scanlines)
+        {
+            for (uint32_t y = 0; ok && y < rows; y++)
+                ok = TIFFWriteScanline(tif, buf + y * rowsize,
+                                       s * ROWSPERSTRIP + y, 0) == 1;
+        }
+        else if (c->tiled)
+            ok = TIFFWriteEncodedTile(tif, s, buf, size) == size;
+        else
+            ok = TIFFWriteEncodedStrip(tif, s, buf, size) == size;
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int checkStriles(const TestCase *c, uint8_t *buf, uint8_t *expected)
+{
+    TIFF *tif = openFile(c, "r");
+    const uint32_t nstriles =
+        tif ? (c->tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif))
+            : 0;
+    int ok = tif != NULL;
+
+    for (uint32_t s = 0; ok && s < nstriles; s++)
+    {
+        uint32_t rows;
+        tmsize_t rowsize = strileGeometry(tif, c, s, &rows);
+        tmsize_t size = rowsize * rows;
+
+        fillStrile(c, s, expected, rowsize, rows);
+        if (c->tiled)
+            ok = TIFFReadEncodedTile(tif, s, buf, (tmsize_t)-1) == size;
+        else
+            ok = TIFFReadEncodedStrip(tif, s, buf, (tmsize_t)-1) == size;
+        ok = ok && memcmp(buf, expected, (size_t)size) == 0;
+        /* The beginning of the strile only */
+        if (ok && c->tiled)
+            ok = TIFFReadEncodedTile(tif, s, buf, 2 * rowsize) ==
+                 2 * rowsize;
+        else if (ok)
+            ok = TIFFReadEncodedStrip(tif, s, buf, 2 * rowsize) ==
+                 2 * rowsize;
+        ok = ok && memcmp(buf, expected, (size_t)(2 * rowsize)) == 0;
+        if (!ok)
+            fprintf(stderr, "strip or tile %u differs\n", s);
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int checkScanlines(const TestCase *c, uint8_t *buf, uint8_t *expected)
+{
+    TIFF *tif = openFile(c, "r");
+    const uint16_t planes = c->planar == PLANARCONFIG_CONTIG ? 1 : c->spp;
+    int ok = tif != NULL;
+
+    /* Planes interleaved row by row, which skips rows of each strip */
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        for (uint16_t p = 0; ok && p < planes; p++)
+        {
+            const uint32_t s = p * STRIPSPERPLANE + y / ROWSPERSTRIP;
+            uint32_t rows;
+            tmsize_t rowsize = strileGeometry(tif, c, s, &rows);
+
+            fillStrile(c, s, expected, rowsize, rows);
+            ok = TIFFReadScanline(tif, buf, y, p) == 1 &&
+                 memcmp(buf, expected + (y % ROWSPERSTRIP) * rowsize,
+                        (size_t)rowsize) == 0;
+            if (!ok)
+                fprintf(stderr, "row %u of plane %u differs\n", y, p);
+        }
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+int main(void)
+{
+    const size_t bufsize = (size_t)WIDTH * 4 * 2 * ROWSPERSTRIP;
+    uint8_t *buf = (uint8_t *)malloc(bufsize);
+    uint8_t *expected = (uint8_t *)malloc(bufsize);
+    int ok = buf != NULL && expected != NULL;
+
+    for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const TestCase *c = &cases[i];
+
+        ok = writeFile(c, buf) && checkStriles(c, buf, expected) &&
+             (c->tiled || checkScanlines(c, buf, expected));
+        if (!ok)
+            fprintf(stderr,
+                    "%u-bit, %u samples, planar %u, %s%s failed\n", c->bps,
+                    c->spp, c->planar, c->tiled ? "tiles" : "strips",
+                    c->scanlines ? " written by scanlines" : "");
+    }
+    free(buf);
+    free(expected);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,233 @@
+/*
+ * Tests for lazy tag loading (TIFFOpenOptionsSetLazyTagThreshold): large
+ * byte and ASCII tag values are only read by the first TIFFGetField().
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "lazy_tags.tif"
+#define XMP_SIZE 50000
+#define ICC_SIZE 30000
+#define DESCRIPTION_SIZE 20000
+#define THRESHOLD 1024
+
+/* Client I/O procedures over stdio that count bytes read */
+static tmsize_t nbytes;
+
+static tmsize_t readProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    tmsize_t got = (tmsize_t)fread(buf, 1, (size_t)size, (FILE *)fd);
+    nbytes += got;
+    return got;
+}
+
+static tmsize_t writeProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+static toff_t seekProc(thandle_t fd, toff_t off, int whence)
+{
+    if (fseek((FILE *)fd, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell((FILE *)fd);
+}
+
+static int closeProc(thandle_t fd) { return fclose((FILE *)fd); }
+
+static toff_t sizeProc(thandle_t fd)
+{
+    long pos = ftell((FILE *)fd), size;
+    fseek((FILE *)fd, 0, SEEK_END);
+    size = ftell((FILE *)fd);
+    fseek((FILE *)fd, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static TIFF *openCounted(tmsize_t threshold)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    FILE *fp = fopen(FILENAME, "rb");
+    TIFF *tif = NULL;
+    if (opts && fp)
+    {
+        TIFFOpenOptionsSetLazyTagThreshold(opts, threshold);
+        tif = TIFFClientOpenExt(FILENAME, "rm", (thandle_t)fp, readProc,
+                                writeProc, seekProc, closeProc, sizeProc, NULL,
+                                NULL, opts);
+    }
+    else if (fp)
+        fclose(fp);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static uint8_t xmp[XMP_SIZE];
+static uint8_t icc[ICC_SIZE];
+static char description[DESCRIPTION_SIZE];
+
+static int writeFile(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint8_t row[8] = {0};
+    int ok;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 8);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 1);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description);
+    TIFFSetField(tif, TIFFTAG_SOFTWARE, "lazy_tags");
+    TIFFSetField(tif, TIFFTAG_XMLPACKET, (uint32_t)XMP_SIZE, xmp);
+    TIFFSetField(tif, TIFFTAG_ICCPROFILE, (uint32_t)ICC_SIZE, icc);
+    ok = TIFFWriteScanline(tif, row, 0, 0) == 1;
+    TIFFClose(tif);
+    return ok;
+}
+
+static int checkTags(TIFF *tif, int expect_icc)
+{
+    const char *desc = NULL, *software = NULL;
+    const void *data = NULL;
+    const void *again = NULL;
+    uint32_t count = 0;
+
+    if (!TIFFGetField(tif, TIFFTAG_SOFTWARE, &software) ||
+        strcmp(software, "lazy_tags") != 0 ||
+        !TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &desc) ||
+        strcmp(desc, description) != 0)
+    {
+        fprintf(stderr, "ASCII tags differ\n");
+        return 0;
+    }
+    if (!TIFFGetField(tif, TIFFTAG_XMLPACKET, &count, &data) ||
+        count != XMP_SIZE || memcmp(data, xmp, XMP_SIZE) != 0 ||
+        !TIFFGetField(tif, TIFFTAG_XMLPACKET, &count, &again) || again != data)
+    {
+        fprintf(stderr, "XMP packet differs\n");
+        return 0;
+    }
+    if (expect_icc != (TIFFGetField(tif, TIFFTAG_ICCPROFILE, &count, &data) &&
+                       count == ICC_SIZE && memcmp(data, icc, ICC_SIZE) == 0))
+    {
+        fprintf(stderr, "ICC profile %s\n",
+                expect_icc ? "differs" : "read from a truncated file");
+        return 0;
+    }
+    return 1;
+}
+
+static int testLazy(void)
+{
+    const tmsize_t large = XMP_SIZE + ICC_SIZE + DESCRIPTION_SIZE;
+    TIFF *tif;
+    tmsize_t opening;
+    int ok;
+
+    /* Eager loading reads every value with the directory */
+    nbytes = 0;
+    tif = openCounted(0);
+    if (!tif)
+        return 0;
+    opening = nbytes;
+    ok = opening >= large && checkTags(tif, 1);
+    TIFFClose(tif);
+    if (!ok)
+    {
+        fprintf(stderr, "eager loading failed\n");
+        return 0;
+    }
+
+    /* Lazy loading leaves the large values in the file until asked for */
+    nbytes = 0;
+    tif = openCounted(THRESHOLD);
+    if (!tif)
+        return 0;
+    opening = nbytes;
+    ok = opening < THRESHOLD * 16 && TIFFGetTagListCount(tif) >= 4 &&
+         checkTags(tif, 1) && nbytes >= large;
+    TIFFClose(tif);
+    if (!ok)
+    {
+        fprintf(stderr, "lazy loading failed: %d bytes read at open\n",
+                (int)opening);
+        return 0;
+    }
+    return 1;
+}
+
+static void errorHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)fmt;
+    (void)ap;
+}
+
+/* A deferred value that cannot be read anymore is reported as absent. */
+static int testTruncated(void)
+{
+    FILE *fp = fopen(FILENAME, "rb");
+    uint8_t *buf = (uint8_t *)malloc(XMP_SIZE + ICC_SIZE + 65536);
+    size_t size = 0;
+    TIFFErrorHandler olderr, oldwarn;
+    TIFF *tif;
+    int ok;
+
+    if (fp)
+    {
+        size = fread(buf, 1, XMP_SIZE + ICC_SIZE + 65536, fp);
+        fclose(fp);
+    }
+    /* The ICC profile is the last value written */
+    fp = fopen(FILENAME, "wb");
+    ok = buf && fp && size > 100 &&
+         fwrite(buf, 1, size - 100, fp) == size - 100;
+    if (fp)
+        fclose(fp);
+    free(buf);
+    if (!ok)
+        return 0;
+
+    tif = openCounted(THRESHOLD);
+    if (!tif)
+        return 0;
+    olderr = TIFFSetErrorHandler(errorHandler);
+    oldwarn = TIFFSetWarningHandler(errorHandler);
+    ok = checkTags(tif, 0) &&
+         !TIFFGetField(tif, TIFFTAG_ICCPROFILE, NULL, NULL);
+    TIFFSetErrorHandler(olderr);
+    TIFFSetWarningHandler(oldwarn);
+    TIFFClose(tif);
+    return ok;
+}
+
+int main(void)
+{
+    int ok;
+    for (int i = 0; i < XMP_SIZE; i++)
+        xmp[i] = (uint8_t)(i * 7);
+    for (int i = 0; i < ICC_SIZE; i++)
+        icc[i] = (uint8_t)(i * 13 + 1);
+    for (int i = 0; i < DESCRIPTION_SIZE - 1; i++)
+        description[i] = (char)('A' + i % 26);
+    ok = writeFile() && testLazy() && testTruncated();
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
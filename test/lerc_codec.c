@@ -0,0 +1,365 @@
+/*
+ * Tests for COMPRESSION_LERC: lossless images, with an alpha mask, a NaN
+ * mask shared by all bands or one NaN mask per band, decode to the original
+ * data whether whole striles, part of them or scanlines are read.
+ */
+
+#include "tif_config.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "lerc_codec.tif"
+#define WIDTH 256
+#define HEIGHT 384
+#define ROWSPERSTRIP 128
+#define TILESIZE 128
+#define PARTIALROWS 3
+
+enum
+{
+    CONTENT_RGB,      /* 3 x uint8 */
+    CONTENT_RGBA,     /* 4 x uint8, alpha either 0 or 255 */
+    CONTENT_NAN_ALL,  /* 3 x float64, NaN in all bands of a pixel */
+    CONTENT_NAN_BAND, /* 2 x float32, NaN in one band of a pixel */
+    CONTENT_NAN_GRAY  /* 1 x float32 */
+};
+
+typedef struct
+{
+    int content;
+    int tiled;
+    int add_compression;
+    int threads;
+} TestCase;
+
+static uint16_t samplesPerPixel(int content)
+{
+    switch (content)
+    {
+        case CONTENT_RGB:
+        case CONTENT_NAN_ALL:
+            return 3;
+        case CONTENT_RGBA:
+            return 4;
+        case CONTENT_NAN_BAND:
+            return 2;
+        default:
+            return 1;
+    }
+}
+
+static uint16_t bitsPerSample(int content)
+{
+    switch (content)
+    {
+        case CONTENT_RGB:
+        case CONTENT_RGBA:
+            return 8;
+        case CONTENT_NAN_ALL:
+            return 64;
+        default:
+            return 32;
+    }
+}
+
+static size_t pixelBytes(int content)
+{
+    return (size_t)samplesPerPixel(content) * bitsPerSample(content) / 8;
+}
+
+static int isMasked(uint32_t x, uint32_t y)
+{
+    return (x * 7 + y * 3) % 11 == 0 || (x >= 40 && x < 60 && y >= 100);
+}
+
+static void fillImage(uint8_t *img, int content)
+{
+    const uint16_t spp = samplesPerPixel(content);
+
+    for (uint32_t y = 0; y < HEIGHT; y++)
+        for (uint32_t x = 0; x < WIDTH; x++)
+        {
+            const size_t i = (size_t)y * WIDTH + x;
+            for (uint16_t s = 0; s < spp; s++)
+            {
+                const double v = (double)(x * 3 + y * 5 + s * 17) / 4;
+                const int masked = isMasked(x, y);
+                switch (content)
+                {
+                    case CONTENT_RGB:
+                        img[i * spp + s] = (uint8_t)(x + y * 3 + s * 40);
+                        break;
+                    case CONTENT_RGBA:
+                        /* Color is not stored where the pixel is masked */
+                        if (s == 3)
+                            img[i * spp + s] = masked ? 0 : 255;
+                        else
+                            img[i * spp + s] =
+                                masked ? 0 : (uint8_t)(x + y * 3 + s * 40);
+                        break;
+                    case CONTENT_NAN_ALL:
+                        ((double *)img)[i * spp + s] = masked ? NAN : v;
+                        break;
+                    case CONTENT_NAN_BAND:
+                        ((float *)img)[i * spp + s] =
+                            masked && s == (uint16_t)(x & 1) ? NAN : (float)v;
+                        break;
+                    default:
+                        ((float *)img)[i] = masked ? NAN : (float)v;
+                        break;
+                }
+            }
+        }
+}
+
+/* Compare n bytes of pixel data, with all NaN values equal. */
+static int sameData(const uint8_t *a, const uint8_t *b, size_t n, int content)
+{
+    if (bitsPerSample(content) == 64)
+    {
+        for (size_t i = 0; i < n / 8; i++)
+        {
+            double va, vb;
+            memcpy(&va, a + i * 8, 8);
+            memcpy(&vb, b + i * 8, 8);
+            if (va != vb && !(va != va && vb != vb))
+                return 0;
+        }
+        return 1;
+    }
+    if (bitsPerSample(content) == 32)
+    {
+        for (size_t i = 0; i < n / 4; i++)
+        {
+            float va, vb;
+            memcpy(&va, a + i * 4, 4);
+            memcpy(&vb, b + i * 4, 4);
+            if (va != vb && !(va != va && vb != vb))
+                return 0;
+        }
+        return 1;
+    }
+    return memcmp(a, b, n) == 0;
+}
+
+static int writeFile(const uint8_t *img, const TestCase *tc)
+{
+    const size_t pixbytes = pixelBytes(tc->content);
+    const size_t rowbytes = pixbytes * WIDTH;
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    int ok = tif != NULL;
+
+    if (!ok)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bitsPerSample(tc->content));
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, samplesPerPixel(tc->content));
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    if (tc->content == CONTENT_RGB || tc->content == CONTENT_RGBA)
+    {
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+        if (tc->content == CONTENT_RGBA)
+        {
+            const uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+            TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+        }
+    }
+    else
+    {
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP);
+        if (tc->content == CONTENT_NAN_ALL || tc->content == CONTENT_NAN_BAND)
+        {
+            uint16_t extra[2] = {EXTRASAMPLE_UNSPECIFIED,
+                                 EXTRASAMPLE_UNSPECIFIED};
+            TIFFSetField(tif, TIFFTAG_EXTRASAMPLES,
+                         samplesPerPixel(tc->content) - 1, extra);
+        }
+    }
+    if (tc->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    if (TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LERC) != 1 ||
+        TIFFSetField(tif, TIFFTAG_LERC_ADD_COMPRESSION,
+                     tc->add_compression) != 1 ||
+        TIFFSetField(tif, TIFFTAG_LERC_MAXZERROR, 0.0) != 1)
+    {
+        fprintf(stderr, "cannot set the LERC fields\n");
+        TIFFClose(tif);
+        return 0;
+    }
+
+    if (tc->tiled)
+    {
+        uint8_t *tile = (uint8_t *)malloc(pixbytes * TILESIZE * TILESIZE);
+        ok = tile != NULL;
+        for (uint32_t ty = 0; ok && ty < HEIGHT; ty += TILESIZE)
+            for (uint32_t tx = 0; ok && tx < WIDTH; tx += TILESIZE)
+            {
+                for (uint32_t y = 0; y < TILESIZE; y++)
+                    memcpy(tile + y * TILESIZE * pixbytes,
+                           img + (ty + y) * rowbytes + tx * pixbytes,
+                           TILESIZE * pixbytes);
+                ok = TIFFWriteTile(tif, tile, tx, ty, 0, 0) ==
+                     (tmsize_t)(pixbytes * TILESIZE * TILESIZE);
+            }
+        free(tile);
+    }
+    else
+    {
+        for (uint32_t s = 0; ok && s < HEIGHT / ROWSPERSTRIP; s++)
+            ok = TIFFWriteEncodedStrip(
+                     tif, s, (void *)(img + s * ROWSPERSTRIP * rowbytes),
+                     (tmsize_t)(ROWSPERSTRIP * rowbytes)) ==
+                 (tmsize_t)(ROWSPERSTRIP * rowbytes);
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    TIFFClose(tif);
+    return ok;
+}
+
+static int checkTiles(TIFF *tif, const uint8_t *img, uint8_t *buf,
+                      int content)
+{
+    const size_t pixbytes = pixelBytes(content);
+    const size_t rowbytes = pixbytes * WIDTH;
+    const size_t tilerow = pixbytes * TILESIZE;
+    int ok = 1;
+
+    for (uint32_t ty = 0; ok && ty < HEIGHT; ty += TILESIZE)
+        for (uint32_t tx = 0; ok && tx < WIDTH; tx += TILESIZE)
+        {
+            const uint32_t t = TIFFComputeTile(tif, tx, ty, 0, 0);
+            const uint8_t *expected = img + ty * rowbytes + tx * pixbytes;
+
+            ok = TIFFReadEncodedTile(tif, t, buf, (tmsize_t)-1) ==
+                 (tmsize_t)(tilerow * TILESIZE);
+            for (uint32_t y = 0; ok && y < TILESIZE; y++)
+                ok = sameData(buf + y * tilerow, expected + y * rowbytes,
+                              tilerow, content);
+            if (!ok)
+            {
+                fprintf(stderr, "tile %u,%u differs\n", tx, ty);
+                break;
+            }
+            /* The beginning of the tile only */
+            ok = TIFFReadEncodedTile(tif, t, buf,
+                                     (tmsize_t)(PARTIALROWS * tilerow)) ==
+                 (tmsize_t)(PARTIALROWS * tilerow);
+            for (uint32_t y = 0; ok && y < PARTIALROWS; y++)
+                ok = sameData(buf + y * tilerow, expected + y * rowbytes,
+                              tilerow, content);
+            if (!ok)
+                fprintf(stderr, "partial tile %u,%u differs\n", tx, ty);
+        }
+    return ok;
+}
+
+static int checkStrips(TIFF *tif, const uint8_t *img, uint8_t *buf,
+                       int content)
+{
+    const size_t rowbytes = pixelBytes(content) * WIDTH;
+    int ok = 1;
+
+    for (uint32_t s = 0; ok && s < HEIGHT / ROWSPERSTRIP; s++)
+    {
+        const uint8_t *expected = img + s * ROWSPERSTRIP * rowbytes;
+        if (TIFFReadEncodedStrip(tif, s, buf, (tmsize_t)-1) !=
+                (tmsize_t)(ROWSPERSTRIP * rowbytes) ||
+            !sameData(buf, expected, ROWSPERSTRIP * rowbytes, content))
+        {
+            fprintf(stderr, "strip %u differs\n", s);
+            ok = 0;
+        }
+        /* The beginning of the strip only */
+        else if (TIFFReadEncodedStrip(tif, s, buf,
+                                      (tmsize_t)(PARTIALROWS * rowbytes)) !=
+                     (tmsize_t)(PARTIALROWS * rowbytes) ||
+                 !sameData(buf, expected, PARTIALROWS * rowbytes, content))
+        {
+            fprintf(stderr, "partial strip %u differs\n", s);
+            ok = 0;
+        }
+    }
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        if (TIFFReadScanline(tif, buf, y, 0) != 1 ||
+            !sameData(buf, img + y * rowbytes, rowbytes, content))
+        {
+            fprintf(stderr, "row %u differs\n", y);
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+static int checkFile(const uint8_t *img, uint8_t *buf, const TestCase *tc)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    int ok = tif != NULL;
+
+    if (ok)
+    {
+        if (tc->threads > 1)
+            TIFFSetThreadCount(tif, tc->threads);
+        if (tc->tiled)
+            ok = checkTiles(tif, img, buf, tc->content);
+        else
+            ok = checkStrips(tif, img, buf, tc->content);
+        TIFFClose(tif);
+    }
+    return ok;
+}
+
+int main(void)
+{
+    static const TestCase cases[] = {
+        {CONTENT_RGB, 0, LERC_ADD_COMPRESSION_NONE, 1},
+        {CONTENT_RGB, 1, LERC_ADD_COMPRESSION_DEFLATE, 1},
+        {CONTENT_RGBA, 0, LERC_ADD_COMPRESSION_NONE, 1},
+        {CONTENT_RGBA, 1, LERC_ADD_COMPRESSION_NONE, 1},
+        {CONTENT_NAN_ALL, 0, LERC_ADD_COMPRESSION_NONE, 1},
+        {CONTENT_NAN_BAND, 0, LERC_ADD_COMPRESSION_NONE, 1},
+        {CONTENT_NAN_BAND, 0, LERC_ADD_COMPRESSION_DEFLATE, 4},
+        {CONTENT_NAN_BAND, 1, LERC_ADD_COMPRESSION_NONE, 4},
+        {CONTENT_NAN_GRAY, 0, LERC_ADD_COMPRESSION_NONE, 1},
+        {CONTENT_NAN_GRAY, 1, LERC_ADD_COMPRESSION_NONE, 1}};
+    const size_t maxbytes = (size_t)WIDTH * HEIGHT * 24;
+    uint8_t *img = (uint8_t *)malloc(maxbytes);
+    uint8_t *buf = (uint8_t *)malloc(maxbytes);
+    int ok = img != NULL && buf != NULL;
+
+    for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        fillImage(img, cases[i].content);
+        if (!writeFile(img, &cases[i]))
+        {
+            fprintf(stderr, "case %u: cannot write the file\n", (unsigned)i);
+            ok = 0;
+        }
+        else if (!checkFile(img, buf, &cases[i]))
+        {
+            fprintf(stderr, "case %u failed\n", (unsigned)i);
+            ok = 0;
+        }
+    }
+    free(img);
+    free(buf);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,563 @@
+/*
+ * Tests for lossless JPEG (TIFFTAG_JPEGLOSSLESS): 8 to 16 bit images, in
+ * strips or tiles, coded with each predictor, decode to the original data
+ * whether whole striles, part of them or scanlines are read, or tiles are
+ * read in batches by TIFFReadEncodedTiles() on the thread pool.  A DNG
+ * style CFA file, whose W x H tiles are W/2 x H frames of two components,
+ * is decoded as well.  A corrupt tile makes a batch fail, its error being
+ * reported once, on the calling thread.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#ifdef TIFF_USE_THREADPOOL
+#include <pthread.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "lj92_codec.tif"
+#define FILENAME_CFA "lj92_codec_cfa.tif"
+#define FILENAME_CORRUPT "lj92_codec_corrupt.tif"
+#define CORRUPT_TILE 5
+#define WIDTH 256
+#define HEIGHT 192
+#define ROWSPERSTRIP 40 /* the last strip is shorter */
+#define STRIPSPERPLANE ((HEIGHT + ROWSPERSTRIP - 1) / ROWSPERSTRIP)
+#define TILESIZE 64
+
+typedef struct
+{
+    uint16_t bps;
+    uint16_t spp;
+    uint16_t planar;
+    int tiled;
+    int scanlines; /* written scanline by scanline */
+    int predictor;
+} TestCase;
+
+static const TestCase cases[] = {
+    {16, 1, PLANARCONFIG_CONTIG, 1, 0, 1},
+    {16, 1, PLANARCONFIG_CONTIG, 1, 0, 4},
+    {16, 1, PLANARCONFIG_CONTIG, 0, 0, 6},
+    {12, 1, PLANARCONFIG_CONTIG, 0, 1, 1},
+    {12, 1, PLANARCONFIG_CONTIG, 1, 0, 7},
+    {8, 3, PLANARCONFIG_CONTIG, 0, 0, 7},
+    {14, 2, PLANARCONFIG_CONTIG, 1, 0, 5},
+    {10, 3, PLANARCONFIG_SEPARATE, 1, 0, 2},
+    {16, 4, PLANARCONFIG_CONTIG, 0, 1, 3}};
+
+/* Sample i of row y of strile s: smooth, with noise and extreme values. */
+static uint16_t sampleValue(const TestCase *c, uint32_t s, uint32_t y,
+                            uint32_t i)
+{
+    const uint32_t mask = (1U << c->bps) - 1;
+    uint32_t v = i * 13 + y * 29 + s * 101;
+
+    v += (i * 2654435761U + y * 40503U) >> 27;
+    if ((i + y) % 97 == 0)
+        v = (i & 1) ? mask : 0;
+    return (uint16_t)(v & mask);
+}
+
+/* Bytes per row of a strile, and the rows of strile s. */
+static tmsize_t strileGeometry(TIFF *tif, const TestCase *c, uint32_t s,
+                               uint32_t *rows)
+{
+    if (c->tiled)
+    {
+        *rows = TILESIZE;
+        return TIFFTileRowSize(tif);
+    }
+    *rows = HEIGHT - s % STRIPSPERPLANE * ROWSPERSTRIP;
+    if (*rows > ROWSPERSTRIP)
+        *rows = ROWSPERSTRIP;
+    return TIFFScanlineSize(tif);
+}
+
+/* The content of strile s, packed as libtiff returns it. */
+static void fillStrile(const TestCase *c, uint32_t s, uint8_t *buf,
+                       tmsize_t rowsize, uint32_t rows)
+{
+    const uint32_t n = (c->tiled ? TILESIZE : WIDTH) *
+                       (c->planar == PLANARCONFIG_CONTIG ? c->spp : 1);
+
+    for (uint32_t y = 0; y < rows; y++)
+    {
+        uint8_t *row = buf + (tmsize_t)y * rowsize;
+
+        memset(row, 0, (size_t)rowsize);
+        for (uint32_t i = 0; i < n; i++)
+        {
+            const uint16_t v = sampleValue(c, s, y, i);
+
+            if (c->bps == 16)
+                memcpy(row + 2 * i, &v, 2);
+            else if (c->bps == 8)
+                row[i] = (uint8_t)v;
+            else
+            {
+                for (uint32_t b = 0; b < c->bps; b++)
+                {
+                    const uint32_t bit = i * c->bps + b;
+                    if (v & (1U << (c->bps - 1 - b)))
+                        row[bit / 8] |= (uint8_t)(0x80 >> (bit % 8));
+                }
+            }
+        }
+    }
+}
+
+static TIFF *openFile(const TestCase *c, const char *mode)
+{
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+
+    if (!tif || mode[0] != 'w')
+        return tif;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, c->bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, c->spp);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, c->planar);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC,
+                 c->spp < 3 ? PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_RGB);
+    if (c->spp == 2 || c->spp == 4)
+    {
+        uint16_t extra = EXTRASAMPLE_UNSPECIFIED;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    if (c->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    if (TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_JPEG) != 1 ||
+        TIFFSetField(tif, TIFFTAG_JPEGLOSSLESS, c->predictor) != 1)
+    {
+        TIFFClose(tif);
+        return NULL;
+    }
+    return tif;
+}
+
+static int writeFile(const TestCase *c, uint8_t *buf)
+{
+    TIFF *tif = openFile(c, "w");
+    const uint32_t nstriles =
+        tif ? (c->tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif))
+            : 0;
+    int ok = tif != NULL;
+
+    for (uint32_t s = 0; ok && s < nstriles; s++)
+    {
+        uint32_t rows;
+        tmsize_t rowsize = strileGeometry(tif, c, s, &rows);
+        tmsize_t size = rowsize * rows;
+
+        fillStrile(c, s, buf, rowsize, rows);
+        if (c->scanlines)
+        {
+            for (uint32_t y = 0; ok && y < rows; y++)
+                ok = TIFFWriteScanline(tif, buf + y * rowsize,
+                                       s * ROWSPERSTRIP + y, 0) == 1;
+        }
+        else if (c->tiled)
+            ok = TIFFWriteEncodedTile(tif, s, buf, size) == size;
+        else
+            ok = TIFFWriteEncodedStrip(tif, s, buf, size) == size;
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int checkStriles(const TestCase *c, uint8_t *buf, uint8_t *expected)
+{
+    TIFF *tif = openFile(c, "r");
+    const uint32_t nstriles =
+        tif ? (c->tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif))
+            : 0;
+    int predictor = 0;
+    int ok = tif != NULL;
+
+    for (uint32_t s = 0; ok && s < nstriles; s++)
+    {
+        uint32_t rows;
+        tmsize_t rowsize = strileGeometry(tif, c, s, &rows);
+        tmsize_t size = rowsize * rows;
+
+        fillStrile(c, s, expected, rowsize, rows);
+        if (c->tiled)
+            ok = TIFFReadEncodedTile(tif, s, buf, (tmsize_t)-1) == size;
+        else
+            ok = TIFFReadEncodedStrip(tif, s, buf, (tmsize_t)-1) == size;
+        ok = ok && memcmp(buf, expected, (size_t)size) == 0;
+        /* The beginning of the strile only */
+        if (ok && c->tiled)
+            ok = TIFFReadEncodedTile(tif, s, buf, 3 * rowsize) ==
+                 3 * rowsize;
+        else if (ok)
+            ok = TIFFReadEncodedStrip(tif, s, buf, 3 * rowsize) ==
+                 3 * rowsize;
+        ok = ok && memcmp(buf, expected, (size_t)(3 * rowsize)) == 0;
+        if (!ok)
+            fprintf(stderr, "strip or tile %u differs\n", s);
+    }
+    /* The predictor is a write setting, not read back from the file */
+    if (ok && (!TIFFGetField(tif, TIFFTAG_JPEGLOSSLESS, &predictor) ||
+               predictor != 0))
+    {
+        fprintf(stderr, "unexpected TIFFTAG_JPEGLOSSLESS %d\n", predictor);
+        ok = 0;
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int checkScanlines(const TestCase *c, uint8_t *buf, uint8_t *expected)
+{
+    TIFF *tif = openFile(c, "r");
+    const uint16_t planes = c->planar == PLANARCONFIG_CONTIG ? 1 : c->spp;
+    int ok = tif != NULL;
+
+    for (uint16_t p = 0; ok && p < planes; p++)
+    {
+        for (uint32_t y = 0; ok && y < HEIGHT; y++)
+        {
+            const uint32_t s = p * STRIPSPERPLANE + y / ROWSPERSTRIP;
+            uint32_t rows;
+            tmsize_t rowsize = strileGeometry(tif, c, s, &rows);
+
+            fillStrile(c, s, expected, rowsize, rows);
+            ok = TIFFReadScanline(tif, buf, y, p) == 1 &&
+                 memcmp(buf, expected + (y % ROWSPERSTRIP) * rowsize,
+                        (size_t)rowsize) == 0;
+            if (!ok)
+                fprintf(stderr, "row %u of plane %u differs\n", y, p);
+        }
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+/* All the tiles at once, in reverse order, decoded on 4 threads. */
+static int checkTiles(const TestCase *c, const char *filename,
+                      uint8_t *expected)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    const uint32_t ntiles = tif ? TIFFNumberOfTiles(tif) : 0;
+    const tmsize_t tilesize = tif ? TIFFTileSize(tif) : 0;
+    uint32_t *tiles = (uint32_t *)malloc(ntiles * sizeof(uint32_t));
+    void **bufs = (void **)malloc(ntiles * sizeof(void *));
+    uint8_t *block = (uint8_t *)malloc((size_t)(ntiles * tilesize));
+    int ok = tif != NULL && tiles != NULL && bufs != NULL && block != NULL;
+
+    if (ok)
+    {
+        TIFFSetThreadCount(tif, 4);
+        for (uint32_t t = 0; t < ntiles; t++)
+        {
+            tiles[t] = ntiles - 1 - t;
+            bufs[t] = block + (tmsize_t)t * tilesize;
+        }
+        ok = TIFFReadEncodedTiles(tif, tiles, ntiles, bufs) ==
+             (tmsize_t)ntiles * tilesize;
+    }
+    for (uint32_t t = 0; ok && t < ntiles; t++)
+    {
+        fillStrile(c, tiles[t], expected, TIFFTileRowSize(tif), TILESIZE);
+        ok = memcmp(bufs[t], expected, (size_t)tilesize) == 0;
+        if (!ok)
+            fprintf(stderr, "tile %u differs in batch\n", tiles[t]);
+    }
+    free(tiles);
+    free(bufs);
+    free(block);
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+/*
+ * DNG style CFA: the raw tiles of a two sample file of half the width are
+ * copied into a one sample file, whose rows are the same samples.
+ */
+static int checkCFA(uint8_t *buf, uint8_t *expected)
+{
+    static const TestCase half = {16, 2, PLANARCONFIG_CONTIG, 1, 0, 1};
+    static const TestCase full = {16, 1, PLANARCONFIG_CONTIG, 1, 0, 1};
+    TIFF *in, *out;
+    uint32_t ntiles = 0;
+    int ok = 1;
+
+    in = TIFFOpen(FILENAME, "w");
+    if (!in)
+        return 0;
+    TIFFSetField(in, TIFFTAG_IMAGEWIDTH, WIDTH / 2);
+    TIFFSetField(in, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(in, TIFFTAG_BITSPERSAMPLE, 16);
+    TIFFSetField(in, TIFFTAG_SAMPLESPERPIXEL, 2);
+    TIFFSetField(in, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(in, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    {
+        uint16_t extra = EXTRASAMPLE_UNSPECIFIED;
+        TIFFSetField(in, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    TIFFSetField(in, TIFFTAG_TILEWIDTH, TILESIZE / 2);
+    TIFFSetField(in, TIFFTAG_TILELENGTH, TILESIZE);
+    TIFFSetField(in, TIFFTAG_COMPRESSION, COMPRESSION_JPEG);
+    TIFFSetField(in, TIFFTAG_JPEGLOSSLESS, half.predictor);
+    ntiles = TIFFNumberOfTiles(in);
+    for (uint32_t t = 0; ok && t < ntiles; t++)
+    {
+        const tmsize_t size = TIFFTileSize(in);
+        fillStrile(&half, t, buf, TIFFTileRowSize(in), TILESIZE);
+        ok = TIFFWriteEncodedTile(in, t, buf, size) == size;
+    }
+    ok = ok && TIFFWriteDirectory(in);
+    TIFFClose(in);
+
+    in = ok ? TIFFOpen(FILENAME, "r") : NULL;
+    out = in ? TIFFOpen(FILENAME_CFA, "w") : NULL;
+    ok = out != NULL;
+    if (ok)
+    {
+        TIFFSetField(out, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField(out, TIFFTAG_IMAGELENGTH, HEIGHT);
+        TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 16);
+        TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_CFA);
+        TIFFSetField(out, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(out, TIFFTAG_TILELENGTH, TILESIZE);
+        TIFFSetField(out, TIFFTAG_COMPRESSION, COMPRESSION_JPEG);
+    }
+    for (uint32_t t = 0; ok && t < ntiles; t++)
+    {
+        const tmsize_t cc = TIFFReadRawTile(in, t, buf, TILESIZE * 1024);
+        ok = cc > 0 && TIFFWriteRawTile(out, t, buf, cc) == cc;
+    }
+    ok = ok && TIFFWriteDirectory(out);
+    if (out)
+        TIFFClose(out);
+    if (in)
+        TIFFClose(in);
+
+    in = ok ? TIFFOpen(FILENAME_CFA, "r") : NULL;
+    ok = in != NULL;
+    for (uint32_t t = 0; ok && t < ntiles; t++)
+    {
+        const tmsize_t size = TIFFTileSize(in);
+        ok = TIFFReadEncodedTile(in, t, buf, (tmsize_t)-1) == size;
+        fillStrile(&full, t, expected, TIFFTileRowSize(in), TILESIZE);
+        ok = ok && memcmp(buf, expected, (size_t)size) == 0;
+        if (!ok)
+            fprintf(stderr, "CFA tile %u differs\n", t);
+    }
+    if (in)
+        TIFFClose(in);
+    return ok && checkTiles(&full, FILENAME_CFA, expected);
+}
+
+typedef struct
+{
+    int errors;
+    int warnings;
+    int elsewhere; /* messages not on the calling thread */
+#ifdef TIFF_USE_THREADPOOL
+    pthread_t thread;
+#endif
+} Messages;
+
+static int countMessage(TIFF *tif, void *user_data, const char *module,
+                        const char *fmt, va_list ap, int error)
+{
+    Messages *m = (Messages *)user_data;
+
+    (void)tif;
+    fprintf(stderr, "%s: ", module);
+    vfprintf(stderr, fmt, ap);
+    fprintf(stderr, "\n");
+    if (error)
+        m->errors++;
+    else
+        m->warnings++;
+#ifdef TIFF_USE_THREADPOOL
+    if (!pthread_equal(pthread_self(), m->thread))
+        m->elsewhere++;
+#endif
+    return 1;
+}
+
+static int countError(TIFF *tif, void *user_data, const char *module,
+                      const char *fmt, va_list ap)
+{
+    return countMessage(tif, user_data, module, fmt, ap, 1);
+}
+
+static int countWarning(TIFF *tif, void *user_data, const char *module,
+                        const char *fmt, va_list ap)
+{
+    return countMessage(tif, user_data, module, fmt, ap, 0);
+}
+
+/*
+ * The raw tiles of a tiled file are copied, the end of the entropy coded
+ * data of one of them overwritten by invalid codes, and the whole file read
+ * in a batch on 4 threads.
+ */
+static int checkCorruptTile(uint8_t *buf)
+{
+    const TestCase *c = &cases[0];
+    Messages messages;
+    TIFFOpenOptions *opts;
+    TIFF *in, *out;
+    uint32_t ntiles = 0;
+    int ok;
+
+    memset(&messages, 0, sizeof(messages));
+#ifdef TIFF_USE_THREADPOOL
+    messages.thread = pthread_self();
+#endif
+    ok = c->tiled && writeFile(c, buf);
+    in = ok ? TIFFOpen(FILENAME, "r") : NULL;
+    out = in ? TIFFOpen(FILENAME_CORRUPT, "w") : NULL;
+    ok = out != NULL;
+    if (ok)
+    {
+        TIFFSetField(out, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField(out, TIFFTAG_IMAGELENGTH, HEIGHT);
+        TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, c->bps);
+        TIFFSetField(out, TIFFTAG_SAMPLESPERPIXEL, c->spp);
+        TIFFSetField(out, TIFFTAG_PLANARCONFIG, c->planar);
+        TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        TIFFSetField(out, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(out, TIFFTAG_TILELENGTH, TILESIZE);
+        TIFFSetField(out, TIFFTAG_COMPRESSION, COMPRESSION_JPEG);
+        ntiles = TIFFNumberOfTiles(in);
+    }
+    for (uint32_t t = 0; ok && t < ntiles; t++)
+    {
+        const tmsize_t cc = TIFFReadRawTile(in, t, buf, TILESIZE * 1024);
+
+        if (t == CORRUPT_TILE && cc > 0)
+        {
+            /* All ones, stuffed, up to the EOI marker */
+            for (tmsize_t i = cc / 2; i + 2 < cc; i += 2)
+            {
+                buf[i] = 0xFF;
+                buf[i + 1] = 0x00;
+            }
+        }
+        ok = cc > 0 && TIFFWriteRawTile(out, t, buf, cc) == cc;
+    }
+    ok = ok && TIFFWriteDirectory(out);
+    if (out)
+        TIFFClose(out);
+    if (in)
+        TIFFClose(in);
+    if (!ok)
+        return 0;
+
+    opts = TIFFOpenOptionsAlloc();
+    if (!opts)
+        return 0;
+    TIFFOpenOptionsSetErrorHandlerExtR(opts, countError, &messages);
+    TIFFOpenOptionsSetWarningHandlerExtR(opts, countWarning, &messages);
+    in = TIFFOpenExt(FILENAME_CORRUPT, "r", opts);
+    TIFFOpenOptionsFree(opts);
+    ok = in != NULL;
+    if (ok)
+    {
+        const tmsize_t tilesize = TIFFTileSize(in);
+        uint32_t *tiles = (uint32_t *)malloc(ntiles * sizeof(uint32_t));
+        void **bufs = (void **)malloc(ntiles * sizeof(void *));
+        uint8_t *block = (uint8_t *)malloc((size_t)(ntiles * tilesize));
+
+        ok = tiles != NULL && bufs != NULL && block != NULL;
+        if (ok)
+        {
+            TIFFSetThreadCount(in, 4);
+            for (uint32_t t = 0; t < ntiles; t++)
+            {
+                tiles[t] = t;
+                bufs[t] = block + (tmsize_t)t * tilesize;
+            }
+            if (TIFFReadEncodedTiles(in, tiles, ntiles, bufs) != -1)
+            {
+                fprintf(stderr, "batch with a corrupt tile read\n");
+                ok = 0;
+            }
+        }
+        free(tiles);
+        free(bufs);
+        free(block);
+        TIFFClose(in);
+    }
+    if (ok && (messages.errors != 1 || messages.elsewhere != 0))
+    {
+        fprintf(stderr,
+                "%d errors, %d messages not on the calling thread, "
+                "expected 1 and 0\n",
+                messages.errors, messages.elsewhere);
+        ok = 0;
+    }
+    return ok;
+}
+
+int main(void)
+{
+    const size_t bufsize = (size_t)WIDTH * 4 * 2 * ROWSPERSTRIP * 4;
+    uint8_t *buf = (uint8_t *)malloc(bufsize);
+    uint8_t *expected = (uint8_t *)malloc(bufsize);
+    int ok = buf != NULL && expected != NULL;
+
+    for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const TestCase *c = &cases[i];
+
+        ok = writeFile(c, buf) && checkStriles(c, buf, expected) &&
+             (c->tiled ? checkTiles(c, FILENAME, expected)
+                       : checkScanlines(c, buf, expected));
+        if (!ok)
+            fprintf(stderr,
+                    "%u-bit, %u samples, planar %u, %s%s, predictor %d "
+                    "failed\n",
+                    c->bps, c->spp, c->planar,
+                    c->tiled ? "tiles" : "strips",
+                    c->scanlines ? " written by scanlines" : "",
+                    c->predictor);
+    }
+    if (ok && !checkCFA(buf, expected))
+    {
+        fprintf(stderr, "DNG style CFA file failed\n");
+        ok = 0;
+    }
+    if (ok && !checkCorruptTile(buf))
+    {
+        fprintf(stderr, "corrupt tile in a batch failed\n");
+        ok = 0;
+    }
+    free(buf);
+    free(expected);
+    if (ok)
+    {
+        unlink(FILENAME);
+        unlink(FILENAME_CFA);
+        unlink(FILENAME_CORRUPT);
+    }
+    return ok ? 0 : 1;
+}
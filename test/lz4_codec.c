@@ -0,0 +1,206 @@
+/*
+ * Tests for COMPRESSION_LZ4: strips and tiles written in the fast and HC
+ * modes, with and without predictor, decode to the original data whether
+ * whole striles, part of them or scanlines are read.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "lz4_codec.tif"
+#define WIDTH 512
+#define HEIGHT 384
+#define ROWSPERSTRIP 64
+#define TILESIZE 128
+#define ROWBYTES (WIDTH * 2)
+#define IMAGEBYTES (ROWBYTES * HEIGHT)
+
+static uint16_t pixelValue(uint32_t x, uint32_t y)
+{
+    return (uint16_t)(x * 37 + y * 11 + ((x * 7 + y * 13) % 5));
+}
+
+static int setFields(TIFF *tif, int tiled, int predictor, int hc, int level)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    if (TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZ4) != 1 ||
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, predictor) != 1 ||
+        TIFFSetField(tif, TIFFTAG_LZ4_HC, hc) != 1 ||
+        TIFFSetField(tif, TIFFTAG_LZ4_LEVEL, level) != 1)
+    {
+        fprintf(stderr, "cannot set the LZ4 fields\n");
+        return 0;
+    }
+    return 1;
+}
+
+/* Write the image, by scanlines or whole striles, and return its size. */
+static uint64_t writeFile(const uint16_t *img, int tiled, int scanlines,
+                          int predictor, int hc, int level)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint64_t size = 0;
+    int ok;
+
+    if (!tif)
+        return 0;
+    ok = setFields(tif, tiled, predictor, hc, level);
+    if (ok && tiled)
+    {
+        uint16_t *tile = (uint16_t *)malloc(TILESIZE * TILESIZE * 2);
+        ok = tile != NULL;
+        for (uint32_t ty = 0; ok && ty < HEIGHT; ty += TILESIZE)
+            for (uint32_t tx = 0; ok && tx < WIDTH; tx += TILESIZE)
+            {
+                for (uint32_t y = 0; y < TILESIZE; y++)
+                    memcpy(tile + y * TILESIZE,
+                           img + (size_t)(ty + y) * WIDTH + tx, TILESIZE * 2);
+                ok = TIFFWriteTile(tif, tile, tx, ty, 0, 0) ==
+                     TILESIZE * TILESIZE * 2;
+            }
+        free(tile);
+    }
+    else if (ok && scanlines)
+    {
+        for (uint32_t y = 0; ok && y < HEIGHT; y++)
+            ok = TIFFWriteScanline(tif, (void *)(img + (size_t)y * WIDTH), y,
+                                   0) == 1;
+    }
+    else if (ok)
+    {
+        for (uint32_t s = 0; ok && s < HEIGHT / ROWSPERSTRIP; s++)
+            ok = TIFFWriteEncodedStrip(
+                     tif, s, (void *)(img + (size_t)s * ROWSPERSTRIP * WIDTH),
+                     ROWSPERSTRIP * ROWBYTES) == ROWSPERSTRIP * ROWBYTES;
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    TIFFClose(tif);
+    if (ok)
+    {
+        FILE *fp = fopen(FILENAME, "rb");
+        if (fp && fseek(fp, 0, SEEK_END) == 0)
+            size = (uint64_t)ftell(fp);
+        if (fp)
+            fclose(fp);
+    }
+    return size;
+}
+
+static int checkFile(const uint16_t *img, uint16_t *buf, int tiled)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    int ok = tif != NULL;
+
+    if (ok && tiled)
+    {
+        for (uint32_t ty = 0; ok && ty < HEIGHT; ty += TILESIZE)
+            for (uint32_t tx = 0; ok && tx < WIDTH; tx += TILESIZE)
+            {
+                ok = TIFFReadTile(tif, buf, tx, ty, 0, 0) ==
+                     TILESIZE * TILESIZE * 2;
+                for (uint32_t y = 0; ok && y < TILESIZE; y++)
+                    ok = memcmp(buf + y * TILESIZE,
+                                img + (size_t)(ty + y) * WIDTH + tx,
+                                TILESIZE * 2) == 0;
+                if (!ok)
+                    fprintf(stderr, "tile %u,%u differs\n", tx, ty);
+            }
+    }
+    else if (ok)
+    {
+        for (uint32_t y = 0; ok && y < HEIGHT; y++)
+        {
+            if (TIFFReadScanline(tif, buf, y, 0) != 1 ||
+                memcmp(buf, img + (size_t)y * WIDTH, ROWBYTES) != 0)
+            {
+                fprintf(stderr, "row %u differs\n", y);
+                ok = 0;
+            }
+        }
+        for (uint32_t s = 0; ok && s < HEIGHT / ROWSPERSTRIP; s++)
+        {
+            const uint16_t *expected = img + (size_t)s * ROWSPERSTRIP * WIDTH;
+            if (TIFFReadEncodedStrip(tif, s, buf, (tmsize_t)-1) !=
+                    ROWSPERSTRIP * ROWBYTES ||
+                memcmp(buf, expected, ROWSPERSTRIP * ROWBYTES) != 0)
+            {
+                fprintf(stderr, "strip %u differs\n", s);
+                ok = 0;
+            }
+            /* The beginning of the strip only */
+            else if (TIFFReadEncodedStrip(tif, s, buf, 3 * ROWBYTES) !=
+                         3 * ROWBYTES ||
+                     memcmp(buf, expected, 3 * ROWBYTES) != 0)
+            {
+                fprintf(stderr, "partial strip %u differs\n", s);
+                ok = 0;
+            }
+        }
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+int main(void)
+{
+    static const struct
+    {
+        int tiled, scanlines, predictor, hc, level;
+    } cases[] = {
+        {0, 0, PREDICTOR_NONE, 0, 0},       {0, 1, PREDICTOR_HORIZONTAL, 0, 0},
+        {0, 0, PREDICTOR_HORIZONTAL, 0, 8}, {0, 1, PREDICTOR_NONE, 1, 0},
+        {1, 0, PREDICTOR_HORIZONTAL, 1, 4}, {1, 0, PREDICTOR_NONE, 0, 0}};
+    uint16_t *img = (uint16_t *)malloc(IMAGEBYTES);
+    uint16_t *buf = (uint16_t *)malloc(IMAGEBYTES);
+    int ok = img != NULL && buf != NULL;
+
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+        for (uint32_t x = 0; x < WIDTH; x++)
+            img[(size_t)y * WIDTH + x] = pixelValue(x, y);
+
+    for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        uint64_t size = writeFile(img, cases[i].tiled, cases[i].scanlines,
+                                  cases[i].predictor, cases[i].hc,
+                                  cases[i].level);
+        /* The differenced image is a repeated pattern */
+        if (size == 0 || (cases[i].predictor == PREDICTOR_HORIZONTAL &&
+                          size > IMAGEBYTES / 4))
+        {
+            fprintf(stderr, "case %u: %" PRIu64 " bytes written\n",
+                    (unsigned)i, size);
+            ok = 0;
+        }
+        else if (!checkFile(img, buf, cases[i].tiled))
+        {
+            fprintf(stderr, "case %u failed\n", (unsigned)i);
+            ok = 0;
+        }
+    }
+    free(img);
+    free(buf);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,128 @@
+/*
+ * Tests for TIFFTAG_LZMATHREADS: strips compressed in blocks by several
+ * threads decode to the original data, with or without threads, whether
+ * whole strips, part of them or scanlines are read.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "lzma_threads.tif"
+#define WIDTH 2048
+#define HEIGHT 2048 /* a 4 MiB strip, cut in 4 blocks of 1 MiB */
+#define THREADS 4
+
+static uint8_t pixelValue(uint32_t x, uint32_t y)
+{
+    return (uint8_t)((x + y) / 4 + ((x * 7 + y * 13) % 5));
+}
+
+static uint64_t writeFile(const uint8_t *img, int threads)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint64_t bytecount = 0;
+    int value = -1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZMA);
+    TIFFSetField(tif, TIFFTAG_LZMAPRESET, 1);
+    if (TIFFSetField(tif, TIFFTAG_LZMATHREADS, threads) != 1 ||
+        TIFFGetField(tif, TIFFTAG_LZMATHREADS, &value) != 1 ||
+        value != threads)
+    {
+        fprintf(stderr, "cannot set LZMATHREADS to %d\n", threads);
+        TIFFClose(tif);
+        return 0;
+    }
+    if (TIFFWriteEncodedStrip(tif, 0, (void *)img, WIDTH * HEIGHT) ==
+        WIDTH * HEIGHT)
+        bytecount = TIFFGetStrileByteCount(tif, 0);
+    if (!TIFFWriteDirectory(tif))
+        bytecount = 0;
+    TIFFClose(tif);
+    return bytecount;
+}
+
+static int checkFile(const uint8_t *img, uint8_t *buf, int threads)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    int ok = tif != NULL;
+
+    if (ok && threads > 0)
+        ok = TIFFSetField(tif, TIFFTAG_LZMATHREADS, threads) == 1;
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        if (TIFFReadScanline(tif, buf, y, 0) != 1 ||
+            memcmp(buf, img + (size_t)y * WIDTH, WIDTH) != 0)
+        {
+            fprintf(stderr, "row %u differs with %d threads\n", y, threads);
+            ok = 0;
+        }
+    }
+    if (ok && (TIFFReadEncodedStrip(tif, 0, buf, WIDTH * HEIGHT) !=
+                   WIDTH * HEIGHT ||
+               memcmp(buf, img, WIDTH * HEIGHT) != 0))
+    {
+        fprintf(stderr, "strip differs with %d threads\n", threads);
+        ok = 0;
+    }
+    /* The beginning of the strip, which needs the first block only */
+    if (ok && (TIFFReadEncodedStrip(tif, 0, buf, WIDTH * 16) != WIDTH * 16 ||
+               memcmp(buf, img, WIDTH * 16) != 0))
+    {
+        fprintf(stderr, "partial strip differs with %d threads\n", threads);
+        ok = 0;
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+int main(void)
+{
+    uint8_t *img = (uint8_t *)malloc(WIDTH * HEIGHT);
+    uint8_t *buf = (uint8_t *)malloc(WIDTH * HEIGHT);
+    uint64_t single, multi;
+    int ok = img != NULL && buf != NULL;
+
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+        for (uint32_t x = 0; x < WIDTH; x++)
+            img[(size_t)y * WIDTH + x] = pixelValue(x, y);
+
+    single = ok ? writeFile(img, 0) : 0;
+    ok = single != 0 && checkFile(img, buf, 0) &&
+         checkFile(img, buf, THREADS);
+    multi = ok ? writeFile(img, THREADS) : 0;
+    ok = multi != 0 && checkFile(img, buf, 0) &&
+         checkFile(img, buf, THREADS);
+#ifdef HAVE_LZMA_STREAM_ENCODER_MT
+    /* Independent blocks make a different, slightly larger, stream */
+    if (ok && multi == single)
+    {
+        fprintf(stderr, "strip not cut in blocks (%" PRIu64 " bytes)\n",
+                multi);
+        ok = 0;
+    }
+#endif
+    free(img);
+    free(buf);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+/*
+ * Tests for COMPRESSION_LZW: runs, repeated patterns and noise, in strips or
+ * tiles, encode to the same bytes as earlier releases and decode losslessly
+ * whether whole striles, part of them or scanlines are read, the latter
+ * splitting long strings between calls.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "lzw_codec.tif"
+#define TILESIZE 64
+
+typedef struct
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t rowsperstrip; /* 0 for tiles */
+    uint16_t predictor;
+    int content;
+    uint32_t rawhash; /* of the compressed striles, FNV-1a */
+} TestCase;
+
+enum
+{
+    CONTENT_CONSTANT, /* a single run: strings as long as they get */
+    CONTENT_RUNS,     /* runs of various lengths */
+    CONTENT_PATTERN,  /* a short period, many new codes of the previous one */
+    CONTENT_NOISE,    /* incompressible: frequent CODE_CLEAR */
+    CONTENT_MIXED
+};
+
+static const TestCase cases[] = {
+    {5, 400, 400, 1, CONTENT_CONSTANT, 0x6d950b4f},
+    {7, 300, 100, 1, CONTENT_RUNS, 0x75b39da2},
+    {3, 500, 200, 1, CONTENT_PATTERN, 0x0cd1287c},
+    {1000, 200, 64, 1, CONTENT_NOISE, 0x69ffe49d},
+    {1000, 200, 0, 1, CONTENT_MIXED, 0x6a4d4925},
+    {517, 300, 300, 2, CONTENT_MIXED, 0xbe106e29},
+    {200, 150, 0, 2, CONTENT_RUNS, 0x8676691d},
+    {2000, 100, 33, 1, CONTENT_PATTERN, 0xe7b5ace0}};
+
+static uint8_t pixel(const TestCase *c, uint32_t x, uint32_t y)
+{
+    uint32_t h = (x * 2654435761U) ^ (y * 40503U + 7);
+
+    h ^= h >> 13;
+    h *= 0x5bd1e995U;
+    h ^= h >> 15;
+    switch (c->content)
+    {
+        case CONTENT_CONSTANT:
+            return 0x5a;
+        case CONTENT_RUNS:
+            return (uint8_t)((x + y * c->width) / (1 + (y % 37)) * 29);
+        case CONTENT_PATTERN:
+            return (uint8_t)("abcab"[(x + y * c->width) % 5]);
+        case CONTENT_NOISE:
+            return (uint8_t)h;
+        default:
+            if ((y / 16 + x / 64) % 3 == 0)
+                return (uint8_t)h;
+            if ((y / 16 + x / 64) % 3 == 1)
+                return (uint8_t)(x / 8);
+            return (uint8_t)(y & 0xf0);
+    }
+}
+
+static TIFF *openFile(const TestCase *c, const char *mode)
+{
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+
+    if (!tif || mode[0] != 'w')
+        return tif;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, c->width);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, c->height);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    if (c->rowsperstrip == 0)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, c->rowsperstrip);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, c->predictor);
+    return tif;
+}
+
+/* The content of strile s, or of the whole image for strips. */
+static void fillStrile(const TestCase *c, uint32_t s, uint8_t *buf)
+{
+    if (c->rowsperstrip == 0)
+    {
+        const uint32_t across = (c->width + TILESIZE - 1) / TILESIZE;
+        const uint32_t x0 = s % across * TILESIZE;
+        const uint32_t y0 = s / across * TILESIZE;
+
+        for (uint32_t y = 0; y < TILESIZE; y++)
+            for (uint32_t x = 0; x < TILESIZE; x++)
+                buf[y * TILESIZE + x] =
+                    x0 + x < c->width && y0 + y < c->height
+                        ? pixel(c, x0 + x, y0 + y)
+                        : 0;
+        return;
+    }
+    for (uint32_t y = 0; y < c->rowsperstrip; y++)
+        for (uint32_t x = 0; x < c->width; x++)
+            if (s * c->rowsperstrip + y < c->height)
+                buf[y * c->width + x] = pixel(c, x, s * c->rowsperstrip + y);
+}
+
+static tmsize_t strileSize(const TestCase *c, uint32_t s)
+{
+    uint32_t rows;
+
+    if (c->rowsperstrip == 0)
+        return TILESIZE * TILESIZE;
+    rows = c->height - s * c->rowsperstrip;
+    if (rows > c->rowsperstrip)
+        rows = c->rowsperstrip;
+    return (tmsize_t)rows * c->width;
+}
+
+static int writeFile(const TestCase *c, uint8_t *buf)
+{
+    TIFF *tif = openFile(c, "w");
+    int ok = tif != NULL;
+
+    if (ok && c->rowsperstrip == 0)
+    {
+        for (uint32_t s = 0; ok && s < TIFFNumberOfTiles(tif); s++)
+        {
+            fillStrile(c, s, buf);
+            ok = TIFFWriteEncodedTile(tif, s, buf, TILESIZE * TILESIZE) ==
+                 TILESIZE * TILESIZE;
+        }
+    }
+    else
+    {
+        for (uint32_t s = 0; ok && s < TIFFNumberOfStrips(tif); s++)
+        {
+            fillStrile(c, s, buf);
+            ok = TIFFWriteEncodedStrip(tif, s, buf, strileSize(c, s)) ==
+                 strileSize(c, s);
+        }
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+/* The encoder output must not change, whatever its table looks like. */
+static int checkEncoding(const TestCase *c, uint8_t *buf)
+{
+    TIFF *tif = openFile(c, "r");
+    const int tiled = c->rowsperstrip == 0;
+    const uint32_t nstriles =
+        tif ? (tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif)) : 0;
+    uint32_t hash = 2166136261U;
+    int ok = tif != NULL;
+
+    for (uint32_t s = 0; ok && s < nstriles; s++)
+    {
+        const tmsize_t size = tiled ? TIFFReadRawTile(tif, s, buf, 2000 * 400)
+                                    : TIFFReadRawStrip(tif, s, buf, 2000 * 400);
+
+        ok = size > 0;
+        for (tmsize_t i = 0; i < size; i++)
+            hash = (hash ^ buf[i]) * 16777619U;
+    }
+    if (ok && hash != c->rawhash)
+    {
+        fprintf(stderr, "compressed data hash is 0x%08x, expected 0x%08x\n",
+                hash, c->rawhash);
+        ok = 0;
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int checkStriles(const TestCase *c, uint8_t *buf, uint8_t *expected)
+{
+    TIFF *tif = openFile(c, "r");
+    const int tiled = c->rowsperstrip == 0;
+    const uint32_t nstriles =
+        tif ? (tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif)) : 0;
+    int ok = tif != NULL;
+
+    for (uint32_t s = 0; ok && s < nstriles; s++)
+    {
+        const tmsize_t size = strileSize(c, s);
+        const tmsize_t rowsize = tiled ? TILESIZE : c->width;
+        const tmsize_t part = (size / rowsize / 3 + 1) * rowsize;
+
+        fillStrile(c, s, expected);
+        if (tiled)
+            ok = TIFFReadEncodedTile(tif, s, buf, (tmsize_t)-1) == size;
+        else
+            ok = TIFFReadEncodedStrip(tif, s, buf, (tmsize_t)-1) == size;
+        ok = ok && memcmp(buf, expected, (size_t)size) == 0;
+        /* The beginning of the strile only */
+        if (ok && tiled)
+            ok = TIFFReadEncodedTile(tif, s, buf, part) == part;
+        else if (ok)
+            ok = TIFFReadEncodedStrip(tif, s, buf, part) == part;
+        ok = ok && memcmp(buf, expected, (size_t)part) == 0;
+        if (!ok)
+            fprintf(stderr, "strip or tile %u differs\n", s);
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int checkScanlines(const TestCase *c, uint8_t *buf, uint8_t *expected)
+{
+    TIFF *tif = openFile(c, "r");
+    int ok = tif != NULL;
+
+    for (uint32_t y = 0; ok && y < c->height; y++)
+    {
+        for (uint32_t x = 0; x < c->width; x++)
+            expected[x] = pixel(c, x, y);
+        ok = TIFFReadScanline(tif, buf, y, 0) == 1 &&
+             memcmp(buf, expected, c->width) == 0;
+        if (!ok)
+            fprintf(stderr, "row %u differs\n", y);
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+/* A strip cut short must fail to decode. */
+static int checkTruncated(uint8_t *buf)
+{
+    const TestCase *c = &cases[4];
+    TIFF *tif = openFile(c, "r");
+    tmsize_t size = 2 * TILESIZE * TILESIZE;
+    uint8_t *raw = (uint8_t *)malloc((size_t)size);
+    tmsize_t rawsize;
+    int ok = tif != NULL && raw != NULL;
+
+    if (ok)
+    {
+        rawsize = TIFFReadRawTile(tif, 0, raw, size);
+        ok = rawsize > 16;
+        TIFFClose(tif);
+        tif = NULL;
+    }
+    if (ok)
+    {
+        TestCase strip = {TILESIZE, TILESIZE, TILESIZE, 1, CONTENT_MIXED, 0};
+
+        tif = openFile(&strip, "w");
+        ok = tif != NULL &&
+             TIFFWriteRawStrip(tif, 0, raw, rawsize / 2) == rawsize / 2 &&
+             TIFFWriteDirectory(tif);
+        if (tif)
+            TIFFClose(tif);
+        tif = ok ? TIFFOpen(FILENAME, "r") : NULL;
+        ok = tif != NULL &&
+             TIFFReadEncodedStrip(tif, 0, buf, TILESIZE * TILESIZE) == -1;
+        if (!ok)
+            fprintf(stderr, "truncated strip was read\n");
+    }
+    if (tif)
+        TIFFClose(tif);
+    free(raw);
+    return ok;
+}
+
+int main(void)
+{
+    const size_t bufsize = 2000 * 400;
+    uint8_t *buf = (uint8_t *)malloc(bufsize);
+    uint8_t *expected = (uint8_t *)malloc(bufsize);
+    int ok = buf != NULL && expected != NULL;
+
+    for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const TestCase *c = &cases[i];
+
+        ok = writeFile(c, buf) && checkEncoding(c, buf) &&
+             checkStriles(c, buf, expected) &&
+             (c->rowsperstrip == 0 || checkScanlines(c, buf, expected));
+        if (!ok)
+            fprintf(stderr, "%ux%u %s, predictor %u, content %d failed\n",
+                    c->width, c->height,
+                    c->rowsperstrip ? "strips" : "tiles", c->predictor,
+                    c->content);
+        if (ok && i == 4)
+            ok = checkTruncated(buf);
+    }
+    free(buf);
+    free(expected);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,91 @@
+/*
+ * The horizontal predictor on 16 bit samples accumulates modulo 2^16, as
+ * the differences are taken on write: LZW strips of samples whose
+ * differences wrap around decode to the original data, on one sample per
+ * pixel (the SIMD path and its scalar tail) and three (the generic
+ * stride), in native and swapped byte order.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "predictor_horacc16.tif"
+#define WIDTH 37 /* not a multiple of the SIMD width */
+#define HEIGHT 8
+
+static uint16_t sampleValue(uint32_t i, uint32_t y)
+{
+    /* Extremes next to each other, then a ramp wrapping around */
+    if (y % 2 == 0)
+        return (i + y / 2) % 2 ? 65535 : 0;
+    return (uint16_t)(i * 40503U + y * 9973U);
+}
+
+static int roundTrip(uint16_t spp, const char *mode)
+{
+    const uint32_t n = WIDTH * spp * HEIGHT;
+    const tmsize_t size = (tmsize_t)n * 2;
+    uint16_t *image = (uint16_t *)malloc((size_t)size);
+    uint16_t *buf = (uint16_t *)malloc((size_t)size);
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+    int ok = image != NULL && buf != NULL && tif != NULL;
+
+    for (uint32_t i = 0; ok && i < n; i++)
+        image[i] = sampleValue(i % (WIDTH * spp), i / (WIDTH * spp));
+    if (ok)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+        TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC,
+                     spp == 1 ? PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_RGB);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, HEIGHT);
+        TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+        /* The encoder differences the buffer in place */
+        memcpy(buf, image, (size_t)size);
+        ok = TIFFWriteEncodedStrip(tif, 0, buf, size) == size;
+    }
+    if (tif)
+        TIFFClose(tif);
+
+    tif = ok ? TIFFOpen(FILENAME, "r") : NULL;
+    ok = tif != NULL && TIFFReadEncodedStrip(tif, 0, buf, size) == size;
+    for (uint32_t i = 0; ok && i < n; i++)
+    {
+        if (buf[i] != image[i])
+        {
+            fprintf(stderr,
+                    "%u samples per pixel, mode %s: sample %u is %u, "
+                    "expected %u\n",
+                    spp, mode, i, buf[i], image[i]);
+            ok = 0;
+        }
+    }
+    if (tif)
+        TIFFClose(tif);
+    free(image);
+    free(buf);
+    return ok;
+}
+
+int main(void)
+{
+    int ok = roundTrip(1, "w") && roundTrip(3, "w") && roundTrip(1, "wb") &&
+             roundTrip(3, "wb") && roundTrip(1, "wl") && roundTrip(3, "wl");
+
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
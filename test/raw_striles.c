@@ -0,0 +1,220 @@
+/*
+ * Tests for TIFFReadRawStriles(): the raw data of a set of tiles, asked for
+ * in any order, matches TIFFReadRawTile() and nearby tiles share reads.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "raw_striles.tif"
+#define TILESIZE 16
+#define TILESACROSS 32
+#define TILEBYTES (TILESIZE * TILESIZE)
+#define MAXSTRILES 64
+
+/* Client I/O procedures over stdio that count reads */
+static int nreads;
+
+static tmsize_t readProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    nreads++;
+    return (tmsize_t)fread(buf, 1, (size_t)size, (FILE *)fd);
+}
+
+static tmsize_t writeProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+static toff_t seekProc(thandle_t fd, toff_t off, int whence)
+{
+    if (fseek((FILE *)fd, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell((FILE *)fd);
+}
+
+static int closeProc(thandle_t fd) { return fclose((FILE *)fd); }
+
+static toff_t sizeProc(thandle_t fd)
+{
+    long pos = ftell((FILE *)fd), size;
+    fseek((FILE *)fd, 0, SEEK_END);
+    size = ftell((FILE *)fd);
+    fseek((FILE *)fd, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static int writeFile(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint8_t buf[TILEBYTES];
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, TILESIZE * TILESACROSS);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, TILESIZE * TILESACROSS);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    for (uint32_t t = 0; ok && t < TILESACROSS * TILESACROSS; t++)
+    {
+        for (int i = 0; i < TILEBYTES; i++)
+            buf[i] = (uint8_t)(t * 7 + i);
+        ok = TIFFWriteEncodedTile(tif, t, buf, TILEBYTES) == TILEBYTES;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Read striles[0..n-1] with a single call and compare each tile to
+ * TIFFReadRawTile(); bufsize truncates the reads. */
+static int checkRead(TIFF *tif, const char *name, const uint32_t *striles,
+                     uint32_t n, tmsize_t bufsize, uint64_t max_gap,
+                     int maxreads)
+{
+    static uint8_t data[MAXSTRILES][TILEBYTES];
+    uint8_t ref[TILEBYTES];
+    void *bufs[MAXSTRILES];
+    tmsize_t sizes[MAXSTRILES];
+    const tmsize_t expected = bufsize < 0 ? TILEBYTES : bufsize;
+
+    for (uint32_t i = 0; i < n; i++)
+    {
+        bufs[i] = data[i];
+        sizes[i] = bufsize;
+    }
+    nreads = 0;
+    if (TIFFReadRawStriles(tif, striles, n, bufs, sizes, max_gap) !=
+        (tmsize_t)n * expected)
+    {
+        fprintf(stderr, "%s: TIFFReadRawStriles() failed\n", name);
+        return 0;
+    }
+    if (maxreads >= 0 && nreads > maxreads)
+    {
+        fprintf(stderr, "%s: %d reads, expected at most %d\n", name, nreads,
+                maxreads);
+        return 0;
+    }
+    for (uint32_t i = 0; i < n; i++)
+    {
+        if (sizes[i] != expected ||
+            TIFFReadRawTile(tif, striles[i], ref, TILEBYTES) != TILEBYTES ||
+            memcmp(data[i], ref, (size_t)expected) != 0)
+        {
+            fprintf(stderr, "%s: tile %u differs\n", name, striles[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* An 8x8 block of tiles in shuffled order, every other tile of a row and a
+ * tile asked for twice. */
+static int checkFile(TIFF *tif, const char *name, int counted)
+{
+    uint32_t block[MAXSTRILES], sparse[TILESACROSS / 2], twice[3];
+    uint32_t seed = 1;
+    int ok;
+
+    for (uint32_t i = 0; i < 64; i++)
+        block[i] = (4 + i / 8) * TILESACROSS + 4 + i % 8;
+    for (uint32_t i = 63; i > 0; i--)
+    {
+        uint32_t j, t;
+        seed = seed * 1103515245U + 12345U;
+        j = (seed >> 8) % (i + 1);
+        t = block[i];
+        block[i] = block[j];
+        block[j] = t;
+    }
+    for (uint32_t i = 0; i < TILESACROSS / 2; i++)
+        sparse[i] = 2 * TILESACROSS + 2 * i;
+    twice[0] = 100;
+    twice[1] = 99;
+    twice[2] = 100;
+
+    /* One read per row of the block, or one for the whole block */
+    ok = checkRead(tif, name, block, 64, -1, 0, counted ? 8 : -1) &&
+         checkRead(tif, name, block, 64, -1,
+                   TILESACROSS * TILEBYTES, counted ? 1 : -1) &&
+         checkRead(tif, name, block, 64, 100, TILESACROSS * TILEBYTES, -1) &&
+         checkRead(tif, name, sparse, TILESACROSS / 2, -1, 0,
+                   counted ? TILESACROSS / 2 : -1) &&
+         checkRead(tif, name, sparse, TILESACROSS / 2, -1, TILEBYTES,
+                   counted ? 1 : -1) &&
+         checkRead(tif, name, twice, 3, -1, 0, counted ? 1 : -1);
+    return ok;
+}
+
+static void errorHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)fmt;
+    (void)ap;
+}
+
+int main(void)
+{
+    TIFF *tif;
+    FILE *fp;
+    TIFFErrorHandler olderr;
+    uint8_t buf[TILEBYTES];
+    void *bufs[1] = {buf};
+    tmsize_t sizes[1] = {-1};
+    const uint32_t outofrange = TILESACROSS * TILESACROSS;
+    int ok;
+
+    if (!writeFile())
+    {
+        fprintf(stderr, "cannot write %s\n", FILENAME);
+        return 1;
+    }
+
+    /* Counted reads through a staging buffer */
+    fp = fopen(FILENAME, "rb");
+    if (!fp)
+        return 1;
+    tif = TIFFClientOpen(FILENAME, "r", (thandle_t)fp, readProc, writeProc,
+                         seekProc, closeProc, sizeProc, NULL, NULL);
+    if (!tif)
+        return 1;
+    ok = checkFile(tif, "client", 1);
+    olderr = TIFFSetErrorHandler(errorHandler);
+    if (ok && TIFFReadRawStriles(tif, &outofrange, 1, bufs, sizes, 0) != -1)
+    {
+        fprintf(stderr, "tile out of range accepted\n");
+        ok = 0;
+    }
+    TIFFSetErrorHandler(olderr);
+    TIFFClose(tif);
+
+    /* Vectored reads, and copies from the mapping */
+    for (int mapped = 0; ok && mapped <= 1; mapped++)
+    {
+        tif = TIFFOpen(FILENAME, mapped ? "r" : "rm");
+        if (!tif)
+            return 1;
+        ok = checkFile(tif, mapped ? "mapped" : "file", 0);
+        TIFFClose(tif);
+    }
+
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
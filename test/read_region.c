@@ -0,0 +1,238 @@
+/*
+ * Tests for TIFFReadRegion() on stripped and tiled, contiguous and separate
+ * images, compressed or not, and on lossless JPEG tiles decoded on a thread
+ * pool.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "read_region.tif"
+#define WIDTH 83
+#define HEIGHT 61
+
+/* Value of byte b of sample s of pixel (x, y) */
+static uint8_t pattern(uint32_t x, uint32_t y, uint32_t s, uint32_t b)
+{
+    return (uint8_t)(x * 3 + y * 7 + s * 31 + b * 101 + (x * y) / 5);
+}
+
+static int writeFile(uint16_t compression, uint16_t bps, uint16_t spp,
+                     uint16_t planar, int tiled)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint32_t bytes = bps / 8;
+    uint8_t *row;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC,
+                 spp == 3 ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, planar);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+    if (compression == COMPRESSION_LZW)
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    else if (compression == COMPRESSION_JPEG &&
+             TIFFSetField(tif, TIFFTAG_JPEGLOSSLESS, 1) != 1)
+    {
+        TIFFClose(tif);
+        return 0;
+    }
+
+    if (tiled)
+    {
+        uint32_t tw = 16, tl = 32;
+        uint16_t planes = planar == PLANARCONFIG_SEPARATE ? spp : 1;
+        uint16_t nsamples = planar == PLANARCONFIG_SEPARATE ? 1 : spp;
+        uint8_t *tile = (uint8_t *)malloc((size_t)tw * tl * nsamples * bytes);
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, tw);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, tl);
+        for (uint16_t p = 0; ok && p < planes; p++)
+            for (uint32_t ty = 0; ok && ty < HEIGHT; ty += tl)
+                for (uint32_t tx = 0; ok && tx < WIDTH; tx += tw)
+                {
+                    uint8_t *q = tile;
+                    for (uint32_t j = 0; j < tl; j++)
+                        for (uint32_t i = 0; i < tw; i++)
+                            for (uint16_t s = 0; s < nsamples; s++)
+                                for (uint32_t b = 0; b < bytes; b++)
+                                    *q++ = pattern(tx + i, ty + j, p + s, b);
+                    ok = TIFFWriteTile(tif, tile, tx, ty, 0, p) > 0;
+                }
+        free(tile);
+    }
+    else
+    {
+        uint16_t planes = planar == PLANARCONFIG_SEPARATE ? spp : 1;
+        uint16_t nsamples = planar == PLANARCONFIG_SEPARATE ? 1 : spp;
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 9);
+        row = (uint8_t *)malloc((size_t)WIDTH * nsamples * bytes);
+        for (uint16_t p = 0; ok && p < planes; p++)
+            for (uint32_t y = 0; ok && y < HEIGHT; y++)
+            {
+                uint8_t *q = row;
+                for (uint32_t x = 0; x < WIDTH; x++)
+                    for (uint16_t s = 0; s < nsamples; s++)
+                        for (uint32_t b = 0; b < bytes; b++)
+                            *q++ = pattern(x, y, p + s, b);
+                ok = TIFFWriteScanline(tif, row, y, p) == 1;
+            }
+        free(row);
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Read a region with a padded stride and check every byte of it. */
+static int checkRegion(TIFF *tif, uint32_t x, uint32_t y, uint32_t w,
+                       uint32_t h, uint16_t sample)
+{
+    uint16_t bps, spp, planar;
+    uint32_t bytes, nsamples, pixelsize;
+    tmsize_t stride;
+    uint8_t *dst;
+    int ok = 1;
+
+    TIFFGetFieldDefaulted(tif, TIFFTAG_BITSPERSAMPLE, &bps);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_SAMPLESPERPIXEL, &spp);
+    TIFFGetFieldDefaulted(tif, TIFFTAG_PLANARCONFIG, &planar);
+    bytes = bps / 8;
+    nsamples = planar == PLANARCONFIG_SEPARATE ? 1 : spp;
+    pixelsize = bytes * nsamples;
+    stride = (tmsize_t)w * pixelsize + 13;
+    dst = (uint8_t *)malloc((size_t)(stride * h));
+    memset(dst, 0xEE, (size_t)(stride * h));
+    if (!TIFFReadRegion(tif, x, y, w, h, sample, dst, stride))
+    {
+        fprintf(stderr, "TIFFReadRegion(%u,%u,%u,%u,%u) failed\n", x, y, w,
+                h, sample);
+        free(dst);
+        return 0;
+    }
+    for (uint32_t j = 0; ok && j < h; j++)
+    {
+        const uint8_t *p = dst + (tmsize_t)j * stride;
+        for (uint32_t i = 0; ok && i < w; i++)
+            for (uint32_t s = 0; ok && s < nsamples; s++)
+                for (uint32_t b = 0; ok && b < bytes; b++)
+                {
+                    if (*p++ != pattern(x + i, y + j, sample + s, b))
+                    {
+                        fprintf(stderr,
+                                "region (%u,%u,%u,%u) differs at %u,%u\n", x,
+                                y, w, h, x + i, y + j);
+                        ok = 0;
+                    }
+                }
+        /* Padding between rows must not be touched */
+        if (ok && p[0] != 0xEE)
+        {
+            fprintf(stderr, "row padding overwritten\n");
+            ok = 0;
+        }
+    }
+    free(dst);
+    return ok;
+}
+
+static int testLayout(const char *name, uint16_t compression, uint16_t bps,
+                      uint16_t spp, uint16_t planar, int tiled)
+{
+    TIFF *tif;
+    uint16_t nplanes = planar == PLANARCONFIG_SEPARATE ? spp : 1;
+    int ok;
+
+    if (!writeFile(compression, bps, spp, planar, tiled))
+    {
+        fprintf(stderr, "%s: cannot write %s\n", name, FILENAME);
+        return 0;
+    }
+    /* With and without memory mapping */
+    for (int mapped = 0; mapped < 2; mapped++)
+    {
+        tif = TIFFOpen(FILENAME, mapped ? "r" : "rm");
+        if (!tif)
+            return 0;
+        /* Lossless JPEG tiles are then decoded concurrently */
+        TIFFSetThreadCount(tif, 4);
+        ok = checkRegion(tif, 0, 0, WIDTH, HEIGHT, 0) &&
+             checkRegion(tif, 5, 10, 1, 1, nplanes - 1) &&
+             checkRegion(tif, 17, 8, 40, 20, 0) &&
+             checkRegion(tif, WIDTH - 7, HEIGHT - 11, 7, 11, nplanes - 1) &&
+             checkRegion(tif, 30, 31, 3, 29, 0);
+        TIFFClose(tif);
+        if (!ok)
+        {
+            fprintf(stderr, "%s failed\n", name);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static void errorHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)fmt;
+    (void)ap;
+}
+
+static int testErrors(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    uint8_t dst[64];
+    TIFFErrorHandler old;
+    int ok;
+
+    if (!tif)
+        return 0;
+    old = TIFFSetErrorHandler(errorHandler);
+    ok = !TIFFReadRegion(tif, WIDTH - 2, 0, 3, 1, 0, dst, sizeof(dst)) &&
+         !TIFFReadRegion(tif, 0, HEIGHT, 1, 1, 0, dst, sizeof(dst)) &&
+         !TIFFReadRegion(tif, 0, 0, 0, 1, 0, dst, sizeof(dst)) &&
+         !TIFFReadRegion(tif, 0, 0, 8, 1, 0, dst, 2) &&
+         !TIFFReadRegion(tif, 0, 0, 1, 1, 3, dst, sizeof(dst));
+    TIFFSetErrorHandler(old);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "invalid region accepted\n");
+    return ok;
+}
+
+int main(void)
+{
+    int ok = testLayout("strips/none/rgb", COMPRESSION_NONE, 8, 3,
+                        PLANARCONFIG_CONTIG, 0) &&
+             testLayout("strips/lzw/gray16", COMPRESSION_LZW, 16, 1,
+                        PLANARCONFIG_CONTIG, 0) &&
+             testLayout("strips/none/separate", COMPRESSION_NONE, 8, 3,
+                        PLANARCONFIG_SEPARATE, 0) &&
+             testLayout("tiles/lzw/rgb", COMPRESSION_LZW, 8, 3,
+                        PLANARCONFIG_CONTIG, 1) &&
+             testLayout("tiles/none/separate16", COMPRESSION_NONE, 16, 3,
+                        PLANARCONFIG_SEPARATE, 1) &&
+#ifdef JPEG_SUPPORT
+             testLayout("tiles/lossless-jpeg/gray16", COMPRESSION_JPEG, 16, 1,
+                        PLANARCONFIG_CONTIG, 1) &&
+             testLayout("tiles/lossless-jpeg/separate", COMPRESSION_JPEG, 8,
+                        3, PLANARCONFIG_SEPARATE, 1) &&
+#endif
+             testErrors();
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
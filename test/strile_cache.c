@@ -0,0 +1,276 @@
+/*
+ * Tests for the decoded strile cache shared between TIFF handles
+ * (TIFFStrileCacheCreate / TIFFOpenOptionsSetStrileCache).
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "strile_cache.tif"
+#define PIXARLOG_FILENAME "strile_cache_pixarlog.tif"
+#define WIDTH 96
+#define HEIGHT 80
+#define TILESIZE 16
+#define NTILES ((WIDTH / TILESIZE) * (HEIGHT / TILESIZE))
+#define TILEBYTES (TILESIZE * TILESIZE)
+
+static int writeFile(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint8_t tile[TILEBYTES];
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW);
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    for (uint32_t t = 0; t < NTILES; t++)
+    {
+        for (int i = 0; i < TILEBYTES; i++)
+            tile[i] = (uint8_t)(t * 7 + i / 3);
+        if (TIFFWriteEncodedTile(tif, t, tile, TILEBYTES) != TILEBYTES)
+        {
+            TIFFClose(tif);
+            return 0;
+        }
+    }
+    TIFFClose(tif);
+    return 1;
+}
+
+static TIFF *openCached(const char *filename, TIFFStrileCache *cache)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif;
+    if (!opts)
+        return NULL;
+    TIFFOpenOptionsSetStrileCache(opts, cache);
+    tif = TIFFOpenExt(filename, "r", opts);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+/* Read every tile and compare it with the expected pattern. */
+static int readAll(TIFF *tif)
+{
+    uint8_t tile[TILEBYTES];
+    for (uint32_t t = 0; t < NTILES; t++)
+    {
+        if (TIFFReadEncodedTile(tif, t, tile, TILEBYTES) != TILEBYTES)
+        {
+            fprintf(stderr, "tile %u failed to read\n", t);
+            return 0;
+        }
+        for (int i = 0; i < TILEBYTES; i++)
+        {
+            if (tile[i] != (uint8_t)(t * 7 + i / 3))
+            {
+                fprintf(stderr, "tile %u differs at byte %d\n", t, i);
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int expectStats(TIFFStrileCache *cache, uint64_t hits, uint64_t misses,
+                       const char *what)
+{
+    TIFFStrileCacheStats stats;
+    TIFFStrileCacheGetStats(cache, &stats);
+    if (stats.hits != hits || stats.misses != misses)
+    {
+        fprintf(stderr,
+                "%s: expected %u hits / %u misses, got %u / %u\n", what,
+                (unsigned)hits, (unsigned)misses, (unsigned)stats.hits,
+                (unsigned)stats.misses);
+        return 0;
+    }
+    if (stats.bytes > stats.max_bytes)
+    {
+        fprintf(stderr, "%s: cache over budget\n", what);
+        return 0;
+    }
+    return 1;
+}
+
+/* Two handles on the same file share decoded tiles. */
+static int testShared(void)
+{
+    TIFFStrileCache *cache = TIFFStrileCacheCreate(1024 * 1024);
+    TIFF *a, *b;
+    uint8_t tile[TILEBYTES];
+    int ok;
+    if (!cache)
+        return 0;
+    a = openCached(FILENAME, cache);
+    b = openCached(FILENAME, cache);
+    /* The handles keep the cache alive after the creator drops it */
+    TIFFStrileCacheRelease(cache);
+    if (!a || !b)
+    {
+        if (a)
+            TIFFClose(a);
+        if (b)
+            TIFFClose(b);
+        return 0;
+    }
+    ok = readAll(a) && expectStats(cache, 0, NTILES, "first handle") &&
+         readAll(b) && expectStats(cache, NTILES, NTILES, "second handle");
+    /* Partial reads are served from the cache too */
+    ok = ok && TIFFReadEncodedTile(b, 1, tile, 10) == 10 &&
+         tile[0] == 7 && expectStats(cache, NTILES + 1, NTILES, "partial");
+    TIFFStrileCacheClear(cache);
+    ok = ok && readAll(b) &&
+         expectStats(cache, NTILES + 1, 2 * NTILES, "after clear");
+    TIFFClose(a);
+    TIFFClose(b);
+    return ok;
+}
+
+/* A budget smaller than the image evicts least recently used tiles. */
+static int testEviction(void)
+{
+    TIFFStrileCache *cache = TIFFStrileCacheCreate(4 * TILEBYTES);
+    TIFFStrileCacheStats stats;
+    uint8_t tile[TILEBYTES];
+    TIFF *tif;
+    int ok;
+    if (!cache)
+        return 0;
+    tif = openCached(FILENAME, cache);
+    ok = tif != NULL && readAll(tif);
+    TIFFStrileCacheGetStats(cache, &stats);
+    if (ok && (stats.evictions == 0 || stats.entries > 4 ||
+               stats.bytes > stats.max_bytes))
+    {
+        fprintf(stderr, "eviction: %u entries, %u evictions\n",
+                (unsigned)stats.entries, (unsigned)stats.evictions);
+        ok = 0;
+    }
+    /* The most recent tile is still cached, the first one is not */
+    ok = ok && TIFFReadEncodedTile(tif, NTILES - 1, tile, TILEBYTES) > 0 &&
+         TIFFReadEncodedTile(tif, 0, tile, TILEBYTES) > 0 &&
+         expectStats(cache, stats.hits + 1, stats.misses + 1, "eviction");
+    if (tif)
+        TIFFClose(tif);
+    TIFFStrileCacheRelease(cache);
+    return ok;
+}
+
+#ifdef PIXARLOG_SUPPORT
+#define STRIPROWS 16
+#define STRIPBYTES (WIDTH * STRIPROWS)
+
+/* PixarLog only encodes strips */
+static int writePixarLogFile(void)
+{
+    TIFF *tif = TIFFOpen(PIXARLOG_FILENAME, "w");
+    uint8_t strip[STRIPBYTES];
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_PIXARLOG);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, STRIPROWS);
+    for (uint32_t s = 0; s < HEIGHT / STRIPROWS; s++)
+    {
+        for (int i = 0; i < STRIPBYTES; i++)
+            strip[i] = (uint8_t)(s * 5 + i / 7);
+        if (TIFFWriteEncodedStrip(tif, s, strip, STRIPBYTES) != STRIPBYTES)
+        {
+            TIFFClose(tif);
+            return 0;
+        }
+    }
+    TIFFClose(tif);
+    return 1;
+}
+
+/*
+ * Handles reading the same file with different PixarLog output formats
+ * must not be served each other's strips.
+ */
+static int testDecodeSettings(void)
+{
+    TIFFStrileCache *cache = TIFFStrileCacheCreate(1024 * 1024);
+    uint8_t strip[2 * STRIPBYTES];
+    TIFF *a, *b;
+    int ok;
+    if (!cache)
+        return 0;
+    a = openCached(PIXARLOG_FILENAME, cache);
+    b = openCached(PIXARLOG_FILENAME, cache);
+    TIFFStrileCacheRelease(cache);
+    if (!a || !b)
+    {
+        if (a)
+            TIFFClose(a);
+        if (b)
+            TIFFClose(b);
+        return 0;
+    }
+    ok = TIFFSetField(b, TIFFTAG_PIXARLOGDATAFMT, PIXARLOGDATAFMT_16BIT) &&
+         TIFFReadEncodedStrip(a, 0, strip, STRIPBYTES) == STRIPBYTES &&
+         expectStats(cache, 0, 1, "8-bit handle");
+    if (ok &&
+        TIFFReadEncodedStrip(b, 0, strip, 2 * STRIPBYTES) != 2 * STRIPBYTES)
+    {
+        fprintf(stderr, "16-bit handle got 8-bit strip from the cache\n");
+        ok = 0;
+    }
+    ok = ok && expectStats(cache, 0, 2, "16-bit handle") &&
+         TIFFReadEncodedStrip(a, 0, strip, STRIPBYTES) == STRIPBYTES &&
+         expectStats(cache, 1, 2, "8-bit handle again");
+    TIFFClose(a);
+    TIFFClose(b);
+    return ok;
+}
+#endif
+
+int main(void)
+{
+    int ret = 0;
+    if (!writeFile())
+    {
+        fprintf(stderr, "cannot write %s\n", FILENAME);
+        return 1;
+    }
+    if (!testShared() || !testEviction())
+        ret = 1;
+#ifdef PIXARLOG_SUPPORT
+    if (!writePixarLogFile())
+    {
+        fprintf(stderr, "cannot write %s\n", PIXARLOG_FILENAME);
+        return 1;
+    }
+    if (!testDecodeSettings())
+        ret = 1;
+#endif
+    if (ret == 0)
+    {
+        unlink(FILENAME);
+#ifdef PIXARLOG_SUPPORT
+        unlink(PIXARLOG_FILENAME);
+#endif
+    }
+    return ret;
+}
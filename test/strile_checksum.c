@@ -0,0 +1,296 @@
+/*
+ * Round-trip and corruption tests for per-strile CRC32C checksums
+ * (TIFFTAG_STRILECHECKSUMS / TIFFGetStrileChecksum), which cover the samples
+ * in file byte order whether the codec or libtiff swabs them.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH 67
+#define HEIGHT 70
+#define ROWSPERSTRIP 16
+#define TILESIZE 32
+
+static uint16_t image[HEIGHT * WIDTH];
+
+static void errorHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)fmt;
+    (void)ap;
+}
+
+static TIFF *openWithFlags(const char *filename, const char *mode, int flags)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif;
+    if (!opts)
+        return NULL;
+    TIFFOpenOptionsSetStrileChecksums(opts, flags);
+    tif = TIFFOpenExt(filename, mode, opts);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static void setupImage(TIFF *tif, uint16_t compression, int tiled)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 16);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, compression);
+    if (compression == COMPRESSION_LZW)
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+}
+
+/* Write the test image by strips, tiles or scanlines. */
+static int writeImage(const char *filename, const char *mode,
+                      uint16_t compression, int how)
+{
+    TIFF *tif = openWithFlags(filename, mode,
+                              TIFF_STRILECHECKSUM_WRITE |
+                                  TIFF_STRILECHECKSUM_VERIFY);
+    uint16_t *buf = (uint16_t *)malloc(sizeof(image));
+    int ok = 1;
+    if (!tif || !buf)
+    {
+        fprintf(stderr, "cannot create %s\n", filename);
+        if (tif)
+            TIFFClose(tif);
+        free(buf);
+        return 0;
+    }
+    setupImage(tif, compression, how == 1);
+    if (how == 0)
+    {
+        for (uint32_t s = 0; ok && s < TIFFNumberOfStrips(tif); s++)
+        {
+            uint32_t row = s * ROWSPERSTRIP;
+            uint32_t rows = HEIGHT - row < ROWSPERSTRIP ? HEIGHT - row
+                                                        : ROWSPERSTRIP;
+            tmsize_t size = (tmsize_t)rows * WIDTH * 2;
+            memcpy(buf, image + row * WIDTH, (size_t)size);
+            ok = TIFFWriteEncodedStrip(tif, s, buf, size) == size;
+        }
+    }
+    else if (how == 1)
+    {
+        for (uint32_t y = 0; ok && y < HEIGHT; y += TILESIZE)
+            for (uint32_t x = 0; ok && x < WIDTH; x += TILESIZE)
+            {
+                memset(buf, 0, TILESIZE * TILESIZE * 2);
+                for (uint32_t j = 0; j < TILESIZE && y + j < HEIGHT; j++)
+                    for (uint32_t i = 0; i < TILESIZE && x + i < WIDTH; i++)
+                        buf[j * TILESIZE + i] = image[(y + j) * WIDTH + x + i];
+                ok = TIFFWriteTile(tif, buf, x, y, 0, 0) > 0;
+            }
+    }
+    else
+    {
+        for (uint32_t row = 0; ok && row < HEIGHT; row++)
+        {
+            memcpy(buf, image + row * WIDTH, WIDTH * 2);
+            ok = TIFFWriteScanline(tif, buf, row, 0) == 1;
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "write of %s failed\n", filename);
+    return ok;
+}
+
+/* Read every strile back and check data, checksums and API agreement. */
+static int readImage(const char *filename, uint32_t *crcs, uint32_t ncrcs)
+{
+    TIFF *tif = openWithFlags(filename, "r", TIFF_STRILECHECKSUM_VERIFY);
+    uint16_t *buf;
+    tmsize_t size;
+    uint32_t n;
+    int ok = 1;
+    if (!tif)
+        return 0;
+    n = TIFFIsTiled(tif) ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    size = TIFFIsTiled(tif) ? TIFFTileSize(tif) : TIFFStripSize(tif);
+    buf = (uint16_t *)malloc((size_t)size);
+    for (uint32_t s = 0; ok && s < n; s++)
+    {
+        uint32_t crc = 0;
+        tmsize_t got = TIFFIsTiled(tif)
+                           ? TIFFReadEncodedTile(tif, s, buf, size)
+                           : TIFFReadEncodedStrip(tif, s, buf, size);
+        if (got <= 0)
+        {
+            fprintf(stderr, "%s: strile %u failed to read\n", filename, s);
+            ok = 0;
+        }
+        else if (!TIFFGetStrileChecksum(tif, s, &crc))
+        {
+            fprintf(stderr, "%s: no checksum for strile %u\n", filename, s);
+            ok = 0;
+        }
+        else if (!TIFFIsTiled(tif) &&
+                 memcmp(buf, image + s * ROWSPERSTRIP * WIDTH, (size_t)got))
+        {
+            fprintf(stderr, "%s: strip %u data mismatch\n", filename, s);
+            ok = 0;
+        }
+        if (crcs && s < ncrcs)
+            crcs[s] = crc;
+    }
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Flip one byte of strip 1 on disk and check that decoding it fails. */
+static int checkCorruption(const char *filename)
+{
+    TIFF *tif = TIFFOpen(filename, "r");
+    uint16_t buf[ROWSPERSTRIP * WIDTH];
+    uint64_t offset;
+    FILE *f;
+    int c;
+    if (!tif)
+        return 0;
+    offset = TIFFGetStrileOffset(tif, 1) + 5;
+    TIFFClose(tif);
+
+    f = fopen(filename, "r+b");
+    if (!f || fseek(f, (long)offset, SEEK_SET) != 0 || (c = fgetc(f)) == EOF ||
+        fseek(f, (long)offset, SEEK_SET) != 0 || fputc(c ^ 0x40, f) == EOF)
+    {
+        fprintf(stderr, "cannot corrupt %s\n", filename);
+        if (f)
+            fclose(f);
+        return 0;
+    }
+    fclose(f);
+
+    tif = openWithFlags(filename, "r", TIFF_STRILECHECKSUM_VERIFY);
+    if (!tif)
+        return 0;
+    /* Strip 1 twice, as the stored checksums are only looked up once */
+    if (TIFFReadEncodedStrip(tif, 0, buf, sizeof(buf)) <= 0 ||
+        TIFFReadEncodedStrip(tif, 1, buf, sizeof(buf)) != -1 ||
+        TIFFReadEncodedStrip(tif, 1, buf, sizeof(buf)) != -1)
+    {
+        fprintf(stderr, "corruption of strip 1 not detected\n");
+        TIFFClose(tif);
+        return 0;
+    }
+    TIFFClose(tif);
+
+    /* Verification is opt-in */
+    tif = TIFFOpen(filename, "r");
+    if (!tif || TIFFReadEncodedStrip(tif, 1, buf, sizeof(buf)) <= 0)
+    {
+        fprintf(stderr, "read with verification disabled failed\n");
+        if (tif)
+            TIFFClose(tif);
+        return 0;
+    }
+    TIFFClose(tif);
+    return 1;
+}
+
+/* A file written without checksums must not grow the tag. */
+static int checkAbsent(const char *filename)
+{
+    TIFF *tif = TIFFOpen(filename, "w");
+    uint32_t crc;
+    int ok;
+    if (!tif)
+        return 0;
+    setupImage(tif, COMPRESSION_NONE, 0);
+    for (uint32_t row = 0; row < HEIGHT; row++)
+        TIFFWriteScanline(tif, image + row * WIDTH, row, 0);
+    TIFFClose(tif);
+    tif = TIFFOpen(filename, "r");
+    if (!tif)
+        return 0;
+    ok = !TIFFGetStrileChecksum(tif, 0, &crc);
+    TIFFClose(tif);
+    return ok;
+}
+
+int main(void)
+{
+    uint32_t bystrip[8], byline[8], packbits_be[8], predictor_be[8];
+    int ret = 0;
+
+    for (uint32_t i = 0; i < HEIGHT * WIDTH; i++)
+        image[i] = (uint16_t)(i * 2654435761U >> 7);
+
+    if (!writeImage("strile_checksum_lzw.tif", "w", COMPRESSION_LZW, 0) ||
+        !readImage("strile_checksum_lzw.tif", bystrip, 8))
+        ret = 1;
+    if (!writeImage("strile_checksum_lzw_line.tif", "w", COMPRESSION_LZW, 2) ||
+        !readImage("strile_checksum_lzw_line.tif", byline, 8))
+        ret = 1;
+    if (memcmp(bystrip, byline, sizeof(bystrip)) != 0)
+    {
+        fprintf(stderr, "strip and scanline checksums differ\n");
+        ret = 1;
+    }
+    if (!writeImage("strile_checksum_be.tif", "wb", COMPRESSION_PACKBITS, 0) ||
+        !readImage("strile_checksum_be.tif", packbits_be, 8))
+        ret = 1;
+    /* The predictor swabs the samples itself: still file byte order */
+    if (!writeImage("strile_checksum_lzw_be.tif", "wb", COMPRESSION_LZW, 0) ||
+        !readImage("strile_checksum_lzw_be.tif", predictor_be, 8))
+        ret = 1;
+    if (memcmp(packbits_be, predictor_be, sizeof(packbits_be)) != 0)
+    {
+        fprintf(stderr, "big-endian checksums differ with the predictor\n");
+        ret = 1;
+    }
+    if (!writeImage("strile_checksum_tiled.tif", "w", COMPRESSION_LZW, 1) ||
+        !readImage("strile_checksum_tiled.tif", NULL, 0))
+        ret = 1;
+    if (!writeImage("strile_checksum_none.tif", "w", COMPRESSION_NONE, 0))
+        ret = 1;
+    else
+    {
+        TIFFErrorHandler old = TIFFSetErrorHandler(errorHandler);
+        if (!checkCorruption("strile_checksum_none.tif"))
+            ret = 1;
+        TIFFSetErrorHandler(old);
+    }
+    if (!checkAbsent("strile_checksum_absent.tif"))
+    {
+        fprintf(stderr, "checksums written without being requested\n");
+        ret = 1;
+    }
+
+    if (ret == 0)
+    {
+        unlink("strile_checksum_lzw.tif");
+        unlink("strile_checksum_lzw_line.tif");
+        unlink("strile_checksum_be.tif");
+        unlink("strile_checksum_lzw_be.tif");
+        unlink("strile_checksum_tiled.tif");
+        unlink("strile_checksum_none.tif");
+        unlink("strile_checksum_absent.tif");
+    }
+    return ret;
+}
@@ -0,0 +1,213 @@
+/*
+ * Tests for the loading of strip offset and byte count arrays: bulk loading
+ * with widening and byte-swapping, partial loading of deferred arrays, and
+ * the check of the strip extents against the file size.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "strile_load.tif"
+#define WIDTH 3
+/* Not a multiple of the vector widths, to exercise the scalar tails */
+#define HEIGHT 2999
+
+/* Client I/O procedures over stdio, with a file size that can be faked */
+static toff_t fakesize;
+
+static tmsize_t readProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    return (tmsize_t)fread(buf, 1, (size_t)size, (FILE *)fd);
+}
+
+static tmsize_t writeProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+static toff_t seekProc(thandle_t fd, toff_t off, int whence)
+{
+    if (fseek((FILE *)fd, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell((FILE *)fd);
+}
+
+static int closeProc(thandle_t fd) { return fclose((FILE *)fd); }
+
+static toff_t sizeProc(thandle_t fd)
+{
+    long pos = ftell((FILE *)fd), size;
+    if (fakesize)
+        return fakesize;
+    fseek((FILE *)fd, 0, SEEK_END);
+    size = ftell((FILE *)fd);
+    fseek((FILE *)fd, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static TIFF *openClient(const char *mode)
+{
+    FILE *fp = fopen(FILENAME, "rb");
+    if (!fp)
+        return NULL;
+    return TIFFClientOpen(FILENAME, mode, (thandle_t)fp, readProc, writeProc,
+                          seekProc, closeProc, sizeProc, NULL, NULL);
+}
+
+static int nwarnings;
+
+static void warningHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)ap;
+    if (strstr(fmt, "extend past the end of the file"))
+        nwarnings++;
+}
+
+/* Strips of varying sizes, so that both arrays have distinct values */
+static int writeFile(const char *mode)
+{
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+    uint8_t row[WIDTH];
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_PACKBITS);
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        row[0] = (uint8_t)y;
+        row[1] = (uint8_t)(y % 3 ? y >> 8 : y);
+        row[2] = (uint8_t)(y % 5 ? y * 7 : y);
+        ok = TIFFWriteScanline(tif, row, y, 0) == 1;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+static uint64_t offsets[HEIGHT];
+static uint64_t bytecounts[HEIGHT];
+
+/* Compare the arrays seen through tif with the reference ones, walking the
+ * striles in an order that defeats the page cache of deferred loading. */
+static int checkArrays(TIFF *tif, const char *what)
+{
+    uint8_t row[WIDTH];
+    for (uint32_t k = 0; k < HEIGHT; k++)
+    {
+        uint32_t s = (k * 1031) % HEIGHT;
+        int err = 0;
+        if (TIFFGetStrileOffsetWithErr(tif, s, &err) != offsets[s] || err ||
+            TIFFGetStrileByteCountWithErr(tif, s, &err) != bytecounts[s] ||
+            err)
+        {
+            fprintf(stderr, "%s: strip %u differs\n", what, s);
+            return 0;
+        }
+    }
+    if (TIFFReadEncodedStrip(tif, HEIGHT - 1, row, WIDTH) != WIDTH ||
+        row[0] != (uint8_t)(HEIGHT - 1))
+    {
+        fprintf(stderr, "%s: cannot read the last strip\n", what);
+        return 0;
+    }
+    return 1;
+}
+
+static int testLayout(const char *name, const char *wmode)
+{
+    static const char *const rmodes[] = {"r", "rm", "rD", "rmD", "rO", "rmO"};
+    TIFF *tif;
+    TIFFErrorHandler oldwarn;
+    int ok;
+
+    if (!writeFile(wmode))
+    {
+        fprintf(stderr, "%s: cannot write %s\n", name, FILENAME);
+        return 0;
+    }
+
+    /* Reference values, through the generic per-strip accessors */
+    tif = TIFFOpen(FILENAME, "r");
+    if (!tif)
+        return 0;
+    for (uint32_t s = 0; s < HEIGHT; s++)
+    {
+        offsets[s] = TIFFGetStrileOffset(tif, s);
+        bytecounts[s] = TIFFGetStrileByteCount(tif, s);
+    }
+    TIFFClose(tif);
+    for (uint32_t s = 1; s < HEIGHT; s++)
+    {
+        if (offsets[s] != offsets[s - 1] + bytecounts[s - 1])
+        {
+            fprintf(stderr, "%s: strips are not contiguous\n", name);
+            return 0;
+        }
+    }
+
+    for (size_t i = 0; i < sizeof(rmodes) / sizeof(rmodes[0]); i++)
+    {
+        char what[64];
+        snprintf(what, sizeof(what), "%s/%s", name, rmodes[i]);
+        tif = i % 2 ? openClient(rmodes[i]) : TIFFOpen(FILENAME, rmodes[i]);
+        if (!tif)
+            return 0;
+        nwarnings = 0;
+        oldwarn = TIFFSetWarningHandler(warningHandler);
+        ok = checkArrays(tif, what);
+        TIFFSetWarningHandler(oldwarn);
+        TIFFClose(tif);
+        if (!ok)
+            return 0;
+        if (nwarnings != 0)
+        {
+            fprintf(stderr, "%s: spurious warning\n", what);
+            return 0;
+        }
+    }
+
+    /* A file that looks truncated in the middle of the strip data */
+    fakesize = offsets[HEIGHT / 2];
+    nwarnings = 0;
+    oldwarn = TIFFSetWarningHandler(warningHandler);
+    tif = openClient("rm");
+    TIFFSetWarningHandler(oldwarn);
+    fakesize = 0;
+    if (tif)
+        TIFFClose(tif);
+    if (nwarnings != 1)
+    {
+        fprintf(stderr, "%s: %d warnings about truncated strips\n", name,
+                nwarnings);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    int ok = testLayout("classic", "w") && testLayout("bigendian", "wb") &&
+             testLayout("bigtiff", "w8") && testLayout("bigtiff-be", "wb8");
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
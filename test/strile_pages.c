@@ -0,0 +1,219 @@
+/*
+ * Tests for the paged strile arrays of files opened with the 'O' mode flag
+ * (TIFFOpenOptionsSetStrileArrayCacheSize): memory and reads stay bounded
+ * while random access returns the same values as a complete load.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "strile_pages.tif"
+#define WIDTH 1
+#define HEIGHT 60001
+#define CACHE_SIZE (64 * 1024)
+/* Far below the 16 bytes per strip of complete arrays */
+#define MAX_MEMORY (HEIGHT * 6)
+
+/* Client I/O procedures over stdio that count reads */
+static int nreads;
+
+static tmsize_t readProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    nreads++;
+    return (tmsize_t)fread(buf, 1, (size_t)size, (FILE *)fd);
+}
+
+static tmsize_t writeProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    (void)fd;
+    (void)buf;
+    (void)size;
+    return -1;
+}
+
+static toff_t seekProc(thandle_t fd, toff_t off, int whence)
+{
+    if (fseek((FILE *)fd, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell((FILE *)fd);
+}
+
+static int closeProc(thandle_t fd) { return fclose((FILE *)fd); }
+
+static toff_t sizeProc(thandle_t fd)
+{
+    long pos = ftell((FILE *)fd), size;
+    fseek((FILE *)fd, 0, SEEK_END);
+    size = ftell((FILE *)fd);
+    fseek((FILE *)fd, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static TIFF *openPaged(const char *mode, tmsize_t cache_size)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    FILE *fp = fopen(FILENAME, "rb");
+    TIFF *tif = NULL;
+    if (opts && fp)
+    {
+        TIFFOpenOptionsSetStrileArrayCacheSize(opts, cache_size);
+        TIFFOpenOptionsSetMaxCumulatedMemAlloc(opts, MAX_MEMORY);
+        tif = TIFFClientOpenExt(FILENAME, mode, (thandle_t)fp, readProc,
+                                writeProc, seekProc, closeProc, sizeProc, NULL,
+                                NULL, opts);
+    }
+    else if (fp)
+        fclose(fp);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static int writeFile(const char *mode)
+{
+    TIFF *tif = TIFFOpen(FILENAME, mode);
+    uint8_t row[WIDTH * 2];
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        row[0] = (uint8_t)(y * 11);
+        ok = TIFFWriteScanline(tif, row, y, 0) == 1;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+static uint64_t offsets[HEIGHT];
+static uint64_t bytecounts[HEIGHT];
+
+static int loadReference(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    if (!tif)
+        return 0;
+    for (uint32_t s = 0; s < HEIGHT; s++)
+    {
+        offsets[s] = TIFFGetStrileOffset(tif, s);
+        bytecounts[s] = TIFFGetStrileByteCount(tif, s);
+    }
+    TIFFClose(tif);
+    return 1;
+}
+
+/* Random access, with a few strips read back, then a sequential scan. */
+static int checkPaged(TIFF *tif, const char *name)
+{
+    uint32_t seed = 1;
+    uint8_t row[WIDTH];
+    int err = 0;
+
+    for (int i = 0; i < 20000; i++)
+    {
+        uint32_t s;
+        seed = seed * 1103515245U + 12345U;
+        s = (seed >> 8) % HEIGHT;
+        if (TIFFGetStrileOffsetWithErr(tif, s, &err) != offsets[s] || err ||
+            TIFFGetStrileByteCountWithErr(tif, s, &err) != bytecounts[s] ||
+            err)
+        {
+            fprintf(stderr, "%s: strip %u differs\n", name, s);
+            return 0;
+        }
+        if (i % 1000 == 0 &&
+            (TIFFReadEncodedStrip(tif, s, row, WIDTH) != WIDTH ||
+             row[0] != (uint8_t)(s * 11)))
+        {
+            fprintf(stderr, "%s: cannot read strip %u\n", name, s);
+            return 0;
+        }
+    }
+
+    /* One read per array and page of 512 strips */
+    nreads = 0;
+    for (uint32_t s = 0; s < HEIGHT; s++)
+    {
+        if (TIFFGetStrileOffset(tif, s) != offsets[s] ||
+            TIFFGetStrileByteCount(tif, s) != bytecounts[s])
+        {
+            fprintf(stderr, "%s: strip %u differs in scan\n", name, s);
+            return 0;
+        }
+    }
+    if (nreads > 2 * (HEIGHT / 512 + 1))
+    {
+        fprintf(stderr, "%s: %d reads for a sequential scan\n", name, nreads);
+        return 0;
+    }
+    return 1;
+}
+
+static void errorHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)fmt;
+    (void)ap;
+}
+
+static int testLayout(const char *name, const char *wmode)
+{
+    TIFF *tif;
+    TIFFErrorHandler olderr;
+    int ok, err = 0;
+
+    if (!writeFile(wmode) || !loadReference())
+    {
+        fprintf(stderr, "%s: cannot write %s\n", name, FILENAME);
+        return 0;
+    }
+
+    tif = openPaged("rO", CACHE_SIZE);
+    if (!tif)
+        return 0;
+    ok = checkPaged(tif, name);
+    TIFFClose(tif);
+    if (!ok)
+        return 0;
+
+    /* Without paging, the lazily filled arrays exceed the memory limit */
+    tif = openPaged("rO", 0);
+    if (!tif)
+        return 0;
+    olderr = TIFFSetErrorHandler(errorHandler);
+    for (uint32_t s = 0; s < HEIGHT && !err; s += 1000)
+        (void)TIFFGetStrileOffsetWithErr(tif, s, &err);
+    TIFFSetErrorHandler(olderr);
+    TIFFClose(tif);
+    if (!err)
+    {
+        fprintf(stderr, "%s: complete arrays fit in the memory limit\n",
+                name);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    int ok = testLayout("classic", "w") && testLayout("bigendian", "wb") &&
+             testLayout("bigtiff", "w8");
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/*
+ * Tests for the streamed writing of strip/tile offset and byte count arrays
+ * (TIFFStreamStrileArrayWriting): images with more striles than fit in the
+ * memory limit are written in sequential and random order, and read back.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "strile_stream.tif"
+#define TILESIZE 16
+#define TILESACROSS 120 /* 14400 tiles */
+#define HEIGHT 40001    /* one row strips */
+/* Far below the 16 bytes per strile of complete arrays */
+#define MAX_MEMORY (200 * 1024)
+
+static TIFF *openLimited(const char *mode)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif = NULL;
+    if (opts)
+    {
+        TIFFOpenOptionsSetMaxCumulatedMemAlloc(opts, MAX_MEMORY);
+        tif = TIFFOpenExt(FILENAME, mode, opts);
+    }
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static uint8_t strileValue(uint32_t s) { return (uint8_t)(s * 13 + 7); }
+
+static void setFields(TIFF *tif, int tiled)
+{
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH,
+                 tiled ? TILESIZE * TILESACROSS : TILESIZE);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH,
+                 tiled ? TILESIZE * TILESACROSS : HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+}
+
+/* Write the striles in sequence or in a scattered order, followed by a
+ * second, ordinary, directory. */
+static int writeFile(const char *mode, int tiled, int scattered, int stream)
+{
+    TIFF *tif = openLimited(mode);
+    uint8_t buf[TILESIZE * TILESIZE];
+    uint32_t nstriles;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    setFields(tif, tiled);
+    if (stream && !TIFFStreamStrileArrayWriting(tif))
+    {
+        TIFFClose(tif);
+        return 0;
+    }
+    nstriles = tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    for (uint32_t k = 0; ok && k < nstriles; k++)
+    {
+        const uint32_t s = scattered ? (uint32_t)((k * 7919ULL) % nstriles) : k;
+        const tmsize_t size = tiled ? TILESIZE * TILESIZE : TILESIZE;
+        memset(buf, strileValue(s), sizeof(buf));
+        ok = (tiled ? TIFFWriteEncodedTile(tif, s, buf, size)
+                    : TIFFWriteEncodedStrip(tif, s, buf, size)) == size &&
+             TIFFGetStrileByteCount(tif, s) == (uint64_t)size;
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    if (ok)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 1);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 1);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        buf[0] = 42;
+        ok = TIFFWriteScanline(tif, buf, 0, 0) == 1;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+static int checkFile(const char *name, int tiled)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    uint8_t buf[TILESIZE * TILESIZE];
+    const tmsize_t size = tiled ? TILESIZE * TILESIZE : TILESIZE;
+    uint32_t nstriles;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    nstriles = tiled ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    if (nstriles != (tiled ? TILESACROSS * TILESACROSS : HEIGHT))
+    {
+        fprintf(stderr, "%s: %u striles\n", name, nstriles);
+        ok = 0;
+    }
+    for (uint32_t s = 0; ok && s < nstriles; s++)
+    {
+        if ((tiled ? TIFFReadEncodedTile(tif, s, buf, size)
+                   : TIFFReadEncodedStrip(tif, s, buf, size)) != size ||
+            buf[0] != strileValue(s) || buf[size - 1] != strileValue(s))
+        {
+            fprintf(stderr, "%s: strile %u differs\n", name, s);
+            ok = 0;
+        }
+    }
+    if (ok && (!TIFFReadDirectory(tif) ||
+               TIFFReadScanline(tif, buf, 0, 0) != 1 || buf[0] != 42))
+    {
+        fprintf(stderr, "%s: cannot read the second directory\n", name);
+        ok = 0;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+static void errorHandler(const char *module, const char *fmt, va_list ap)
+{
+    (void)module;
+    (void)fmt;
+    (void)ap;
+}
+
+static int testLayout(const char *name, const char *mode, int tiled)
+{
+    TIFFErrorHandler olderr;
+    int ok;
+
+    /* Tiles are also written out of order, which reads back the entries */
+    for (int scattered = 0; scattered <= tiled; scattered++)
+    {
+        if (!writeFile(mode, tiled, scattered, 1))
+        {
+            fprintf(stderr, "%s: cannot write %s\n", name, FILENAME);
+            return 0;
+        }
+        if (!checkFile(name, tiled))
+            return 0;
+    }
+
+    /* Without streaming, the arrays exceed the memory limit */
+    olderr = TIFFSetErrorHandler(errorHandler);
+    ok = writeFile(mode, tiled, 0, 0);
+    TIFFSetErrorHandler(olderr);
+    if (ok)
+    {
+        fprintf(stderr, "%s: complete arrays fit in the memory limit\n", name);
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    int ok = testLayout("classic", "w", 0) &&
+             testLayout("bigendian", "wb", 0) &&
+             testLayout("bigtiff-tiled", "w8", 1) &&
+             testLayout("bigtiff-be-tiled", "wb8", 1) &&
+             testLayout("classic-tiled", "w", 1);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,62 @@
+#include "tiff_threadpool.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+/*
+ * Tasks that submit to the pool they run in and wait for it, as ZIPDecode()
+ * does from within TPDecodePredictTile(), must not deadlock: with every
+ * worker busy in an outer task, nobody would be left to run inner tasks.
+ */
+
+#define WORKERS 2
+#define OUTER_TASKS 8
+#define INNER_TASKS 16
+#define TIMEOUT_SECONDS 30
+
+static pthread_mutex_t cnt_mutex = PTHREAD_MUTEX_INITIALIZER;
+static int counter = 0;
+static TIFFThreadPool *tp;
+
+static void inner_task(void *arg)
+{
+    (void)arg;
+    pthread_mutex_lock(&cnt_mutex);
+    counter++;
+    pthread_mutex_unlock(&cnt_mutex);
+}
+
+static void outer_task(void *arg)
+{
+    (void)arg;
+    for (int i = 0; i < INNER_TASKS; i++)
+        if (!_TIFFThreadPoolSubmit(tp, inner_task, NULL))
+            inner_task(NULL);
+    _TIFFThreadPoolWait(tp);
+}
+
+int main(void)
+{
+    /* A deadlock kills the test with SIGALRM */
+    alarm(TIMEOUT_SECONDS);
+    tp = _TIFFThreadPoolInit(WORKERS);
+    if (!tp)
+    {
+        fprintf(stderr, "cannot create thread pool\n");
+        return 1;
+    }
+
+    for (int i = 0; i < OUTER_TASKS; i++)
+        if (!_TIFFThreadPoolSubmit(tp, outer_task, NULL))
+            outer_task(NULL);
+    _TIFFThreadPoolWait(tp);
+    _TIFFThreadPoolShutdown(tp);
+
+    int expected = OUTER_TASKS * INNER_TASKS;
+    if (counter != expected)
+    {
+        fprintf(stderr, "counter=%d expected=%d\n", counter, expected);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,271 @@
+/*
+ * Tests for COMPRESSION_WEBP: lossless RGB and RGBA strips and tiles decode
+ * to the original data whether whole striles are read, which decodes them
+ * in one call, or part of them or scanlines, which decodes them
+ * incrementally.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "webp_codec.tif"
+#define WIDTH 200
+#define HEIGHT 150 /* the last strip is shorter */
+#define ROWSPERSTRIP 64
+#define TILESIZE 64
+#define PARTIALROWS 5
+
+enum
+{
+    CONTENT_RGB,
+    CONTENT_RGBA,
+    CONTENT_RGBA_OPAQUE /* stored by libwebp without alpha */
+};
+
+typedef struct
+{
+    int content;
+    int tiled;
+} TestCase;
+
+static uint16_t samplesPerPixel(int content)
+{
+    return content == CONTENT_RGB ? 3 : 4;
+}
+
+static void fillImage(uint8_t *img, int content)
+{
+    const uint16_t spp = samplesPerPixel(content);
+
+    for (uint32_t y = 0; y < HEIGHT; y++)
+        for (uint32_t x = 0; x < WIDTH; x++)
+        {
+            uint8_t *p = img + ((size_t)y * WIDTH + x) * spp;
+            p[0] = (uint8_t)(x * 3 + y);
+            p[1] = (uint8_t)(y * 5 + (x & 7));
+            p[2] = (uint8_t)((x ^ y) * 7);
+            if (content == CONTENT_RGBA)
+                p[3] = (uint8_t)((x + y) % 3 == 0 ? 0 : x + y * 2);
+            else if (content == CONTENT_RGBA_OPAQUE)
+                p[3] = 255;
+        }
+}
+
+static int writeFile(const uint8_t *img, const TestCase *tc)
+{
+    const uint16_t spp = samplesPerPixel(tc->content);
+    const size_t rowbytes = (size_t)WIDTH * spp;
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    int ok = tif != NULL;
+
+    if (!ok)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
+    if (spp == 4)
+    {
+        const uint16_t extra = EXTRASAMPLE_UNASSALPHA;
+        TIFFSetField(tif, TIFFTAG_EXTRASAMPLES, 1, &extra);
+    }
+    if (tc->tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    if (TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_WEBP) != 1 ||
+        TIFFSetField(tif, TIFFTAG_WEBP_LOSSLESS, 1) != 1 ||
+        TIFFSetField(tif, TIFFTAG_WEBP_LOSSLESS_EXACT, 1) != 1)
+    {
+        fprintf(stderr, "cannot set the WebP fields\n");
+        TIFFClose(tif);
+        return 0;
+    }
+
+    if (tc->tiled)
+    {
+        const size_t tilerow = (size_t)TILESIZE * spp;
+        uint8_t *tile = (uint8_t *)malloc(tilerow * TILESIZE);
+        ok = tile != NULL;
+        for (uint32_t ty = 0; ok && ty < HEIGHT; ty += TILESIZE)
+            for (uint32_t tx = 0; ok && tx < WIDTH; tx += TILESIZE)
+            {
+                /* Edge tiles are padded with zeroes */
+                memset(tile, 0, tilerow * TILESIZE);
+                for (uint32_t y = 0; y < TILESIZE && ty + y < HEIGHT; y++)
+                    for (uint32_t x = 0; x < TILESIZE && tx + x < WIDTH; x++)
+                        memcpy(tile + y * tilerow + x * spp,
+                               img + (ty + y) * rowbytes + (tx + x) * spp,
+                               spp);
+                ok = TIFFWriteTile(tif, tile, tx, ty, 0, 0) ==
+                     (tmsize_t)(tilerow * TILESIZE);
+            }
+        free(tile);
+    }
+    else
+    {
+        for (uint32_t y = 0; ok && y < HEIGHT; y += ROWSPERSTRIP)
+        {
+            const uint32_t rows =
+                HEIGHT - y < ROWSPERSTRIP ? HEIGHT - y : ROWSPERSTRIP;
+            ok = TIFFWriteEncodedStrip(tif, y / ROWSPERSTRIP,
+                                       (void *)(img + y * rowbytes),
+                                       (tmsize_t)(rows * rowbytes)) ==
+                 (tmsize_t)(rows * rowbytes);
+        }
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Compare rows [0, rows) of a tile with the image, within the image. */
+static int sameTileRows(const uint8_t *tile, const uint8_t *img, uint32_t tx,
+                        uint32_t ty, uint32_t rows, uint16_t spp)
+{
+    const size_t rowbytes = (size_t)WIDTH * spp;
+    const size_t tilerow = (size_t)TILESIZE * spp;
+    const uint32_t cols = WIDTH - tx < TILESIZE ? WIDTH - tx : TILESIZE;
+
+    for (uint32_t y = 0; y < rows && ty + y < HEIGHT; y++)
+        if (memcmp(tile + y * tilerow, img + (ty + y) * rowbytes + tx * spp,
+                   (size_t)cols * spp) != 0)
+            return 0;
+    return 1;
+}
+
+static int checkTiles(TIFF *tif, const uint8_t *img, uint8_t *buf,
+                      uint16_t spp)
+{
+    const size_t tilebytes = (size_t)TILESIZE * TILESIZE * spp;
+    int ok = 1;
+
+    for (uint32_t ty = 0; ok && ty < HEIGHT; ty += TILESIZE)
+        for (uint32_t tx = 0; ok && tx < WIDTH; tx += TILESIZE)
+        {
+            const uint32_t t = TIFFComputeTile(tif, tx, ty, 0, 0);
+
+            if (TIFFReadEncodedTile(tif, t, buf, (tmsize_t)-1) !=
+                    (tmsize_t)tilebytes ||
+                !sameTileRows(buf, img, tx, ty, TILESIZE, spp))
+            {
+                fprintf(stderr, "tile %u,%u differs\n", tx, ty);
+                ok = 0;
+            }
+            /* The beginning of the tile only */
+            else if (TIFFReadEncodedTile(
+                         tif, t, buf,
+                         (tmsize_t)PARTIALROWS * TILESIZE * spp) !=
+                         (tmsize_t)PARTIALROWS * TILESIZE * spp ||
+                     !sameTileRows(buf, img, tx, ty, PARTIALROWS, spp))
+            {
+                fprintf(stderr, "partial tile %u,%u differs\n", tx, ty);
+                ok = 0;
+            }
+        }
+    return ok;
+}
+
+static int checkStrips(TIFF *tif, const uint8_t *img, uint8_t *buf,
+                       uint16_t spp)
+{
+    const size_t rowbytes = (size_t)WIDTH * spp;
+    int ok = 1;
+
+    for (uint32_t y = 0; ok && y < HEIGHT; y += ROWSPERSTRIP)
+    {
+        const uint32_t s = y / ROWSPERSTRIP;
+        const uint32_t rows =
+            HEIGHT - y < ROWSPERSTRIP ? HEIGHT - y : ROWSPERSTRIP;
+        const uint8_t *expected = img + y * rowbytes;
+
+        if (TIFFReadEncodedStrip(tif, s, buf, (tmsize_t)-1) !=
+                (tmsize_t)(rows * rowbytes) ||
+            memcmp(buf, expected, rows * rowbytes) != 0)
+        {
+            fprintf(stderr, "strip %u differs\n", s);
+            ok = 0;
+        }
+        /* The beginning of the strip only */
+        else if (TIFFReadEncodedStrip(tif, s, buf,
+                                      (tmsize_t)(PARTIALROWS * rowbytes)) !=
+                     (tmsize_t)(PARTIALROWS * rowbytes) ||
+                 memcmp(buf, expected, PARTIALROWS * rowbytes) != 0)
+        {
+            fprintf(stderr, "partial strip %u differs\n", s);
+            ok = 0;
+        }
+    }
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        if (TIFFReadScanline(tif, buf, y, 0) != 1 ||
+            memcmp(buf, img + y * rowbytes, rowbytes) != 0)
+        {
+            fprintf(stderr, "row %u differs\n", y);
+            ok = 0;
+        }
+    }
+    return ok;
+}
+
+static int checkFile(const uint8_t *img, uint8_t *buf, const TestCase *tc)
+{
+    const uint16_t spp = samplesPerPixel(tc->content);
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    int ok = tif != NULL;
+
+    if (ok)
+    {
+        if (tc->tiled)
+            ok = checkTiles(tif, img, buf, spp);
+        else
+            ok = checkStrips(tif, img, buf, spp);
+        TIFFClose(tif);
+    }
+    return ok;
+}
+
+int main(void)
+{
+    static const TestCase cases[] = {
+        {CONTENT_RGB, 0},  {CONTENT_RGB, 1},         {CONTENT_RGBA, 0},
+        {CONTENT_RGBA, 1}, {CONTENT_RGBA_OPAQUE, 0}, {CONTENT_RGBA_OPAQUE, 1}};
+    const size_t maxbytes = (size_t)WIDTH * HEIGHT * 4;
+    uint8_t *img = (uint8_t *)malloc(maxbytes);
+    uint8_t *buf = (uint8_t *)malloc(maxbytes);
+    int ok = img != NULL && buf != NULL;
+
+    for (size_t i = 0; ok && i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        fillImage(img, cases[i].content);
+        if (!writeFile(img, &cases[i]))
+        {
+            fprintf(stderr, "case %u: cannot write the file\n", (unsigned)i);
+            ok = 0;
+        }
+        else if (!checkFile(img, buf, &cases[i]))
+        {
+            fprintf(stderr, "case %u failed\n", (unsigned)i);
+            ok = 0;
+        }
+    }
+    free(img);
+    free(buf);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
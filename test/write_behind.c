@@ -0,0 +1,284 @@
+/*
+ * Tests for the write-behind buffering of TIFFOpenOptionsSetWriteBehind():
+ * a one row per strip image is written with few write calls, strips read
+ * back while writing and rewritten in update mode are correct, and the
+ * file is the same as an unbuffered one.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "write_behind.tif"
+#define REFNAME "write_behind_ref.tif"
+#define RELOCNAME "write_behind_reloc.tif"
+#define WIDTH 1728 /* a fax line */
+#define ROWBYTES (WIDTH / 8)
+#define HEIGHT 10000
+#define BUFFER_SIZE (1024 * 1024)
+
+/* Client I/O procedures over stdio that count writes */
+static int nwrites;
+
+static tmsize_t readProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    return (tmsize_t)fread(buf, 1, (size_t)size, (FILE *)fd);
+}
+
+static tmsize_t writeProc(thandle_t fd, void *buf, tmsize_t size)
+{
+    nwrites++;
+    return (tmsize_t)fwrite(buf, 1, (size_t)size, (FILE *)fd);
+}
+
+static toff_t seekProc(thandle_t fd, toff_t off, int whence)
+{
+    if (fseek((FILE *)fd, (long)off, whence) != 0)
+        return (toff_t)-1;
+    return (toff_t)ftell((FILE *)fd);
+}
+
+static int closeProc(thandle_t fd) { return fclose((FILE *)fd); }
+
+static toff_t sizeProc(thandle_t fd)
+{
+    long pos = ftell((FILE *)fd), size;
+    fseek((FILE *)fd, 0, SEEK_END);
+    size = ftell((FILE *)fd);
+    fseek((FILE *)fd, pos, SEEK_SET);
+    return (toff_t)size;
+}
+
+static TIFF *openFile(const char *name, const char *mode, int buffered,
+                      int client)
+{
+    TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
+    TIFF *tif = NULL;
+
+    if (!opts)
+        return NULL;
+    if (buffered)
+        TIFFOpenOptionsSetWriteBehind(opts, BUFFER_SIZE,
+                                      client ? 0 : 4 * BUFFER_SIZE);
+    if (client)
+    {
+        FILE *fp = fopen(name, mode[0] == 'w' ? "w+b" : "r+b");
+        if (fp)
+            tif = TIFFClientOpenExt(name, mode, (thandle_t)fp, readProc,
+                                    writeProc, seekProc, closeProc, sizeProc,
+                                    NULL, NULL, opts);
+    }
+    else
+        tif = TIFFOpenExt(name, mode, opts);
+    TIFFOpenOptionsFree(opts);
+    return tif;
+}
+
+static void fillRow(uint8_t *row, uint32_t y, int pass)
+{
+    for (int i = 0; i < ROWBYTES; i++)
+        row[i] = (uint8_t)(y * 3 + i + pass);
+}
+
+/* Write the image, checking a strip written a while ago on the way. */
+static int writeFile(const char *name, int buffered, int client)
+{
+    TIFF *tif = openFile(name, "w", buffered, client);
+    uint8_t row[ROWBYTES], check[ROWBYTES];
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 1);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISWHITE);
+    TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 1);
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        fillRow(row, y, 0);
+        ok = TIFFWriteEncodedStrip(tif, y, row, ROWBYTES) == ROWBYTES;
+        if (ok && y == HEIGHT / 2)
+        {
+            fillRow(row, y / 2, 0);
+            ok = TIFFReadRawStrip(tif, y / 2, check, ROWBYTES) == ROWBYTES &&
+                 memcmp(row, check, ROWBYTES) == 0;
+            if (!ok)
+                fprintf(stderr, "cannot read back a strip while writing\n");
+        }
+    }
+    ok = ok && TIFFWriteDirectory(tif);
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Rewrite every 100th strip in place and add a directory. */
+static int updateFile(const char *name, int buffered, int client)
+{
+    TIFF *tif = openFile(name, "r+", buffered, client);
+    uint8_t row[ROWBYTES];
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    for (uint32_t y = 0; ok && y < HEIGHT; y += 100)
+    {
+        fillRow(row, y, 1);
+        ok = TIFFWriteEncodedStrip(tif, y, row, ROWBYTES) == ROWBYTES;
+    }
+    ok = ok && TIFFRewriteDirectory(tif);
+    if (ok)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 1);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 1);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+        row[0] = 42;
+        ok = TIFFWriteScanline(tif, row, 0, 0) == 1;
+    }
+    TIFFClose(tif);
+    return ok;
+}
+
+static int checkFile(const char *name)
+{
+    TIFF *tif = TIFFOpen(name, "r");
+    uint8_t row[ROWBYTES], expected[ROWBYTES];
+    int ok = tif != NULL;
+
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        fillRow(expected, y, y % 100 == 0);
+        if (TIFFReadEncodedStrip(tif, y, row, ROWBYTES) != ROWBYTES ||
+            memcmp(row, expected, ROWBYTES) != 0)
+        {
+            fprintf(stderr, "%s: strip %u differs\n", name, y);
+            ok = 0;
+        }
+    }
+    if (ok && (!TIFFReadDirectory(tif) ||
+               TIFFReadScanline(tif, row, 0, 0) != 1 || row[0] != 42))
+    {
+        fprintf(stderr, "%s: cannot read the second directory\n", name);
+        ok = 0;
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+/* Byte-wise comparison of two files. */
+static int sameFiles(const char *name1, const char *name2)
+{
+    FILE *f1 = fopen(name1, "rb"), *f2 = fopen(name2, "rb");
+    int c1 = 0, c2 = 0;
+
+    while (f1 && f2 && c1 == c2 && c1 != EOF)
+    {
+        c1 = fgetc(f1);
+        c2 = fgetc(f2);
+    }
+    if (f1)
+        fclose(f1);
+    if (f2)
+        fclose(f2);
+    return f1 && f2 && c1 == c2;
+}
+
+/*
+ * Write a strip in place with two raw writes, the second of which no longer
+ * fits, so that the data of the first, still buffered, has to be moved to
+ * the end of the file.
+ */
+static int testRelocate(int client)
+{
+    TIFF *tif = openFile(RELOCNAME, "w", 0, 0);
+    uint8_t data[3 * ROWBYTES], check[3 * ROWBYTES];
+    int ok = tif != NULL;
+
+    for (int i = 0; i < 3 * ROWBYTES; i++)
+        data[i] = (uint8_t)(i * 7 + i / 5);
+    if (ok)
+    {
+        TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+        TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 2);
+        TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 1);
+        TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+        TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISWHITE);
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 2);
+        memset(check, 0, sizeof(check));
+        ok = TIFFWriteEncodedStrip(tif, 0, check, 2 * ROWBYTES) ==
+                 2 * ROWBYTES &&
+             TIFFWriteDirectory(tif);
+        TIFFClose(tif);
+    }
+    tif = ok ? openFile(RELOCNAME, "r+", 1, client) : NULL;
+    ok = tif != NULL &&
+         TIFFWriteRawStrip(tif, 0, data, ROWBYTES) == ROWBYTES &&
+         TIFFWriteRawStrip(tif, 0, data + ROWBYTES, 2 * ROWBYTES) ==
+             2 * ROWBYTES &&
+         TIFFRewriteDirectory(tif);
+    if (tif)
+        TIFFClose(tif);
+    tif = ok ? TIFFOpen(RELOCNAME, "r") : NULL;
+    ok = tif != NULL &&
+         TIFFReadRawStrip(tif, 0, check, 3 * ROWBYTES) == 3 * ROWBYTES &&
+         memcmp(data, check, 3 * ROWBYTES) == 0;
+    if (tif)
+        TIFFClose(tif);
+    if (!ok)
+        fprintf(stderr, "relocated strip differs\n");
+    return ok;
+}
+
+int main(void)
+{
+    int unbuffered, buffered, ok;
+
+    /* Client I/O, where writes are counted */
+    nwrites = 0;
+    ok = writeFile(REFNAME, 0, 1);
+    unbuffered = nwrites;
+    nwrites = 0;
+    ok = ok && writeFile(FILENAME, 1, 1);
+    buffered = nwrites;
+    if (ok && buffered * 100 > unbuffered)
+    {
+        fprintf(stderr, "%d writes with write-behind, %d without\n", buffered,
+                unbuffered);
+        ok = 0;
+    }
+    ok = ok && sameFiles(FILENAME, REFNAME) &&
+         updateFile(REFNAME, 0, 1) && updateFile(FILENAME, 1, 1) &&
+         sameFiles(FILENAME, REFNAME) && checkFile(FILENAME) &&
+         testRelocate(1);
+    if (!ok)
+    {
+        fprintf(stderr, "client I/O failed\n");
+        return 1;
+    }
+
+    /* TIFFOpen(), with file space reserved ahead */
+    ok = writeFile(FILENAME, 1, 0) && updateFile(FILENAME, 1, 0) &&
+         sameFiles(FILENAME, REFNAME) && checkFile(FILENAME) &&
+         testRelocate(0);
+    if (!ok)
+    {
+        fprintf(stderr, "TIFFOpen() failed\n");
+        return 1;
+    }
+    unlink(FILENAME);
+    unlink(REFNAME);
+    unlink(RELOCNAME);
+    return 0;
+}
@@ -0,0 +1,324 @@
+/*
+ * Tests for the ZSTD codec: strips compressed with worker threads
+ * (TIFFTAG_ZSTD_WORKERS) decode to the original data, whether whole
+ * striles, part of them or scanlines are read, and small tiles compressed
+ * with a dictionary, trained (TIFFTAG_ZSTD_DICTSIZE) or given
+ * (TIFFTAG_ZSTD_DICTIONARY), are smaller and decode to the original data.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define FILENAME "zstd_options.tif"
+#define WIDTH 2048
+#define HEIGHT 1536 /* 3 MiB strips, several compression jobs each */
+#define ROWSPERSTRIP 768
+#define TILESIZE 256
+#define JOBSIZE (512 * 1024)
+#define SMALLTILE 64
+#define DICTSIZE 4096 /* trained on the first 100 of the 384 small tiles */
+#define BIGDICTSIZE 65536 /* trained on the first half of the image */
+
+static uint8_t pixelValue(uint32_t x, uint32_t y)
+{
+    return (uint8_t)((x + y) / 4 + ((x * 7 + y * 13) % 5));
+}
+
+static void fillImage(uint8_t *img)
+{
+    for (uint32_t y = 0; y < HEIGHT; y++)
+        for (uint32_t x = 0; x < WIDTH; x++)
+            img[(size_t)y * WIDTH + x] = pixelValue(x, y);
+}
+
+static TIFF *createFile(int tiled, int workers)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    int value = 0;
+
+    if (!tif)
+        return NULL;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ZSTD);
+    TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL);
+    TIFFSetField(tif, TIFFTAG_ZSTD_LEVEL, 3);
+    if (tiled)
+    {
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, TILESIZE);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, TILESIZE);
+    }
+    else
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWSPERSTRIP);
+    if (TIFFSetField(tif, TIFFTAG_ZSTD_WORKERS, workers) != 1 ||
+        TIFFSetField(tif, TIFFTAG_ZSTD_JOBSIZE, JOBSIZE) != 1 ||
+        TIFFGetField(tif, TIFFTAG_ZSTD_WORKERS, &value) != 1 ||
+        value != workers ||
+        TIFFGetField(tif, TIFFTAG_ZSTD_JOBSIZE, &value) != 1 ||
+        value != JOBSIZE)
+    {
+        fprintf(stderr, "cannot set the ZSTD options\n");
+        TIFFClose(tif);
+        return NULL;
+    }
+    return tif;
+}
+
+static int writeFile(const uint8_t *img, int tiled, int workers)
+{
+    TIFF *tif = createFile(tiled, workers);
+    uint8_t *buf;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    if (!tiled)
+    {
+        for (uint32_t s = 0; ok && s < HEIGHT / ROWSPERSTRIP; s++)
+            ok = TIFFWriteEncodedStrip(
+                     tif, s, (void *)(img + (size_t)s * ROWSPERSTRIP * WIDTH),
+                     (tmsize_t)ROWSPERSTRIP * WIDTH) >= 0;
+        TIFFClose(tif);
+        return ok;
+    }
+    buf = (uint8_t *)malloc(TILESIZE * TILESIZE);
+    if (!buf)
+        ok = 0;
+    for (uint32_t y = 0; ok && y < HEIGHT; y += TILESIZE)
+        for (uint32_t x = 0; ok && x < WIDTH; x += TILESIZE)
+        {
+            for (uint32_t r = 0; r < TILESIZE; r++)
+                memcpy(buf + r * TILESIZE, img + (size_t)(y + r) * WIDTH + x,
+                       TILESIZE);
+            ok = TIFFWriteTile(tif, buf, x, y, 0, 0) >= 0;
+        }
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+/* Read back whole strips, the first half of one, and scanlines. */
+static int checkStrips(const uint8_t *img, uint8_t *buf)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    const tmsize_t stripsize = (tmsize_t)ROWSPERSTRIP * WIDTH;
+    int ok = tif != NULL;
+
+    for (uint32_t s = 0; ok && s < HEIGHT / ROWSPERSTRIP; s++)
+        ok = TIFFReadEncodedStrip(tif, s, buf, stripsize) == stripsize &&
+             memcmp(buf, img + (size_t)s * stripsize, (size_t)stripsize) == 0;
+    if (!ok)
+        fprintf(stderr, "strips differ\n");
+    if (ok && (TIFFReadEncodedStrip(tif, 1, buf, stripsize / 2) !=
+                   stripsize / 2 ||
+               memcmp(buf, img + stripsize, (size_t)stripsize / 2) != 0))
+    {
+        fprintf(stderr, "the first half of a strip differs\n");
+        ok = 0;
+    }
+    for (uint32_t y = 0; ok && y < HEIGHT; y++)
+    {
+        if (TIFFReadScanline(tif, buf, y, 0) != 1 ||
+            memcmp(buf, img + (size_t)y * WIDTH, WIDTH) != 0)
+        {
+            fprintf(stderr, "scanline %u differs\n", y);
+            ok = 0;
+        }
+    }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+static int checkTiles(const uint8_t *img, uint8_t *buf)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    int ok = tif != NULL;
+
+    for (uint32_t y = 0; ok && y < HEIGHT; y += TILESIZE)
+        for (uint32_t x = 0; ok && x < WIDTH; x += TILESIZE)
+        {
+            ok = TIFFReadTile(tif, buf, x, y, 0, 0) == TILESIZE * TILESIZE;
+            for (uint32_t r = 0; ok && r < TILESIZE; r++)
+                ok = memcmp(buf + r * TILESIZE,
+                            img + (size_t)(y + r) * WIDTH + x, TILESIZE) == 0;
+            if (!ok)
+                fprintf(stderr, "tile at %u,%u differs\n", x, y);
+        }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+/* Similar content in every small tile, as in map tiles. */
+static uint8_t smallTileValue(uint32_t x, uint32_t y)
+{
+    const uint32_t t = (y / SMALLTILE) * (WIDTH / SMALLTILE) + x / SMALLTILE;
+    x %= SMALLTILE;
+    y %= SMALLTILE;
+    if ((x / 8 + y / 8 + t % 3) % 4 == 0)
+        return (uint8_t)(200 + t % 7);
+    return (uint8_t)((x * 5 + y * 3 + t) % 11);
+}
+
+/* Small tiles, with a trained dictionary when dictsize > 0, the given one
+ * when dictsize < 0. Returns the file size, 0 on error. */
+static long writeSmallTiles(int dictsize, uint32_t dictlen, const void *dict)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "w");
+    uint8_t buf[SMALLTILE * SMALLTILE];
+    int ok = tif != NULL;
+    FILE *fp;
+    long size = 0;
+
+    if (!ok)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, HEIGHT / 2);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_ZSTD);
+    TIFFSetField(tif, TIFFTAG_TILEWIDTH, SMALLTILE);
+    TIFFSetField(tif, TIFFTAG_TILELENGTH, SMALLTILE);
+    if (dictsize > 0)
+        ok = TIFFSetField(tif, TIFFTAG_ZSTD_DICTSIZE, dictsize) == 1;
+    else if (dictsize < 0)
+        ok = TIFFSetField(tif, TIFFTAG_ZSTD_DICTIONARY, dictlen, dict) == 1;
+    for (uint32_t y = 0; ok && y < HEIGHT / 2; y += SMALLTILE)
+        for (uint32_t x = 0; ok && x < WIDTH; x += SMALLTILE)
+        {
+            for (uint32_t i = 0; i < SMALLTILE * SMALLTILE; i++)
+                buf[i] = smallTileValue(x + i % SMALLTILE, y + i / SMALLTILE);
+            ok = TIFFWriteTile(tif, buf, x, y, 0, 0) >= 0;
+        }
+    if (tif)
+        TIFFClose(tif);
+    fp = ok ? fopen(FILENAME, "rb") : NULL;
+    if (fp)
+    {
+        fseek(fp, 0, SEEK_END);
+        size = ftell(fp);
+        fclose(fp);
+    }
+    return size;
+}
+
+/* Check the small tiles, returning their dictionary in *dict. */
+static int checkSmallTiles(uint32_t *dictlen, uint8_t *dict)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    uint8_t buf[SMALLTILE * SMALLTILE];
+    const void *data = NULL;
+    int ok = tif != NULL;
+
+    *dictlen = 0;
+    if (ok && TIFFGetField(tif, TIFFTAG_ZSTD_DICTIONARY, dictlen, &data) &&
+        *dictlen <= DICTSIZE)
+        memcpy(dict, data, *dictlen);
+    for (uint32_t y = 0; ok && y < HEIGHT / 2; y += SMALLTILE)
+        for (uint32_t x = 0; ok && x < WIDTH; x += SMALLTILE)
+        {
+            ok = TIFFReadTile(tif, buf, x, y, 0, 0) == sizeof(buf);
+            for (uint32_t i = 0; ok && i < SMALLTILE * SMALLTILE; i++)
+                ok = buf[i] ==
+                     smallTileValue(x + i % SMALLTILE, y + i / SMALLTILE);
+            if (!ok)
+                fprintf(stderr, "small tile at %u,%u differs\n", x, y);
+        }
+    if (tif)
+        TIFFClose(tif);
+    return ok;
+}
+
+/*
+ * Whether the last small tile is compressed with a dictionary: the
+ * Dictionary_ID_flag of its frame header is set.
+ */
+static int lastTileUsesDictionary(void)
+{
+    TIFF *tif = TIFFOpen(FILENAME, "r");
+    uint8_t raw[8];
+    int used = 0;
+
+    if (tif && TIFFReadRawTile(tif, TIFFNumberOfTiles(tif) - 1, raw,
+                               sizeof(raw)) == (tmsize_t)sizeof(raw))
+        used = raw[0] == 0x28 && raw[1] == 0xB5 && raw[2] == 0x2F &&
+               raw[3] == 0xFD && (raw[4] & 3) != 0;
+    if (tif)
+        TIFFClose(tif);
+    return used;
+}
+
+static int testDictionary(void)
+{
+    static uint8_t dict[DICTSIZE];
+    uint32_t dictlen;
+    long plain, trained, given;
+
+    plain = writeSmallTiles(0, 0, NULL);
+    if (!plain || !checkSmallTiles(&dictlen, dict) || dictlen != 0)
+        return 0;
+    trained = writeSmallTiles(DICTSIZE, 0, NULL);
+    if (!trained || !checkSmallTiles(&dictlen, dict) || dictlen == 0 ||
+        dictlen > DICTSIZE || !lastTileUsesDictionary())
+    {
+        fprintf(stderr, "no dictionary trained\n");
+        return 0;
+    }
+    given = writeSmallTiles(-1, dictlen, dict);
+    if (!given || !checkSmallTiles(&dictlen, dict))
+        return 0;
+    if (trained >= plain || given >= trained)
+    {
+        fprintf(stderr,
+                "%ld bytes without dictionary, %ld with a trained one, "
+                "%ld with a given one\n",
+                plain, trained, given);
+        return 0;
+    }
+    /* The budget is more than the image: trained on half of it */
+    if (!writeSmallTiles(BIGDICTSIZE, 0, NULL) ||
+        !checkSmallTiles(&dictlen, dict) || dictlen == 0 ||
+        !lastTileUsesDictionary())
+    {
+        fprintf(stderr, "no dictionary trained on a small image\n");
+        return 0;
+    }
+    return 1;
+}
+
+int main(void)
+{
+    uint8_t *img = (uint8_t *)malloc((size_t)WIDTH * HEIGHT);
+    uint8_t *buf = (uint8_t *)malloc((size_t)WIDTH * ROWSPERSTRIP);
+    int ok = img != NULL && buf != NULL;
+
+    if (ok)
+        fillImage(img);
+    for (int workers = 0; ok && workers <= 2; workers += 2)
+    {
+        ok = writeFile(img, 0, workers) && checkStrips(img, buf) &&
+             writeFile(img, 1, workers) && checkTiles(img, buf);
+        if (!ok)
+            fprintf(stderr, "failed with %d workers\n", workers);
+    }
+    ok = ok && testDictionary();
+    free(img);
+    free(buf);
+    if (ok)
+        unlink(FILENAME);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,960 @@
+/*
+ * tiffbench -- unified codec / I/O benchmark for libtiff.
+ *
+ * Generates synthetic images (gray, RGB, float, palette, bilevel) laid out
+ * as strips or tiles, and measures write, read and RGBA throughput for every
+ * requested codec x level x predictor x thread count combination.  Results are
+ * emitted as a single JSON document so that runs can be compared
+ * mechanically.
+ */
+
+#include "libport.h"
+#include "tif_config.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#define TIFFBENCH_HAVE_RUSAGE 1
+#endif
+
+#include "tiffio.h"
+
+#define streq(a, b) (strcmp(a, b) == 0)
+
+#define MAX_LIST 16
+#define MIN_SIZE 256
+#define MAX_SIZE 32768
+/* TIFFReadRGBAImage() needs a full 32-bit raster; skip it above this. */
+#define MAX_RGBA_BYTES ((uint64_t)1 << 30)
+
+typedef enum
+{
+    KIND_GRAY,
+    KIND_RGB,
+    KIND_FLOAT,
+    KIND_PALETTE,
+    KIND_BILEVEL,
+    KIND_GRAY16
+} ImageKind;
+
+static const char *const kindNames[] = {"gray",    "rgb",     "float",
+                                        "palette", "bilevel", "gray16"};
+
+typedef struct
+{
+    const char *name;
+    uint16_t scheme;
+} BenchCodec;
+
+static const BenchCodec benchCodecs[] = {
+    {"none", COMPRESSION_NONE},     {"lzw", COMPRESSION_LZW},
+    {"packbits", COMPRESSION_PACKBITS}, {"zip", COMPRESSION_ADOBE_DEFLATE},
+    {"lzma", COMPRESSION_LZMA},     {"zstd", COMPRESSION_ZSTD},
+    {"jpeg", COMPRESSION_JPEG},     {"webp", COMPRESSION_WEBP},
+    {"lerc", COMPRESSION_LERC},     {"g3", COMPRESSION_CCITTFAX3},
+    {"g4", COMPRESSION_CCITTFAX4},  {"lz4", COMPRESSION_LZ4},
+    {"jpegls", COMPRESSION_JPEGLS}, {NULL, 0}};
+
+typedef struct
+{
+    uint32_t sizes[MAX_LIST];
+    int nsizes;
+    int kinds[MAX_LIST];
+    int nkinds;
+    int tiled[2];
+    int nlayouts;
+    const BenchCodec *codecs[MAX_LIST];
+    int ncodecs;
+    uint16_t predictors[MAX_LIST];
+    int npredictors;
+    int threads[MAX_LIST];
+    int nthreads;
+    int levels[MAX_LIST];
+    int nlevels;
+    int iterations;
+    uint32_t tilesize;
+    uint32_t rowsperstrip; /* 0: TIFFDefaultStripSize() */
+    const char *tmpdir;
+} BenchConfig;
+
+typedef struct
+{
+    double *samples; /* per-operation latencies in seconds */
+    size_t count;
+    size_t alloc;
+    double total; /* wall time in seconds */
+    uint64_t bytes; /* uncompressed bytes processed */
+} BenchStat;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long maxRSSKiB(void)
+{
+#ifdef TIFFBENCH_HAVE_RUSAGE
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+    {
+#ifdef __APPLE__
+        return (long)(ru.ru_maxrss / 1024);
+#else
+        return (long)ru.ru_maxrss;
+#endif
+    }
+#endif
+    return -1;
+}
+
+static int statAdd(BenchStat *st, double seconds)
+{
+    if (st->count == st->alloc)
+    {
+        size_t nalloc = st->alloc ? st->alloc * 2 : 256;
+        double *p = (double *)realloc(st->samples, nalloc * sizeof(double));
+        if (!p)
+            return 0;
+        st->samples = p;
+        st->alloc = nalloc;
+    }
+    st->samples[st->count++] = seconds;
+    return 1;
+}
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double statPercentile(BenchStat *st, double pct)
+{
+    size_t idx;
+    if (st->count == 0)
+        return 0.0;
+    idx = (size_t)(pct / 100.0 * (double)(st->count - 1) + 0.5);
+    return st->samples[idx];
+}
+
+static void emitStat(FILE *out, const char *name, BenchStat *st)
+{
+    double mbps = st->total > 0 ? (double)st->bytes / 1e6 / st->total : 0.0;
+    qsort(st->samples, st->count, sizeof(double), cmpDouble);
+    fprintf(out,
+            "\"%s\": {\"mb_per_s\": %.3f, \"p50_ms\": %.4f, "
+            "\"p99_ms\": %.4f, \"ops\": %lu}",
+            name, mbps, statPercentile(st, 50.0) * 1e3,
+            statPercentile(st, 99.0) * 1e3, (unsigned long)st->count);
+}
+
+/*
+ * Synthetic content: a smooth diagonal gradient with a little LCG noise, so
+ * that codecs and predictors see something between "all zero" and "random".
+ */
+static uint32_t lcgState = 0x12345678u;
+
+static uint32_t lcgNext(void)
+{
+    lcgState = lcgState * 1664525u + 1013904223u;
+    return lcgState >> 16;
+}
+
+static void kindLayout(int kind, uint16_t *spp, uint16_t *bps,
+                       uint16_t *photometric, uint16_t *format)
+{
+    *spp = 1;
+    *bps = 8;
+    *format = SAMPLEFORMAT_UINT;
+    switch (kind)
+    {
+        case KIND_RGB:
+            *spp = 3;
+            *photometric = PHOTOMETRIC_RGB;
+            break;
+        case KIND_FLOAT:
+            *bps = 32;
+            *format = SAMPLEFORMAT_IEEEFP;
+            *photometric = PHOTOMETRIC_MINISBLACK;
+            break;
+        case KIND_PALETTE:
+            *photometric = PHOTOMETRIC_PALETTE;
+            break;
+        case KIND_BILEVEL:
+            *bps = 1;
+            *photometric = PHOTOMETRIC_MINISWHITE;
+            break;
+        case KIND_GRAY16:
+            *bps = 16;
+            *photometric = PHOTOMETRIC_MINISBLACK;
+            break;
+        default:
+            *photometric = PHOTOMETRIC_MINISBLACK;
+            break;
+    }
+}
+
+static uint8_t *makeImage(int kind, uint32_t size, tmsize_t *rowbytes)
+{
+    uint16_t spp, bps, photometric, format;
+    uint64_t stride, total;
+    uint8_t *img;
+    uint32_t x, y;
+
+    kindLayout(kind, &spp, &bps, &photometric, &format);
+    stride = ((uint64_t)size * spp * bps + 7) / 8;
+    total = stride * size;
+    if (total != (uint64_t)(size_t)total)
+        return NULL;
+    img = (uint8_t *)malloc((size_t)total);
+    if (!img)
+        return NULL;
+    for (y = 0; y < size; y++)
+    {
+        uint8_t *row = img + stride * y;
+        if (kind == KIND_BILEVEL)
+        {
+            memset(row, 0, (size_t)stride);
+            for (x = 0; x < size; x++)
+                if (((x / 16 + y / 16) & 1) || (lcgNext() & 0xff) == 0)
+                    row[x >> 3] |= (uint8_t)(0x80 >> (x & 7));
+        }
+        else if (kind == KIND_FLOAT)
+        {
+            float *f = (float *)row;
+            for (x = 0; x < size; x++)
+                f[x] = (float)(x + y) * 0.25f + (float)(lcgNext() & 7) / 8.f;
+        }
+        else if (kind == KIND_GRAY16)
+        {
+            /* 12 significant bits, as from medical scanners */
+            uint16_t *s = (uint16_t *)row;
+            for (x = 0; x < size; x++)
+                s[x] = (uint16_t)(((x + y) * 4 + (lcgNext() & 15)) & 0xfff);
+        }
+        else
+        {
+            for (x = 0; x < size * spp; x++)
+                row[x] = (uint8_t)(((x / spp) + y) + (lcgNext() & 3));
+        }
+    }
+    *rowbytes = (tmsize_t)stride;
+    return img;
+}
+
+static int combinationValid(int kind, const BenchCodec *codec,
+                            uint16_t predictor)
+{
+    switch (codec->scheme)
+    {
+        case COMPRESSION_CCITTFAX3:
+        case COMPRESSION_CCITTFAX4:
+            return kind == KIND_BILEVEL && predictor == PREDICTOR_NONE;
+        case COMPRESSION_JPEG:
+            return (kind == KIND_GRAY || kind == KIND_RGB) &&
+                   predictor == PREDICTOR_NONE;
+        case COMPRESSION_WEBP:
+            return kind == KIND_RGB && predictor == PREDICTOR_NONE;
+        case COMPRESSION_JPEGLS:
+            return kind != KIND_FLOAT && predictor == PREDICTOR_NONE;
+        case COMPRESSION_LERC:
+            return kind != KIND_BILEVEL && kind != KIND_PALETTE &&
+                   predictor == PREDICTOR_NONE;
+        case COMPRESSION_LZW:
+        case COMPRESSION_ADOBE_DEFLATE:
+        case COMPRESSION_LZMA:
+        case COMPRESSION_ZSTD:
+        case COMPRESSION_LZ4:
+            if (predictor == PREDICTOR_FLOATINGPOINT)
+                return kind == KIND_FLOAT;
+            if (predictor == PREDICTOR_HORIZONTAL)
+                return kind != KIND_BILEVEL;
+            return 1;
+        default:
+            return predictor == PREDICTOR_NONE;
+    }
+}
+
+/*
+ * Codecs with a compression level, and the levels they accept: ZIP with
+ * libdeflate (zlib stops at 9), LZMA presets, ZSTD and the LZ4
+ * acceleration factor.  LEVEL_DEFAULT leaves the codec default.
+ */
+#define LEVEL_DEFAULT (-1)
+#define LEVEL_MAX 65537
+
+static int levelRange(const BenchCodec *codec, int *lo, int *hi)
+{
+    switch (codec->scheme)
+    {
+        case COMPRESSION_ADOBE_DEFLATE:
+            *lo = 1;
+            *hi = 12;
+            return 1;
+        case COMPRESSION_LZMA:
+            *lo = 0;
+            *hi = 9;
+            return 1;
+        case COMPRESSION_ZSTD:
+            *lo = 1;
+            *hi = 22;
+            return 1;
+        case COMPRESSION_LZ4:
+            *lo = 1;
+            *hi = LEVEL_MAX;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int codecHasLevel(const BenchCodec *codec)
+{
+    int lo, hi;
+    return levelRange(codec, &lo, &hi);
+}
+
+static void setLevel(TIFF *tif, const BenchCodec *codec, int level)
+{
+    if (level == LEVEL_DEFAULT)
+        return;
+    switch (codec->scheme)
+    {
+        case COMPRESSION_ADOBE_DEFLATE:
+            TIFFSetField(tif, TIFFTAG_ZIPQUALITY, level);
+            break;
+        case COMPRESSION_LZMA:
+            TIFFSetField(tif, TIFFTAG_LZMAPRESET, level);
+            break;
+        case COMPRESSION_ZSTD:
+            TIFFSetField(tif, TIFFTAG_ZSTD_LEVEL, level);
+            break;
+        case COMPRESSION_LZ4:
+            TIFFSetField(tif, TIFFTAG_LZ4_LEVEL, level);
+            break;
+        default:
+            break;
+    }
+}
+
+static void tmpName(const BenchConfig *cfg, char *buf, size_t len)
+{
+    snprintf(buf, len, "%s/tiffbench-%ld.tif", cfg->tmpdir,
+#ifdef HAVE_UNISTD_H
+             (long)getpid()
+#else
+             0L
+#endif
+    );
+}
+
+static int writeImage(const char *path, int kind, int tiled, uint32_t size,
+                      const BenchConfig *cfg, const BenchCodec *codec,
+                      int level, uint16_t predictor, int threads,
+                      const uint8_t *img, tmsize_t rowbytes, BenchStat *st)
+{
+    uint16_t spp, bps, photometric, format;
+    TIFF *tif;
+    uint8_t *buf = NULL;
+    double t0 = now();
+    int ok = 1;
+
+    kindLayout(kind, &spp, &bps, &photometric, &format);
+    if (codec->scheme == COMPRESSION_JPEG && kind == KIND_RGB)
+        photometric = PHOTOMETRIC_YCBCR;
+
+    tif = TIFFOpen(path, size >= 16384 ? "w8" : "w");
+    if (!tif)
+        return 0;
+    TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, size);
+    TIFFSetField(tif, TIFFTAG_IMAGELENGTH, size);
+    TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp);
+    TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps);
+    TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, format);
+    TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
+    TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, photometric);
+    TIFFSetField(tif, TIFFTAG_COMPRESSION, codec->scheme);
+    setLevel(tif, codec, level);
+    /* zstd and lzma compress a large strip or tile with several threads */
+    if (codec->scheme == COMPRESSION_ZSTD && threads > 1)
+        TIFFSetField(tif, TIFFTAG_ZSTD_WORKERS, threads);
+    if (codec->scheme == COMPRESSION_LZMA && threads > 1)
+        TIFFSetField(tif, TIFFTAG_LZMATHREADS, threads);
+    if (predictor != PREDICTOR_NONE)
+        TIFFSetField(tif, TIFFTAG_PREDICTOR, predictor);
+    if (photometric == PHOTOMETRIC_YCBCR)
+        TIFFSetField(tif, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+    if (kind == KIND_PALETTE)
+    {
+        uint16_t cmap[3][256];
+        int i;
+        for (i = 0; i < 256; i++)
+        {
+            cmap[0][i] = (uint16_t)(i * 257);
+            cmap[1][i] = (uint16_t)((255 - i) * 257);
+            cmap[2][i] = (uint16_t)((i ^ 0x55) * 257);
+        }
+        TIFFSetField(tif, TIFFTAG_COLORMAP, cmap[0], cmap[1], cmap[2]);
+    }
+
+    if (tiled)
+    {
+        const uint32_t tilesize = cfg->tilesize;
+        uint32_t tx, ty, r;
+        tmsize_t tilebytes;
+        TIFFSetField(tif, TIFFTAG_TILEWIDTH, tilesize);
+        TIFFSetField(tif, TIFFTAG_TILELENGTH, tilesize);
+        tilebytes = TIFFTileSize(tif);
+        buf = (uint8_t *)malloc((size_t)tilebytes);
+        if (!buf)
+            ok = 0;
+        for (ty = 0; ok && ty < size; ty += tilesize)
+        {
+            for (tx = 0; ok && tx < size; tx += tilesize)
+            {
+                tmsize_t tilerow = tilebytes / tilesize;
+                uint64_t xoff = ((uint64_t)tx * spp * bps) / 8;
+                tmsize_t ncopy = tilerow;
+                double s;
+                if (xoff + (uint64_t)ncopy > (uint64_t)rowbytes)
+                    ncopy = rowbytes - (tmsize_t)xoff;
+                memset(buf, 0, (size_t)tilebytes);
+                for (r = 0; r < tilesize && ty + r < size; r++)
+                    memcpy(buf + r * tilerow,
+                           img + (uint64_t)(ty + r) * rowbytes + xoff,
+                           (size_t)ncopy);
+                s = now();
+                if (TIFFWriteTile(tif, buf, tx, ty, 0, 0) < 0)
+                    ok = 0;
+                ok &= statAdd(st, now() - s);
+                st->bytes += (uint64_t)tilebytes;
+            }
+        }
+    }
+    else
+    {
+        uint32_t rps = cfg->rowsperstrip ? cfg->rowsperstrip
+                                         : TIFFDefaultStripSize(tif, 0);
+        uint32_t strip, nstrips;
+        TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rps);
+        nstrips = TIFFNumberOfStrips(tif);
+        for (strip = 0; ok && strip < nstrips; strip++)
+        {
+            uint32_t row = strip * rps;
+            uint32_t nrows = size - row < rps ? size - row : rps;
+            tmsize_t cc = rowbytes * (tmsize_t)nrows;
+            double s = now();
+            if (TIFFWriteEncodedStrip(tif, strip,
+                                      (void *)(img + (uint64_t)row * rowbytes),
+                                      cc) < 0)
+                ok = 0;
+            ok &= statAdd(st, now() - s);
+            st->bytes += (uint64_t)cc;
+        }
+    }
+    free(buf);
+    TIFFClose(tif);
+    st->total += now() - t0;
+    return ok;
+}
+
+static int readImage(const char *path, int threads, BenchStat *st)
+{
+    TIFF *tif = TIFFOpen(path, "r");
+    uint8_t *buf;
+    tmsize_t bufsize;
+    uint32_t i, n;
+    double t0;
+    int ok = 1;
+
+    if (!tif)
+        return 0;
+    TIFFSetThreadCount(tif, threads);
+    if (TIFFIsCODECConfigured(COMPRESSION_LZMA) && threads > 1)
+    {
+        uint16_t scheme = COMPRESSION_NONE;
+        TIFFGetField(tif, TIFFTAG_COMPRESSION, &scheme);
+        if (scheme == COMPRESSION_LZMA)
+            TIFFSetField(tif, TIFFTAG_LZMATHREADS, threads);
+    }
+    bufsize = TIFFIsTiled(tif) ? TIFFTileSize(tif) : TIFFStripSize(tif);
+    n = TIFFIsTiled(tif) ? TIFFNumberOfTiles(tif) : TIFFNumberOfStrips(tif);
+    buf = (uint8_t *)malloc((size_t)bufsize);
+    if (!buf)
+    {
+        TIFFClose(tif);
+        return 0;
+    }
+    t0 = now();
+    for (i = 0; ok && i < n; i++)
+    {
+        double s = now();
+        tmsize_t got = TIFFIsTiled(tif)
+                           ? TIFFReadEncodedTile(tif, i, buf, bufsize)
+                           : TIFFReadEncodedStrip(tif, i, buf, bufsize);
+        if (got < 0)
+            ok = 0;
+        else
+            st->bytes += (uint64_t)got;
+        ok &= statAdd(st, now() - s);
+    }
+    st->total += now() - t0;
+    free(buf);
+    TIFFClose(tif);
+    return ok;
+}
+
+static int readRGBA(const char *path, int threads, uint32_t size,
+                    BenchStat *st)
+{
+    TIFF *tif = TIFFOpen(path, "r");
+    uint32_t *raster;
+    double s;
+    int ok;
+
+    if (!tif)
+        return 0;
+    TIFFSetThreadCount(tif, threads);
+    raster = (uint32_t *)malloc((size_t)size * size * sizeof(uint32_t));
+    if (!raster)
+    {
+        TIFFClose(tif);
+        return 0;
+    }
+    s = now();
+    ok = TIFFReadRGBAImage(tif, size, size, raster, 1);
+    s = now() - s;
+    st->total += s;
+    st->bytes += (uint64_t)size * size * sizeof(uint32_t);
+    ok &= statAdd(st, s);
+    free(raster);
+    TIFFClose(tif);
+    return ok;
+}
+
+static uint64_t fileSize(const char *path)
+{
+    FILE *fp = fopen(path, "rb");
+    long sz;
+    if (!fp)
+        return 0;
+    if (fseek(fp, 0, SEEK_END) != 0)
+    {
+        fclose(fp);
+        return 0;
+    }
+    sz = ftell(fp);
+    fclose(fp);
+    return sz < 0 ? 0 : (uint64_t)sz;
+}
+
+static int runCase(FILE *out, const BenchConfig *cfg, int *first, int kind,
+                   int tiled, uint32_t size, const BenchCodec *codec,
+                   int level, uint16_t predictor, int threads,
+                   const uint8_t *img, tmsize_t rowbytes)
+{
+    char path[1024];
+    BenchStat wr = {0}, rd = {0}, rgba = {0};
+    int doRGBA = kind != KIND_FLOAT &&
+                 (uint64_t)size * size * 4 <= MAX_RGBA_BYTES;
+    int ok = 1;
+    int it;
+
+    tmpName(cfg, path, sizeof(path));
+    for (it = 0; ok && it < cfg->iterations; it++)
+        ok = writeImage(path, kind, tiled, size, cfg, codec, level, predictor,
+                        threads, img, rowbytes, &wr);
+    for (it = 0; ok && it < cfg->iterations; it++)
+        ok = readImage(path, threads, &rd);
+    for (it = 0; ok && doRGBA && it < cfg->iterations; it++)
+        ok = readRGBA(path, threads, size, &rgba);
+
+    fprintf(out, "%s\n    {\"kind\": \"%s\", \"layout\": \"%s\", ",
+            *first ? "" : ",", kindNames[kind], tiled ? "tile" : "strip");
+    fprintf(out, "\"size\": %" PRIu32 ", \"codec\": \"%s\", \"level\": ", size,
+            codec->name);
+    if (level == LEVEL_DEFAULT)
+        fprintf(out, "null, ");
+    else
+        fprintf(out, "%d, ", level);
+    fprintf(out, "\"predictor\": %u, \"threads\": %d, \"ok\": %s, ",
+            (unsigned)predictor, threads, ok ? "true" : "false");
+    fprintf(out, "\"raw_bytes\": %" PRIu64 ", \"file_bytes\": %" PRIu64 ", ",
+            (uint64_t)rowbytes * size, fileSize(path));
+    emitStat(out, "write", &wr);
+    fprintf(out, ", ");
+    emitStat(out, "read", &rd);
+    if (doRGBA)
+    {
+        fprintf(out, ", ");
+        emitStat(out, "rgba", &rgba);
+    }
+    fprintf(out, ", \"max_rss_kib\": %ld}", maxRSSKiB());
+    fflush(out);
+    *first = 0;
+
+    remove(path);
+    free(wr.samples);
+    free(rd.samples);
+    free(rgba.samples);
+    return ok;
+}
+
+static const char usageMsg[] =
+    "usage: tiffbench [options]\n"
+    "  -s sizes      comma separated image sizes in pixels (default "
+    "256,1024)\n"
+    "  -k kinds      gray,rgb,float,palette,bilevel,gray16 (default all)\n"
+    "  -l layouts    strip,tile (default both)\n"
+    "  -c codecs     codec names (default every configured codec)\n"
+    "  -L levels     comma separated compression levels of zip (1-12), "
+    "lzma (0-9),\n"
+    "                zstd (1-22) and lz4 (1-65537), each codec skipping "
+    "the levels\n"
+    "                out of its range (default: the codec default)\n"
+    "  -p predictors comma separated predictor values (default 1,2,3)\n"
+    "  -t threads    comma separated thread counts, for decoding and zstd\n"
+    "                and lzma compression (default 1)\n"
+    "  -n count      iterations per case (default 3)\n"
+    "  -T size       tile width and length (default 256)\n"
+    "  -r rows       rows per strip, 0 for the whole image (default: "
+    "about 8 KiB\n"
+    "                strips)\n"
+    "  -d dir        directory for temporary files (default .)\n"
+    "  -o file       write JSON to file instead of stdout\n";
+
+static void usage(int code)
+{
+    fprintf(code == EXIT_SUCCESS ? stdout : stderr, "%s", usageMsg);
+    exit(code);
+}
+
+static long parseLong(const char *s, long lo, long hi)
+{
+    char *end = NULL;
+    long v;
+    errno = 0;
+    v = strtol(s, &end, 10);
+    if (errno != 0 || end == s || *end != '\0' || v < lo || v > hi)
+    {
+        fprintf(stderr, "tiffbench: invalid value '%s' (range %ld..%ld)\n",
+                s, lo, hi);
+        exit(EXIT_FAILURE);
+    }
+    return v;
+}
+
+/* Split a comma separated list in place, calling fn on each token. */
+typedef void (*TokenFn)(BenchConfig *, const char *);
+
+static void forEachToken(BenchConfig *cfg, char *list, TokenFn fn)
+{
+    char *tok = strtok(list, ",");
+    while (tok)
+    {
+        fn(cfg, tok);
+        tok = strtok(NULL, ",");
+    }
+}
+
+static void addSize(BenchConfig *cfg, const char *s)
+{
+    if (cfg->nsizes < MAX_LIST)
+        cfg->sizes[cfg->nsizes++] =
+            (uint32_t)parseLong(s, MIN_SIZE, MAX_SIZE);
+}
+
+static void addKind(BenchConfig *cfg, const char *s)
+{
+    int k;
+    for (k = 0; k <= KIND_GRAY16; k++)
+    {
+        if (streq(s, kindNames[k]))
+        {
+            if (cfg->nkinds < MAX_LIST)
+                cfg->kinds[cfg->nkinds++] = k;
+            return;
+        }
+    }
+    fprintf(stderr, "tiffbench: unknown image kind '%s'\n", s);
+    exit(EXIT_FAILURE);
+}
+
+static void addLayout(BenchConfig *cfg, const char *s)
+{
+    if (cfg->nlayouts >= 2)
+        return;
+    if (streq(s, "strip"))
+        cfg->tiled[cfg->nlayouts++] = 0;
+    else if (streq(s, "tile"))
+        cfg->tiled[cfg->nlayouts++] = 1;
+    else
+    {
+        fprintf(stderr, "tiffbench: unknown layout '%s'\n", s);
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void addCodec(BenchConfig *cfg, const char *s)
+{
+    const BenchCodec *c;
+    for (c = benchCodecs; c->name; c++)
+    {
+        if (streq(s, c->name))
+        {
+            if (!TIFFIsCODECConfigured(c->scheme))
+            {
+                fprintf(stderr, "tiffbench: codec '%s' is not configured\n",
+                        s);
+                exit(EXIT_FAILURE);
+            }
+            if (cfg->ncodecs < MAX_LIST)
+                cfg->codecs[cfg->ncodecs++] = c;
+            return;
+        }
+    }
+    fprintf(stderr, "tiffbench: unknown codec '%s'\n", s);
+    exit(EXIT_FAILURE);
+}
+
+static void addPredictor(BenchConfig *cfg, const char *s)
+{
+    if (cfg->npredictors < MAX_LIST)
+        cfg->predictors[cfg->npredictors++] = (uint16_t)parseLong(s, 1, 3);
+}
+
+static void addThreads(BenchConfig *cfg, const char *s)
+{
+    if (cfg->nthreads < MAX_LIST)
+        cfg->threads[cfg->nthreads++] = (int)parseLong(s, 1, 1024);
+}
+
+static void addLevel(BenchConfig *cfg, const char *s)
+{
+    if (cfg->nlevels < MAX_LIST)
+        cfg->levels[cfg->nlevels++] = (int)parseLong(s, 0, LEVEL_MAX);
+}
+
+/* Whether level can be run with codec: codecs without levels run once. */
+static int levelValid(const BenchCodec *codec, int level)
+{
+    int lo, hi;
+
+    if (!levelRange(codec, &lo, &hi))
+        return 1;
+    return level >= lo && level <= hi;
+}
+
+/* Tell which codec and level pairs are skipped as out of range. */
+static void checkLevels(const BenchConfig *cfg)
+{
+    int ci, vi, lo, hi;
+
+    for (ci = 0; ci < cfg->ncodecs; ci++)
+    {
+        if (!levelRange(cfg->codecs[ci], &lo, &hi))
+            continue;
+        for (vi = 0; vi < cfg->nlevels; vi++)
+        {
+            if (!levelValid(cfg->codecs[ci], cfg->levels[vi]))
+                fprintf(stderr,
+                        "tiffbench: skipping level %d, out of the %d..%d "
+                        "range of %s\n",
+                        cfg->levels[vi], lo, hi, cfg->codecs[ci]->name);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchConfig cfg;
+    FILE *out = stdout;
+    const char *outname = NULL;
+    int first = 1;
+    int failures = 0;
+    int c, si, ki, li, ci, vi, pi, ti;
+
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.iterations = 3;
+    cfg.tilesize = 256;
+    cfg.tmpdir = ".";
+
+    while ((c = getopt(argc, argv, "s:k:l:c:L:p:t:n:T:r:d:o:h")) != -1)
+    {
+        switch (c)
+        {
+            case 's':
+                forEachToken(&cfg, optarg, addSize);
+                break;
+            case 'k':
+                forEachToken(&cfg, optarg, addKind);
+                break;
+            case 'l':
+                forEachToken(&cfg, optarg, addLayout);
+                break;
+            case 'c':
+                forEachToken(&cfg, optarg, addCodec);
+                break;
+            case 'L':
+                forEachToken(&cfg, optarg, addLevel);
+                break;
+            case 'p':
+                forEachToken(&cfg, optarg, addPredictor);
+                break;
+            case 't':
+                forEachToken(&cfg, optarg, addThreads);
+                break;
+            case 'n':
+                cfg.iterations = (int)parseLong(optarg, 1, 1000);
+                break;
+            case 'T':
+                cfg.tilesize = (uint32_t)parseLong(optarg, 16, 8192);
+                if (cfg.tilesize % 16 != 0)
+                {
+                    fprintf(stderr,
+                            "tiffbench: tile size must be a multiple of 16\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'r':
+                cfg.rowsperstrip = (uint32_t)parseLong(optarg, 0, MAX_SIZE);
+                if (cfg.rowsperstrip == 0)
+                    cfg.rowsperstrip = MAX_SIZE;
+                break;
+            case 'd':
+                cfg.tmpdir = optarg;
+                break;
+            case 'o':
+                outname = optarg;
+                break;
+            case 'h':
+                usage(EXIT_SUCCESS);
+                break;
+            default:
+                usage(EXIT_FAILURE);
+        }
+    }
+    if (optind != argc)
+        usage(EXIT_FAILURE);
+
+    if (cfg.nsizes == 0)
+    {
+        cfg.sizes[cfg.nsizes++] = 256;
+        cfg.sizes[cfg.nsizes++] = 1024;
+    }
+    if (cfg.nkinds == 0)
+        for (ki = 0; ki <= KIND_GRAY16; ki++)
+            cfg.kinds[cfg.nkinds++] = ki;
+    if (cfg.nlayouts == 0)
+    {
+        cfg.tiled[cfg.nlayouts++] = 0;
+        cfg.tiled[cfg.nlayouts++] = 1;
+    }
+    if (cfg.ncodecs == 0)
+    {
+        const BenchCodec *bc;
+        for (bc = benchCodecs; bc->name && cfg.ncodecs < MAX_LIST; bc++)
+            if (TIFFIsCODECConfigured(bc->scheme))
+                cfg.codecs[cfg.ncodecs++] = bc;
+    }
+    if (cfg.npredictors == 0)
+    {
+        cfg.predictors[cfg.npredictors++] = PREDICTOR_NONE;
+        cfg.predictors[cfg.npredictors++] = PREDICTOR_HORIZONTAL;
+        cfg.predictors[cfg.npredictors++] = PREDICTOR_FLOATINGPOINT;
+    }
+    if (cfg.nthreads == 0)
+        cfg.threads[cfg.nthreads++] = 1;
+    if (cfg.nlevels == 0)
+        cfg.levels[cfg.nlevels++] = LEVEL_DEFAULT;
+    else
+        checkLevels(&cfg);
+
+    if (outname)
+    {
+        out = fopen(outname, "w");
+        if (!out)
+        {
+            fprintf(stderr, "tiffbench: cannot create %s: %s\n", outname,
+                    strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+
+    fprintf(out, "{\n  \"tool\": \"tiffbench\",\n  \"libtiff\": \"");
+    {
+        /* The version string is multi-line; keep only the first line. */
+        const char *v = TIFFGetVersion();
+        while (*v && *v != '\n')
+        {
+            if (*v == '"' || *v == '\\')
+                fputc('\\', out);
+            fputc(*v++, out);
+        }
+    }
+    fprintf(out, "\",\n  \"iterations\": %d,\n  \"results\": [", cfg.iterations);
+
+    for (ki = 0; ki < cfg.nkinds; ki++)
+    {
+        for (si = 0; si < cfg.nsizes; si++)
+        {
+            tmsize_t rowbytes = 0;
+            uint8_t *img = makeImage(cfg.kinds[ki], cfg.sizes[si], &rowbytes);
+            if (!img)
+            {
+                fprintf(stderr,
+                        "tiffbench: cannot allocate %s image of %" PRIu32
+                        " px\n",
+                        kindNames[cfg.kinds[ki]], cfg.sizes[si]);
+                failures++;
+                continue;
+            }
+            for (li = 0; li < cfg.nlayouts; li++)
+                for (ci = 0; ci < cfg.ncodecs; ci++)
+                    for (vi = 0; vi < cfg.nlevels; vi++)
+                    {
+                        const int level = codecHasLevel(cfg.codecs[ci])
+                                              ? cfg.levels[vi]
+                                              : LEVEL_DEFAULT;
+                        /* Levels don't apply: a single run */
+                        if (level == LEVEL_DEFAULT && vi > 0)
+                            break;
+                        if (level != LEVEL_DEFAULT &&
+                            !levelValid(cfg.codecs[ci], level))
+                            continue;
+                        for (pi = 0; pi < cfg.npredictors; pi++)
+                        {
+                            if (!combinationValid(cfg.kinds[ki],
+                                                  cfg.codecs[ci],
+                                                  cfg.predictors[pi]))
+                                continue;
+                            for (ti = 0; ti < cfg.nthreads; ti++)
+                                if (!runCase(out, &cfg, &first, cfg.kinds[ki],
+                                             cfg.tiled[li], cfg.sizes[si],
+                                             cfg.codecs[ci], level,
+                                             cfg.predictors[pi],
+                                             cfg.threads[ti], img, rowbytes))
+                                    failures++;
+                        }
+                    }
+            free(img);
+        }
+    }
+
+    fprintf(out, "\n  ],\n  \"failures\": %d\n}\n", failures);
+    if (out != stdout)
+        fclose(out);
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -88,13 +88,35 @@ static int ignore = FALSE; /* if true, ignore read errors */
 static uint32_t defg3opts = (uint32_t)-1;
 static int quality = 75; /* JPEG quality */
 static int jpeg_photometric = PHOTOMETRIC_YCBCR;
+static int jpeg_lossless = 0; /* lossless JPEG predictor, 0 for DCT */
 static uint16_t defcompression = (uint16_t)-1;
 static uint16_t defpredictor = (uint16_t)-1;
 static int defpreset = -1;
 static int subcodec = -1;
+static int zstddictsize = 0; /* size of the ZSTD dictionary to train */
+static int lzmathreads = 0;  /* LZMA2 compression threads */
+static int lz4hc = FALSE;    /* LZ4 high compression mode */
+
+/* -O cog: directories and strile arrays first, then the image data */
+static int coglayout = FALSE;
+static int cogghost = FALSE; /* -O cog:ghost */
+
+/* Image copied into each output directory, for the data pass of the
+ * cloud optimized layout */
+typedef struct
+{
+    char *filename;
+    uint64_t diroff;
+} cogSource;
+static cogSource *cogsources = NULL;
+static tdir_t ncogsources = 0;
 
 static int tiffcp(TIFF *, TIFF *);
 static int processCompressOptions(char *);
+static int processLayoutOptions(char *);
+static int cogAddSource(TIFF *);
+static int cogWriteGhostArea(TIFF *);
+static int cogWriteData(TIFF *);
 static void usage(int code);
 
 static char comma = ','; /* (default) comma separator character */
@@ -221,7 +243,7 @@ int main(int argc, char *argv[])
 
     *mp++ = 'w';
     *mp = '\0';
-    while ((c = getopt(argc, argv, "m:,:b:c:f:l:o:p:r:w:aistBLMC8xh")) != -1)
+    while ((c = getopt(argc, argv, "m:,:b:c:f:l:o:p:r:w:O:aistBLMC8xh")) != -1)
         switch (c)
         {
             case 'm':
@@ -283,6 +305,10 @@ int main(int argc, char *argv[])
             case 'o': /* initial directory offset */
                 diroff = strtoul(optarg, NULL, 0);
                 break;
+            case 'O': /* output file layout */
+                if (!processLayoutOptions(optarg))
+                    usage(EXIT_FAILURE);
+                break;
             case 'p': /* planar configuration */
                 if (streq(optarg, "separate"))
                     defconfig = PLANARCONFIG_SEPARATE;
@@ -353,6 +379,11 @@ int main(int argc, char *argv[])
         }
     if (argc - optind < 2)
         usage(EXIT_FAILURE);
+    if (coglayout && mode[0] == 'a')
+    {
+        fprintf(stderr, "tiffcp: -O cog cannot be used with -a\n");
+        return (EXIT_FAILURE);
+    }
     TIFFOpenOptions *opts = TIFFOpenOptionsAlloc();
     if (opts == NULL)
     {
@@ -363,6 +394,11 @@ int main(int argc, char *argv[])
     TIFFOpenOptionsFree(opts);
     if (out == NULL)
         return (EXIT_FAILURE);
+    if (cogghost && !cogWriteGhostArea(out))
+    {
+        (void)TIFFClose(out);
+        return (EXIT_FAILURE);
+    }
     if ((argc - optind) == 2)
         pageNum = -1;
     for (; optind < argc - 1; optind++)
@@ -393,7 +429,8 @@ int main(int argc, char *argv[])
             tilewidth = deftilewidth;
             tilelength = deftilelength;
             g3opts = defg3opts;
-            if (!tiffcp(in, out) || !TIFFWriteDirectory(out))
+            if (!tiffcp(in, out) || !TIFFWriteDirectory(out) ||
+                (coglayout && !cogAddSource(in)))
             {
                 (void)TIFFClose(in);
                 (void)TIFFClose(out);
@@ -410,10 +447,26 @@ int main(int argc, char *argv[])
         (void)TIFFClose(in);
     }
 
+    if (coglayout && !cogWriteData(out))
+    {
+        (void)TIFFClose(out);
+        return (EXIT_FAILURE);
+    }
     (void)TIFFClose(out);
     return (EXIT_SUCCESS);
 }
 
+static int processLayoutOptions(char *opt)
+{
+    if (streq(opt, "cog"))
+        coglayout = TRUE;
+    else if (streq(opt, "cog:ghost"))
+        coglayout = cogghost = TRUE;
+    else
+        return (0);
+    return (1);
+}
+
 static void processZIPOptions(char *cp)
 {
     if ((cp = strchr(cp, ':')))
@@ -427,6 +480,12 @@ static void processZIPOptions(char *cp)
                 defpreset = atoi(++cp);
             else if (*cp == 's')
                 subcodec = atoi(++cp);
+            else if (*cp == 'd')
+                zstddictsize = atoi(++cp);
+            else if (*cp == 't')
+                lzmathreads = atoi(++cp);
+            else if (*cp == 'h')
+                lz4hc = TRUE;
             else
                 usage(EXIT_FAILURE);
         } while ((cp = strchr(cp, ':')));
@@ -483,6 +542,10 @@ static int processCompressOptions(char *opt)
     {
         defcompression = COMPRESSION_PACKBITS;
     }
+    else if (streq(opt, "jpegls"))
+    {
+        defcompression = COMPRESSION_JPEGLS;
+    }
     else if (strneq(opt, "jpeg", 4))
     {
         char *cp = strchr(opt, ':');
@@ -494,6 +557,8 @@ static int processCompressOptions(char *opt)
                 quality = atoi(cp + 1);
             else if (cp[1] == 'r')
                 jpeg_photometric = PHOTOMETRIC_RGB;
+            else if (cp[1] == 'l')
+                jpeg_lossless = isdigit((int)cp[2]) ? atoi(cp + 2) : 1;
             else
                 usage(EXIT_FAILURE);
 
@@ -536,6 +601,11 @@ static int processCompressOptions(char *opt)
         processZIPOptions(opt);
         defcompression = COMPRESSION_ZSTD;
     }
+    else if (strneq(opt, "lz4", 3))
+    {
+        processZIPOptions(opt);
+        defcompression = COMPRESSION_LZ4;
+    }
     else if (strneq(opt, "webp", 4))
     {
         processZIPOptions(opt);
@@ -560,6 +630,10 @@ static const char usage_info[] =
     "where options are:\n"
     " -a              append to output instead of overwriting\n"
     " -o offset       set initial directory offset\n"
+    " -O cog          write a cloud optimized layout: all directories and\n"
+    "                 their strip/tile arrays first, then the image data\n"
+    " -O cog:ghost    same, with a ghost area describing the layout after the\n"
+    "                 header, as written by GDAL\n"
     " -p contig       pack samples contiguously (e.g. RGBRGB...)\n"
     " -p separate     store samples separately (e.g. RRR...GGG...BBB...)\n"
     " -s              write output in strips\n"
@@ -624,12 +698,21 @@ static const char usage_info[] =
     /* "    LZMA options:", */
     "    #            set predictor value\n"
     "    p#           set compression level (preset)\n"
+    "    t#           compress each strip or tile with # threads\n"
 #endif
 #ifdef ZSTD_SUPPORT
     " -c zstd[:opts]  compress output with ZSTD encoding\n"
     /* "    ZSTD options:", */
     "    #            set predictor value\n"
     "    p#           set compression level (preset)\n"
+    "    d#           train a dictionary of # bytes on the first tiles\n"
+#endif
+#ifdef LZ4_SUPPORT
+    " -c lz4[:opts]   compress output with LZ4 encoding\n"
+    /* "    LZ4 options:", */
+    "    #            set predictor value\n"
+    "    p#           set acceleration (fast mode) or level (HC mode)\n"
+    "    h            use the high compression (HC) mode\n"
 #endif
 #ifdef WEBP_SUPPORT
     " -c webp[:opts]  compress output with WEBP encoding\n"
@@ -642,9 +725,13 @@ static const char usage_info[] =
     /* "    JPEG options:", */
     "    #            set compression quality level (0-100, default 75)\n"
     "    r            output color image as RGB rather than YCbCr\n"
+    "    l[#]         lossless JPEG with predictor # (1-7, default 1)\n"
     "    For example, -c jpeg:r:50 for JPEG-encoded RGB with 50% comp. "
     "quality\n"
 #endif
+#ifdef JPEGLS_SUPPORT
+    " -c jpegls       compress output with lossless JPEG-LS encoding\n"
+#endif
 #ifdef JBIG_SUPPORT
     " -c jbig         compress output with ISO JBIG encoding\n"
 #endif
@@ -667,7 +754,8 @@ static const char usage_info[] =
 #if defined(LZW_SUPPORT) || defined(ZIP_SUPPORT) || defined(LZMA_SUPPORT) ||   \
     defined(ZSTD_SUPPORT) || defined(WEBP_SUPPORT) || defined(JPEG_SUPPORT) || \
     defined(JBIG_SUPPORT) || defined(PACKBITS_SUPPORT) ||                      \
-    defined(CCITT_SUPPORT) || defined(LOGLUV_SUPPORT) || defined(LERC_SUPPORT)
+    defined(CCITT_SUPPORT) || defined(LOGLUV_SUPPORT) ||                       \
+    defined(LERC_SUPPORT) || defined(LZ4_SUPPORT) || defined(JPEGLS_SUPPORT)
     " -c none         use no compression algorithm on output\n"
 #endif
     "\n"
@@ -869,7 +957,7 @@ static int tiffcp(TIFF *in, TIFF *out)
             return FALSE;
         }
     }
-    if (compression == COMPRESSION_JPEG)
+    if (compression == COMPRESSION_JPEG && !jpeg_lossless)
     {
         if (input_photometric == PHOTOMETRIC_RGB ||
             input_photometric == PHOTOMETRIC_YCBCR)
@@ -976,6 +1064,29 @@ static int tiffcp(TIFF *in, TIFF *out)
             /* For 3 sample images, the input data provided to libtiff is
              * always RGB, not YCbCr subsampled. */
             TIFFSetField(out, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+            /* Shared tables would only be known once data is encoded, and
+             * then would move the directory to the end of the file */
+            if (coglayout)
+            {
+                uint16_t photometric;
+                float *refbw;
+
+                TIFFSetField(out, TIFFTAG_JPEGTABLESMODE, 0);
+                /* Likewise for the ReferenceBlackWhite the codec adds to
+                 * YCbCr images when encoding starts */
+                if (TIFFGetField(out, TIFFTAG_PHOTOMETRIC, &photometric) &&
+                    photometric == PHOTOMETRIC_YCBCR &&
+                    !TIFFGetField(out, TIFFTAG_REFERENCEBLACKWHITE, &refbw))
+                {
+                    const float top = (float)(1L << bitspersample);
+                    const float ycbcrrefbw[6] = {0,       top - 1, top / 2,
+                                                 top - 1, top / 2, top - 1};
+                    TIFFSetField(out, TIFFTAG_REFERENCEBLACKWHITE,
+                                 ycbcrrefbw);
+                }
+            }
+            if (jpeg_lossless)
+                TIFFSetField(out, TIFFTAG_JPEGLOSSLESS, jpeg_lossless);
             break;
         case COMPRESSION_JBIG:
             CopyTag(TIFFTAG_FAXRECVPARAMS, 1, TIFF_LONG);
@@ -1023,13 +1134,15 @@ static int tiffcp(TIFF *in, TIFF *out)
         case COMPRESSION_DEFLATE:
         case COMPRESSION_LZMA:
         case COMPRESSION_ZSTD:
+        case COMPRESSION_LZ4:
             if (predictor != (uint16_t)-1)
                 TIFFSetField(out, TIFFTAG_PREDICTOR, predictor);
             else if (input_compression == COMPRESSION_LZW ||
                      input_compression == COMPRESSION_ADOBE_DEFLATE ||
                      input_compression == COMPRESSION_DEFLATE ||
                      input_compression == COMPRESSION_LZMA ||
-                     input_compression == COMPRESSION_ZSTD)
+                     input_compression == COMPRESSION_ZSTD ||
+                     input_compression == COMPRESSION_LZ4)
             {
                 CopyField(TIFFTAG_PREDICTOR, predictor);
             }
@@ -1045,6 +1158,31 @@ static int tiffcp(TIFF *in, TIFF *out)
                     }
                 }
             }
+            if (compression == COMPRESSION_ZSTD && zstddictsize > 0)
+            {
+                if (TIFFSetField(out, TIFFTAG_ZSTD_DICTSIZE, zstddictsize) !=
+                    1)
+                {
+                    return FALSE;
+                }
+            }
+            if (compression == COMPRESSION_LZMA && lzmathreads > 0)
+            {
+                if (TIFFSetField(out, TIFFTAG_LZMATHREADS, lzmathreads) != 1)
+                {
+                    return FALSE;
+                }
+            }
+            if (compression == COMPRESSION_LZ4)
+            {
+                if ((preset != -1 &&
+                     TIFFSetField(out, TIFFTAG_LZ4_LEVEL, preset) != 1) ||
+                    (lz4hc && TIFFSetField(out, TIFFTAG_LZ4_HC, 1) != 1))
+                {
+                    return FALSE;
+                }
+                break;
+            }
             /*fallthrough*/
         case COMPRESSION_WEBP:
             if (preset != -1)
@@ -1146,10 +1284,212 @@ static int tiffcp(TIFF *in, TIFF *out)
         CopyTag(p->tag, p->count, p->type);
     }
 
+    cf = pickCopyFunc(in, out, bitspersample, samplesperpixel);
+    if (cf && coglayout)
+    {
+        /* Only the directory for now, see cogWriteData() */
+        return (TIFFDeferStrileArrayWriting(out) &&
+                TIFFWriteCheck(out, TIFFIsTiled(out), "tiffcp"));
+    }
+    return (cf ? (*cf)(in, out, length, width, samplesperpixel) : FALSE);
+}
+
+/*
+ * Cloud optimized layout.
+ *
+ * tiffcp() first writes all the directories with deferred strip/tile arrays.
+ * cogWriteData() then reserves the arrays right after them, and copies the
+ * image data of each directory, rewriting its arrays in place.
+ */
+
+static int cogAddSource(TIFF *in)
+{
+    cogSource *sources;
+    char *filename;
+
+    sources = (cogSource *)realloc(cogsources,
+                                   (ncogsources + 1) * sizeof(cogSource));
+    if (sources == NULL)
+    {
+        fprintf(stderr, "tiffcp: Out of memory\n");
+        return (FALSE);
+    }
+    cogsources = sources;
+    filename = strdup(TIFFFileName(in));
+    if (filename == NULL)
+    {
+        fprintf(stderr, "tiffcp: Out of memory\n");
+        return (FALSE);
+    }
+    cogsources[ncogsources].filename = filename;
+    cogsources[ncogsources].diroff = TIFFCurrentDirOffset(in);
+    ncogsources++;
+    return (TRUE);
+}
+
+/*
+ * Describe the layout in a ghost area between the header and the first
+ * directory, as GDAL does for its COG files.
+ */
+static int cogWriteGhostArea(TIFF *out)
+{
+    static const char layout[] = "LAYOUT=IFDS_BEFORE_DATA\n"
+                                 "BLOCK_ORDER=ROW_MAJOR\n"
+                                 "KNOWN_INCOMPATIBLE_EDITION=NO\n"
+                                 " "; /* pad to an even size */
+    char ghost[128];
+    int len;
+
+    len = snprintf(ghost, sizeof(ghost),
+                   "GDAL_STRUCTURAL_METADATA_SIZE=%06d bytes\n%s",
+                   (int)strlen(layout), layout);
+    if (TIFFGetSeekProc(out)(TIFFClientdata(out), 0, SEEK_END) == (toff_t)-1 ||
+        TIFFGetWriteProc(out)(TIFFClientdata(out), ghost, len) != len)
+    {
+        TIFFError(TIFFFileName(out), "Error, writing ghost area");
+        return (FALSE);
+    }
+    return (TRUE);
+}
+
+/*
+ * Copy the image data of in into the current directory of out, written
+ * beforehand by tiffcp(). Only codec options are set, as changing tags
+ * would rewrite the directory at the end of the file.
+ */
+static int cogCopyData(TIFF *in, TIFF *out)
+{
+    uint16_t bitspersample = 1, samplesperpixel = 1;
+    uint16_t input_compression;
+    uint32_t width = 0, length = 0;
+    copyFunc cf;
+
+    TIFFGetField(in, TIFFTAG_IMAGEWIDTH, &width);
+    TIFFGetField(in, TIFFTAG_IMAGELENGTH, &length);
+    TIFFGetFieldDefaulted(in, TIFFTAG_BITSPERSAMPLE, &bitspersample);
+    TIFFGetFieldDefaulted(in, TIFFTAG_SAMPLESPERPIXEL, &samplesperpixel);
+    TIFFGetFieldDefaulted(in, TIFFTAG_COMPRESSION, &input_compression);
+    if (input_compression == COMPRESSION_JPEG)
+        TIFFSetField(in, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+
+    /* Settings picked by tiffcp() for this directory */
+    TIFFGetFieldDefaulted(out, TIFFTAG_COMPRESSION, &compression);
+    TIFFGetFieldDefaulted(out, TIFFTAG_PLANARCONFIG, &config);
+    if (TIFFIsTiled(out))
+    {
+        TIFFGetField(out, TIFFTAG_TILEWIDTH, &tilewidth);
+        TIFFGetField(out, TIFFTAG_TILELENGTH, &tilelength);
+    }
+    else
+        TIFFGetFieldDefaulted(out, TIFFTAG_ROWSPERSTRIP, &rowsperstrip);
+
+    switch (compression)
+    {
+        case COMPRESSION_JPEG:
+            TIFFSetField(out, TIFFTAG_JPEGQUALITY, quality);
+            TIFFSetField(out, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+            TIFFSetField(out, TIFFTAG_JPEGTABLESMODE, 0);
+            if (jpeg_lossless)
+                TIFFSetField(out, TIFFTAG_JPEGLOSSLESS, jpeg_lossless);
+            break;
+        case COMPRESSION_LERC:
+            if (max_z_error > 0)
+                TIFFSetField(out, TIFFTAG_LERC_MAXZERROR, max_z_error);
+            if (preset != -1 && subcodec == LERC_ADD_COMPRESSION_DEFLATE)
+                TIFFSetField(out, TIFFTAG_ZIPQUALITY, preset);
+            else if (preset != -1 && subcodec == LERC_ADD_COMPRESSION_ZSTD)
+                TIFFSetField(out, TIFFTAG_ZSTD_LEVEL, preset);
+            break;
+        case COMPRESSION_ADOBE_DEFLATE:
+        case COMPRESSION_DEFLATE:
+            if (subcodec != -1)
+                TIFFSetField(out, TIFFTAG_DEFLATE_SUBCODEC, subcodec);
+            /*fallthrough*/
+        case COMPRESSION_LZW:
+        case COMPRESSION_LZMA:
+        case COMPRESSION_ZSTD:
+        case COMPRESSION_WEBP:
+            if (preset == 100)
+                TIFFSetField(out, TIFFTAG_WEBP_LOSSLESS, TRUE);
+            else if (preset != -1)
+                TIFFSetField(out, TIFFTAG_WEBP_LEVEL, preset);
+            break;
+        case COMPRESSION_LZ4:
+            if (preset != -1)
+                TIFFSetField(out, TIFFTAG_LZ4_LEVEL, preset);
+            if (lz4hc)
+                TIFFSetField(out, TIFFTAG_LZ4_HC, 1);
+            break;
+    }
+
     cf = pickCopyFunc(in, out, bitspersample, samplesperpixel);
     return (cf ? (*cf)(in, out, length, width, samplesperpixel) : FALSE);
 }
 
+static int cogWriteData(TIFF *out)
+{
+    TIFFOpenOptions *opts;
+    TIFF *in = NULL;
+    const char *inname = NULL;
+    int ok = TRUE;
+    tdir_t d;
+
+    /* The strip/tile arrays of all directories, before any image data */
+    for (d = 0; ok && d < ncogsources; d++)
+        ok = TIFFSetDirectory(out, d) && TIFFForceStrileArrayWriting(out);
+
+    /* Then the image data, starting with the last directory, so that
+     * reduced resolution images, which conventionally follow the full
+     * resolution one, come smallest first */
+    opts = TIFFOpenOptionsAlloc();
+    if (opts == NULL)
+        ok = FALSE;
+    else
+        TIFFOpenOptionsSetMaxSingleMemAlloc(opts, maxMalloc);
+    for (d = ncogsources; ok && d-- > 0;)
+    {
+        const cogSource *src = &cogsources[d];
+        if (in == NULL || !streq(inname, src->filename))
+        {
+            if (in)
+                TIFFClose(in);
+            inname = src->filename;
+            in = TIFFOpenExt(inname,
+                             (defcompression == COMPRESSION_JBIG) ? "rc" : "r",
+                             opts);
+            if (in == NULL)
+            {
+                ok = FALSE;
+                break;
+            }
+        }
+        ok = TIFFSetSubDirectory(in, src->diroff) && TIFFSetDirectory(out, d);
+        if (ok)
+        {
+            const uint64_t diroff = TIFFCurrentDirOffset(out);
+            ok = cogCopyData(in, out) && TIFFFlush(out);
+            /* A tag set while copying the data moves the directory after
+             * it, which would not be a cloud optimized layout any more */
+            if (ok && TIFFCurrentDirOffset(out) != diroff)
+            {
+                TIFFError(TIFFFileName(out),
+                          "Error, directory %u moved after the image data",
+                          (unsigned)d);
+                ok = FALSE;
+            }
+        }
+    }
+    if (in)
+        TIFFClose(in);
+    TIFFOpenOptionsFree(opts);
+    for (d = 0; d < ncogsources; d++)
+        free(cogsources[d].filename);
+    free(cogsources);
+    cogsources = NULL;
+    ncogsources = 0;
+    return (ok);
+}
+
 /*
  * Copy Functions.
  */